@@ -0,0 +1,188 @@
+import sys
+from dataclasses import dataclass, field
+
+import numpy as np
+
+# Host side model of the per peer clock sync, main/clock_sync.c. The remote pings
+# with its heartbeat, the car answers with a timestamped ACK, over a path slower
+# one way than the other and with queueing spikes, between two clocks that drift.
+# Measures how fast the model locks and how far it then is from the true peer time.
+
+# Must match clock_sync.h
+RTT_WINDOW = 8
+RTT_SLACK_US = 150
+STEP_US = 5000
+STEP_COUNT = 3
+LOCK_SAMPLES = 16
+MAX_SKEW_PPB = 500 * 1000
+LOCK_KP_SHIFT, LOCK_KI_SHIFT = 1, 2
+KP_SHIFT, KI_SHIFT = 3, 6
+
+
+def cdiv(a: int, b: int) -> int:
+    # C integer division, rounds toward zero
+    q = abs(a) // abs(b)
+    return q if (a >= 0) == (b >= 0) else -q
+
+
+class ClockSync:
+    def __init__(self) -> None:
+        self.at_us = self.offset_us = self.skew_ppb = 0
+        self.rtt_us: list[int] = []
+        self.step_count = 0
+        self.valid = False
+        self.error_us = 0
+        self.samples = self.accepted = self.filtered = self.steps = 0
+
+    def predict(self, local_us: int) -> int:
+        return self.offset_us + cdiv((local_us - self.at_us) * self.skew_ppb, 1000000000)
+
+    def rtt_limit(self, rtt_us: int) -> int:
+        self.rtt_us = (self.rtt_us + [rtt_us])[-RTT_WINDOW:]
+        rtt_min = min(self.rtt_us)
+        return rtt_min + max(rtt_min // 4, RTT_SLACK_US)
+
+    def update(self, t1: int, t2: int, t3: int, t4: int) -> bool:
+        self.samples += 1
+        rtt = (t4 - t1) - (t3 - t2)
+        if t4 < t1 or t3 < t2 or rtt < 0 or rtt > 2**32 - 1 or rtt > self.rtt_limit(rtt):
+            self.filtered += 1
+            return False
+
+        offset = cdiv((t2 - t1) + (t3 - t4), 2)
+        mid = t1 + cdiv(t4 - t1, 2)
+        if not self.valid:
+            self.at_us, self.offset_us, self.skew_ppb, self.error_us = mid, offset, 0, 0
+            self.valid = True
+            self.accepted += 1
+            return True
+
+        predicted = self.predict(mid)
+        error = offset - predicted
+        if abs(error) > STEP_US:
+            self.step_count += 1
+            if self.step_count >= STEP_COUNT:
+                self.valid = False
+                self.step_count = self.accepted = 0
+                self.steps += 1
+            return False
+        self.step_count = 0
+
+        locking = self.accepted < LOCK_SAMPLES
+        dt = mid - self.at_us
+        if dt > 0:
+            skew = self.skew_ppb + (cdiv(error * 1000000000, dt) >> (LOCK_KI_SHIFT if locking else KI_SHIFT))
+            self.skew_ppb = max(-MAX_SKEW_PPB, min(MAX_SKEW_PPB, skew))
+        self.offset_us = predicted + (error >> (LOCK_KP_SHIFT if locking else KP_SHIFT))
+        self.at_us = mid
+        self.error_us = error
+        self.accepted += 1
+        return True
+
+    def to_peer(self, local_us: int) -> int:
+        return local_us + self.predict(local_us)
+
+
+@dataclass
+class LinkModel:
+    ping_period_us: int = 300 * 1000  # Heartbeat interval of the remote
+    forward_us: float = 900  # Remote to car, Wi-Fi task to the app task of the car
+    backward_us: float = 600  # Car to remote
+    jitter_us: float = 120  # Mean of the exponential extra delay, each way
+    spike_probability: float = 0.05  # Channel busy, retries, a long bundle window
+    spike_us: float = 8000
+    loss_probability: float = 0.02
+    skew_ppm: float = 35  # Car crystal against the remote one, both near their tolerance
+    skew_wander_ppm: float = 10  # Slow drift of the skew over the run, warm up
+    peer_restart_s: float = 0  # Car reboot time, 0 for none
+
+
+LOCK_BOUND_US = 150  # Off the path asymmetry
+LOCK_RUN = 32  # Samples in a row within the bound, about 10 s
+
+
+@dataclass
+class SyncReport:
+    times_s: np.ndarray = field(default_factory=lambda: np.zeros(0))
+    errors_us: np.ndarray = field(default_factory=lambda: np.zeros(0))
+    asymmetry_us: float = 0  # Offset bias no two way exchange can see, half the path difference
+    start_s: float = 0  # First ping, or the car reboot
+    lock_s: float = float("nan")  # From `start_s` to the first LOCK_RUN samples within LOCK_BOUND_US
+    sync: ClockSync = field(default_factory=ClockSync)
+
+
+def simulate(duration_s: float, link: LinkModel, seed: int = 0) -> SyncReport:
+    rng = np.random.default_rng(seed)
+    report = SyncReport(asymmetry_us=(link.forward_us - link.backward_us) / 2, start_s=link.peer_restart_s or 1)
+    sync = report.sync
+    peer_origin_us = 123456789.0  # Car booted long before the remote
+    peer_base_us = 0.0
+
+    def peer_time(t_us: float) -> float:
+        # Integral of 1 + skew over the local clock
+        a = link.skew_ppm * 1e-6
+        b = link.skew_wander_ppm * 1e-6 / (duration_s * 1e6)
+        return peer_origin_us + t_us + a * t_us + b * t_us * t_us / 2 - peer_base_us
+
+    def delay(base_us: float) -> float:
+        extra = rng.exponential(link.jitter_us)
+        if rng.random() < link.spike_probability:
+            extra += rng.exponential(link.spike_us)
+        return base_us + extra
+
+    times, errors = [], []
+    restarted = False
+    t1 = 1e6
+    while t1 < duration_s * 1e6:
+        if link.peer_restart_s and not restarted and t1 >= link.peer_restart_s * 1e6:
+            peer_base_us = peer_time(t1) - 1e6  # Booted a second ago
+            restarted = True
+        arrive = t1 + delay(link.forward_us)
+        depart = arrive + rng.uniform(50, 400)  # Until the app task answers
+        back = depart + delay(link.backward_us)
+        if rng.random() >= link.loss_probability and rng.random() >= link.loss_probability:
+            sync.update(int(t1), int(peer_time(arrive)), int(peer_time(depart)), int(back))
+        if sync.valid:
+            times.append(t1 / 1e6)
+            errors.append(sync.to_peer(int(t1)) - peer_time(t1))
+        t1 += link.ping_period_us
+
+    report.times_s = np.array(times)
+    report.errors_us = np.array(errors)
+    within = np.abs(report.errors_us - report.asymmetry_us) <= LOCK_BOUND_US
+    run = 0
+    for i in np.nonzero(report.times_s >= report.start_s)[0]:
+        run = run + 1 if within[i] else 0
+        if run == LOCK_RUN:
+            report.lock_s = report.times_s[i - LOCK_RUN + 1] - report.start_s
+            break
+    return report
+
+
+def print_report(report: SyncReport) -> None:
+    sync = report.sync
+    settled = report.errors_us[report.times_s >= report.start_s + report.lock_s] - report.asymmetry_us
+    print(
+        f"samples: {sync.samples}, accepted: {sync.accepted}, filtered: {sync.filtered}, steps: {sync.steps}"
+        f" | skew estimate: {sync.skew_ppb / 1000:.1f} ppm | locked {report.lock_s:.1f} s after {report.start_s:.0f} s"
+    )
+    if len(settled):
+        print(
+            f"locked, error less the {report.asymmetry_us:.0f} us path asymmetry:"
+            f" mean {settled.mean():.1f} us, rms {np.sqrt(np.mean(settled ** 2)):.1f} us,"
+            f" p99 {np.percentile(np.abs(settled), 99):.1f} us, max {np.abs(settled).max():.1f} us"
+        )
+
+
+if __name__ == "__main__":
+
+    duration_s = float(sys.argv[1]) if len(sys.argv) > 1 else 600
+    cases = {
+        "nominal": LinkModel(),
+        "busy channel": LinkModel(spike_probability=0.3, jitter_us=300),
+        "fast crystal": LinkModel(skew_ppm=-80, skew_wander_ppm=-20),
+        "car reboots": LinkModel(peer_restart_s=duration_s / 2),
+    }
+    for name, link in cases.items():
+        print(f"--- {name}")
+        print_report(simulate(duration_s, link))
@@ -1,17 +1,20 @@
-import re
+import os
 import sys
-import threading
 import tkinter as tk
-from time import sleep
-from tkinter import Misc, ttk
+from datetime import datetime
+from tkinter import Misc, filedialog, ttk
 
 import matplotlib
 import serial
 import serial.tools.list_ports
 
 from ansiEncoding import ANSI
+from serialPipeline import SerialPipeline
+from telemetryDecoder import TelemetryRecord
+from telemetryRecorder import TelemetryRecorder, TelemetryRecording, TelemetryReplayer
 from tkAnsiFormatter import tkAnsiFormatter
 from tkPlotGraph import tkPlotGraph
+from tkRecordingView import tkRecordingView
 from tkTerminal import tkTerminal
 
 matplotlib.use("Agg")
@@ -22,6 +25,9 @@ class SerialApp:
         self.root = root
         self.serial_port = None
         self.killed = False
+        self.frame_ms = 50
+        self.recordings_dir = "recordings"
+        self.replayer = None
         self.auto_scroll = tk.BooleanVar(value=True)
 
         # Get a list of all available serial ports
@@ -72,11 +78,22 @@ class SerialApp:
         self.delta_figure.grid(row=2, column=2)
         # self.delta_figure.set_ylim(-10, 10)
 
-        # Create threads to draw figures and serial port reading
-        self.draw_graphs_thread = threading.Thread(target=self.draw_graphs)
-        self.draw_graphs_thread.start()
-        self.read_serial_thread = threading.Thread(target=self.read_from_port)
-        self.read_serial_thread.start()
+        # Pipeline counters
+        self.status_var = tk.StringVar()
+        self.status_label = tk.Label(root, textvariable=self.status_var, anchor="w")
+        self.status_label.grid(row=3, column=0, columnspan=3, sticky="w")
+
+        # Recording controls, every connection is recorded to `recordings_dir`
+        controls = tk.Frame(root)
+        controls.grid(row=4, column=0, columnspan=3, sticky="w")
+        self.speed_var = tk.StringVar(value="1x")
+        tk.Button(controls, text="Replay", width=12, command=self.replay_toggle).pack(side="left")
+        tk.OptionMenu(controls, self.speed_var, "1x", "4x", "16x", "64x").pack(side="left")
+        tk.Button(controls, text="View Recording", width=16, command=self.view_recording).pack(side="left")
+
+        # Reader and parser run in background threads, the UI stage runs on the Tk main loop
+        self.pipeline = SerialPipeline()
+        self.root.after(self.frame_ms, self.update_ui)
 
     def get_ports(self) -> list[str]:
         # Get a list of all available serial ports
@@ -86,8 +103,9 @@ class SerialApp:
     def close(self) -> None:
         # Flag the process as dead and close serial port
         self.killed = True
-        self.draw_graphs_thread.join()
-        self.read_serial_thread.join()
+        self.pipeline.stop()
+        self.stop_recording()
+        print("Serial Port threads exited")
 
     def connect_toggle(self) -> None:
         # If already connected, disconnect
@@ -111,8 +129,10 @@ class SerialApp:
 
         # Open port
         self.serial_port = serial.Serial(
-            self.port_var.get(), baudrate=115200, timeout=1.0
+            self.port_var.get(), baudrate=115200, timeout=self.pipeline.read_timeout
         )
+        self.pipeline.open(self.serial_port)
+        self.start_recording()
         self.conn_button.config(text="Disconnect")
 
         self.terminal.write(
@@ -120,75 +140,102 @@ class SerialApp:
         )
 
     def disconnect_serial(self):
+        self.stop_recording()
         if self.serial_port and self.serial_port.is_open:
-            self.serial_port.close()
+            self.pipeline.close()
             self.conn_button.config(text="Connect")
             self.terminal.write(
                 f"{ANSI.bBrightMagenta} Port [{self.port_var.get()}] Disconnected{ANSI.default}\n"
             )
 
-    def update_graphs(self, reading: str) -> None:
-        match = re.search(
-            r"I \((\d+)\).*Lspd:( *[-\d.]+).*Rspd:( *[-\d.]+).*Δd:( *[-\d.]+)", reading
-        )
-        if match:
-            time, lspd, rspd, errdis = map(float, match.groups())
-            self.lspd_figure.append(time, lspd)
-            self.rspd_figure.append(time, rspd)
-            self.delta_figure.append(time, errdis)
+    def update_graphs(self, record: TelemetryRecord) -> None:
+        if record.name == "motor_stat":
+            fields = record.fields
+            self.lspd_figure.append(record.time_ms, fields["lspd"])
+            self.rspd_figure.append(record.time_ms, fields["rspd"])
+            self.delta_figure.append(record.time_ms, fields["delta_distance"])
+
+    def start_recording(self) -> None:
+        path = os.path.join(self.recordings_dir, datetime.now().strftime("%Y%m%d-%H%M%S"))
+        self.pipeline.recorder = TelemetryRecorder(path)
+        self.show_message(f"Recording to [{path}]")
+
+    def stop_recording(self) -> None:
+        recorder, self.pipeline.recorder = self.pipeline.recorder, None
+        if recorder:
+            recorder.close()
+
+    def ask_recording(self):
+        path = filedialog.askdirectory(initialdir=self.recordings_dir, mustexist=True)
+        if not path:
+            return None
+        try:
+            return TelemetryRecording(path)
+        except OSError as e:
+            self.show_message(f"Could not open recording [{path}]: {e}")
+            return None
+
+    # Streams a recording through the same plots, live data is ignored meanwhile
+    def replay_toggle(self) -> None:
+        if self.replayer:
+            self.replayer = None
+            self.show_message("Replay stopped")
+            return
+        recording = self.ask_recording()
+        if recording:
+            self.reset_graphs()
+            self.replayer = TelemetryReplayer(recording, speed=float(self.speed_var.get().rstrip("x")))
+            self.show_message(f"Replaying [{recording.path}] at {self.speed_var.get()}")
+
+    def view_recording(self) -> None:
+        recording = self.ask_recording()
+        if recording and "motor_stat" in recording.streams:
+            tkRecordingView(self.root, recording)
 
     def reset_graphs(self) -> None:
         self.lspd_figure.reset()
         self.rspd_figure.reset()
         self.delta_figure.reset()
 
-    def draw_graphs(self) -> None:
-        while True:
-            if self.killed:
-                print("Graphing thread exited")
-                return
-            sleep(0.05)
-
-            # Update graph
-            try:
-                self.lspd_figure.draw()
-                self.rspd_figure.draw()
-                self.delta_figure.draw()
-            except RuntimeError:
-                self.show_message(str(sys.exc_info()))
-                pass
-
-    def read_from_port(self) -> None:
-        while True:
-            if self.killed:
-                print("Serial Port thread exiting")
-                self.disconnect_serial()
-                return
-            sleep(0.1)
-
-            # Reads serial port data by line
-            while self.serial_port and self.serial_port.is_open:
-                try:
-                    line = self.serial_port.readline()
-
-                    # Check if line is not empty
-                    if not line:
-                        break
-
-                    reading = line.decode("utf-8")
-                    self.update_graphs(reading)
-                    self.terminal.write(reading)
-
-                except serial.SerialException as serr:
-                    self.disconnect_serial()
-                    self.show_message(
-                        f"Could not read port [{self.port_var.get()}]: {serr}"
-                    )
-
-                except TypeError as terr:
-                    self.show_message(
-                        f"Bad serial data for port [{self.port_var.get()}]: {terr}"
-                    )
+    # UI stage, runs once per frame on the Tk main loop
+    def update_ui(self) -> None:
+        if self.killed:
+            return
+
+        source = self.replayer or self.pipeline
+        lines: list[str] = []
+        for batch in source.get_batches():
+            lines.extend(batch.lines)
+            for record in batch.records:
+                self.update_graphs(record)
+        if lines:
+            self.terminal.write("".join(lines))
+
+        # Update graph
+        try:
+            self.lspd_figure.draw()
+            self.rspd_figure.draw()
+            self.delta_figure.draw()
+        except RuntimeError:
+            self.show_message(str(sys.exc_info()))
+
+        stats = self.pipeline.stats
+        self.status_var.set(
+            f"lines: {stats.lines} | records: {stats.records} | backlog: {stats.raw_backlog}/{stats.ui_backlog}"
+            f" | dropped: {stats.chunks_dropped}/{stats.batches_dropped} | bad frames: {self.pipeline.decoder.bad_frames}"
+        )
+
+        if self.replayer and self.replayer.finished():
+            self.replayer = None
+            self.show_message("Replay finished")
+
+        # The port may have been closed by the reader on error
+        for msg in self.pipeline.get_messages():
+            self.show_message(msg)
+        if self.serial_port and not self.serial_port.is_open:
+            self.conn_button.config(text="Connect")
+
+        self.root.after(self.frame_ms, self.update_ui)
 
     def show_message(self, msg: str) -> None:
         self.terminal.write(f"{ANSI.bBrightMagenta}{msg}{ANSI.default}\n")
@@ -0,0 +1,262 @@
+/*
+ * Aggregation of main/bundle_pack.c in simulated time, with the policy of
+ * espnow_bundle.c around it: a record waits in the pack of its peer until
+ * the window after the first one ends, a pack that is full goes out early,
+ * a lone record goes out as a plain frame, and one pending ACK per peer is
+ * enough. Only the bundled TX classes take part: ACKs for the frames each
+ * peer sends, setpoints and motor stats, and debug text in bursts.
+ *
+ * The window is swept from 0, every record a frame of its own, upwards.
+ * Reported per window are the frames and the airtime they take against
+ * the latency the wait adds. Airtime is a legacy frame at `rate_kbps`:
+ * preamble, MAC and vendor headers, the espnow_data_t header and payload,
+ * then SIFS and the MAC ACK, and DIFS with the mean backoff before it.
+ *
+ * Every bundle is unpacked again with bundle_pack_next and must give back
+ * the records in the order they were added. Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/bundle_pack_sim.c main/bundle_pack.c -o bundle_pack_sim
+ *   ./bundle_pack_sim [duration_ms] [rate_kbps]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bundle_pack.h"
+
+#define SIM_STEP_US (100)
+#define SIM_PEERS (3)               // Within ESPNOW_BUNDLE_MAX_PEERS, no pack is flushed to make room
+#define SIM_DATA_HEADER_BYTES (16)  // sizeof(espnow_data_t) on the ESP32-S3
+#define SIM_MAC_HEADER_BYTES (43)   // MAC header, action category and OUI, vendor element, FCS
+#define SIM_CAPACITY (250 - SIM_DATA_HEADER_BYTES) // ESPNOW_BUNDLE_MAX_PAYLOAD
+#define SIM_PREAMBLE_US (192)       // DSSS long preamble, 1 and 2 Mbit/s
+#define SIM_MAC_ACK_US (10 + 192 + 112) // SIFS, then the 14 byte ACK at 1 Mbit/s
+#define SIM_CONTENTION_US (50 + 310)    // DIFS and the mean backoff of CWmin 31
+#define SIM_RECORDS_MAX (SIM_CAPACITY / sizeof(bundle_pack_record_t))
+#define SIM_TYPE_ACK (8)   // ESPNOW_PARAM_TYPE_ACK
+#define SIM_TYPE_TEXT (0)  // ESPNOW_PARAM_TYPE_TEXT
+
+static unsigned sim_violations = 0;
+
+#define SIM_CHECK(cond)                                                           \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        sim_violations++;                                         \
+                }                                                                 \
+        } while (0)
+
+typedef struct
+{
+        const char *name;
+        uint8_t type;
+        uint8_t len;        // Text lengths vary up to this
+        uint32_t period_us; // Per peer
+        uint8_t burst;      // Records pushed back to back per period
+} sim_source_t;
+
+static const sim_source_t sim_sources[] = {
+    {"ack setpoint", SIM_TYPE_ACK, 0, 20 * 1000, 1},  // 50 Hz servo setpoints from each peer
+    {"ack motor stat", SIM_TYPE_ACK, 0, 50 * 1000, 1}, // 20 Hz motor stats
+    {"text", SIM_TYPE_TEXT, 48, 200 * 1000, 3},        // Debug lines
+};
+#define SIM_SOURCES (sizeof(sim_sources) / sizeof(sim_sources[0]))
+
+/* What went into a pack, to check the unpacked records against */
+typedef struct
+{
+        uint8_t type;
+        uint8_t len;
+        uint32_t id;
+        int64_t queued_us;
+} sim_record_t;
+
+typedef struct
+{
+        bundle_pack_t pack;
+        sim_record_t records[SIM_RECORDS_MAX];
+} sim_peer_t;
+
+typedef struct
+{
+        uint32_t offered;
+        uint32_t records; // Sent, alone or in a bundle
+        uint32_t coalesced;
+        uint32_t frames;
+        uint32_t bundles;
+        uint32_t full; // Packs sent early because the next record did not fit
+        uint64_t airtime_us;
+        uint64_t latency_us;
+        uint32_t latency_max_us;
+} sim_stat_t;
+
+static sim_peer_t sim_peers[SIM_PEERS];
+static unsigned rate_kbps = 1000;
+
+static uint32_t sim_airtime_us(size_t payload_len)
+{
+        return SIM_CONTENTION_US + SIM_PREAMBLE_US + (SIM_MAC_HEADER_BYTES + SIM_DATA_HEADER_BYTES + payload_len) * 8 * 1000 / rate_kbps +
+               SIM_MAC_ACK_US;
+}
+
+static void sim_send(sim_stat_t *stat, size_t records, size_t payload_len)
+{
+        stat->frames++;
+        stat->records += records;
+        stat->bundles += records > 1;
+        stat->airtime_us += sim_airtime_us(payload_len);
+}
+
+/* espnow_bundle_flush_slot: a lone record as a plain frame, more as one bundle */
+static void sim_flush(sim_stat_t *stat, sim_peer_t *peer, int64_t now)
+{
+        bundle_pack_t *pack = &peer->pack;
+        if (pack->count == 0)
+                return;
+
+        SIM_CHECK(pack->len <= SIM_CAPACITY);
+        const uint8_t *pos = pack->buffer;
+        const uint8_t *end = pack->buffer + pack->len;
+        const bundle_pack_record_t *record;
+        size_t unpacked = 0;
+        while ((record = bundle_pack_next(&pos, end)) != NULL)
+        {
+                SIM_CHECK(unpacked < pack->count);
+                if (unpacked >= pack->count)
+                        break;
+                const sim_record_t *sent = &peer->records[unpacked++];
+                SIM_CHECK((record->type == sent->type) && (record->len == sent->len));
+                if (record->len >= sizeof(uint32_t))
+                        SIM_CHECK(memcmp(record->payload, &sent->id, sizeof(uint32_t)) == 0);
+                uint32_t waited_us = now - sent->queued_us;
+                stat->latency_us += waited_us;
+                if (waited_us > stat->latency_max_us)
+                        stat->latency_max_us = waited_us;
+        }
+        SIM_CHECK(pos == end);
+        SIM_CHECK(unpacked == pack->count);
+
+        if (pack->count == 1)
+        {
+                record = (const bundle_pack_record_t *)pack->buffer;
+                sim_send(stat, 1, record->len);
+        }
+        else
+        {
+                sim_send(stat, pack->count, pack->len);
+        }
+        int64_t waited_us = bundle_pack_take(pack, now);
+        SIM_CHECK(waited_us >= 0);
+}
+
+/* espnow_bundle_send for one record, a window of 0 sends it as it comes */
+static void sim_offer(sim_stat_t *stat, sim_peer_t *peer, uint8_t type, uint8_t len, uint32_t id, int64_t window_us, int64_t now)
+{
+        stat->offered++;
+        if (window_us == 0)
+        {
+                sim_send(stat, 1, len);
+                return;
+        }
+
+        uint8_t payload[UINT8_MAX] = {0};
+        memcpy(payload, &id, sizeof(id));
+        bool once = (type == SIM_TYPE_ACK);
+        bundle_pack_result_t result = bundle_pack_add(&peer->pack, type, payload, len, once, now);
+        if (result == BUNDLE_PACK_FULL)
+        {
+                stat->full++;
+                sim_flush(stat, peer, now);
+                result = bundle_pack_add(&peer->pack, type, payload, len, once, now);
+        }
+        SIM_CHECK(result != BUNDLE_PACK_FULL);
+        if (result == BUNDLE_PACK_COALESCED)
+        {
+                SIM_CHECK(type == SIM_TYPE_ACK);
+                stat->coalesced++;
+                return;
+        }
+        peer->records[peer->pack.count - 1] = (sim_record_t){.type = type, .len = len, .id = id, .queued_us = now};
+}
+
+static void sim_run(sim_stat_t *stat, int64_t window_us, int64_t duration_us)
+{
+        memset(stat, 0, sizeof(sim_stat_t));
+        for (size_t p = 0; p < SIM_PEERS; p++)
+                bundle_pack_init(&sim_peers[p].pack, SIM_CAPACITY);
+        srand(1);
+
+        int64_t next_us[SIM_PEERS][SIM_SOURCES];
+        for (size_t p = 0; p < SIM_PEERS; p++)
+                for (size_t s = 0; s < SIM_SOURCES; s++)
+                        next_us[p][s] = rand() % sim_sources[s].period_us;
+
+        uint32_t id = 0;
+        for (int64_t now = 0; now < duration_us; now += SIM_STEP_US)
+        {
+                for (size_t p = 0; p < SIM_PEERS; p++)
+                {
+                        for (size_t s = 0; s < SIM_SOURCES; s++)
+                        {
+                                const sim_source_t *source = &sim_sources[s];
+                                if (now < next_us[p][s])
+                                        continue;
+                                next_us[p][s] += source->period_us / 2 + rand() % (source->period_us + 1); // Jittered around the period
+                                for (size_t n = 0; n < source->burst; n++)
+                                {
+                                        uint8_t len = source->len ? sizeof(uint32_t) + rand() % (source->len - sizeof(uint32_t) + 1) : 0;
+                                        sim_offer(stat, &sim_peers[p], source->type, len, id++, window_us, now);
+                                }
+                        }
+
+                        // espnow_bundle_timer_cb
+                        sim_peer_t *peer = &sim_peers[p];
+                        if ((peer->pack.count != 0) && (now >= peer->pack.first_queued_us + window_us))
+                                sim_flush(stat, peer, now);
+                }
+        }
+        for (size_t p = 0; p < SIM_PEERS; p++)
+                sim_flush(stat, &sim_peers[p], duration_us);
+
+        SIM_CHECK(stat->records + stat->coalesced == stat->offered);
+        SIM_CHECK(stat->latency_max_us <= window_us + SIM_STEP_US);
+        if (window_us == 0)
+                SIM_CHECK((stat->frames == stat->offered) && (stat->coalesced == 0));
+}
+
+int main(int argc, char **argv)
+{
+        int64_t duration_us = 10 * 1000 * 1000;
+        if (argc > 1)
+                duration_us = atoll(argv[1]) * 1000;
+        if (argc > 2)
+                rate_kbps = atoi(argv[2]);
+        if (rate_kbps == 0)
+                rate_kbps = 1000;
+
+        const int64_t windows_us[] = {0, 1000, 2000, 4000, 8000, 16000};
+        sim_stat_t base = {0};
+        printf("rate: %u kbit/s, %d peers, capacity %d bytes, plain ACK %u us on air\n", rate_kbps, SIM_PEERS, SIM_CAPACITY, sim_airtime_us(0));
+        printf("%9s %8s %8s %8s %8s %6s %10s %7s %8s %8s\n", "window us", "offered", "frames", "bundles", "acks -", "full", "air ms/s",
+               "saved", "mean us", "max us");
+        for (size_t w = 0; w < sizeof(windows_us) / sizeof(windows_us[0]); w++)
+        {
+                sim_stat_t stat;
+                sim_run(&stat, windows_us[w], duration_us);
+                if (w == 0)
+                        base = stat;
+                double seconds = duration_us / 1e6;
+                double saved = base.airtime_us ? 100.0 * (1.0 - (double)stat.airtime_us / base.airtime_us) : 0;
+                printf("%9lld %8u %8u %8u %8u %6u %10.1f %6.1f%% %8llu %8u\n", (long long)windows_us[w], stat.offered, stat.frames, stat.bundles,
+                       stat.coalesced, stat.full, stat.airtime_us / 1000.0 / seconds, saved,
+                       stat.records ? (unsigned long long)(stat.latency_us / stat.records) : 0ULL, stat.latency_max_us);
+                if (w > 0)
+                        SIM_CHECK(stat.frames <= base.frames);
+        }
+
+        printf("%s, %u violation(s)\n", sim_violations ? "FAIL" : "OK", sim_violations);
+        return sim_violations ? 1 : 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * main/channel_score.c as a Linux process, fed the scan lines that
+ * channel_scan_run logs. Every "scan ch:" line of a scan is parsed back
+ * into channel_scan_stat_t, and the "Quietest channel: N, current: M" line
+ * that closes it is checked against channel_score_pick. A logged score
+ * must match channel_score, which catches a firmware and a host build of
+ * different scoring.
+ *
+ * Without a file the built-in scans are replayed, written in the same log
+ * format: a nearly quiet band, one busy access point, the usual 1/6/11 plan, a
+ * loud neighbour with few frames, and a current channel only a little
+ * worse than the best. Some properties are checked on top: overlap falls
+ * off with distance on both sides, a channel never listened to loses, and
+ * the current channel is kept within CHANNEL_SCORE_HYSTERESIS.
+ *
+ * Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/channel_score_test.c main/channel_score.c -o channel_score_test
+ *   ./channel_score_test [monitor.log]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "channel_score.h"
+
+static unsigned test_violations = 0;
+
+#define TEST_CHECK(cond)                                                          \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        test_violations++;                                        \
+                }                                                                 \
+        } while (0)
+
+static const char *test_scans[] = {
+    "quiet band, a few frames on 1",
+    "I (812) channel_scan: scan ch: 1 dwell_ms: 120 frames:    9 busy_us:   2890 rssi_max: -48",
+    "I (932) channel_scan: scan ch: 2 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1052) channel_scan: scan ch: 3 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1172) channel_scan: scan ch: 4 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1292) channel_scan: scan ch: 5 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1412) channel_scan: scan ch: 6 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1532) channel_scan: scan ch: 7 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1652) channel_scan: scan ch: 8 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1772) channel_scan: scan ch: 9 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1892) channel_scan: scan ch:10 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (2012) channel_scan: scan ch:11 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (2132) channel_scan: scan ch:12 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (2252) channel_scan: scan ch:13 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (2253) channel_scan: Quietest channel: 6, current: 1",
+
+    "one busy access point on 6",
+    "I (812) channel_scan: scan ch: 1 dwell_ms: 121 frames:    3 busy_us:    890 rssi_max: -84",
+    "I (933) channel_scan: scan ch: 2 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1053) channel_scan: scan ch: 3 dwell_ms: 120 frames:    2 busy_us:   1210 rssi_max: -86",
+    "I (1173) channel_scan: scan ch: 4 dwell_ms: 120 frames:   11 busy_us:   6020 rssi_max: -74",
+    "I (1293) channel_scan: scan ch: 5 dwell_ms: 120 frames:   35 busy_us:  21300 rssi_max: -61",
+    "I (1413) channel_scan: scan ch: 6 dwell_ms: 121 frames:  212 busy_us:  58740 rssi_max: -52",
+    "I (1534) channel_scan: scan ch: 7 dwell_ms: 120 frames:   41 busy_us:  19800 rssi_max: -60",
+    "I (1654) channel_scan: scan ch: 8 dwell_ms: 120 frames:   10 busy_us:   5540 rssi_max: -73",
+    "I (1774) channel_scan: scan ch: 9 dwell_ms: 120 frames:    1 busy_us:    410 rssi_max: -88",
+    "I (1894) channel_scan: scan ch:10 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (2014) channel_scan: scan ch:11 dwell_ms: 120 frames:    4 busy_us:   1300 rssi_max: -83",
+    "I (2134) channel_scan: scan ch:12 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (2254) channel_scan: scan ch:13 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (2255) channel_scan: Quietest channel: 13, current: 6",
+
+    "access points on 1, 6 and 11",
+    "I (812) channel_scan: scan ch: 1 dwell_ms: 120 frames:  164 busy_us:  41200 rssi_max: -55",
+    "I (932) channel_scan: scan ch: 2 dwell_ms: 120 frames:   30 busy_us:  12900 rssi_max: -63",
+    "I (1052) channel_scan: scan ch: 3 dwell_ms: 120 frames:    8 busy_us:   3100 rssi_max: -77",
+    "I (1172) channel_scan: scan ch: 4 dwell_ms: 120 frames:    6 busy_us:   2400 rssi_max: -79",
+    "I (1292) channel_scan: scan ch: 5 dwell_ms: 120 frames:   22 busy_us:   9800 rssi_max: -66",
+    "I (1412) channel_scan: scan ch: 6 dwell_ms: 120 frames:  131 busy_us:  33800 rssi_max: -58",
+    "I (1532) channel_scan: scan ch: 7 dwell_ms: 120 frames:   25 busy_us:  10100 rssi_max: -65",
+    "I (1652) channel_scan: scan ch: 8 dwell_ms: 120 frames:    5 busy_us:   2100 rssi_max: -80",
+    "I (1772) channel_scan: scan ch: 9 dwell_ms: 120 frames:    9 busy_us:   3300 rssi_max: -76",
+    "I (1892) channel_scan: scan ch:10 dwell_ms: 120 frames:   28 busy_us:  11700 rssi_max: -64",
+    "I (2012) channel_scan: scan ch:11 dwell_ms: 120 frames:  148 busy_us:  39100 rssi_max: -57",
+    "I (2132) channel_scan: scan ch:12 dwell_ms: 120 frames:   27 busy_us:  11200 rssi_max: -66",
+    "I (2252) channel_scan: scan ch:13 dwell_ms: 120 frames:    4 busy_us:   1500 rssi_max: -82",
+    "I (2253) channel_scan: Quietest channel: 0, current: 1",
+
+    "loud neighbour on 12 with few frames",
+    "I (812) channel_scan: scan ch: 1 dwell_ms: 120 frames:   48 busy_us:  16400 rssi_max: -70",
+    "I (932) channel_scan: scan ch: 2 dwell_ms: 120 frames:   12 busy_us:   4700 rssi_max: -78",
+    "I (1052) channel_scan: scan ch: 3 dwell_ms: 120 frames:    3 busy_us:   1100 rssi_max: -85",
+    "I (1172) channel_scan: scan ch: 4 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1292) channel_scan: scan ch: 5 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1412) channel_scan: scan ch: 6 dwell_ms: 120 frames:    2 busy_us:    700 rssi_max: -87",
+    "I (1532) channel_scan: scan ch: 7 dwell_ms: 120 frames:    2 busy_us:    650 rssi_max: -86",
+    "I (1652) channel_scan: scan ch: 8 dwell_ms: 120 frames:    0 busy_us:      0 rssi_max: -128",
+    "I (1772) channel_scan: scan ch: 9 dwell_ms: 120 frames:    1 busy_us:    300 rssi_max: -80",
+    "I (1892) channel_scan: scan ch:10 dwell_ms: 120 frames:    3 busy_us:    950 rssi_max: -62",
+    "I (2012) channel_scan: scan ch:11 dwell_ms: 120 frames:    5 busy_us:   1600 rssi_max: -41",
+    "I (2132) channel_scan: scan ch:12 dwell_ms: 120 frames:    6 busy_us:   1900 rssi_max: -29",
+    "I (2252) channel_scan: scan ch:13 dwell_ms: 120 frames:    5 busy_us:   1700 rssi_max: -35",
+    "I (2253) channel_scan: Quietest channel: 0, current: 1",
+
+    "current channel a little worse than the best",
+    "I (812) channel_scan: scan ch: 1 dwell_ms: 120 frames:   20 busy_us:   8000 rssi_max: -72",
+    "I (932) channel_scan: scan ch: 2 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (1052) channel_scan: scan ch: 3 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (1172) channel_scan: scan ch: 4 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (1292) channel_scan: scan ch: 5 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (1412) channel_scan: scan ch: 6 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (1532) channel_scan: scan ch: 7 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (1652) channel_scan: scan ch: 8 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (1772) channel_scan: scan ch: 9 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (1892) channel_scan: scan ch:10 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (2012) channel_scan: scan ch:11 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (2132) channel_scan: scan ch:12 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (2252) channel_scan: scan ch:13 dwell_ms: 120 frames:   14 busy_us:   6000 rssi_max: -75",
+    "I (2253) channel_scan: Quietest channel: 1, current: 1",
+    NULL,
+};
+
+static channel_scan_stat_t test_stats[CHANNEL_SCORE_NUM_CHANNELS];
+static int64_t test_logged[CHANNEL_SCORE_NUM_CHANNELS]; // Score in the log line, -1 when it had none
+static size_t test_count = 0;
+static size_t test_scans_replayed = 0;
+
+/* One log line, returns false when it belongs to no scan */
+static bool test_line(const char *line)
+{
+        const char *scan = strstr(line, "scan ch:");
+        if (scan != NULL)
+        {
+                int channel, dwell_ms, frames, busy_us, rssi_max, logged_score;
+                int fields = sscanf(scan, "scan ch:%d dwell_ms:%d frames:%d busy_us:%d rssi_max:%d score:%d", &channel, &dwell_ms, &frames,
+                                    &busy_us, &rssi_max, &logged_score);
+                if ((fields < 5) || (test_count >= CHANNEL_SCORE_NUM_CHANNELS))
+                        return false;
+                if (channel == CHANNEL_SCORE_MIN_CHANNEL)
+                        test_count = 0; // A new scan, an unfinished one before it is dropped
+                test_stats[test_count++] = (channel_scan_stat_t){
+                    .channel = channel,
+                    .dwell_ms = dwell_ms,
+                    .frames = frames,
+                    .busy_us = busy_us,
+                    .rssi_max = rssi_max,
+                };
+                test_logged[test_count - 1] = (fields == 6) ? logged_score : -1; // Needs the neighbours above, checked with the result
+                return true;
+        }
+
+        const char *result = strstr(line, "Quietest channel:");
+        int best, current;
+        if ((result == NULL) || (sscanf(result, "Quietest channel: %d, current: %d", &best, &current) != 2))
+                return false;
+        TEST_CHECK(test_count == CHANNEL_SCORE_NUM_CHANNELS);
+        if (test_count != CHANNEL_SCORE_NUM_CHANNELS)
+                return true;
+
+        uint8_t picked = channel_score_pick(test_stats, test_count, current);
+        for (size_t i = 0; i < test_count; i++)
+        {
+                if (test_logged[i] >= 0)
+                        TEST_CHECK(channel_score(test_stats, test_count, i) == (uint32_t)test_logged[i]);
+                const channel_scan_stat_t *stat = &test_stats[i];
+                printf("    ch:%2d frames:%5u busy_us:%7u rssi_max:%4d score:%6u%s\n", stat->channel, stat->frames, stat->busy_us, stat->rssi_max,
+                       channel_score(test_stats, test_count, i), (stat->channel == picked) ? " <" : "");
+        }
+        printf("    picked %d, logged %d, current %d\n", picked, best, current);
+        if (best != 0) // 0 in the built-in scans: any channel the properties below accept
+                TEST_CHECK(picked == best);
+        test_count = 0;
+        test_scans_replayed++;
+        return true;
+}
+
+/* The pick of the last complete scan, for the properties of the built-in ones */
+static uint8_t test_pick(const char *name, uint8_t current)
+{
+        for (size_t i = 0; test_scans[i] != NULL; i++)
+        {
+                if (strcmp(test_scans[i], name) != 0)
+                        continue;
+                for (i++; (test_scans[i] != NULL) && (strstr(test_scans[i], "scan ch:") != NULL); i++)
+                        test_line(test_scans[i]);
+                return channel_score_pick(test_stats, test_count, current);
+        }
+        return 0;
+}
+
+static void test_properties(void)
+{
+        // 1/6/11: the gaps between the access points, never next to one
+        uint8_t picked = test_pick("access points on 1, 6 and 11", 1);
+        TEST_CHECK((picked == 3) || (picked == 4) || (picked == 8) || (picked == 9) || (picked == 13));
+        test_count = 0;
+
+        // A loud neighbour costs more than its few frames, the far end of the band is avoided
+        picked = test_pick("loud neighbour on 12 with few frames", 1);
+        TEST_CHECK((picked >= 4) && (picked <= 8));
+        test_count = 0;
+
+        // Overlap falls off with distance and is the same on both sides
+        channel_scan_stat_t stats[CHANNEL_SCORE_NUM_CHANNELS];
+        for (size_t i = 0; i < CHANNEL_SCORE_NUM_CHANNELS; i++)
+                stats[i] = (channel_scan_stat_t){.channel = CHANNEL_SCORE_MIN_CHANNEL + i, .dwell_ms = 120, .rssi_max = INT8_MIN};
+        stats[6] = (channel_scan_stat_t){.channel = 7, .dwell_ms = 120, .frames = 100, .busy_us = 30000, .rssi_max = -60};
+        for (int distance = 1; distance <= CHANNEL_SCORE_OVERLAP + 1; distance++)
+        {
+                uint32_t below = channel_score(stats, CHANNEL_SCORE_NUM_CHANNELS, 6 - distance);
+                uint32_t above = channel_score(stats, CHANNEL_SCORE_NUM_CHANNELS, 6 + distance);
+                TEST_CHECK(below == above);
+                TEST_CHECK(below < channel_score(stats, CHANNEL_SCORE_NUM_CHANNELS, 6 - distance + 1));
+        }
+        TEST_CHECK(channel_score(stats, CHANNEL_SCORE_NUM_CHANNELS, 6 - CHANNEL_SCORE_OVERLAP - 1) == 0);
+
+        // A channel not listened to loses against a measured quiet one
+        stats[6] = (channel_scan_stat_t){.channel = 7, .dwell_ms = 120, .rssi_max = INT8_MIN};
+        stats[0].dwell_ms = 0;
+        for (size_t i = 1; i < CHANNEL_SCORE_NUM_CHANNELS; i++)
+        {
+                stats[i].frames = 5;
+                stats[i].busy_us = 2000;
+                stats[i].rssi_max = -80;
+        }
+        TEST_CHECK(channel_score_pick(stats, CHANNEL_SCORE_NUM_CHANNELS, 0) != 1);
+
+        // Hysteresis: the current channel stays unless the best beats it by CHANNEL_SCORE_HYSTERESIS percent
+        for (size_t i = 0; i < CHANNEL_SCORE_NUM_CHANNELS; i++)
+                stats[i] = (channel_scan_stat_t){.channel = CHANNEL_SCORE_MIN_CHANNEL + i, .dwell_ms = 1000, .frames = 0, .busy_us = 100000};
+        uint32_t flat = channel_score(stats, CHANNEL_SCORE_NUM_CHANNELS, 0);
+        stats[12].busy_us = 75000; // Channel 13, its score falls with its own airtime only
+        uint32_t better = channel_score(stats, CHANNEL_SCORE_NUM_CHANNELS, 12);
+        uint32_t current = channel_score(stats, CHANNEL_SCORE_NUM_CHANNELS, 8);
+        printf("hysteresis: 13 at %u against 9 at %u, flat %u\n", better, current, flat);
+        TEST_CHECK(channel_score_pick(stats, CHANNEL_SCORE_NUM_CHANNELS, 9) == (((uint64_t)better * 100 < (uint64_t)current * (100 - CHANNEL_SCORE_HYSTERESIS)) ? 13 : 9));
+        TEST_CHECK(channel_score_pick(stats, CHANNEL_SCORE_NUM_CHANNELS, 0) == 13); // No current channel, the best wins
+        stats[12].busy_us = 0;
+        stats[11].busy_us = 0;
+        stats[10].busy_us = 0;
+        TEST_CHECK(channel_score_pick(stats, CHANNEL_SCORE_NUM_CHANNELS, 1) == 13);
+}
+
+int main(int argc, char **argv)
+{
+        if (argc > 1)
+        {
+                FILE *log = fopen(argv[1], "r");
+                if (log == NULL)
+                {
+                        perror(argv[1]);
+                        return 1;
+                }
+                char line[256];
+                while (fgets(line, sizeof(line), log) != NULL)
+                        test_line(line);
+                fclose(log);
+        }
+        else
+        {
+                for (size_t i = 0; test_scans[i] != NULL; i++)
+                        if (!test_line(test_scans[i]))
+                                printf("%s\n", test_scans[i]);
+                test_properties();
+        }
+
+        printf("%zu scan(s) replayed\n", test_scans_replayed);
+        TEST_CHECK(test_scans_replayed > 0);
+        printf("%s, %u violation(s)\n", test_violations ? "FAIL" : "OK", test_violations);
+        return test_violations ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+
+/*
+ * main/link_bench.c as a Linux process, over UDP on the loopback interface
+ * instead of ESP-NOW. A reflector thread stands in for the peer, optionally
+ * dropping and delaying echoes, so the matching, loss accounting and
+ * percentiles can be checked without radios.
+ *
+ *   gcc -O2 -Wall -I main host/link_bench_loopback.c main/link_bench.c -lpthread -o link_bench_loopback
+ *   ./link_bench_loopback [rate_hz] [payload_len] [count] [loss_percent] [delay_us] [jitter_us]
+ * */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "link_bench.h"
+
+#define LOOPBACK_PORT_BENCH (47001)
+#define LOOPBACK_PORT_REFLECTOR (47002)
+
+typedef struct
+{
+        int socket;
+        struct sockaddr_in peer;
+} loopback_t;
+
+static unsigned loss_percent = 0;
+static unsigned delay_us = 0;
+static unsigned jitter_us = 0;
+
+static int64_t loopback_now_us(void *ctx)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* First byte tells a probe from an echo, as the ESP-NOW packet type does */
+static bool loopback_send(void *ctx, bool echo, const void *frame, size_t len)
+{
+        loopback_t *loopback = ctx;
+        uint8_t packet[1 + LINK_BENCH_MAX_PAYLOAD];
+        packet[0] = echo;
+        memcpy(packet + 1, frame, len);
+        return sendto(loopback->socket, packet, 1 + len, 0, (struct sockaddr *)&loopback->peer, sizeof(loopback->peer)) == (ssize_t)(1 + len);
+}
+
+static int loopback_open(loopback_t *loopback, uint16_t port, uint16_t peer_port)
+{
+        struct sockaddr_in local = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+        loopback->peer = (struct sockaddr_in){.sin_family = AF_INET, .sin_port = htons(peer_port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+        loopback->socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if ((loopback->socket < 0) || (bind(loopback->socket, (struct sockaddr *)&local, sizeof(local)) != 0))
+        {
+                perror("loopback socket");
+                return -1;
+        }
+        return 0;
+}
+
+/* The peer: echoes every probe, minus the simulated losses, after the simulated delay */
+static void *loopback_reflector(void *arg)
+{
+        loopback_t *loopback = arg;
+        const link_bench_link_t link = {.send = loopback_send, .now_us = loopback_now_us, .ctx = loopback};
+        uint8_t packet[1 + LINK_BENCH_MAX_PAYLOAD];
+        for (;;)
+        {
+                ssize_t len = recv(loopback->socket, packet, sizeof(packet), 0);
+                if ((len < 1) || (packet[0] != 0))
+                        continue;
+                if ((unsigned)(rand() % 100) < loss_percent)
+                        continue;
+                unsigned wait_us = delay_us + (jitter_us ? (unsigned)(rand() % jitter_us) : 0);
+                if (wait_us)
+                        usleep(wait_us);
+                link_bench_reflect(&link, packet + 1, len - 1);
+        }
+        return NULL;
+}
+
+int main(int argc, char **argv)
+{
+        link_bench_config_t config;
+        link_bench_default_config(&config);
+        if (argc > 1)
+                config.rate_hz = atoi(argv[1]);
+        if (argc > 2)
+                config.payload_len = atoi(argv[2]);
+        if (argc > 3)
+                config.count = atoi(argv[3]);
+        if (argc > 4)
+                loss_percent = atoi(argv[4]);
+        if (argc > 5)
+                delay_us = atoi(argv[5]);
+        if (argc > 6)
+                jitter_us = atoi(argv[6]);
+
+        static loopback_t bench_side, reflector_side;
+        if ((loopback_open(&bench_side, LOOPBACK_PORT_BENCH, LOOPBACK_PORT_REFLECTOR) != 0) ||
+            (loopback_open(&reflector_side, LOOPBACK_PORT_REFLECTOR, LOOPBACK_PORT_BENCH) != 0))
+                return 1;
+        pthread_t reflector;
+        pthread_create(&reflector, NULL, loopback_reflector, &reflector_side);
+
+        static link_bench_t bench;
+        const link_bench_link_t link = {.send = loopback_send, .now_us = loopback_now_us, .ctx = &bench_side};
+        link_bench_init(&bench, &config, &link);
+        for (int64_t wake_us; (wake_us = link_bench_poll(&bench)) >= 0;)
+        {
+                int64_t wait_us = wake_us - loopback_now_us(NULL);
+                struct pollfd fd = {.fd = bench_side.socket, .events = POLLIN};
+                if (poll(&fd, 1, (wait_us > 0) ? (int)((wait_us + 999) / 1000) : 0) <= 0)
+                        continue;
+                uint8_t packet[1 + LINK_BENCH_MAX_PAYLOAD];
+                ssize_t len = recv(bench_side.socket, packet, sizeof(packet), 0);
+                int64_t rx_us = loopback_now_us(NULL);
+                if ((len > 1) && (packet[0] == 1))
+                        link_bench_echo(&bench, packet + 1, len - 1, rx_us);
+        }
+
+        link_bench_result_t result;
+        link_bench_result(&bench, &result);
+        printf("rate: %u Hz, payload: %u B, loss: %u %%, delay: %u+%u us\n", config.rate_hz, config.payload_len, loss_percent, delay_us, jitter_us);
+        printf("sent: %u, received: %u, lost: %u, late: %u, duplicates: %u, send failed: %u\n", result.sent, result.received,
+               result.lost, result.late, result.duplicates, result.send_failed);
+        printf("rtt us: min %u, p50 %u, p90 %u, p99 %u, p99.9 %u, max %u, mean %u\n", result.min_us, result.p50_us, result.p90_us,
+               result.p99_us, result.p999_us, result.max_us, result.mean_us);
+        return 0;
+}
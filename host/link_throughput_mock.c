@@ -0,0 +1,205 @@
+/*
+ * main/link_throughput.c as a Linux process, against a mock of the ESP-NOW
+ * send path: a frame from a frame_pool, the espnow_data_t header with its
+ * CRC, a copy into a bounded driver queue, and a driver thread standing in
+ * for the Wi-Fi task that takes frames off the queue and reports each one
+ * to the send callback. With no airtime the radio is infinitely fast, so
+ * the rates are an upper bound for the software path alone.
+ *
+ *   gcc -O2 -Wall -I main host/link_throughput_mock.c main/link_throughput.c main/frame_pool.c main/spsc_ring.c -lpthread -o link_throughput_mock
+ *   ./link_throughput_mock [duration_ms] [airtime_us] [loss_percent] [driver_queue]
+ * */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame_pool.h"
+#include "link_throughput.h"
+#include "spsc_ring.h"
+
+#define MOCK_TX_POOL_SIZE (4)      // ESPNOW_TX_POOL_SIZE
+#define MOCK_FRAME_SIZE (252)      // ESPNOW_FRAME_SIZE
+#define MOCK_MAX_DATA_LEN (250)    // ESP_NOW_MAX_DATA_LEN
+#define MOCK_DRIVER_QUEUE_MAX (64) // Power of two
+
+/* Same layout as espnow_data_t */
+typedef struct
+{
+        uint16_t seq_num;
+        uint16_t crc;
+        uint32_t broadcast;
+        uint32_t type;
+        uint8_t session;
+        uint8_t len;
+        uint8_t payload[0];
+} mock_data_t;
+
+typedef struct
+{
+        size_t len;
+        uint8_t data[MOCK_MAX_DATA_LEN];
+} mock_tx_t;
+
+static uint8_t mock_tx_frames[MOCK_TX_POOL_SIZE][MOCK_FRAME_SIZE];
+static frame_pool_t mock_tx_pool;
+static mock_tx_t mock_driver_buffer[MOCK_DRIVER_QUEUE_MAX];
+static spsc_ring_t mock_driver_queue;
+static uint16_t mock_crc_table[256];
+static link_throughput_t bench;
+static volatile bool mock_running = true;
+static int64_t mock_busy_ns = 0; // Spent in mock_submit
+
+static unsigned airtime_us = 0;
+static unsigned loss_percent = 0;
+
+static int64_t mock_now_us(void *ctx)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static int64_t mock_thread_cpu_ns(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Reflected CCITT polynomial with table lookup, as the ROM's esp_crc16_le */
+static void mock_crc_init(void)
+{
+        for (unsigned i = 0; i < 256; i++)
+        {
+                uint16_t crc = i;
+                for (int bit = 0; bit < 8; bit++)
+                        crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+                mock_crc_table[i] = crc;
+        }
+}
+
+static uint16_t mock_crc16_le(uint16_t crc, const uint8_t *data, size_t len)
+{
+        crc = ~crc;
+        while (len--)
+                crc = (crc >> 8) ^ mock_crc_table[(crc ^ *data++) & 0xFF];
+        return ~crc;
+}
+
+/* espnow_send_data: frame from the pool, header and CRC, esp_now_send copies it into the driver queue */
+static link_throughput_submit_t mock_send(const void *payload, size_t len)
+{
+        static uint16_t seq = 0;
+        if (sizeof(mock_data_t) + len > MOCK_MAX_DATA_LEN)
+                return LINK_THROUGHPUT_SUBMIT_ERROR;
+        mock_data_t *packet = frame_pool_alloc(&mock_tx_pool);
+        if (packet == NULL)
+                return LINK_THROUGHPUT_SUBMIT_NO_BUFFER;
+
+        const size_t frame_len = sizeof(mock_data_t) + len;
+        packet->session = 1;
+        packet->type = 0;
+        packet->broadcast = 1;
+        packet->seq_num = seq++;
+        packet->len = len;
+        memcpy(packet->payload, payload, len);
+        packet->crc = 0;
+        packet->crc = mock_crc16_le(UINT16_MAX, (const uint8_t *)packet, frame_len);
+
+        mock_tx_t tx = {.len = frame_len};
+        memcpy(tx.data, packet, frame_len);
+        bool queued = spsc_ring_push(&mock_driver_queue, &tx);
+        frame_pool_free(&mock_tx_pool, packet);
+        return queued ? LINK_THROUGHPUT_SUBMIT_OK : LINK_THROUGHPUT_SUBMIT_QUEUE_FULL;
+}
+
+static link_throughput_submit_t mock_submit(void *ctx, const void *payload, size_t len)
+{
+        int64_t start = mock_thread_cpu_ns();
+        link_throughput_submit_t ret = mock_send(payload, len);
+        mock_busy_ns += mock_thread_cpu_ns() - start;
+        return ret;
+}
+
+/* The Wi-Fi task: one frame per airtime, then the send callback */
+static void *mock_driver(void *arg)
+{
+        mock_tx_t tx;
+        while (mock_running)
+        {
+                if (!spsc_ring_pop(&mock_driver_queue, &tx))
+                {
+                        sched_yield();
+                        continue;
+                }
+                if (airtime_us)
+                        usleep(airtime_us); // The radio is busy, the CPU is not
+                link_throughput_complete(&bench, (unsigned)(rand() % 100) >= loss_percent);
+        }
+        return NULL;
+}
+
+int main(int argc, char **argv)
+{
+        link_throughput_config_t config;
+        link_throughput_default_config(&config);
+        unsigned driver_queue = 32;
+        config.duration_us = 200 * 1000;
+        if (argc > 1)
+                config.duration_us = atoi(argv[1]) * 1000;
+        if (argc > 2)
+                airtime_us = atoi(argv[2]);
+        if (argc > 3)
+                loss_percent = atoi(argv[3]);
+        if (argc > 4)
+                driver_queue = atoi(argv[4]);
+
+        mock_crc_init();
+        frame_pool_init(&mock_tx_pool, mock_tx_frames, MOCK_FRAME_SIZE, MOCK_TX_POOL_SIZE);
+        if (!spsc_ring_init(&mock_driver_queue, mock_driver_buffer, sizeof(mock_tx_t), driver_queue))
+        {
+                fprintf(stderr, "driver_queue must be a power of two up to %d\n", MOCK_DRIVER_QUEUE_MAX);
+                return 1;
+        }
+        pthread_t driver;
+        pthread_create(&driver, NULL, mock_driver, NULL);
+
+        const uint16_t payloads[] = {0, 32, 64, 128, MOCK_MAX_DATA_LEN - sizeof(mock_data_t)};
+        const uint8_t windows[] = {1, 2, 4, 8, 16, 32};
+        const link_throughput_link_t link = {.submit = mock_submit, .now_us = mock_now_us};
+        printf("airtime: %u us, loss: %u %%, driver queue: %u\n", airtime_us, loss_percent, driver_queue);
+        printf("%7s %6s %10s %10s %10s %6s %6s %8s %s\n", "payload", "window", "offered/s", "accepted/s", "complete/s", "ok%", "cpu%",
+               "ns/frame", "limit");
+        for (size_t p = 0; p < sizeof(payloads) / sizeof(payloads[0]); p++)
+        {
+                for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+                {
+                        config.payload_len = payloads[p];
+                        config.window = windows[w];
+                        link_throughput_init(&bench, &config, &link);
+                        mock_busy_ns = 0;
+                        while (link_throughput_poll(&bench))
+                                if (link_throughput_in_flight(&bench) >= bench.config.window)
+                                        sched_yield();
+
+                        link_throughput_result_t result;
+                        link_throughput_result(&bench, &result);
+                        // Only the send path counts as busy, not the polling around it
+                        uint16_t cpu_permille = mock_busy_ns / result.elapsed_us;
+                        uint32_t completed = result.completed_ok + result.completed_fail;
+                        printf("%7u %6u %10u %10u %10u %6.1f %6.1f %8lld %s\n", config.payload_len, config.window,
+                               link_throughput_rate(&result, result.offered), link_throughput_rate(&result, result.accepted),
+                               link_throughput_rate(&result, completed), completed ? 100.0 * result.completed_ok / completed : 0.0,
+                               cpu_permille / 10.0, result.offered ? (long long)(mock_busy_ns / result.offered) : 0LL,
+                               LINK_THROUGHPUT_LIMIT_STRING[link_throughput_limit(&result, cpu_permille)]);
+                }
+        }
+        mock_running = false;
+        pthread_join(driver, NULL);
+        return 0;
+}
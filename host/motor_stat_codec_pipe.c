@@ -0,0 +1,95 @@
+/*
+ * main/motor_stat_codec.c behind pipes, for host/motor_stat_codec_test.py
+ * to run the same data through it and through motorStatCodec.py.
+ *
+ *   encode: records on stdin, a tag byte then its data: 'S' and a
+ *   motor_group_stat_pkt_t, or 'K' to request a keyframe. For every 'S'
+ *   the length of the frame as a byte, then the frame, on stdout.
+ *   decode: frames on stdin, each behind a length byte. For every frame the
+ *   motor_stat_codec_result_t as a byte, then the motor_group_stat_pkt_t,
+ *   zeros unless the frame decoded, on stdout. Once stdin ends the decoder
+ *   counters frames, keyframes, lost, dropped and bad as uint32.
+ *   params: the constants of motor_stat_codec.h, "name value" per line.
+ *
+ *   gcc -O2 -Wall -I main host/motor_stat_codec_pipe.c main/motor_stat_codec.c -o motor_stat_codec_pipe
+ *   ./motor_stat_codec_pipe encode [keyframe_interval] | decode | params
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "motor_stat_codec.h"
+
+_Static_assert(MOTOR_STAT_CODEC_MAX_FRAME <= UINT8_MAX, "frame length no longer fits the length byte");
+
+static int pipe_encode(uint16_t keyframe_interval)
+{
+        motor_stat_encoder_t encoder;
+        motor_stat_encoder_init(&encoder, keyframe_interval);
+        int tag;
+        while ((tag = getchar()) != EOF)
+        {
+                if (tag == 'K')
+                {
+                        motor_stat_encoder_request_keyframe(&encoder);
+                        continue;
+                }
+                motor_group_stat_pkt_t stat;
+                if ((tag != 'S') || (fread(&stat, sizeof(stat), 1, stdin) != 1))
+                {
+                        fprintf(stderr, "encode: bad record\n");
+                        return 1;
+                }
+                uint8_t frame[MOTOR_STAT_CODEC_MAX_FRAME];
+                uint8_t len = motor_stat_encode(&encoder, &stat, frame);
+                fwrite(&len, 1, 1, stdout);
+                fwrite(frame, 1, len, stdout);
+        }
+        return 0;
+}
+
+static int pipe_decode(void)
+{
+        motor_stat_decoder_t decoder;
+        motor_stat_decoder_init(&decoder);
+        int len;
+        while ((len = getchar()) != EOF)
+        {
+                uint8_t frame[UINT8_MAX];
+                if (fread(frame, 1, len, stdin) != (size_t)len)
+                {
+                        fprintf(stderr, "decode: frame cut short\n");
+                        return 1;
+                }
+                motor_group_stat_pkt_t stat;
+                memset(&stat, 0, sizeof(stat));
+                uint8_t result = motor_stat_decode(&decoder, frame, len, &stat);
+                fwrite(&result, 1, 1, stdout);
+                fwrite(&stat, sizeof(stat), 1, stdout);
+        }
+        const uint32_t counters[] = {decoder.frames, decoder.keyframes, decoder.lost, decoder.dropped, decoder.bad};
+        fwrite(counters, sizeof(counters), 1, stdout);
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        const char *mode = (argc > 1) ? argv[1] : "";
+        if (strcmp(mode, "encode") == 0)
+                return pipe_encode((argc > 2) ? atoi(argv[2]) : MOTOR_STAT_CODEC_DEFAULT_KEYFRAME_INTERVAL);
+        if (strcmp(mode, "decode") == 0)
+                return pipe_decode();
+        if (strcmp(mode, "params") == 0)
+        {
+                printf("FIELDS %d\n", MOTOR_STAT_CODEC_FIELDS);
+                printf("HEADER_SIZE %d\n", MOTOR_STAT_CODEC_HEADER_SIZE);
+                printf("MAX_FRAME %d\n", MOTOR_STAT_CODEC_MAX_FRAME);
+                printf("KEYFRAME %d\n", MOTOR_STAT_CODEC_KEYFRAME);
+                printf("DEFAULT_KEYFRAME_INTERVAL %d\n", MOTOR_STAT_CODEC_DEFAULT_KEYFRAME_INTERVAL);
+                printf("PACKET_SIZE %zu\n", sizeof(motor_group_stat_pkt_t));
+                return 0;
+        }
+        fprintf(stderr, "usage: %s encode [keyframe_interval] | decode | params\n", argv[0]);
+        return 2;
+}
@@ -0,0 +1,210 @@
+"""
+motorStatCodec.py against main/motor_stat_codec.c, run as
+host/motor_stat_codec_pipe.c, in both directions.
+
+The constants of motorStatCodec.py must be those of motor_stat_codec.h,
+and a probe frame from the C encoder must give back SCALES. A trace of
+stats, with unchanged fields, NaN, infinities, values past the int16
+range and values on and next to the rounding point between two steps,
+then goes through both encoders with keyframes requested at random. The
+frames must be byte for byte the same. The frames of the Python encoder,
+some lost, cut short, padded, duplicated or replaced with garbage on the
+way, then go through both decoders, which must agree on every result,
+every value and their counters.
+Exits with 1 on any violation.
+
+  gcc -O2 -Wall -I main host/motor_stat_codec_pipe.c main/motor_stat_codec.c -o motor_stat_codec_pipe
+  python3 host/motor_stat_codec_test.py [./motor_stat_codec_pipe] [stats] [seed]
+"""
+
+import math
+import os
+import random
+import struct
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+
+import motorStatCodec as codec  # noqa: E402
+
+PACKET = struct.Struct("<i4fi4f2f")  # motor_group_stat_pkt_t
+COUNTERS = struct.Struct("<5I")  # frames, keyframes, lost, dropped, bad
+RESULT_OK, RESULT_NEED_KEYFRAME, RESULT_BAD_FRAME = range(3)  # motor_stat_codec_result_t
+
+violations = 0
+
+
+def check(cond: bool, what: str) -> None:
+    global violations
+    if not cond:
+        print(f"violation: {what}")
+        violations += 1
+
+
+def f32(value: float) -> float:
+    return struct.unpack("<f", struct.pack("<f", value))[0]
+
+
+def run(pipe: str, args: list[str], data: bytes) -> bytes:
+    result = subprocess.run([pipe, *args], input=data, stdout=subprocess.PIPE, check=False)
+    check(result.returncode == 0, f"{' '.join(args)}: exit status {result.returncode}")
+    return result.stdout
+
+
+def check_params(pipe: str) -> None:
+    params = dict(line.split() for line in run(pipe, ["params"], b"").decode().splitlines())
+    expected = {
+        "FIELDS": codec.FIELDS,
+        "HEADER_SIZE": codec.HEADER.size,
+        "MAX_FRAME": codec.MAX_FRAME,
+        "KEYFRAME": codec.KEYFRAME,
+        "DEFAULT_KEYFRAME_INTERVAL": codec.DEFAULT_KEYFRAME_INTERVAL,
+        "PACKET_SIZE": PACKET.size,
+    }
+    for name, value in expected.items():
+        check(int(params.get(name, -1)) == value, f"{name}: C {params.get(name)}, Python {value}")
+
+    # A keyframe of 1.0 in every float and 1 in every counter holds each scale as the value of its field
+    probe = [1 if scale == 0 else 1.0 for scale in codec.SCALES]
+    frame = run(pipe, ["encode"], b"S" + PACKET.pack(*probe))[1:]
+    _, mask = codec.HEADER.unpack_from(frame)
+    pos = codec.HEADER.size
+    for i, scale in enumerate(codec.SCALES):
+        value = 0
+        if mask & (1 << i):
+            value, pos = codec.get_varint(frame, pos)
+        check(value == (scale or 1), f"SCALES[{i}]: C {value}, Python {scale}")
+    print(f"params: {'OK' if not violations else 'FAIL'}")
+
+
+def random_float(rng: random.Random, scale: int) -> float:
+    pick = rng.randrange(10)
+    if pick == 0:
+        return rng.choice((math.nan, math.inf, -math.inf, 0.0, -0.0))
+    if pick == 1:
+        return rng.choice((1, -1)) * rng.uniform(32766, 40000) / scale  # Around saturation
+    if pick == 2:
+        return rng.uniform(-1e30, 1e30)
+    if pick <= 5:  # On the rounding point between two steps, or the float next to it
+        step = rng.randint(-32768, 32767) + 0.5
+        return f32(step / scale) + rng.choice((0.0, 1e-7, -1e-7)) * abs(step) / scale
+    return rng.gauss(0, 3)
+
+
+def make_trace(rng: random.Random, count: int) -> list[list[float]]:
+    trace = []
+    stat = [0 if scale == 0 else 0.0 for scale in codec.SCALES]
+    for _ in range(count):
+        stat = list(stat)
+        for i, scale in enumerate(codec.SCALES):
+            if rng.random() < 0.3:
+                continue  # Unchanged, left out of a delta frame
+            if scale == 0:
+                stat[i] = codec._wrap32(stat[i] + rng.choice((rng.randint(-300, 300), rng.randint(-(2**31), 2**31 - 1))))
+            else:
+                stat[i] = f32(random_float(rng, scale))
+        trace.append(stat)
+    return trace
+
+
+def check_encode(pipe: str, trace: list[list[float]], rng: random.Random, interval: int) -> list[bytes]:
+    encoder = codec.MotorStatEncoder(interval)
+    data = bytearray()
+    frames = []
+    for stat in trace:
+        if rng.random() < 0.02:
+            data += b"K"
+            encoder.request_keyframe()
+        data += b"S" + PACKET.pack(*stat)
+        frames.append(encoder.encode(stat))
+
+    out = run(pipe, ["encode", str(interval)], bytes(data))
+    pos = 0
+    mismatches = 0
+    for n, frame in enumerate(frames):
+        length = out[pos] if pos < len(out) else 0
+        got = out[pos + 1 : pos + 1 + length]
+        pos += 1 + length
+        check(len(got) <= codec.MAX_FRAME, f"interval {interval} frame {n}: {len(got)} bytes")
+        if got != frame:
+            mismatches += 1
+            if mismatches <= 5:
+                check(False, f"interval {interval} frame {n}: C {got.hex()}, Python {frame.hex()}, stat {trace[n]}")
+    check(mismatches == 0, f"interval {interval}: {mismatches} of {len(frames)} frames differ")
+    check(pos == len(out), f"interval {interval}: {len(out) - pos} bytes past the last frame")
+    return frames
+
+
+# The channel between the encoder and the decoders
+def impair(rng: random.Random, frames: list[bytes]) -> list[bytes]:
+    out = []
+    for frame in frames:
+        pick = rng.random()
+        if pick < 0.02:
+            continue  # Lost
+        if pick < 0.03:
+            frame = frame[: rng.randrange(len(frame))]
+        elif pick < 0.04:
+            frame += bytes([rng.randrange(256)])
+        elif pick < 0.045:
+            frame = frame[:2] + bytes([frame[2] | 0x10]) + frame[3:]  # Unknown field
+        elif pick < 0.055:
+            frame = bytes(rng.randrange(256) for _ in range(rng.randrange(11)))
+        elif pick < 0.065:
+            out.append(frame)  # Twice
+        out.append(frame)
+    return out
+
+
+def check_decode(pipe: str, frames: list[bytes]) -> None:
+    out = run(pipe, ["decode"], b"".join(bytes([len(frame)]) + frame for frame in frames))
+    check(len(out) == len(frames) * (1 + PACKET.size) + COUNTERS.size, f"decode: {len(out)} bytes out")
+    decoder = codec.MotorStatDecoder()
+    results = [0, 0, 0]
+    for n, frame in enumerate(frames):
+        record = out[n * (1 + PACKET.size) : (n + 1) * (1 + PACKET.size)]
+        if len(record) < 1 + PACKET.size:
+            break
+        dropped = decoder.dropped
+        values = decoder.decode(frame)
+        if values is not None:
+            expected = RESULT_OK
+        elif decoder.dropped != dropped:
+            expected = RESULT_NEED_KEYFRAME
+        else:
+            expected = RESULT_BAD_FRAME
+        results[expected] += 1
+        check(record[0] == expected, f"frame {n} {frame.hex()}: C result {record[0]}, Python {expected}")
+        if values is not None and record[0] == RESULT_OK:
+            # C divides in float, the Python decoder in double
+            got = list(PACKET.unpack(record[1:]))
+            want = [value if scale == 0 else f32(value) for value, scale in zip(values, codec.SCALES)]
+            check(got == want, f"frame {n}: C {got}, Python {want}")
+    counters = COUNTERS.unpack(out[-COUNTERS.size :]) if len(out) >= COUNTERS.size else ()
+    expected = (decoder.frames, decoder.keyframes, decoder.lost, decoder.dropped, decoder.bad)
+    check(counters == expected, f"decoder counters: C {counters}, Python {expected}")
+    print(f"decode: {len(frames)} frames, {results[RESULT_OK]} ok, {results[RESULT_NEED_KEYFRAME]} waiting for a keyframe, "
+          f"{results[RESULT_BAD_FRAME]} bad, lost {decoder.lost}")
+
+
+def main() -> int:
+    pipe = sys.argv[1] if len(sys.argv) > 1 else "./motor_stat_codec_pipe"
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 20000
+    rng = random.Random(int(sys.argv[3]) if len(sys.argv) > 3 else 1)
+
+    check_params(pipe)
+    trace = make_trace(rng, count)
+    for interval in (1, 200, codec.DEFAULT_KEYFRAME_INTERVAL):  # The frames of the default go on to the decoders
+        before = violations
+        frames = check_encode(pipe, trace, rng, interval)
+        print(f"encode, keyframe interval {interval}: {len(frames)} frames, "
+              f"{sum(map(len, frames)) / len(frames):.1f} B average, {'OK' if violations == before else 'FAIL'}")
+    check_decode(pipe, impair(rng, frames))
+
+    print(f"{'FAIL' if violations else 'OK'}, {violations} violation(s)")
+    return 1 if violations else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
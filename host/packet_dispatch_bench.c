@@ -0,0 +1,304 @@
+/*
+ * main/dispatch_table.c as a Linux process, the lookup and size check
+ * behind packet_dispatch_payload. First the size rules: a fixed length
+ * handler takes its exact length only, a variable length one anything up
+ * to its maximum, a type without a handler or out of range reaches nothing,
+ * and every payload is counted once as dispatched, unhandled or bad size.
+ *
+ * Then a benchmark over a random stream of received packets, mostly of the
+ * registered types and sizes, some too long, too short or unhandled. The
+ * table is timed against the switch over the type with a copy of the
+ * payload into a static struct that app_main had before it. Both must
+ * deliver the same packets.
+ *
+ * Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/packet_dispatch_bench.c main/dispatch_table.c -o packet_dispatch_bench
+ *   ./packet_dispatch_bench [packets] [seed]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dispatch_table.h"
+
+#define TEST_TYPES (19)          // ESPNOW_PARAM_TYPE_MAX
+#define TEST_MAX_PAYLOAD (234)   // ESPNOW_BUNDLE_MAX_PAYLOAD, ESP_NOW_MAX_DATA_LEN less the espnow_data_t header
+#define TEST_PACKETS_MAX (1 << 20)
+#define TEST_ROUNDS (20)
+
+static unsigned test_violations = 0;
+
+#define TEST_CHECK(cond)                                                          \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        test_violations++;                                        \
+                }                                                                 \
+        } while (0)
+
+/* packet_handler_t with the peer left opaque */
+typedef void (*test_handler_t)(void *peer, const void *payload, size_t len, void *arg);
+
+typedef struct
+{
+        size_t calls;
+        size_t bytes;
+        uint32_t sum; // Of the first payload byte, so the handler reads the payload
+        size_t last_len;
+        void *last_arg;
+} test_sink_t;
+
+/* The handlers app_main and link_bench_espnow register, with their payload sizes */
+typedef struct
+{
+        unsigned type;
+        size_t payload_len;
+        bool variable_len;
+} test_registration_t;
+
+static const test_registration_t test_registrations[] = {
+    {2, 48, false},               // MOTOR_STAT, sizeof(motor_group_stat_pkt_t)
+    {14, 43, true},               // MOTOR_STAT_DELTA, MOTOR_STAT_CODEC_MAX_FRAME
+    {10, TEST_MAX_PAYLOAD, true}, // BUNDLE, ESPNOW_BUNDLE_MAX_PAYLOAD
+    {11, 3, false},               // CHANNEL_SWITCH, sizeof(channel_switch_pkt_t)
+    {15, 200, true},              // PROBE, LINK_BENCH_MAX_PAYLOAD
+    {16, 200, true},              // PROBE_ECHO
+};
+#define TEST_REGISTRATIONS (sizeof(test_registrations) / sizeof(test_registrations[0]))
+
+typedef struct
+{
+        uint8_t type;
+        uint8_t len;
+} test_packet_t;
+
+static test_sink_t test_sinks[DISPATCH_TABLE_MAX_TYPES];
+static test_packet_t test_packets[TEST_PACKETS_MAX];
+static uint8_t test_payload[UINT8_MAX + 1];
+
+static void test_handler(void *peer, const void *payload, size_t len, void *arg)
+{
+        (void)peer;
+        test_sink_t *sink = arg;
+        sink->calls++;
+        sink->bytes += len;
+        sink->sum += len ? ((const uint8_t *)payload)[0] : 0;
+        sink->last_len = len;
+        sink->last_arg = arg;
+}
+
+/* What packet_dispatch_payload does with the result */
+static dispatch_table_result_t test_dispatch(dispatch_table_t *table, unsigned type, const void *payload, size_t len)
+{
+        const dispatch_entry_t *entry;
+        dispatch_table_result_t result = dispatch_table_lookup(table, type, len, &entry);
+        if (result == DISPATCH_TABLE_OK)
+                ((test_handler_t)entry->handler)(NULL, payload, len, entry->arg);
+        return result;
+}
+
+static void test_sizes(void)
+{
+        unsigned violations = test_violations;
+        dispatch_table_t table;
+        memset(&table, 0, sizeof(table));
+        memset(test_sinks, 0, sizeof(test_sinks));
+
+        TEST_CHECK(dispatch_table_register(&table, 2, (dispatch_fn_t)test_handler, 12, false, &test_sinks[2]));
+        TEST_CHECK(dispatch_table_register(&table, 3, (dispatch_fn_t)test_handler, 40, true, &test_sinks[3]));
+        TEST_CHECK(dispatch_table_register(&table, 4, (dispatch_fn_t)test_handler, 0, false, &test_sinks[4]));
+
+        // Rejected registrations leave the table as it was
+        TEST_CHECK(!dispatch_table_register(&table, DISPATCH_TABLE_MAX_TYPES, (dispatch_fn_t)test_handler, 1, false, NULL));
+        TEST_CHECK(!dispatch_table_register(&table, 5, NULL, 1, false, NULL));
+        TEST_CHECK(!dispatch_table_register(&table, 5, (dispatch_fn_t)test_handler, UINT8_MAX + 1, true, NULL));
+        TEST_CHECK(dispatch_table_get(&table, 5) == NULL);
+        TEST_CHECK(dispatch_table_get(&table, DISPATCH_TABLE_MAX_TYPES) == NULL);
+
+        // Fixed length: exact only
+        TEST_CHECK(test_dispatch(&table, 2, test_payload, 12) == DISPATCH_TABLE_OK);
+        TEST_CHECK((test_sinks[2].last_len == 12) && (test_sinks[2].last_arg == &test_sinks[2]));
+        TEST_CHECK(test_dispatch(&table, 2, test_payload, 11) == DISPATCH_TABLE_BAD_SIZE);
+        TEST_CHECK(test_dispatch(&table, 2, test_payload, 13) == DISPATCH_TABLE_BAD_SIZE);
+        TEST_CHECK(test_dispatch(&table, 2, test_payload, 0) == DISPATCH_TABLE_BAD_SIZE);
+        TEST_CHECK(test_sinks[2].calls == 1);
+
+        // Variable length: 0 up to the maximum
+        for (size_t len = 0; len <= 40; len++)
+                TEST_CHECK(test_dispatch(&table, 3, test_payload, len) == DISPATCH_TABLE_OK);
+        TEST_CHECK(test_dispatch(&table, 3, test_payload, 41) == DISPATCH_TABLE_BAD_SIZE);
+        TEST_CHECK(test_dispatch(&table, 3, test_payload, UINT8_MAX) == DISPATCH_TABLE_BAD_SIZE);
+        TEST_CHECK(test_sinks[3].calls == 41);
+
+        // No payload at all
+        TEST_CHECK(test_dispatch(&table, 4, NULL, 0) == DISPATCH_TABLE_OK);
+        TEST_CHECK(test_dispatch(&table, 4, test_payload, 1) == DISPATCH_TABLE_BAD_SIZE);
+
+        // Unhandled and out of range, whatever the size
+        TEST_CHECK(test_dispatch(&table, 5, test_payload, 12) == DISPATCH_TABLE_UNHANDLED);
+        TEST_CHECK(test_dispatch(&table, DISPATCH_TABLE_MAX_TYPES, test_payload, 12) == DISPATCH_TABLE_UNHANDLED);
+        TEST_CHECK(test_dispatch(&table, UINT8_MAX, test_payload, 0) == DISPATCH_TABLE_UNHANDLED);
+
+        TEST_CHECK(table.stat.dispatched == 1 + 41 + 1);
+        TEST_CHECK(table.stat.bad_size == 3 + 2 + 1);
+        TEST_CHECK(table.stat.unhandled == 3);
+
+        // Replacing a handler takes the new size at once
+        TEST_CHECK(dispatch_table_register(&table, 2, (dispatch_fn_t)test_handler, 13, false, &test_sinks[5]));
+        TEST_CHECK(test_dispatch(&table, 2, test_payload, 12) == DISPATCH_TABLE_BAD_SIZE);
+        TEST_CHECK(test_dispatch(&table, 2, test_payload, 13) == DISPATCH_TABLE_OK);
+        TEST_CHECK((test_sinks[5].calls == 1) && (test_sinks[2].calls == 1));
+        printf("sizes: %s\n", (test_violations != violations) ? "FAIL" : "OK");
+}
+
+/* Registered types mostly at a valid size, the rest at a wrong one or of a type nobody handles */
+static void test_stream(size_t packets)
+{
+        for (size_t i = 0; i < packets; i++)
+        {
+                int pick = rand() % 100;
+                const test_registration_t *reg = &test_registrations[rand() % TEST_REGISTRATIONS];
+                size_t len;
+                if (pick < 80)
+                        len = reg->variable_len ? rand() % (reg->payload_len + 1) : reg->payload_len;
+                else if (pick < 90)
+                        len = reg->payload_len + 1 + rand() % 8; // Too long
+                else
+                        len = reg->payload_len ? rand() % reg->payload_len : 0; // Short, valid for a variable length type
+                test_packets[i] = (test_packet_t){.type = reg->type, .len = (len > UINT8_MAX) ? UINT8_MAX : len};
+                if (pick >= 95)
+                        test_packets[i].type = rand() % TEST_TYPES; // Often unhandled
+        }
+}
+
+/* The switch app_main had before the table: a size check and a copy per type */
+static struct
+{
+        uint8_t motor_stat[48];
+        uint8_t motor_stat_delta[43];
+        uint8_t bundle[TEST_MAX_PAYLOAD];
+        uint8_t channel_switch[3];
+        uint8_t probe[200];
+} test_copies;
+
+static bool test_switch(unsigned type, const void *payload, size_t len)
+{
+        test_sink_t *sink = &test_sinks[type % DISPATCH_TABLE_MAX_TYPES];
+        switch (type)
+        {
+        case 2:
+                if (len != sizeof(test_copies.motor_stat))
+                        return false;
+                memcpy(test_copies.motor_stat, payload, len);
+                test_handler(NULL, test_copies.motor_stat, len, sink);
+                return true;
+        case 14:
+                if (len > sizeof(test_copies.motor_stat_delta))
+                        return false;
+                memcpy(test_copies.motor_stat_delta, payload, len);
+                test_handler(NULL, test_copies.motor_stat_delta, len, sink);
+                return true;
+        case 10:
+                if (len > sizeof(test_copies.bundle))
+                        return false;
+                memcpy(test_copies.bundle, payload, len);
+                test_handler(NULL, test_copies.bundle, len, sink);
+                return true;
+        case 11:
+                if (len != sizeof(test_copies.channel_switch))
+                        return false;
+                memcpy(test_copies.channel_switch, payload, len);
+                test_handler(NULL, test_copies.channel_switch, len, sink);
+                return true;
+        case 15:
+        case 16:
+                if (len > sizeof(test_copies.probe))
+                        return false;
+                memcpy(test_copies.probe, payload, len);
+                test_handler(NULL, test_copies.probe, len, sink);
+                return true;
+        default:
+                return false;
+        }
+}
+
+static double test_now_ns(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void test_bench(size_t packets)
+{
+        dispatch_table_t table;
+        memset(&table, 0, sizeof(table));
+        for (size_t i = 0; i < TEST_REGISTRATIONS; i++)
+        {
+                const test_registration_t *reg = &test_registrations[i];
+                dispatch_table_register(&table, reg->type, (dispatch_fn_t)test_handler, reg->payload_len, reg->variable_len, &test_sinks[reg->type]);
+        }
+        test_stream(packets);
+
+        // Same packets delivered by both
+        size_t table_calls = 0, switch_calls = 0;
+        for (size_t i = 0; i < packets; i++)
+        {
+                bool by_table = test_dispatch(&table, test_packets[i].type, test_payload, test_packets[i].len) == DISPATCH_TABLE_OK;
+                bool by_switch = test_switch(test_packets[i].type, test_payload, test_packets[i].len);
+                TEST_CHECK(by_table == by_switch);
+                if (by_table != by_switch)
+                        break;
+                table_calls += by_table;
+                switch_calls += by_switch;
+        }
+        TEST_CHECK(table.stat.dispatched + table.stat.unhandled + table.stat.bad_size == packets);
+        TEST_CHECK(table.stat.dispatched == table_calls);
+        TEST_CHECK(switch_calls == table_calls);
+        dispatch_stat_t stat = table.stat;
+
+        double best_table_ns = 0, best_switch_ns = 0;
+        for (unsigned round = 0; round < TEST_ROUNDS; round++)
+        {
+                double start = test_now_ns();
+                for (size_t i = 0; i < packets; i++)
+                        test_dispatch(&table, test_packets[i].type, test_payload, test_packets[i].len);
+                double table_ns = (test_now_ns() - start) / packets;
+
+                start = test_now_ns();
+                for (size_t i = 0; i < packets; i++)
+                        test_switch(test_packets[i].type, test_payload, test_packets[i].len);
+                double switch_ns = (test_now_ns() - start) / packets;
+
+                if ((round == 0) || (table_ns < best_table_ns))
+                        best_table_ns = table_ns;
+                if ((round == 0) || (switch_ns < best_switch_ns))
+                        best_switch_ns = switch_ns;
+        }
+        printf("bench: %zu packets, %zu delivered, %zu bad size, %zu unhandled\n", packets, stat.dispatched, stat.bad_size, stat.unhandled);
+        printf("%-22s %8.1f ns/packet\n", "table, in place", best_table_ns);
+        printf("%-22s %8.1f ns/packet\n", "switch, copy", best_switch_ns);
+}
+
+int main(int argc, char **argv)
+{
+        size_t packets = 100000;
+        if (argc > 1)
+                packets = atoi(argv[1]);
+        if ((packets == 0) || (packets > TEST_PACKETS_MAX))
+                packets = TEST_PACKETS_MAX;
+        srand(argc > 2 ? atoi(argv[2]) : 1);
+        for (size_t i = 0; i < sizeof(test_payload); i++)
+                test_payload[i] = i;
+
+        test_sizes();
+        test_bench(packets);
+
+        printf("%s, %u violation(s)\n", test_violations ? "FAIL" : "OK", test_violations);
+        return test_violations ? 1 : 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * main/pair_cache.c as a Linux process, with NVS replaced by a blob in
+ * memory that can fail a write or have a byte flipped at rest.
+ *
+ * The cache part checks the order after connects, the eviction of the
+ * least recent peer, that a reconnect to the same peer writes nothing,
+ * and that a damaged, old or missing blob loads as an empty cache while a
+ * failed write leaves the previous blob in place.
+ *
+ * The resume part runs the handshake of espnow_pair.c in simulated time:
+ * a rebooted side polls pair_resume_t and sends requests over a link with
+ * loss and latency, the other side answers with an ACK when the first is
+ * in its cache and a NACK otherwise. Reported is the time from restore to
+ * connected, which discovery puts at a second or more.
+ *
+ * Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/pair_cache_mock.c main/pair_cache.c -o pair_cache_mock
+ *   ./pair_cache_mock [trials] [loss_percent] [latency_us]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pair_cache.h"
+
+#define MOCK_STEP_US (100)
+#define MOCK_LINK_MAX (16) // Frames on air at once
+
+static unsigned mock_violations = 0;
+
+#define MOCK_CHECK(cond)                                                          \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        mock_violations++;                                        \
+                }                                                                 \
+        } while (0)
+
+/* NVS stand-in: nvs_set_blob and nvs_commit either replace the whole blob or leave it */
+typedef struct
+{
+        uint8_t blob[sizeof(pair_cache_blob_t)];
+        size_t len;
+        bool present;
+        bool fail_writes;
+        unsigned writes;
+} mock_nvs_t;
+
+static bool mock_nvs_read(void *ctx, void *blob, size_t *len)
+{
+        mock_nvs_t *nvs = ctx;
+        if (!nvs->present || (nvs->len > *len))
+                return false;
+        memcpy(blob, nvs->blob, nvs->len);
+        *len = nvs->len;
+        return true;
+}
+
+static bool mock_nvs_write(void *ctx, const void *blob, size_t len)
+{
+        mock_nvs_t *nvs = ctx;
+        if (nvs->fail_writes || (len > sizeof(nvs->blob)))
+                return false;
+        memcpy(nvs->blob, blob, len);
+        nvs->len = len;
+        nvs->present = true;
+        nvs->writes++;
+        return true;
+}
+
+static pair_cache_store_t mock_store(mock_nvs_t *nvs)
+{
+        return (pair_cache_store_t){.read = mock_nvs_read, .write = mock_nvs_write, .ctx = nvs};
+}
+
+static pair_cache_entry_t mock_entry(uint8_t id, uint8_t channel)
+{
+        pair_cache_entry_t entry = {.mac = {0x24, 0x6F, 0x28, 0x00, 0x00, id}, .channel = channel, .phy_rate = 0x29};
+        memcpy(entry.lmk, "lmk1234567890123", PAIR_CACHE_KEY_LEN);
+        return entry;
+}
+
+static bool mock_order(const pair_cache_t *cache, const uint8_t *ids, size_t count)
+{
+        if (cache->count != count)
+                return false;
+        for (size_t i = 0; i < count; i++)
+                if (cache->entries[i].mac[5] != ids[i])
+                        return false;
+        return true;
+}
+
+static void mock_cache(void)
+{
+        mock_nvs_t nvs = {0};
+        pair_cache_store_t store = mock_store(&nvs);
+        pair_cache_t cache;
+
+        MOCK_CHECK(pair_cache_init(&cache, &store) == 0);
+        MOCK_CHECK(cache.load_errors == 0); // Nothing stored is not an error
+
+        for (uint8_t id = 1; id <= 3; id++)
+        {
+                pair_cache_entry_t entry = mock_entry(id, 6);
+                MOCK_CHECK(pair_cache_remember(&cache, &entry));
+        }
+        MOCK_CHECK(mock_order(&cache, (uint8_t[]){3, 2, 1}, 3));
+        MOCK_CHECK(nvs.writes == 3);
+
+        pair_cache_entry_t entry = mock_entry(3, 6);
+        MOCK_CHECK(pair_cache_remember(&cache, &entry)); // Reconnect, nothing changed
+        MOCK_CHECK(nvs.writes == 3);
+
+        entry = mock_entry(1, 6);
+        MOCK_CHECK(pair_cache_remember(&cache, &entry));
+        MOCK_CHECK(mock_order(&cache, (uint8_t[]){1, 3, 2}, 3));
+
+        entry = mock_entry(1, 11); // Channel switch
+        MOCK_CHECK(pair_cache_remember(&cache, &entry));
+        MOCK_CHECK(pair_cache_find(&cache, entry.mac)->channel == 11);
+        MOCK_CHECK(nvs.writes == 5);
+
+        for (uint8_t id = 4; id <= 5; id++)
+        {
+                entry = mock_entry(id, 11);
+                MOCK_CHECK(pair_cache_remember(&cache, &entry));
+        }
+        MOCK_CHECK(mock_order(&cache, (uint8_t[]){5, 4, 1, 3}, PAIR_CACHE_MAX)); // 2 was the least recent
+        MOCK_CHECK(pair_cache_find(&cache, mock_entry(2, 6).mac) == NULL);
+
+        pair_cache_t reloaded;
+        MOCK_CHECK(pair_cache_init(&reloaded, &store) == PAIR_CACHE_MAX);
+        MOCK_CHECK(memcmp(reloaded.entries, cache.entries, sizeof(cache.entries)) == 0);
+
+        MOCK_CHECK(pair_cache_forget(&cache, mock_entry(4, 11).mac));
+        MOCK_CHECK(mock_order(&cache, (uint8_t[]){5, 1, 3}, 3));
+        unsigned writes = nvs.writes;
+        MOCK_CHECK(pair_cache_forget(&cache, mock_entry(4, 11).mac)); // Already gone
+        MOCK_CHECK(nvs.writes == writes);
+
+        // A failed write keeps the last good blob
+        nvs.fail_writes = true;
+        entry = mock_entry(7, 11);
+        MOCK_CHECK(!pair_cache_remember(&cache, &entry));
+        MOCK_CHECK(cache.save_errors == 1);
+        nvs.fail_writes = false;
+        MOCK_CHECK(pair_cache_init(&reloaded, &store) == 3);
+        MOCK_CHECK(mock_order(&reloaded, (uint8_t[]){5, 1, 3}, 3));
+
+        // Any flipped byte is caught
+        for (size_t i = 0; i < nvs.len; i++)
+        {
+                nvs.blob[i] ^= 0x10;
+                MOCK_CHECK(pair_cache_init(&reloaded, &store) == 0);
+                MOCK_CHECK(reloaded.load_errors == 1);
+                nvs.blob[i] ^= 0x10;
+        }
+
+        // Another version or length
+        pair_cache_blob_t *blob = (pair_cache_blob_t *)nvs.blob;
+        blob->version++;
+        blob->crc = pair_cache_crc16(UINT16_MAX, blob, offsetof(pair_cache_blob_t, crc));
+        MOCK_CHECK(pair_cache_init(&reloaded, &store) == 0);
+        nvs.len--;
+        MOCK_CHECK(pair_cache_init(&reloaded, &store) == 0);
+
+        printf("cache: %u write(s), %s\n", nvs.writes, mock_violations ? "FAIL" : "OK");
+}
+
+typedef struct
+{
+        int64_t arrive_us;
+        bool to_resumer;
+        bool accept;
+} mock_frame_t;
+
+static mock_frame_t mock_link[MOCK_LINK_MAX];
+static size_t mock_link_count = 0;
+
+static void mock_link_send(int64_t now, unsigned loss_percent, unsigned latency_us, bool to_resumer, bool accept)
+{
+        if (((unsigned)rand() % 100 < loss_percent) || (mock_link_count == MOCK_LINK_MAX))
+                return;
+        mock_link[mock_link_count++] = (mock_frame_t){.arrive_us = now + latency_us + rand() % (latency_us + 1), .to_resumer = to_resumer, .accept = accept};
+}
+
+/* One boot: returns the time to connected, -1 when the resume gave up or was refused */
+static int64_t mock_resume(bool known, unsigned loss_percent, unsigned latency_us, unsigned *attempts)
+{
+        pair_resume_t resume;
+        mock_link_count = 0;
+        pair_resume_start(&resume, 0);
+        for (int64_t now = 0; now <= PAIR_RESUME_TIMEOUT_US + MOCK_STEP_US; now += MOCK_STEP_US)
+        {
+                for (size_t i = 0; i < mock_link_count;)
+                {
+                        mock_frame_t frame = mock_link[i];
+                        if (frame.arrive_us > now)
+                        {
+                                i++;
+                                continue;
+                        }
+                        mock_link[i] = mock_link[--mock_link_count];
+                        if (!frame.to_resumer) // The other side, answers every request
+                                mock_link_send(now, loss_percent, latency_us, true, known);
+                        else if (frame.accept)
+                                pair_resume_accepted(&resume, now);
+                        else
+                                pair_resume_rejected(&resume);
+                }
+
+                switch (pair_resume_poll(&resume, now))
+                {
+                case PAIR_RESUME_ACTION_SEND:
+                        mock_link_send(now, loss_percent, latency_us, false, false);
+                        break;
+                case PAIR_RESUME_ACTION_GIVE_UP:
+                        MOCK_CHECK(now >= PAIR_RESUME_TIMEOUT_US);
+                        break;
+                case PAIR_RESUME_ACTION_NONE:
+                        break;
+                }
+                if (resume.state != PAIR_RESUME_PENDING)
+                        break;
+        }
+        *attempts = resume.attempts;
+        MOCK_CHECK(resume.state != PAIR_RESUME_PENDING);
+        MOCK_CHECK(pair_resume_poll(&resume, PAIR_RESUME_TIMEOUT_US * 2) == PAIR_RESUME_ACTION_NONE); // Settled for good
+        return (resume.state == PAIR_RESUME_DONE) ? (int64_t)resume.elapsed_us : -1;
+}
+
+static int mock_compare(const void *a, const void *b)
+{
+        int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+        return (x > y) - (x < y);
+}
+
+static void mock_resume_run(unsigned trials, unsigned loss_percent, unsigned latency_us)
+{
+        int64_t *samples = calloc(trials, sizeof(int64_t));
+        unsigned done = 0, attempts_total = 0;
+        for (unsigned t = 0; t < trials; t++)
+        {
+                unsigned attempts;
+                int64_t elapsed = mock_resume(true, loss_percent, latency_us, &attempts);
+                attempts_total += attempts;
+                if (elapsed >= 0)
+                        samples[done++] = elapsed;
+                if (loss_percent == 0) // Lossless, the first request makes it, each way takes up to twice the latency
+                        MOCK_CHECK((elapsed >= 0) && (elapsed <= 4 * (int64_t)latency_us + MOCK_STEP_US));
+        }
+        qsort(samples, done, sizeof(int64_t), mock_compare);
+        printf("%6u %7u %6u %9u %8.2f %8lld %8lld %8lld\n", loss_percent, latency_us, trials, done, (double)attempts_total / trials,
+               done ? (long long)samples[done / 2] : -1LL, done ? (long long)samples[(done - 1) * 99 / 100] : -1LL,
+               done ? (long long)samples[done - 1] : -1LL);
+        free(samples);
+
+        unsigned attempts;
+        MOCK_CHECK(mock_resume(false, loss_percent, latency_us, &attempts) < 0); // Refused, or timed out, never connected
+}
+
+int main(int argc, char **argv)
+{
+        unsigned trials = 2000;
+        unsigned loss_percent = 30;
+        unsigned latency_us = 1000;
+        if (argc > 1)
+                trials = atoi(argv[1]);
+        if (argc > 2)
+                loss_percent = atoi(argv[2]);
+        if (argc > 3)
+                latency_us = atoi(argv[3]);
+        srand(1);
+
+        mock_cache();
+
+        printf("retry: %d us, timeout: %d us\n", PAIR_RESUME_RETRY_US, PAIR_RESUME_TIMEOUT_US);
+        printf("%6s %7s %6s %9s %8s %8s %8s %8s\n", "loss%", "lat us", "boots", "resumed", "requests", "p50 us", "p99 us", "max us");
+        mock_resume_run(trials, 0, latency_us);
+        mock_resume_run(trials, 10, latency_us);
+        mock_resume_run(trials, loss_percent, latency_us);
+
+        printf("%s, %u violation(s)\n", mock_violations ? "FAIL" : "OK", mock_violations);
+        return mock_violations ? 1 : 0;
+}
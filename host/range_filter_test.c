@@ -0,0 +1,263 @@
+/*
+ * main/range_filter.c as a Linux process, fed with simulated ultrasonic
+ * readings the way tof_sensor.c feeds it: an echo time turned into mm by
+ * range_filter_echo_to_mm, or a failed reading. A trace is a target that
+ * holds still, steps away and creeps, with Gaussian noise on every echo,
+ * single spikes from multipath echoes and timeouts.
+ *
+ * Checked per reading: while most good readings in the window are close
+ * to the truth, the reported distance is too, whatever spikes or readings
+ * from before a step make up the rest. A spike is then flagged, a close
+ * reading never is, and a window of failures reports nothing. Over a
+ * trace the filtered error must stay below the raw noise, and confidence
+ * must fall as noise, spikes and timeouts are added. The echo conversion
+ * is checked against the speed of sound in floating point.
+ *
+ * Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/range_filter_test.c main/range_filter.c -lm -o range_filter_test
+ *   ./range_filter_test [readings] [seed]
+ * */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "range_filter.h"
+
+#define TEST_TEMPERATURE_C (20)
+#define TEST_READINGS_MAX (1 << 20)
+
+static unsigned test_violations = 0;
+
+#define TEST_CHECK(cond)                                                          \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        test_violations++;                                        \
+                }                                                                 \
+        } while (0)
+
+typedef struct
+{
+        const char *name;
+        double noise_mm;       // Standard deviation of every echo
+        unsigned spike_permille;
+        unsigned timeout_permille;
+} test_trace_t;
+
+static const test_trace_t test_traces[] = {
+    {"clean", 0, 0, 0},
+    {"noise 3 mm", 3, 0, 0},
+    {"noise 3 mm, spikes", 3, 50, 0},
+    {"noise 3 mm, timeouts", 3, 0, 150},
+    {"all of it", 6, 50, 150},
+};
+#define TEST_TRACES (sizeof(test_traces) / sizeof(test_traces[0]))
+
+typedef struct
+{
+        double raw_sq_mm;
+        double filtered_sq_mm;
+        size_t samples;
+        size_t raw;
+        uint64_t confidence;
+        size_t spikes;
+        size_t spikes_flagged;
+        size_t false_outliers; // Close to the truth, flagged anyway
+        size_t unsettled;
+        size_t empty;
+} test_stat_t;
+
+static double test_gauss(void)
+{
+        double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+        return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/* Round trip time of an echo from `distance_mm` */
+static uint32_t test_echo_ns(double distance_mm, int temperature_c)
+{
+        return (uint32_t)(2 * distance_mm / (331.3 + 0.606 * temperature_c) * 1e6 + 0.5);
+}
+
+/* Holds still, steps by 400 mm, creeps 0.5 mm per reading, all within the 2 to 400 cm of an SR04 */
+static double test_truth(size_t i)
+{
+        size_t phase = i % 600;
+        if (phase < 200)
+                return 800;
+        if (phase < 400)
+                return 1200;
+        return 1200 - (phase - 400) * 0.5;
+}
+
+static void test_units(void)
+{
+        unsigned violations = test_violations;
+        range_filter_config_t config;
+        range_filter_t filter;
+        TEST_CHECK(range_filter_default_config(NULL) == NULL);
+        const uint8_t windows[][2] = {{0, 9}, {1, 1}, {4, 5}, {5, 5}, {9, 9}, {10, 9}, {200, 9}};
+        for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); i++)
+        {
+                range_filter_default_config(&config)->window = windows[i][0];
+                range_filter_init(&filter, &config);
+                TEST_CHECK(filter.config.window == windows[i][1]);
+        }
+
+        // Within 1 mm of the floating point conversion, cold to hot, near to far
+        for (int temperature_c = -40; temperature_c <= 85; temperature_c += 5)
+        {
+                for (uint32_t echo_ns = 0; echo_ns < 30 * 1000 * 1000; echo_ns += 7919)
+                {
+                        double expected = echo_ns * 1e-9 * (331.3 + 0.606 * temperature_c) * 1000 / 2;
+                        double error = fabs(range_filter_echo_to_mm(echo_ns, temperature_c) - expected);
+                        TEST_CHECK(error <= 0.5 + 1e-6);
+                }
+        }
+        TEST_CHECK(range_filter_echo_to_mm(test_echo_ns(1000, 20), 20) == 1000);
+
+        // Nothing but failures reports nothing, not even after good readings left the window
+        range_filter_result_t result;
+        range_filter_init(&filter, range_filter_default_config(&config));
+        range_filter_push(&filter, 500, true, &result);
+        TEST_CHECK((result.distance_mm == 500) && !result.outlier && (result.confidence > 0));
+        for (size_t i = 0; i < config.window; i++)
+                range_filter_push(&filter, 0, false, &result);
+        TEST_CHECK((result.distance_mm == 0) && (result.confidence == 0) && !result.outlier);
+
+        // Too few votes to call anything an outlier, then a spike against three
+        range_filter_reset(&filter);
+        range_filter_push(&filter, 500, true, &result);
+        range_filter_push(&filter, 2000, true, &result);
+        TEST_CHECK(!result.outlier);
+        range_filter_push(&filter, 505, true, &result);
+        range_filter_push(&filter, 3000, true, &result);
+        TEST_CHECK(result.outlier && (result.distance_mm == 505));
+        range_filter_push(&filter, 0, false, &result);
+        TEST_CHECK(!result.outlier); // A failed reading is not an outlier
+        printf("units: %s\n", (test_violations != violations) ? "FAIL" : "OK");
+}
+
+/* The readings in the filter's window, to tell which are close to the truth now */
+typedef struct
+{
+        uint32_t readings[RANGE_FILTER_MAX_WINDOW]; // 0 for a failed one
+        size_t head;
+        size_t window;
+} test_window_t;
+
+static void test_trace(const test_trace_t *trace, size_t readings, test_stat_t *stat)
+{
+        range_filter_config_t config;
+        range_filter_t filter;
+        range_filter_init(&filter, range_filter_default_config(&config));
+        test_window_t window = {.window = config.window};
+        const double bound = 4 * trace->noise_mm + 1 + config.window * 0.5; // Noise, rounding, the creep over a window
+
+        for (size_t i = 0; i < readings; i++)
+        {
+                double truth = test_truth(i);
+                bool valid = (unsigned)(rand() % 1000) >= trace->timeout_permille;
+                bool spike = valid && ((unsigned)(rand() % 1000) < trace->spike_permille);
+                double measured = truth + trace->noise_mm * test_gauss();
+                if (spike)
+                        measured = truth + ((rand() % 2) ? 1 : -1) * (200 + rand() % 1500); // A second surface or the floor
+                if (measured < 20)
+                        measured = 20;
+                uint32_t raw_mm = valid ? range_filter_echo_to_mm(test_echo_ns(measured, TEST_TEMPERATURE_C), TEST_TEMPERATURE_C) : 0;
+                bool close = valid && (fabs(raw_mm - truth) <= bound);
+
+                range_filter_result_t result;
+                range_filter_push(&filter, raw_mm, valid, &result);
+                window.readings[window.head] = raw_mm;
+                window.head = (window.head + 1) % window.window;
+
+                // Readings of before a step are as far off as spikes
+                size_t votes = 0, closes = 0;
+                for (size_t k = 0; k < window.window; k++)
+                {
+                        votes += window.readings[k] != 0;
+                        closes += (window.readings[k] != 0) && (fabs(window.readings[k] - truth) <= bound);
+                }
+                if (votes == 0)
+                {
+                        TEST_CHECK((result.distance_mm == 0) && (result.confidence == 0));
+                        stat->empty++;
+                        continue;
+                }
+                TEST_CHECK(result.distance_mm != 0);
+                if (2 * closes <= votes) // No majority to hold the median, right after a step or with spikes in a thin window
+                {
+                        stat->unsettled++;
+                        continue;
+                }
+
+                // A strict majority within the bound holds the median within it, whatever the rest
+                double error = (double)result.distance_mm - truth;
+                TEST_CHECK(fabs(error) <= bound);
+                if (spike && (votes >= RANGE_FILTER_MIN_VOTES))
+                {
+                        stat->spikes++;
+                        stat->spikes_flagged += result.outlier;
+                }
+                if (close)
+                        stat->false_outliers += result.outlier;
+                stat->filtered_sq_mm += error * error;
+                if (valid && !spike)
+                {
+                        stat->raw_sq_mm += ((double)raw_mm - truth) * ((double)raw_mm - truth);
+                        stat->raw++;
+                }
+                stat->confidence += result.confidence;
+                stat->samples++;
+        }
+}
+
+int main(int argc, char **argv)
+{
+        size_t readings = 60000;
+        if (argc > 1)
+                readings = atoi(argv[1]);
+        if (readings > TEST_READINGS_MAX)
+                readings = TEST_READINGS_MAX;
+        srand(argc > 2 ? atoi(argv[2]) : 1);
+
+        test_units();
+        range_filter_config_t config;
+        range_filter_default_config(&config);
+        printf("%-22s %9s %9s %6s %8s %8s %6s %9s %6s\n", "trace", "raw rms", "filt rms", "conf", "spikes", "flagged", "false", "unsettled",
+               "empty");
+        double confidence[TEST_TRACES];
+        for (size_t t = 0; t < TEST_TRACES; t++)
+        {
+                const test_trace_t *trace = &test_traces[t];
+                unsigned violations = test_violations;
+                test_stat_t stat = {0};
+                test_trace(trace, readings, &stat);
+                double raw_rms = stat.raw ? sqrt(stat.raw_sq_mm / stat.raw) : 0;
+                double filtered_rms = stat.samples ? sqrt(stat.filtered_sq_mm / stat.samples) : 0;
+                confidence[t] = stat.samples ? (double)stat.confidence / stat.samples : 0;
+
+                TEST_CHECK(stat.spikes_flagged == stat.spikes);
+                TEST_CHECK(stat.false_outliers == 0);
+                TEST_CHECK(stat.unsettled * 20 < readings); // Not a vacuous pass, most readings are checked
+                if ((trace->spike_permille == 0) && (trace->timeout_permille == 0))
+                        TEST_CHECK(stat.unsettled <= (readings / 600 + 1) * 2 * (config.window / 2)); // Two steps a cycle, each followed within half a window
+                if (trace->noise_mm > 0)
+                        TEST_CHECK(filtered_rms < raw_rms);
+                printf("%-22s %9.2f %9.2f %6.1f %8zu %8zu %6zu %9zu %6zu  %s\n", trace->name, raw_rms, filtered_rms, confidence[t],
+                       stat.spikes, stat.spikes_flagged, stat.false_outliers, stat.unsettled, stat.empty,
+                       (test_violations != violations) ? "FAIL" : "OK");
+        }
+        // Clean above noisy, noisy above noisy with spikes or timeouts, which are above all of it
+        TEST_CHECK(confidence[0] > confidence[1]);
+        TEST_CHECK((confidence[1] > confidence[2]) && (confidence[1] > confidence[3]));
+        TEST_CHECK((confidence[2] > confidence[4]) && (confidence[3] > confidence[4]));
+
+        printf("%s, %u violation(s)\n", test_violations ? "FAIL" : "OK", test_violations);
+        return test_violations ? 1 : 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * main/seq_window.c as a Linux process. Streams of sequence numbers as
+ * ESP-NOW retries and reordering produce them go through one window:
+ * shuffled within the window, every frame sent one to three times, with
+ * and without loss, across the 16-bit wrap. Each frame must be accepted
+ * exactly once and the loss must show up as gaps. A reference model over
+ * unwrapped numbers checks every decision of long random streams.
+ *
+ * A restarted sender numbering from 0 again is locked out while the
+ * window still holds its old numbers, unless it comes with a new session
+ * or the window is reset, as esp_peer_set_status does on lost, resuming
+ * and connected.
+ *
+ * Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/seq_window_test.c main/seq_window.c -o seq_window_test
+ *   ./seq_window_test [frames] [seed]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "seq_window.h"
+
+#define TEST_FRAMES_MAX (1 << 16)
+#define TEST_DISPLACEMENT (SEQ_WINDOW_SIZE / 2) // Furthest a frame is moved by the shuffle
+
+static unsigned test_violations = 0;
+
+#define TEST_CHECK(cond)                                                          \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        test_violations++;                                        \
+                }                                                                 \
+        } while (0)
+
+static uint32_t test_stream[TEST_FRAMES_MAX * 3];
+static uint8_t test_accepted[TEST_FRAMES_MAX];
+
+static uint32_t test_keys[TEST_FRAMES_MAX * 3];
+
+/* Moves each frame by less than TEST_DISPLACEMENT, a retry or a late frame never falls out of the window */
+static void test_shuffle(uint32_t *stream, size_t count)
+{
+        for (size_t i = 0; i < count; i++)
+                test_keys[i] = i + rand() % TEST_DISPLACEMENT;
+        for (size_t i = 1; i < count; i++) // Insertion sort by key, stable, and each frame moves little
+        {
+                uint32_t key = test_keys[i], value = stream[i];
+                size_t j = i;
+                for (; (j > 0) && (test_keys[j - 1] > key); j--)
+                {
+                        test_keys[j] = test_keys[j - 1];
+                        stream[j] = stream[j - 1];
+                }
+                test_keys[j] = key;
+                stream[j] = value;
+        }
+}
+
+/* `frames` numbers from `first`, `copies_max` copies each, `loss_percent` never sent */
+static void test_stream_run(const char *name, uint16_t first, size_t frames, unsigned copies_max, unsigned loss_percent, bool shuffled)
+{
+        size_t count = 0, lost = 0, extra = 0;
+        for (size_t i = 0; i < frames; i++)
+        {
+                if ((i > 0) && (i + 1 < frames) && ((unsigned)rand() % 100 < loss_percent)) // First and last always arrive
+                {
+                        lost++;
+                        continue;
+                }
+                unsigned copies = 1 + rand() % copies_max;
+                extra += copies - 1;
+                for (unsigned c = 0; c < copies; c++)
+                        test_stream[count++] = i;
+        }
+        if (shuffled)
+                test_shuffle(test_stream + 1, count - 1); // The first frame sets the window
+
+        seq_window_t window;
+        seq_window_reset(&window);
+        memset(test_accepted, 0, frames);
+        for (size_t i = 0; i < count; i++)
+                if (seq_window_check(&window, 7, (uint16_t)(first + test_stream[i])))
+                        test_accepted[test_stream[i]]++;
+
+        size_t twice = 0, never = 0;
+        for (size_t i = 0; i < frames; i++)
+        {
+                twice += test_accepted[i] > 1;
+                never += test_accepted[i] == 0;
+        }
+        TEST_CHECK(twice == 0);
+        TEST_CHECK(never == lost);
+        TEST_CHECK(window.accepted == frames - lost);
+        TEST_CHECK(window.duplicates == extra);
+        TEST_CHECK(window.stale == 0);
+        TEST_CHECK(window.gaps == lost);
+        TEST_CHECK(window.resyncs == 0);
+        printf("%-22s %6zu %6zu %6zu %6zu %6zu %6zu\n", name, count, window.accepted, window.duplicates, window.reordered, window.gaps, lost);
+}
+
+/* Decisions against a model that never wraps: new and no more than SEQ_WINDOW_SIZE - 1 behind the highest */
+static void test_reference(size_t frames)
+{
+        seq_window_t window;
+        seq_window_reset(&window);
+        static uint8_t seen[TEST_FRAMES_MAX + SEQ_WINDOW_SIZE * 4];
+        memset(seen, 0, sizeof(seen));
+        int64_t top = -1, next = 0;
+        size_t mismatches = 0;
+        const uint16_t base = 65000; // Crosses the wrap early on
+        for (size_t i = 0; i < frames; i++)
+        {
+                int64_t seq;
+                switch (rand() % 4)
+                {
+                case 0: // Old, maybe beyond the window
+                        seq = (top > 0) ? top - rand() % (SEQ_WINDOW_SIZE * 2) : 0;
+                        break;
+                case 1: // Jump ahead, a burst lost
+                        next += rand() % 8;
+                        // Fall through
+                default:
+                        seq = next++;
+                        break;
+                }
+                if (seq < 0)
+                        seq = 0;
+                if ((size_t)seq >= sizeof(seen))
+                        break;
+
+                bool expected = !seen[seq] && ((top < 0) || (seq > top - SEQ_WINDOW_SIZE));
+                bool accepted = seq_window_check(&window, 7, (uint16_t)(base + seq));
+                mismatches += expected != accepted;
+                if (accepted)
+                        seen[seq] = 1;
+                if (accepted && (seq > top))
+                        top = seq;
+        }
+        TEST_CHECK(mismatches == 0);
+        printf("reference: %zu frames, %zu mismatch(es), stale %zu, duplicates %zu\n", frames, mismatches, window.stale, window.duplicates);
+}
+
+static void test_restart(void)
+{
+        unsigned violations = test_violations;
+        seq_window_t window;
+        seq_window_reset(&window);
+        for (uint16_t seq = 0; seq < 500; seq++)
+                TEST_CHECK(seq_window_check(&window, 7, seq));
+
+        // Same session drawn again and numbers within reach: locked out until the window is reset
+        size_t dropped = 0;
+        for (uint16_t seq = 0; seq < 100; seq++)
+                dropped += !seq_window_check(&window, 7, seq);
+        TEST_CHECK(dropped == 100);
+        seq_window_reset(&window);
+        for (uint16_t seq = 0; seq < 100; seq++)
+                TEST_CHECK(seq_window_check(&window, 7, seq));
+        TEST_CHECK(window.accepted == 100);
+
+        // A new session is taken at once, its frames are not duplicates of the old ones
+        for (uint16_t seq = 100; seq < 500; seq++)
+                seq_window_check(&window, 7, seq);
+        TEST_CHECK(seq_window_check(&window, 8, 0));
+        TEST_CHECK(window.resyncs == 1);
+        TEST_CHECK(!seq_window_check(&window, 8, 0));
+        for (uint16_t seq = 1; seq < 100; seq++)
+                TEST_CHECK(seq_window_check(&window, 8, seq));
+        TEST_CHECK(window.stale == 0);
+
+        // A jump beyond the resync distance in the same session
+        TEST_CHECK(seq_window_check(&window, 8, 99 + SEQ_WINDOW_RESYNC_DISTANCE + 1));
+        TEST_CHECK(window.resyncs == 2);
+        TEST_CHECK(window.gaps == 0);
+
+        // Just behind the window edge
+        seq_window_reset(&window);
+        TEST_CHECK(seq_window_check(&window, 1, 1000));
+        TEST_CHECK(seq_window_check(&window, 1, 1000 - (SEQ_WINDOW_SIZE - 1)));
+        TEST_CHECK(!seq_window_check(&window, 1, 1000 - SEQ_WINDOW_SIZE));
+        TEST_CHECK(window.stale == 1);
+
+        // Old replays, however far behind, are stale and leave the window where it is
+        seq_window_reset(&window);
+        for (uint16_t seq = 0; seq < 3000; seq++)
+                seq_window_check(&window, 1, seq);
+        size_t accepted = window.accepted;
+        const uint16_t replays[] = {2999 - SEQ_WINDOW_SIZE, 2999 - SEQ_WINDOW_RESYNC_DISTANCE, 2999 - SEQ_WINDOW_RESYNC_DISTANCE - 1, 0, (uint16_t)(2999 - 32768)};
+        for (size_t i = 0; i < sizeof(replays) / sizeof(replays[0]); i++)
+                TEST_CHECK(!seq_window_check(&window, 1, replays[i]));
+        TEST_CHECK(window.stale == sizeof(replays) / sizeof(replays[0]));
+        TEST_CHECK(window.resyncs == 0);
+        TEST_CHECK(window.top == 2999);
+        TEST_CHECK(window.accepted == accepted);
+        TEST_CHECK(!seq_window_check(&window, 1, 2999));
+        TEST_CHECK(seq_window_check(&window, 1, 3000));
+        printf("restart: %s\n", (test_violations != violations) ? "FAIL" : "OK");
+}
+
+int main(int argc, char **argv)
+{
+        size_t frames = 20000;
+        if (argc > 1)
+                frames = atoi(argv[1]);
+        if (frames > TEST_FRAMES_MAX)
+                frames = TEST_FRAMES_MAX;
+        srand(argc > 2 ? atoi(argv[2]) : 1);
+
+        printf("%-22s %6s %6s %6s %6s %6s %6s\n", "stream", "sent", "accept", "dup", "reord", "gaps", "lost");
+        test_stream_run("in order", 0, frames, 1, 0, false);
+        test_stream_run("duplicated", 0, frames, 3, 0, false);
+        test_stream_run("shuffled", 0, frames, 1, 0, true);
+        test_stream_run("shuffled duplicated", 0, frames, 3, 0, true);
+        test_stream_run("shuffled dup 10% loss", 0, frames, 3, 10, true);
+        test_stream_run("across the wrap", 65536 - frames / 2, frames, 3, 5, true);
+        test_reference(frames);
+        test_restart();
+
+        printf("%s, %u violation(s)\n", test_violations ? "FAIL" : "OK", test_violations);
+        return test_violations ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * main/servo_profile.c as a Linux process. Random moves of servos with the
+ * limits servo_group.c derives from degree per second settings, stepped at
+ * the PWM frame rate, each one checked frame by frame:
+ *
+ *   trapezoid stage: speed within max_velocity, change of speed within
+ *   max_acceleration, never past a target that stays put, on the target
+ *   and at rest within three frames of the time the continuous profile
+ *   takes
+ *   output: within the same speed and acceleration, jerk within what the
+ *   box filter of `smoothing` frames allows, exactly on the target at the
+ *   end, servo_profile_done only then
+ *
+ * A second run moves the target while the servo is on its way, as a stream
+ * of setpoints does, and every move must still end on the last target.
+ *
+ * Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/servo_profile_test.c main/servo_profile.c -lm -o servo_profile_test
+ *   ./servo_profile_test [moves] [seed]
+ * */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "servo_profile.h"
+
+#define TEST_FRAME_HZ (50)            // SERVO_FRAME_HZ
+#define TEST_RANGE (180 * SERVO_PROFILE_ONE)
+#define TEST_FRAMES_MAX (60 * TEST_FRAME_HZ)
+
+static unsigned test_violations = 0;
+
+#define TEST_CHECK(cond)                                                          \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        test_violations++;                                        \
+                }                                                                 \
+        } while (0)
+
+/* Degree per second settings as a servo_group_config_t holds them */
+typedef struct
+{
+        const char *name;
+        uint32_t velocity_dps;
+        uint32_t acceleration_dps2;
+        uint32_t jerk_dps3;
+} test_config_t;
+
+static const test_config_t test_configs[] = {
+    {"slow trapezoid", 60, 120, 0},
+    {"fast trapezoid", 600, 3000, 0},
+    {"catapult s-curve", 360, 1440, 7200},
+    {"keeper s-curve", 240, 2400, 4000},
+    {"max smoothing", 90, 900, 1},
+};
+#define TEST_CONFIGS (sizeof(test_configs) / sizeof(test_configs[0]))
+
+typedef struct
+{
+        size_t moves;
+        size_t frames;
+        double max_jerk;     // Of the output, in max_acceleration / smoothing
+        int64_t max_over_us; // Beyond the continuous profile
+        size_t overshoots;
+} test_stat_t;
+
+/* Frames the continuous trapezoid takes over `distance`, then the box filter delay */
+static double test_min_frames(const servo_profile_limits_t *limits, double distance)
+{
+        if (distance == 0)
+                return 0;
+        double v = limits->max_velocity, a = limits->max_acceleration;
+        double frames = (distance >= v * v / a) ? distance / v + v / a : 2 * sqrt(distance / a);
+        return frames + limits->smoothing - 1;
+}
+
+static void test_limits(void)
+{
+        unsigned violations = test_violations;
+        servo_profile_limits_t limits;
+        TEST_CHECK(servo_profile_limits_from(&limits, 360, 1440, 0, 50));
+        TEST_CHECK(limits.max_velocity == (360 * SERVO_PROFILE_ONE) / 50);
+        TEST_CHECK(limits.max_acceleration == (1440 * SERVO_PROFILE_ONE) / (50 * 50));
+        TEST_CHECK(limits.smoothing == 1);
+        TEST_CHECK(servo_profile_limits_from(&limits, 360, 1440, 7200, 50));
+        TEST_CHECK(limits.smoothing == 10); // 1440 * 50 / 7200
+        TEST_CHECK(servo_profile_limits_from(&limits, 360, 1440, 7199, 50));
+        TEST_CHECK(limits.smoothing == 11); // Rounded up, the jerk stays under the limit
+        TEST_CHECK(servo_profile_limits_from(&limits, 360, 1440, 1, 50));
+        TEST_CHECK(limits.smoothing == SERVO_PROFILE_MAX_SMOOTHING);
+        TEST_CHECK(!servo_profile_limits_from(&limits, 360, 0, 0, 50));
+        TEST_CHECK(!servo_profile_limits_from(&limits, 0, 1440, 0, 50));
+        TEST_CHECK(!servo_profile_limits_from(&limits, 360, 1440, 0, 0));
+        TEST_CHECK(!servo_profile_limits_from(NULL, 360, 1440, 0, 50));
+        printf("limits: %s\n", (test_violations != violations) ? "FAIL" : "OK");
+}
+
+/* One move from rest at `start` to `target`, the target changed to `retarget` after `retarget_frame` frames when that is not 0 */
+static void test_move(const servo_profile_limits_t *limits, int32_t start, int32_t target, int32_t retarget, size_t retarget_frame,
+                      test_stat_t *stat)
+{
+        const int64_t v = limits->max_velocity, a = limits->max_acceleration;
+        const int64_t n = limits->smoothing;
+        servo_profile_t profile;
+        servo_profile_init(&profile, limits, start);
+        TEST_CHECK(servo_profile_done(&profile));
+        servo_profile_set_target(&profile, target);
+        TEST_CHECK((start == target) || !servo_profile_done(&profile));
+
+        int64_t out[3] = {start, start, start}; // Output of the last three frames, newest first
+        int64_t velocity = 0;
+        int64_t lowest = (start < target) ? start : target, highest = (start < target) ? target : start;
+        size_t frame = 0;
+        for (; (frame < TEST_FRAMES_MAX) && !servo_profile_done(&profile); frame++)
+        {
+                if (retarget_frame && (frame == retarget_frame))
+                {
+                        servo_profile_set_target(&profile, retarget);
+                        target = retarget;
+                        lowest = INT32_MIN;
+                        highest = INT32_MAX; // Braking for a target that jumped back may overshoot, the checks below do not
+                }
+
+                int64_t before = profile.position;
+                int64_t output = servo_profile_step(&profile);
+                TEST_CHECK(llabs(profile.velocity) <= v);
+                TEST_CHECK(llabs(profile.velocity - velocity) <= a);
+                TEST_CHECK(profile.position - before == profile.velocity);
+                velocity = profile.velocity;
+                if ((profile.position < lowest) || (profile.position > highest))
+                        stat->overshoots++;
+
+                // The output differences are box averages of the stage's, the rounding adds up to one unit each
+                int64_t speed = output - out[0];
+                int64_t accel = speed - (out[0] - out[1]);
+                int64_t jerk = accel - ((out[0] - out[1]) - (out[1] - out[2]));
+                TEST_CHECK(llabs(speed) <= v + 1);
+                TEST_CHECK(llabs(accel) <= a + 2);
+                TEST_CHECK(llabs(jerk) <= (2 * a + n - 1) / n + 4); // a / n into or out of a cruise, 2 * a / n straight from speeding up to braking
+                if ((double)llabs(jerk) * n / a > stat->max_jerk)
+                        stat->max_jerk = (double)llabs(jerk) * n / a;
+                out[2] = out[1];
+                out[1] = out[0];
+                out[0] = output;
+        }
+        TEST_CHECK(servo_profile_done(&profile));
+        TEST_CHECK(profile.output == target);
+        TEST_CHECK(servo_profile_step(&profile) == target); // Stays put once done
+        TEST_CHECK(servo_profile_done(&profile));
+
+        if (!retarget_frame)
+        {
+                double min_frames = test_min_frames(limits, llabs((int64_t)target - start));
+                TEST_CHECK(frame + 0.0 <= min_frames + 3);
+                TEST_CHECK(frame + 0.0 >= min_frames - 2);
+                int64_t over_us = (int64_t)((frame - min_frames) * 1000000 / TEST_FRAME_HZ);
+                if (over_us > stat->max_over_us)
+                        stat->max_over_us = over_us;
+        }
+        stat->moves++;
+        stat->frames += frame;
+}
+
+static int32_t test_angle(void)
+{
+        return (int32_t)(((int64_t)rand() << 16 | (rand() & 0xFFFF)) % (TEST_RANGE + 1) - TEST_RANGE / 2);
+}
+
+int main(int argc, char **argv)
+{
+        size_t moves = 2000;
+        if (argc > 1)
+                moves = atoi(argv[1]);
+        srand(argc > 2 ? atoi(argv[2]) : 1);
+
+        test_limits();
+        printf("%-18s %6s %9s %9s %9s %7s %8s %6s\n", "config", "moves", "v q16/f", "a q16/f2", "smoothing", "frames", "over us", "jerk");
+        for (size_t c = 0; c < TEST_CONFIGS; c++)
+        {
+                const test_config_t *config = &test_configs[c];
+                unsigned violations = test_violations;
+                servo_profile_limits_t limits;
+                TEST_CHECK(servo_profile_limits_from(&limits, config->velocity_dps, config->acceleration_dps2, config->jerk_dps3, TEST_FRAME_HZ));
+
+                test_stat_t stat = {0};
+                // Edge cases: no move, a move of one unit, of one frame's braking, the whole range
+                test_move(&limits, 0, 0, 0, 0, &stat);
+                test_move(&limits, 0, 1, 0, 0, &stat);
+                test_move(&limits, 0, -limits.max_acceleration, 0, 0, &stat);
+                test_move(&limits, -TEST_RANGE / 2, TEST_RANGE / 2, 0, 0, &stat);
+                for (size_t m = 0; m < moves; m++)
+                {
+                        int32_t start = test_angle(), target = test_angle();
+                        if (m % 4 == 3) // Short moves, where the profile never reaches cruise speed
+                                target = start + (target >> 6);
+                        test_move(&limits, start, target, 0, 0, &stat);
+                }
+                TEST_CHECK(stat.overshoots == 0);
+
+                // Targets that move on the way
+                test_stat_t moving = {0};
+                for (size_t m = 0; m < moves; m++)
+                        test_move(&limits, test_angle(), test_angle(), test_angle(), 1 + rand() % 100, &moving);
+
+                printf("%-18s %6zu %9d %9d %9u %7.1f %8lld %6.2f  %s\n", config->name, stat.moves + moving.moves, limits.max_velocity,
+                       limits.max_acceleration, limits.smoothing, (double)stat.frames / stat.moves, (long long)stat.max_over_us, stat.max_jerk,
+                       (test_violations != violations) ? "FAIL" : "OK");
+        }
+
+        printf("%s, %u violation(s)\n", test_violations ? "FAIL" : "OK", test_violations);
+        return test_violations ? 1 : 0;
+}
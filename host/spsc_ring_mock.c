@@ -0,0 +1,597 @@
+/*
+ * main/spsc_ring.c as a Linux process, with the event_ring.c glue around
+ * it: a push reports to main/watermark.c and wakes the consumer through a
+ * notification when spsc_ring_take_waiter says it sleeps, the consumer
+ * drains in batches and sleeps the way event_ring_wait does. A pthread
+ * mutex and condition variable with a counter stand in for the task
+ * notification, given and taken as xTaskNotifyGive and ulTaskNotifyTake
+ * with pdTRUE.
+ *
+ * Stress: one producer and one consumer thread per ring, all rings at
+ * once, as the Wi-Fi task feeds the ESP-NOW and RSSI rings for app_task
+ * and rssi_task. Each producer interleaves two sources the way the send
+ * and receive callbacks share the ESP-NOW ring and retries a push on a
+ * full ring. Every item must come out once, intact and in order per
+ * source, the watermark counts must match, and no consumer may sleep into
+ * its timeout with items waiting, a lost wakeup.
+ *
+ * Benchmark: items of the size of espnow_event_t go through the ring,
+ * popped one at a time and in batches, and through a queue mock with the
+ * semantics of xQueueSend and a blocking xQueueReceive, a critical section
+ * and a copy per item, all with the watermark calls of event_ring.c and
+ * watermark_queue_send. One thread filling and draining gives the cost of
+ * each structure alone. One producer and one consumer thread, pinned to
+ * CPUs of their own when the host has two, give the handoff, along with
+ * how often the consumer went to sleep. On a single CPU the threads take
+ * turns and every sleep is a context switch, which then outweighs the
+ * ring: a consumer that drains in batches empties the ring sooner and
+ * sleeps more often.
+ *
+ * Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/spsc_ring_mock.c main/spsc_ring.c main/watermark.c -lpthread -o spsc_ring_mock
+ *   ./spsc_ring_mock [items] [rings] [capacity]
+ * */
+
+#define _GNU_SOURCE // pthread_setaffinity_np
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spsc_ring.h"
+#include "watermark.h"
+
+#define MOCK_RINGS_MAX (WATERMARK_QUEUE_MAX) // One watermark entry each
+#define MOCK_CAPACITY_MAX (1024)
+#define MOCK_BATCH (8)                   // APP_EVENT_BATCH
+#define MOCK_WAIT_US (200 * 1000)        // Far beyond any handoff, a timeout with items waiting is a lost wakeup
+#define MOCK_SOURCES (2)                 // ESPNOW_SEND_CB and ESPNOW_RECV_CB
+#define MOCK_BENCH_ROUNDS (3)
+
+static unsigned mock_violations = 0;
+
+#define MOCK_CHECK(cond)                                                          \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        mock_violations++;                                        \
+                }                                                                 \
+        } while (0)
+
+/* Laid out like espnow_event_t, 32 bytes with a 64-bit field */
+typedef struct
+{
+        int64_t time_us;
+        uint32_t seq;
+        uint32_t check; // Of seq and source, a torn copy shows up here
+        uint8_t source;
+        uint8_t padding[15];
+} mock_item_t;
+
+_Static_assert(sizeof(mock_item_t) == 32, "mock_item_t no longer the size of espnow_event_t");
+
+/* ulTaskNotifyTake / xTaskNotifyGive */
+typedef struct
+{
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        unsigned count;
+} mock_notify_t;
+
+typedef struct
+{
+        spsc_ring_t ring;
+        mock_notify_t notify;
+        watermark_queue_t watermark;
+        mock_item_t buffer[MOCK_CAPACITY_MAX];
+        size_t items;
+        // Producer
+        size_t full;
+        size_t wakeups;
+        // Consumer
+        size_t received;
+        size_t waits;
+        size_t lost_wakeups;
+        size_t out_of_order;
+        size_t torn;
+} mock_ring_t;
+
+static mock_ring_t mock_rings[MOCK_RINGS_MAX];
+static unsigned mock_cpus = 1;
+
+static int64_t mock_now_us(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void mock_notify_init(mock_notify_t *notify)
+{
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_mutex_init(&notify->lock, NULL);
+        pthread_cond_init(&notify->cond, &attr);
+        notify->count = 0;
+}
+
+static void mock_notify_give(mock_notify_t *notify)
+{
+        pthread_mutex_lock(&notify->lock);
+        notify->count++;
+        pthread_cond_signal(&notify->cond);
+        pthread_mutex_unlock(&notify->lock);
+}
+
+/* Clears the count as pdTRUE does, returns it, 0 on timeout */
+static unsigned mock_notify_take(mock_notify_t *notify, int64_t wait_us)
+{
+        const int64_t deadline = mock_now_us() + wait_us;
+        struct timespec until = {.tv_sec = deadline / 1000000, .tv_nsec = (deadline % 1000000) * 1000};
+        pthread_mutex_lock(&notify->lock);
+        while ((notify->count == 0) && (pthread_cond_timedwait(&notify->cond, &notify->lock, &until) != ETIMEDOUT))
+                ;
+        unsigned count = notify->count;
+        notify->count = 0;
+        pthread_mutex_unlock(&notify->lock);
+        return count;
+}
+
+/* event_ring_push: store, count, wake the consumer if it sleeps */
+static bool mock_push(mock_ring_t *mock, const mock_item_t *item)
+{
+        if (!spsc_ring_push(&mock->ring, item))
+        {
+                watermark_queue_dropped(mock->watermark);
+                return false;
+        }
+        watermark_queue_sent(mock->watermark, spsc_ring_count(&mock->ring), (uint32_t)mock_now_us());
+        if (spsc_ring_take_waiter(&mock->ring))
+        {
+                mock->wakeups++;
+                mock_notify_give(&mock->notify);
+        }
+        return true;
+}
+
+/* event_ring_pop_batch */
+static size_t mock_pop_batch(mock_ring_t *mock, mock_item_t *items, size_t max)
+{
+        size_t count = spsc_ring_pop_batch(&mock->ring, items, max);
+        uint32_t now_us = (uint32_t)mock_now_us();
+        for (size_t i = 0; i < count; i++)
+                watermark_queue_received(mock->watermark, now_us);
+        return count;
+}
+
+/* event_ring_wait, true when it timed out */
+static bool mock_wait(mock_ring_t *mock, int64_t wait_us)
+{
+        if (!spsc_ring_prepare_wait(&mock->ring))
+                return false;
+        bool woken = mock_notify_take(&mock->notify, wait_us) != 0;
+        spsc_ring_finish_wait(&mock->ring);
+        return !woken;
+}
+
+static uint32_t mock_check_value(uint32_t seq, uint8_t source)
+{
+        return (seq * 2654435761u) ^ source;
+}
+
+static void mock_ring_init(mock_ring_t *mock, size_t capacity, size_t items, watermark_queue_t watermark)
+{
+        memset(mock, 0, sizeof(mock_ring_t));
+        MOCK_CHECK(spsc_ring_init(&mock->ring, mock->buffer, sizeof(mock_item_t), capacity));
+        mock_notify_init(&mock->notify);
+        mock->items = items;
+        mock->watermark = watermark;
+        watermark_queue_register(watermark, capacity);
+}
+
+static void *mock_producer(void *arg)
+{
+        mock_ring_t *mock = arg;
+        uint32_t seq[MOCK_SOURCES] = {0};
+        unsigned state = (uintptr_t)mock * 2654435761u;
+        for (size_t i = 0; i < mock->items; i++)
+        {
+                state = state * 1103515245 + 12345;
+                uint8_t source = (state >> 16) % MOCK_SOURCES;
+                mock_item_t item = {.time_us = mock_now_us(), .seq = seq[source], .source = source};
+                item.check = mock_check_value(item.seq, source);
+                memset(item.padding, (uint8_t)item.seq, sizeof(item.padding));
+                while (!mock_push(mock, &item))
+                {
+                        mock->full++;
+                        sched_yield();
+                }
+                seq[source]++;
+                if ((state >> 24) % 64 == 0) // Now and then a pause, the consumer goes to sleep
+                        sched_yield();
+        }
+        return NULL;
+}
+
+static void *mock_consumer(void *arg)
+{
+        mock_ring_t *mock = arg;
+        uint32_t expected[MOCK_SOURCES] = {0};
+        mock_item_t items[MOCK_BATCH];
+        while (mock->received < mock->items)
+        {
+                size_t count = mock_pop_batch(mock, items, MOCK_BATCH);
+                if (count == 0)
+                {
+                        mock->waits++;
+                        if (mock_wait(mock, MOCK_WAIT_US) && (spsc_ring_count(&mock->ring) != 0))
+                                mock->lost_wakeups++;
+                        continue;
+                }
+                for (size_t i = 0; i < count; i++)
+                {
+                        const mock_item_t *item = &items[i];
+                        uint8_t source = item->source % MOCK_SOURCES;
+                        bool intact = (item->source < MOCK_SOURCES) && (item->check == mock_check_value(item->seq, item->source));
+                        for (size_t b = 0; intact && (b < sizeof(item->padding)); b++)
+                                intact = item->padding[b] == (uint8_t)item->seq;
+                        mock->torn += !intact;
+                        mock->out_of_order += item->seq != expected[source];
+                        expected[source] = item->seq + 1;
+                }
+                mock->received += count;
+        }
+        return NULL;
+}
+
+/* Single threaded: limits, wrap of a batch, the waiter handshake */
+static void mock_unit(void)
+{
+        unsigned violations = mock_violations;
+        static mock_item_t buffer[8];
+        spsc_ring_t ring;
+        MOCK_CHECK(!spsc_ring_init(&ring, buffer, sizeof(mock_item_t), 6));
+        MOCK_CHECK(!spsc_ring_init(&ring, buffer, sizeof(mock_item_t), 0));
+        MOCK_CHECK(!spsc_ring_init(&ring, buffer, 0, 8));
+        MOCK_CHECK(!spsc_ring_init(&ring, NULL, sizeof(mock_item_t), 8));
+        MOCK_CHECK(spsc_ring_init(&ring, buffer, sizeof(mock_item_t), 8));
+        MOCK_CHECK(spsc_ring_capacity(&ring) == 8);
+
+        mock_item_t item = {0}, out[8];
+        for (uint32_t i = 0; i < 8; i++)
+        {
+                item.seq = i;
+                MOCK_CHECK(spsc_ring_push(&ring, &item));
+        }
+        item.seq = 8;
+        MOCK_CHECK(!spsc_ring_push(&ring, &item));
+        MOCK_CHECK(spsc_ring_count(&ring) == 8);
+
+        // Leave 3 at the end, refill to wrap, then one batch across the end of the buffer
+        MOCK_CHECK(spsc_ring_pop_batch(&ring, out, 5) == 5);
+        MOCK_CHECK((out[0].seq == 0) && (out[4].seq == 4));
+        for (uint32_t i = 8; i < 13; i++)
+        {
+                item.seq = i;
+                MOCK_CHECK(spsc_ring_push(&ring, &item));
+        }
+        memset(out, 0, sizeof(out));
+        MOCK_CHECK(spsc_ring_pop_batch(&ring, out, 8) == 8);
+        for (uint32_t i = 0; i < 8; i++)
+                MOCK_CHECK(out[i].seq == 5 + i);
+        MOCK_CHECK(spsc_ring_pop_batch(&ring, out, 8) == 0);
+        MOCK_CHECK(!spsc_ring_pop(&ring, out));
+
+        // Sleep only on an empty ring, a push after the flag takes the waiter exactly once
+        MOCK_CHECK(!spsc_ring_take_waiter(&ring));
+        MOCK_CHECK(spsc_ring_prepare_wait(&ring));
+        MOCK_CHECK(spsc_ring_push(&ring, &item));
+        MOCK_CHECK(spsc_ring_take_waiter(&ring));
+        MOCK_CHECK(!spsc_ring_take_waiter(&ring));
+        spsc_ring_finish_wait(&ring);
+        MOCK_CHECK(!spsc_ring_prepare_wait(&ring)); // Not empty
+        MOCK_CHECK(!spsc_ring_take_waiter(&ring));
+        printf("unit: %s\n", (mock_violations != violations) ? "FAIL" : "OK");
+}
+
+static void mock_stress(size_t items, unsigned rings, size_t capacity)
+{
+        watermark_reset();
+        for (unsigned r = 0; r < rings; r++)
+                mock_ring_init(&mock_rings[r], capacity, items, r);
+
+        pthread_t producers[MOCK_RINGS_MAX], consumers[MOCK_RINGS_MAX];
+        int64_t start_us = mock_now_us();
+        for (unsigned r = 0; r < rings; r++)
+        {
+                pthread_create(&consumers[r], NULL, mock_consumer, &mock_rings[r]);
+                pthread_create(&producers[r], NULL, mock_producer, &mock_rings[r]);
+        }
+        for (unsigned r = 0; r < rings; r++)
+        {
+                pthread_join(producers[r], NULL);
+                pthread_join(consumers[r], NULL);
+        }
+        int64_t elapsed_us = mock_now_us() - start_us;
+
+        printf("stress: %u ring(s) of %zu, %zu items each, %lld ms\n", rings, capacity, items, (long long)(elapsed_us / 1000));
+        printf("%4s %9s %9s %9s %9s %6s %6s %5s %8s\n", "ring", "received", "full", "waits", "wakeups", "lost", "order", "torn", "wm peak");
+        for (unsigned r = 0; r < rings; r++)
+        {
+                mock_ring_t *mock = &mock_rings[r];
+                watermark_queue_stat_t stat;
+                MOCK_CHECK(watermark_queue_get(mock->watermark, &stat));
+                MOCK_CHECK(mock->received == items);
+                MOCK_CHECK(mock->lost_wakeups == 0);
+                MOCK_CHECK(mock->out_of_order == 0);
+                MOCK_CHECK(mock->torn == 0);
+                MOCK_CHECK(mock->wakeups <= mock->waits);
+                MOCK_CHECK((stat.sent == items) && (stat.received == items) && (stat.dropped == mock->full));
+                MOCK_CHECK((stat.peak > 0) && (stat.peak <= capacity));
+                MOCK_CHECK(spsc_ring_count(&mock->ring) == 0);
+                printf("%4u %9zu %9zu %9zu %9zu %6zu %6zu %5zu %8u\n", r, mock->received, mock->full, mock->waits, mock->wakeups,
+                       mock->lost_wakeups, mock->out_of_order, mock->torn, stat.peak);
+        }
+}
+
+/* xQueueSend with portMAX_DELAY and xQueueReceive, copies under one lock, a condition per side */
+typedef struct
+{
+        pthread_mutex_t lock;
+        pthread_cond_t not_empty;
+        pthread_cond_t not_full;
+        mock_item_t buffer[MOCK_CAPACITY_MAX];
+        size_t capacity;
+        size_t head;
+        size_t count;
+        size_t items;
+        size_t waits; // Receiver found the queue empty and slept
+} mock_queue_t;
+
+static mock_queue_t mock_queue = {.lock = PTHREAD_MUTEX_INITIALIZER, .not_empty = PTHREAD_COND_INITIALIZER, .not_full = PTHREAD_COND_INITIALIZER};
+
+/* watermark_queue_send */
+static void mock_queue_send(mock_queue_t *queue, const mock_item_t *item)
+{
+        pthread_mutex_lock(&queue->lock);
+        while (queue->count == queue->capacity)
+                pthread_cond_wait(&queue->not_full, &queue->lock);
+        queue->buffer[(queue->head + queue->count++) % queue->capacity] = *item;
+        uint32_t depth = queue->count;
+        pthread_cond_signal(&queue->not_empty);
+        pthread_mutex_unlock(&queue->lock);
+        watermark_queue_sent(WATERMARK_QUEUE_BUTTON, depth, (uint32_t)mock_now_us());
+}
+
+/* watermark_queue_receive with a blocking xQueueReceive */
+static void mock_queue_receive(mock_queue_t *queue, mock_item_t *item)
+{
+        pthread_mutex_lock(&queue->lock);
+        queue->waits += queue->count == 0;
+        while (queue->count == 0)
+                pthread_cond_wait(&queue->not_empty, &queue->lock);
+        *item = queue->buffer[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+        pthread_mutex_unlock(&queue->lock);
+        watermark_queue_received(WATERMARK_QUEUE_BUTTON, (uint32_t)mock_now_us());
+}
+
+static void *mock_queue_producer(void *arg)
+{
+        mock_queue_t *queue = arg;
+        mock_item_t item = {0};
+        for (size_t i = 0; i < queue->items; i++)
+        {
+                item.seq = i;
+                mock_queue_send(queue, &item);
+        }
+        return NULL;
+}
+
+static void *mock_queue_consumer(void *arg)
+{
+        mock_queue_t *queue = arg;
+        mock_item_t item;
+        for (size_t i = 0; i < queue->items; i++)
+        {
+                mock_queue_receive(queue, &item);
+                MOCK_CHECK(item.seq == i);
+                if (item.seq != i)
+                        break;
+        }
+        return NULL;
+}
+
+static size_t mock_bench_batch;
+
+static void *mock_bench_consumer(void *arg)
+{
+        mock_ring_t *mock = arg;
+        mock_item_t items[MOCK_BATCH];
+        size_t received = 0;
+        while (received < mock->items)
+        {
+                size_t count = mock_pop_batch(mock, items, mock_bench_batch);
+                if (count == 0)
+                {
+                        mock->waits++;
+                        mock_wait(mock, MOCK_WAIT_US);
+                        continue;
+                }
+                for (size_t i = 0; i < count; i++)
+                        MOCK_CHECK(items[i].seq == received + i);
+                received += count;
+        }
+        mock->received = received;
+        return NULL;
+}
+
+static void *mock_bench_producer(void *arg)
+{
+        mock_ring_t *mock = arg;
+        mock_item_t item = {0};
+        for (size_t i = 0; i < mock->items; i++)
+        {
+                item.seq = i;
+                while (!mock_push(mock, &item))
+                        sched_yield(); // A producer that waits, as the queue mock does
+        }
+        return NULL;
+}
+
+/* Producer and consumer on CPUs of their own when there are two, a handoff is then a cache line and not a context switch */
+static void mock_pin(pthread_t thread, unsigned cpu)
+{
+        if (mock_cpus < 2)
+                return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu % mock_cpus, &set);
+        pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+/* One thread fills and drains, the cost of the structure alone. Best of a few rounds, in ns per item */
+static double mock_bench_local(size_t items, size_t capacity, size_t batch)
+{
+        double best_ns = 0;
+        for (unsigned round = 0; round < MOCK_BENCH_ROUNDS; round++)
+        {
+                mock_ring_t *mock = &mock_rings[0];
+                mock_item_t item = {0}, items_out[MOCK_BATCH];
+                mock_queue.capacity = capacity;
+                mock_queue.head = mock_queue.count = 0;
+                if (batch != 0)
+                        mock_ring_init(mock, capacity, items, WATERMARK_QUEUE_ESPNOW);
+
+                size_t done = 0;
+                const int64_t start_us = mock_now_us();
+                while (done < items)
+                {
+                        size_t count = (items - done < capacity) ? items - done : capacity;
+                        for (size_t i = 0; i < count; i++)
+                        {
+                                item.seq = done + i;
+                                if (batch == 0)
+                                        mock_queue_send(&mock_queue, &item);
+                                else
+                                        MOCK_CHECK(mock_push(mock, &item));
+                        }
+                        for (size_t i = 0; i < count;)
+                        {
+                                if (batch == 0)
+                                {
+                                        mock_queue_receive(&mock_queue, &item);
+                                        MOCK_CHECK(item.seq == done + i);
+                                        i++;
+                                        continue;
+                                }
+                                size_t popped = mock_pop_batch(mock, items_out, batch);
+                                MOCK_CHECK((popped > 0) && (items_out[0].seq == done + i));
+                                i += popped;
+                        }
+                        done += count;
+                }
+                double ns = (mock_now_us() - start_us) * 1000.0 / items;
+                if ((round == 0) || (ns < best_ns))
+                        best_ns = ns;
+        }
+        return best_ns;
+}
+
+/* A producer and a consumer thread. Best of a few rounds, in ns per item, and the consumer's sleeps in that round */
+static double mock_bench_threads(size_t items, size_t capacity, size_t batch, size_t *sleeps)
+{
+        double best_ns = 0;
+        for (unsigned round = 0; round < MOCK_BENCH_ROUNDS; round++)
+        {
+                pthread_t producer, consumer;
+                int64_t start_us;
+                if (batch == 0)
+                {
+                        mock_queue.capacity = capacity;
+                        mock_queue.head = 0;
+                        mock_queue.count = 0;
+                        mock_queue.items = items;
+                        mock_queue.waits = 0;
+                        start_us = mock_now_us();
+                        pthread_create(&consumer, NULL, mock_queue_consumer, &mock_queue);
+                        pthread_create(&producer, NULL, mock_queue_producer, &mock_queue);
+                }
+                else
+                {
+                        mock_ring_t *mock = &mock_rings[0];
+                        mock_ring_init(mock, capacity, items, WATERMARK_QUEUE_ESPNOW);
+                        mock_bench_batch = batch;
+                        start_us = mock_now_us();
+                        pthread_create(&consumer, NULL, mock_bench_consumer, mock);
+                        pthread_create(&producer, NULL, mock_bench_producer, mock);
+                }
+                mock_pin(consumer, 0);
+                mock_pin(producer, 1);
+                pthread_join(producer, NULL);
+                pthread_join(consumer, NULL);
+                double ns = (mock_now_us() - start_us) * 1000.0 / items;
+                if ((round == 0) || (ns < best_ns))
+                {
+                        best_ns = ns;
+                        *sleeps = (batch == 0) ? mock_queue.waits : mock_rings[0].waits;
+                }
+                if (batch != 0)
+                        MOCK_CHECK(mock_rings[0].received == items);
+        }
+        return best_ns;
+}
+
+static void mock_bench_run(const char *name, size_t items, size_t capacity, size_t batch)
+{
+        size_t sleeps = 0;
+        double local_ns = mock_bench_local(items, capacity, batch);
+        double threads_ns = mock_bench_threads(items, capacity, batch, &sleeps);
+        printf("%-16s %10.1f %11.1f %14.1f\n", name, local_ns, threads_ns, sleeps * 1000.0 / items);
+}
+
+int main(int argc, char **argv)
+{
+        size_t items = 200000;
+        unsigned rings = 2;
+        size_t capacity = 16; // ESPNOW_QUEUE_SIZE
+        if (argc > 1)
+                items = atoi(argv[1]);
+        if (argc > 2)
+                rings = atoi(argv[2]);
+        if (argc > 3)
+                capacity = atoi(argv[3]);
+        if ((rings == 0) || (rings > MOCK_RINGS_MAX) || (capacity == 0) || (capacity > MOCK_CAPACITY_MAX) || (capacity & (capacity - 1)))
+        {
+                fprintf(stderr, "rings 1 to %d, capacity a power of two up to %d\n", MOCK_RINGS_MAX, MOCK_CAPACITY_MAX);
+                return 1;
+        }
+
+        mock_unit();
+        mock_stress(items, rings, capacity);
+
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        mock_cpus = (cpus > 0) ? cpus : 1;
+        printf("bench: %zu items of %zu bytes, capacity %zu, %u CPU(s)%s\n", items, sizeof(mock_item_t), capacity, mock_cpus,
+               (mock_cpus < 2) ? ", threads take turns, two thread numbers measure the context switches" : ", threads pinned to CPU 0 and 1");
+        printf("%-16s %10s %11s %14s\n", "ns/item", "one thread", "two threads", "sleeps/1k item");
+        watermark_reset();
+        watermark_queue_register(WATERMARK_QUEUE_BUTTON, capacity);
+        mock_bench_run("queue mock", items, capacity, 0);
+        mock_bench_run("ring, pop 1", items, capacity, 1);
+        mock_bench_run("ring, batch 8", items, capacity, MOCK_BATCH);
+
+        printf("%s, %u violation(s)\n", mock_violations ? "FAIL" : "OK", mock_violations);
+        return mock_violations ? 1 : 0;
+}
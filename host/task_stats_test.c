@@ -0,0 +1,250 @@
+/*
+ * main/task_stats.c as a Linux process, with hand made snapshots of the
+ * FreeRTOS run-time counters as task_table.c takes them every period.
+ *
+ * The aggregation must give every task its share of the interval in
+ * per-mille, rounded, across a wrap of the counters, with a task created
+ * in between counted from 0 and a deleted one left out, sorted by core,
+ * then by load. Random snapshots are checked against a reference over the
+ * same deltas. The table must show every entry with the values it holds,
+ * and a short buffer must get a terminated prefix of the full table.
+ *
+ * Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/task_stats_test.c main/task_stats.c -o task_stats_test
+ *   ./task_stats_test [rounds] [seed]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "task_stats.h"
+
+static unsigned test_violations = 0;
+
+#define TEST_CHECK(cond)                                                          \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        test_violations++;                                        \
+                }                                                                 \
+        } while (0)
+
+#define TEST_TABLE_SIZE (TASK_STATS_MAX_TASKS * 64)
+
+static task_stats_sample_t test_sample(const char *name, uint32_t number, uint32_t runtime, int8_t core, uint8_t priority)
+{
+        task_stats_sample_t sample = {.number = number, .runtime = runtime, .stack_hwm = 1000 + number, .core = core, .priority = priority};
+        size_t len = strlen(name);
+        memcpy(sample.name, name, (len < TASK_STATS_NAME_LEN) ? len : TASK_STATS_NAME_LEN); // Not terminated when it fills the field
+        return sample;
+}
+
+/* The application tasks of task_table.c and the ones IDF starts, one period of 1000 ticks on two cores */
+static void test_aggregate(void)
+{
+        unsigned violations = test_violations;
+        const uint32_t elapsed = 1000;
+        task_stats_sample_t prev[] = {
+            test_sample("IDLE", 1, 5000, 0, 0),
+            test_sample("IDLE", 2, 7000, 1, 0),
+            test_sample("wifi", 3, UINT32_MAX - 99, 0, 23), // Wraps within the interval
+            test_sample("esp_timer", 4, 100, 0, 22),
+            test_sample("tx_task", 5, 100, 0, 5),
+            test_sample("app_task", 6, 900, 1, 9),
+            test_sample("gone", 7, 100, TASK_STATS_NO_AFFINITY, 1),
+        };
+        task_stats_sample_t cur[] = {
+            test_sample("IDLE", 1, 5000 + 600, 0, 0),
+            test_sample("IDLE", 2, 7000 + 850, 1, 0),
+            test_sample("wifi", 3, 200, 0, 23), // 300 ticks
+            test_sample("esp_timer", 4, 100 + 50, 0, 22),
+            test_sample("tx_task", 5, 100 + 50, 0, 5),
+            test_sample("app_task", 6, 900 + 145, 1, 9),
+            test_sample("joystick_task", 8, 5, 1, 10), // Created during the interval
+            test_sample("any", 9, 3, TASK_STATS_NO_AFFINITY, 1),
+        };
+        const size_t count = sizeof(cur) / sizeof(cur[0]);
+        task_stats_entry_t out[TASK_STATS_MAX_TASKS];
+
+        TEST_CHECK(task_stats_aggregate(prev, sizeof(prev) / sizeof(prev[0]), cur, count, elapsed, out) == count);
+        TEST_CHECK(task_stats_find(out, count, "gone") == NULL);
+        const task_stats_entry_t *wifi = task_stats_find(out, count, "wifi");
+        TEST_CHECK((wifi != NULL) && (wifi->cpu_permille == 300) && (wifi->priority == 23) && (wifi->stack_hwm == 1003));
+        const task_stats_entry_t *joystick = task_stats_find(out, count, "joystick_task");
+        TEST_CHECK((joystick != NULL) && (joystick->cpu_permille == 5) && (joystick->core == 1));
+        TEST_CHECK(task_stats_find(out, count, "tx") == NULL);
+        TEST_CHECK(task_stats_find(NULL, count, "wifi") == NULL);
+
+        // Whole interval per core, nothing lost to rounding here
+        unsigned core_permille[2] = {0};
+        for (size_t i = 0; i < count; i++)
+                if (out[i].core != TASK_STATS_NO_AFFINITY)
+                        core_permille[out[i].core] += out[i].cpu_permille;
+        TEST_CHECK((core_permille[0] == 1000) && (core_permille[1] == 1000));
+
+        // Unpinned first, then core 0 and core 1, busiest first within a core
+        for (size_t i = 1; i < count; i++)
+        {
+                TEST_CHECK(out[i - 1].core <= out[i].core);
+                if (out[i - 1].core == out[i].core)
+                        TEST_CHECK(out[i - 1].cpu_permille >= out[i].cpu_permille);
+        }
+        TEST_CHECK((out[0].core == TASK_STATS_NO_AFFINITY) && (strcmp(out[0].name, "any") == 0));
+        TEST_CHECK((strcmp(out[1].name, "IDLE") == 0) && (out[1].core == 0) && (out[1].cpu_permille == 600));
+
+        // Rounded to the nearest per-mille, an interval of 0 gives no load
+        task_stats_sample_t half = test_sample("half", 1, 1, 0, 1);
+        TEST_CHECK(task_stats_aggregate(NULL, 0, &half, 1, 2000, out) == 1);
+        TEST_CHECK(out[0].cpu_permille == 1); // 0.5 per-mille
+        half.runtime = 0;
+        task_stats_aggregate(NULL, 0, &half, 1, 2001, out);
+        TEST_CHECK(out[0].cpu_permille == 0);
+        half.runtime = 1234;
+        task_stats_aggregate(NULL, 0, &half, 1, 0, out);
+        TEST_CHECK(out[0].cpu_permille == 0);
+
+        // A name that fills the field is terminated
+        task_stats_sample_t long_name = test_sample("a_name_of_sixteen_chars", 1, 0, 0, 1);
+        TEST_CHECK(memchr(long_name.name, '\0', TASK_STATS_NAME_LEN) == NULL);
+        task_stats_aggregate(NULL, 0, &long_name, 1, 1000, out);
+        TEST_CHECK(strlen(out[0].name) == TASK_STATS_NAME_LEN - 1);
+
+        TEST_CHECK(task_stats_aggregate(prev, 1, NULL, 1, 1000, out) == 0);
+        TEST_CHECK(task_stats_aggregate(prev, 1, cur, 1, 1000, NULL) == 0);
+        printf("aggregate: %s\n", (test_violations != violations) ? "FAIL" : "OK");
+}
+
+/* Every line of the table parsed back against the entry it came from */
+static void test_format_check(const task_stats_entry_t *entries, size_t count)
+{
+        static char table[TEST_TABLE_SIZE];
+        size_t len = task_stats_format(table, sizeof(table), entries, count);
+        TEST_CHECK(len == strlen(table));
+        TEST_CHECK(len + 1 < sizeof(table)); // Nothing cut off
+
+        char *line = strchr(table, '\n');
+        TEST_CHECK((line != NULL) && (strncmp(table, "task", 4) == 0));
+        size_t lines = 0;
+        while ((line != NULL) && (*++line != '\0'))
+        {
+                char name[TASK_STATS_NAME_LEN], core[8];
+                unsigned priority, whole, tenth;
+                unsigned long stack;
+                int fields = sscanf(line, "%15s %7s %u %u.%u %lu", name, core, &priority, &whole, &tenth, &stack);
+                TEST_CHECK(fields == 6);
+                if ((fields != 6) || (lines >= count))
+                        break;
+                const task_stats_entry_t *entry = &entries[lines++];
+                TEST_CHECK(strcmp(name, entry->name) == 0);
+                if (entry->core == TASK_STATS_NO_AFFINITY)
+                        TEST_CHECK(strcmp(core, "any") == 0);
+                else
+                        TEST_CHECK(atoi(core) == entry->core);
+                TEST_CHECK(priority == entry->priority);
+                TEST_CHECK((whole * 10 + tenth == entry->cpu_permille) && (tenth < 10));
+                TEST_CHECK(stack == entry->stack_hwm);
+                line = strchr(line, '\n');
+        }
+        TEST_CHECK(lines == count);
+
+        // Any shorter buffer holds a terminated prefix of the full table
+        static char part[TEST_TABLE_SIZE];
+        for (size_t size = 1; size <= len + 1; size += 1 + size / 8)
+        {
+                memset(part, 'x', sizeof(part));
+                size_t part_len = task_stats_format(part, size, entries, count);
+                TEST_CHECK(part_len == strlen(part));
+                TEST_CHECK(part_len == ((size > len) ? len : size - 1));
+                TEST_CHECK(strncmp(part, table, part_len) == 0);
+                TEST_CHECK(part[size] == 'x');
+        }
+        TEST_CHECK(task_stats_format(part, 0, entries, count) == 0);
+}
+
+/* Random snapshots of up to TASK_STATS_MAX_TASKS tasks, some created, some deleted between the two */
+static void test_random(unsigned rounds)
+{
+        unsigned violations = test_violations;
+        static task_stats_sample_t prev[TASK_STATS_MAX_TASKS], cur[TASK_STATS_MAX_TASKS + 4];
+        static task_stats_entry_t out[TASK_STATS_MAX_TASKS];
+        size_t clipped = 0;
+        for (unsigned round = 0; round < rounds; round++)
+        {
+                size_t prev_count = rand() % (TASK_STATS_MAX_TASKS + 1);
+                for (size_t i = 0; i < prev_count; i++)
+                {
+                        char name[TASK_STATS_NAME_LEN];
+                        snprintf(name, sizeof(name), "task%zu", i);
+                        prev[i] = test_sample(name, i, (uint32_t)rand() * 2654435761u, rand() % 3 - 1, rand() % 25);
+                }
+
+                uint32_t elapsed = 1 + rand() % 5000000;
+                size_t cur_count = 0;
+                for (size_t i = 0; i < prev_count; i++)
+                {
+                        if ((round % 4 != 0) && (rand() % 8 == 0)) // Deleted, never in every fourth round to fill the table
+                                continue;
+                        cur[cur_count] = prev[i];
+                        cur[cur_count].runtime += rand() % (elapsed + 1);
+                        cur[cur_count].stack_hwm = rand() % 8192;
+                        cur_count++;
+                }
+                while ((cur_count < sizeof(cur) / sizeof(cur[0])) && (rand() % 2 == 0)) // Created
+                {
+                        uint32_t number = 100 + cur_count;
+                        cur[cur_count++] = test_sample("new", number, rand() % (elapsed + 1), rand() % 3 - 1, rand() % 25);
+                }
+
+                size_t count = task_stats_aggregate(prev, prev_count, cur, cur_count, elapsed, out);
+                size_t expected = (cur_count > TASK_STATS_MAX_TASKS) ? TASK_STATS_MAX_TASKS : cur_count;
+                clipped += cur_count > TASK_STATS_MAX_TASKS;
+                TEST_CHECK(count == expected);
+                for (size_t i = 0; i < expected; i++)
+                {
+                        uint32_t before = 0;
+                        for (size_t j = 0; j < prev_count; j++)
+                                if (prev[j].number == cur[i].number)
+                                        before = prev[j].runtime;
+                        uint32_t delta = cur[i].runtime - before;
+                        uint16_t permille = (uint16_t)(((uint64_t)delta * 1000 + elapsed / 2) / elapsed);
+
+                        size_t found = 0;
+                        for (size_t k = 0; k < count; k++)
+                        {
+                                if (out[k].number != cur[i].number)
+                                        continue;
+                                found++;
+                                TEST_CHECK(out[k].cpu_permille == permille);
+                                TEST_CHECK(out[k].stack_hwm == cur[i].stack_hwm);
+                                TEST_CHECK((out[k].core == cur[i].core) && (out[k].priority == cur[i].priority));
+                        }
+                        TEST_CHECK(found == 1);
+                }
+                for (size_t k = 1; k < count; k++)
+                        TEST_CHECK((out[k - 1].core < out[k].core) ||
+                                   ((out[k - 1].core == out[k].core) && (out[k - 1].cpu_permille >= out[k].cpu_permille)));
+                test_format_check(out, count);
+                if (test_violations != violations)
+                        break;
+        }
+        printf("random: %u rounds, %zu clipped to %d tasks, %s\n", rounds, clipped, TASK_STATS_MAX_TASKS,
+               (test_violations != violations) ? "FAIL" : "OK");
+}
+
+int main(int argc, char **argv)
+{
+        unsigned rounds = 2000;
+        if (argc > 1)
+                rounds = atoi(argv[1]);
+        srand(argc > 2 ? atoi(argv[2]) : 1);
+
+        test_aggregate();
+        test_random(rounds);
+
+        printf("%s, %u violation(s)\n", test_violations ? "FAIL" : "OK", test_violations);
+        return test_violations ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+"""
+TelemetryDecoder of telemetryDecoder.py on the output of
+host/telemetry_pty_writer.c read through a pty. The writer puts log lines
+and frames built by main/telemetry_frame.c on the pty slave, whose line
+discipline turns every "\\n" into "\\r\\n" as the firmware console does, also
+inside the frames. The master side is fed to the decoder in chunks of random
+size, cutting lines and frames anywhere.
+
+Every line must come out in order, every record with the values the writer
+put in, the frame cut off at the start must count as the only bad frame and
+cost no line.
+Exits with 1 on any violation.
+
+  gcc -O2 -Wall -I main host/telemetry_pty_writer.c main/telemetry_frame.c -o telemetry_pty_writer
+  python3 host/telemetry_pty_test.py [./telemetry_pty_writer] [records] [seed]
+"""
+
+import errno
+import os
+import pty
+import random
+import struct
+import subprocess
+import sys
+import termios
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+
+from telemetryDecoder import TelemetryDecoder, TelemetryRecord  # noqa: E402
+
+violations = 0
+
+
+def check(cond: bool, what: str) -> None:
+    global violations
+    if not cond:
+        print(f"violation: {what}")
+        violations += 1
+
+
+def f32(value: float) -> float:
+    return struct.unpack("<f", struct.pack("<f", value))[0]
+
+
+# The values of `writer_record`
+def expected_record(i: int) -> tuple[int, dict[str, float]]:
+    if i % 3 == 0:
+        names = ("idle0", "idle1", "wifi", "esp_timer", "button_task", "joystick_task", "rssi_task", "tx_task", "app_task", "task_stats")
+        return 1, {name: (i * 31 + k * 0x0A0D) & 0xFFFF for k, name in enumerate(names)}
+    if i % 3 == 1:
+        return 0, {
+            "lcnt": i * 10, "lset": f32(i * 0.25), "lspd": f32(-i), "lacc": 0.0, "lpwm": 10.0,
+            "rcnt": -i, "rset": 13.0, "rspd": f32(i * 0.5), "racc": 0.0, "rpwm": -10.0,
+            "delta_distance": f32(i), "delta_velocity": 0.0,
+        }
+    return 9, {}
+
+
+def expected_lines(records: int) -> list[str]:
+    lines = []
+    for i in range(records):
+        lines.append(f"I ({i}) app_main: line {i}\r\n")
+        if i % 5 == 0:
+            lines.append(f"W ({i}) espnow: second line {i}, a\tdelimiter-free\rtext\r\n")
+    lines.append(f"I ({records}) app_main: done\r\n")
+    return lines
+
+
+def read_pty(writer: str, records: int) -> bytes:
+    master, slave = pty.openpty()
+    attrs = termios.tcgetattr(slave)
+    attrs[1] |= termios.OPOST | termios.ONLCR  # What the console does with "\n", usually the default already
+    termios.tcsetattr(slave, termios.TCSANOW, attrs)
+
+    process = subprocess.Popen([writer, str(records)], stdout=slave)
+    os.close(slave)
+    data = bytearray()
+    while True:
+        try:
+            chunk = os.read(master, 4096)
+        except OSError as error:  # EIO once the writer is gone and the slave closed
+            if error.errno != errno.EIO:
+                raise
+            break
+        if not chunk:
+            break
+        data += chunk
+    os.close(master)
+    check(process.wait() == 0, "writer exit status")
+    return bytes(data)
+
+
+def main() -> int:
+    writer = sys.argv[1] if len(sys.argv) > 1 else "./telemetry_pty_writer"
+    records = int(sys.argv[2]) if len(sys.argv) > 2 else 300
+    rng = random.Random(int(sys.argv[3]) if len(sys.argv) > 3 else 1)
+
+    data = read_pty(writer, records)
+    check(b"\r\n" in data, "no CRLF from the pty, the test would not cover it")
+
+    decoder = TelemetryDecoder(crlf=True)
+    items = []
+    pos = 0
+    while pos < len(data):
+        size = rng.randint(1, 64)
+        items += decoder.feed(data[pos : pos + size])
+        pos += size
+
+    lines = [item for item in items if isinstance(item, str)]
+    found = [item for item in items if isinstance(item, TelemetryRecord)]
+    # The tail of the cut off frame shows up as text in front of the first line, no byte of a line may be lost
+    text = "".join(lines)
+    written = "".join(expected_lines(records))
+    check(text.endswith(written), f"lines: {len(lines)} decoded, {len(expected_lines(records))} written")
+    check(len(text) - len(written) < 32, f"{len(text) - len(written)} characters from the cut off frame")
+    check(len(found) == records, f"records: {len(found)} decoded, {records} written")
+    for i, record in enumerate(found[:records]):
+        type, fields = expected_record(i)
+        check(record.type == type, f"record {i} type {record.type} != {type}")
+        check(record.time_ms == i, f"record {i} time_ms {record.time_ms}")
+        check(record.fields == fields, f"record {i} fields {record.fields} != {fields}")
+    check(decoder.bad_frames == 1, f"bad frames: {decoder.bad_frames}, only the cut off first one expected")
+
+    print(f"{len(data)} bytes, {len(lines)} lines, {len(found)} records, {decoder.bad_frames} bad frame(s)")
+    print(f"{'FAIL' if violations else 'OK'}, {violations} violation(s)")
+    return 1 if violations else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,107 @@
+/*
+ * Console output of the firmware for host/telemetry_pty_test.py: log lines
+ * with telemetry frames in between, the frames built by
+ * main/telemetry_frame.c as telemetry_send does. The values are a function
+ * of the record index the test computes again, and are picked to put 0x00,
+ * 0x0A and 0x0D into the raw frames, what COBS and the CRLF of the console
+ * have to get through.
+ *
+ * The output starts with the tail of a frame, as a monitor attached in the
+ * middle of one sees it.
+ *
+ *   gcc -O2 -Wall -I main host/telemetry_pty_writer.c main/telemetry_frame.c -o telemetry_pty_writer
+ *   ./telemetry_pty_writer [records]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry_frame.h"
+
+#define WRITER_TYPE_MOTOR_STAT (0) // telemetry_record_type_t
+#define WRITER_TYPE_TASK_STAT (1)
+#define WRITER_TYPE_UNKNOWN (9)    // No decoder, must come through as an empty record
+
+typedef struct
+{
+        int32_t lcnt;
+        float lset, lspd, lacc, lpwm;
+        int32_t rcnt;
+        float rset, rspd, racc, rpwm;
+        float delta_distance, delta_velocity;
+} __attribute__((packed)) writer_motor_stat_t;
+
+static void writer_frame(uint8_t type, uint32_t time_ms, const void *data, size_t len)
+{
+        uint8_t encoded[TELEMETRY_ENCODED_FRAME_SIZE];
+        size_t encoded_len = telemetry_frame_encode(type, time_ms, data, len, encoded);
+        fwrite(encoded, 1, encoded_len, stdout);
+}
+
+static void writer_record(uint32_t i)
+{
+        switch (i % 3)
+        {
+        case 0:
+        {
+                uint16_t task_stat[10];
+                for (size_t k = 0; k < 10; k++)
+                        task_stat[k] = (i * 31 + k * 0x0A0D) & 0xFFFF;
+                writer_frame(WRITER_TYPE_TASK_STAT, i, task_stat, sizeof(task_stat));
+                break;
+        }
+        case 1:
+        {
+                writer_motor_stat_t stat = {
+                    .lcnt = i * 10,
+                    .lset = i * 0.25f,
+                    .lspd = -(float)i,
+                    .lacc = 0,
+                    .lpwm = 10.0f,
+                    .rcnt = -(int32_t)i,
+                    .rset = 13.0f,
+                    .rspd = i * 0.5f,
+                    .racc = 0,
+                    .rpwm = -10.0f,
+                    .delta_distance = i,
+                    .delta_velocity = 0,
+                };
+                writer_frame(WRITER_TYPE_MOTOR_STAT, i, &stat, sizeof(stat));
+                break;
+        }
+        default:
+        {
+                uint8_t bytes[64];
+                size_t len = i % sizeof(bytes);
+                for (size_t k = 0; k < len; k++)
+                        bytes[k] = (k % 4 == 0) ? 0x00 : (k % 4 == 1) ? 0x0D : (k % 4 == 2) ? 0x0A : (uint8_t)(i + k);
+                writer_frame(WRITER_TYPE_UNKNOWN, i, bytes, len);
+                break;
+        }
+        }
+}
+
+int main(int argc, char **argv)
+{
+        uint32_t records = 300;
+        if (argc > 1)
+                records = atoi(argv[1]);
+
+        // Tail of a frame cut off by attaching
+        uint8_t encoded[TELEMETRY_ENCODED_FRAME_SIZE];
+        uint16_t partial[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+        size_t encoded_len = telemetry_frame_encode(WRITER_TYPE_TASK_STAT, 0, partial, sizeof(partial), encoded);
+        fwrite(encoded + encoded_len / 2, 1, encoded_len - encoded_len / 2, stdout);
+
+        for (uint32_t i = 0; i < records; i++)
+        {
+                printf("I (%u) app_main: line %u\n", i, i);
+                if (i % 5 == 0)
+                        printf("W (%u) espnow: second line %u, a\tdelimiter-free\rtext\n", i, i);
+                writer_record(i);
+        }
+        printf("I (%u) app_main: done\n", records);
+        fflush(stdout);
+        return 0;
+}
@@ -0,0 +1,378 @@
+/*
+ * main/tof_scheduler.c in simulated time, driven the way tof_sensor_task
+ * drives it: wake on an echo or at tof_scheduler_next_us, hand the echoes
+ * in, poll, trigger what it returns. Each sensor faces an obstacle that
+ * drifts between the near and far end of a scene, so its echo times vary
+ * from ping to ping. Some pings come back as the 38 ms pulse of an SR04
+ * that sees nothing, some never come back, some come back only after the
+ * timeout.
+ *
+ * Checked on every trigger: no sensor it conflicts with, in either
+ * direction of the configured masks, is in flight or cooling down, its own
+ * cooldown after the last echo or timeout is over, and a conflicting
+ * sensor that waited longer is passed over only while an older one it
+ * conflicts with holds it back. Checked on every wake: a timeout comes
+ * exactly `timeout_us` after the trigger, a late echo is refused, and
+ * polling any earlier time up to the next wake fires nothing. Over a run
+ * no sensor waits longer than one cycle per sensor in the array plus its
+ * own, the reported rates lie within the measured intervals, and with obstacles
+ * in range every layout beats firing one sensor after the other every
+ * SR04_DEFAULT_PERIOD_US, as the single sensor driver did.
+ *
+ * Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/tof_scheduler_sim.c main/tof_scheduler.c -o tof_scheduler_sim
+ *   ./tof_scheduler_sim [duration_ms] [seed]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tof_scheduler.h"
+
+#define SIM_NEVER (INT64_MAX)
+#define SIM_SERIAL_PERIOD_US (40 * 1000) // SR04_DEFAULT_PERIOD_US of the single sensor driver
+#define SIM_NOTHING_US (38 * 1000)       // Echo pulse of an SR04 that sees nothing
+#define SIM_MM_PER_US (0.343)            // Speed of sound at 20 °C
+
+static unsigned sim_violations = 0;
+
+#define SIM_CHECK(cond)                                                           \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        sim_violations++;                                         \
+                }                                                                 \
+        } while (0)
+
+typedef struct
+{
+        const char *name;
+        uint8_t count;
+        uint32_t conflicts[TOF_SCHEDULER_MAX]; // As configured, not necessarily symmetric
+} sim_layout_t;
+
+static const sim_layout_t sim_layouts[] = {
+    {"6 apart", 6, {0}},
+    {"6 ring", 6, {0x22, 0x05, 0x0A, 0x14, 0x28, 0x11}},
+    {"4 facing", 4, {0xE, 0xD, 0xB, 0x7}},
+    {"8 one-way", 8, {0x02, 0x01, 0x08, 0x04, 0x20, 0x10, 0x80, 0x7F}}, // Pairs, the last hears all, the others not it
+};
+#define SIM_LAYOUTS (sizeof(sim_layouts) / sizeof(sim_layouts[0]))
+
+typedef struct
+{
+        const char *name;
+        uint32_t near_mm;
+        uint32_t far_mm;
+        unsigned nothing_permille; // The 38 ms pulse
+        unsigned lost_permille;    // No echo, half of them come back after the timeout
+        bool in_range;             // Must beat the serial driver
+} sim_scene_t;
+
+static const sim_scene_t sim_scenes[] = {
+    {"near", 100, 1000, 0, 0, true},
+    {"room", 200, 4000, 20, 20, true},
+    {"open", 1000, 4000, 300, 100, false},
+};
+#define SIM_SCENES (sizeof(sim_scenes) / sizeof(sim_scenes[0]))
+
+typedef struct
+{
+        double distance_mm;
+        bool in_flight;
+        int64_t fired_us;
+        int64_t echo_at_us; // SIM_NEVER when no echo is coming
+        uint32_t echo_us;
+        int64_t ready_us; // End of the cooldown as this sim works it out
+        uint32_t fires;
+        uint32_t echoes;
+        uint32_t timeouts;
+        uint32_t late;
+        int64_t max_gap_us;
+        uint32_t min_interval_us;
+        uint32_t max_interval_us;
+} sim_sensor_t;
+
+typedef struct
+{
+        uint32_t readings;
+        uint32_t late;
+        int64_t max_gap_us;
+        int64_t gap_bound_us;
+        uint32_t min_rate_mhz;
+} sim_stat_t;
+
+static sim_sensor_t sim_sensors[TOF_SCHEDULER_MAX];
+static uint32_t sim_conflicts[TOF_SCHEDULER_MAX]; // Symmetric, worked out here
+
+static int sim_rand(int range)
+{
+        return range ? rand() % range : 0;
+}
+
+/* Triggers `index`: moves its obstacle a little and draws when, if ever, the echo ends */
+static void sim_ping(const tof_scheduler_config_t *config, const sim_scene_t *scene, size_t index, int64_t now_us)
+{
+        sim_sensor_t *sensor = &sim_sensors[index];
+        sensor->distance_mm += sim_rand(101) - 50;
+        if (sensor->distance_mm < scene->near_mm)
+                sensor->distance_mm = scene->near_mm;
+        if (sensor->distance_mm > scene->far_mm)
+                sensor->distance_mm = scene->far_mm;
+
+        sensor->in_flight = true;
+        sensor->fired_us = now_us;
+        sensor->echo_at_us = SIM_NEVER;
+        int draw = sim_rand(1000);
+        if (draw < (int)scene->lost_permille)
+        {
+                if (draw % 2)
+                {
+                        sensor->echo_us = config->timeout_us + 1 + sim_rand(10 * 1000);
+                        sensor->echo_at_us = now_us + sensor->echo_us;
+                }
+                return;
+        }
+        if (draw < (int)(scene->lost_permille + scene->nothing_permille))
+                sensor->echo_us = SIM_NOTHING_US;
+        else
+                sensor->echo_us = 2 * sensor->distance_mm / SIM_MM_PER_US + sim_rand(41) - 20;
+        sensor->echo_at_us = now_us + sensor->echo_us;
+}
+
+static int64_t sim_cooldown_us(const tof_scheduler_config_t *config, uint32_t echo_us)
+{
+        if (echo_us > config->max_echo_us)
+                echo_us = config->max_echo_us;
+        return config->min_cooldown_us + (uint64_t)echo_us * config->cooldown_percent / 100;
+}
+
+/* Cooled down at `now_us` and waiting longer than `than`, ties go to the lower index as in tof_scheduler_poll */
+static bool sim_older(const sim_sensor_t *before, size_t index, size_t than, int64_t now_us)
+{
+        const sim_sensor_t *sensor = &before[index];
+        if (sensor->in_flight || (now_us < sensor->ready_us))
+                return false;
+        return (sensor->fired_us < before[than].fired_us) || ((sensor->fired_us == before[than].fired_us) && (index < than));
+}
+
+/* Checks a trigger against the state of the array `before` the poll, then starts the ping */
+static void sim_fire(const tof_scheduler_config_t *config, const sim_scene_t *scene, const sim_sensor_t *before, size_t index,
+                     int64_t now_us)
+{
+        sim_sensor_t *sensor = &sim_sensors[index];
+        SIM_CHECK(!sensor->in_flight);
+        SIM_CHECK(now_us >= sensor->ready_us);
+        for (size_t j = 0; j < config->count; j++)
+        {
+                if (!(sim_conflicts[index] & (1UL << j)))
+                        continue;
+                SIM_CHECK(!before[j].in_flight); // Crosstalk
+                SIM_CHECK(now_us >= before[j].ready_us);
+
+                // A neighbour waiting longer is passed over only while an older sensor it conflicts with holds it back
+                if (!sim_older(before, j, index, now_us))
+                        continue;
+                bool held = false;
+                for (size_t k = 0; !held && (k < config->count); k++)
+                        held = (k != index) && (sim_conflicts[j] & (1UL << k)) && sim_older(before, k, j, now_us);
+                SIM_CHECK(held);
+        }
+
+        if (sensor->fires > 0)
+        {
+                uint32_t interval = now_us - sensor->fired_us;
+                if (interval > sensor->max_gap_us)
+                        sensor->max_gap_us = interval;
+                if ((sensor->fires == 1) || (interval < sensor->min_interval_us))
+                        sensor->min_interval_us = interval;
+                if (interval > sensor->max_interval_us)
+                        sensor->max_interval_us = interval;
+        }
+        sensor->fires++;
+        sim_ping(config, scene, index, now_us);
+}
+
+static void sim_run(const sim_layout_t *layout, const sim_scene_t *scene, int64_t duration_us, sim_stat_t *stat)
+{
+        tof_scheduler_config_t config;
+        tof_scheduler_default_config(&config, layout->count);
+        memcpy(config.conflicts, layout->conflicts, sizeof(config.conflicts));
+        tof_scheduler_t scheduler;
+        tof_scheduler_init(&scheduler, &config);
+
+        memset(sim_sensors, 0, sizeof(sim_sensors));
+        memset(sim_conflicts, 0, sizeof(sim_conflicts));
+        for (size_t i = 0; i < config.count; i++)
+        {
+                sim_sensors[i].distance_mm = scene->near_mm + sim_rand(scene->far_mm - scene->near_mm + 1);
+                sim_sensors[i].echo_at_us = SIM_NEVER;
+                sim_sensors[i].fired_us = INT64_MIN;
+                for (size_t j = 0; j < config.count; j++)
+                {
+                        if ((i != j) && ((layout->conflicts[i] & (1UL << j)) || (layout->conflicts[j] & (1UL << i))))
+                                sim_conflicts[i] |= 1UL << j;
+                }
+                SIM_CHECK(scheduler.slots[i].conflicts == sim_conflicts[i]);
+        }
+
+        int64_t now = 0;
+        while (now < duration_us)
+        {
+                // Captures that came in since the last wake
+                for (size_t i = 0; i < config.count; i++)
+                {
+                        sim_sensor_t *sensor = &sim_sensors[i];
+                        if (sensor->echo_at_us > now)
+                                continue;
+                        bool taken = tof_scheduler_echo(&scheduler, i, now, sensor->echo_us);
+                        SIM_CHECK(taken == sensor->in_flight);
+                        if (sensor->in_flight)
+                        {
+                                sensor->in_flight = false;
+                                sensor->ready_us = now + sim_cooldown_us(&config, sensor->echo_us);
+                                sensor->echoes++;
+                        }
+                        else
+                        {
+                                sensor->late++;
+                        }
+                        sensor->echo_at_us = SIM_NEVER;
+                }
+
+                uint32_t timed_out;
+                uint32_t fire = tof_scheduler_poll(&scheduler, now, &timed_out);
+                for (size_t i = 0; i < config.count; i++)
+                {
+                        sim_sensor_t *sensor = &sim_sensors[i];
+                        bool expired = sensor->in_flight && (now - sensor->fired_us >= config.timeout_us);
+                        SIM_CHECK(expired == !!(timed_out & (1UL << i)));
+                        if (!expired)
+                                continue;
+                        SIM_CHECK(now - sensor->fired_us == config.timeout_us); // Woken right on time
+                        sensor->in_flight = false;
+                        sensor->ready_us = now + sim_cooldown_us(&config, config.max_echo_us);
+                        sensor->timeouts++;
+                }
+                SIM_CHECK((fire & ~((1UL << config.count) - 1)) == 0);
+                sim_sensor_t before[TOF_SCHEDULER_MAX];
+                memcpy(before, sim_sensors, sizeof(before));
+                for (size_t i = 0; i < config.count; i++)
+                {
+                        if (fire & (1UL << i))
+                                sim_fire(&config, scene, before, i, now);
+                }
+
+                int64_t wake = tof_scheduler_next_us(&scheduler, now);
+                SIM_CHECK(wake > now);
+                for (size_t i = 0; i < config.count; i++)
+                {
+                        if (sim_sensors[i].echo_at_us < wake)
+                                wake = sim_sensors[i].echo_at_us;
+                }
+                SIM_CHECK(wake != SIM_NEVER); // Or the array stalled for good
+                if (wake == SIM_NEVER)
+                        break;
+
+                // Nothing may be due before the wake the task would sleep until
+                if (wake - now > 1)
+                {
+                        tof_scheduler_t probe = scheduler;
+                        uint32_t probe_timed_out;
+                        SIM_CHECK(tof_scheduler_poll(&probe, now + 1 + sim_rand(wake - now - 1), &probe_timed_out) == 0);
+                        SIM_CHECK(probe_timed_out == 0);
+                }
+                now = wake;
+        }
+
+        // One cycle, a lost echo and the longest cooldown, of its own. Then every sensor that waited longer
+        // fires before it, the longest waiting of all within a cycle, so at most one cycle each and its own
+        const int64_t cycle_us = config.timeout_us + sim_cooldown_us(&config, config.max_echo_us);
+        *stat = (sim_stat_t){.min_rate_mhz = UINT32_MAX};
+        for (size_t i = 0; i < config.count; i++)
+        {
+                const sim_sensor_t *sensor = &sim_sensors[i];
+                const tof_scheduler_slot_t *slot = &scheduler.slots[i];
+                SIM_CHECK(slot->fires == sensor->fires);
+                SIM_CHECK(slot->echoes == sensor->echoes);
+                SIM_CHECK(slot->timeouts == sensor->timeouts);
+                SIM_CHECK(sensor->fires > 1);
+
+                int64_t bound_us = (config.count + 1) * cycle_us;
+                SIM_CHECK(sensor->max_gap_us <= bound_us);
+                if (bound_us > stat->gap_bound_us)
+                        stat->gap_bound_us = bound_us;
+                if (sensor->max_gap_us > stat->max_gap_us)
+                        stat->max_gap_us = sensor->max_gap_us;
+
+                // A running average of the intervals, a few us of rounding aside
+                uint32_t rate_mhz = tof_scheduler_rate_mhz(&scheduler, i);
+                SIM_CHECK(rate_mhz <= 1000ULL * 1000 * 1000 / (sensor->min_interval_us - 4));
+                SIM_CHECK(rate_mhz >= 1000ULL * 1000 * 1000 / (sensor->max_interval_us + 4));
+                if (rate_mhz < stat->min_rate_mhz)
+                        stat->min_rate_mhz = rate_mhz;
+                stat->readings += sensor->echoes + sensor->timeouts;
+                stat->late += sensor->late;
+        }
+        SIM_CHECK(tof_scheduler_rate_mhz(&scheduler, config.count) == 0);
+}
+
+/* Echoes for sensors that were not waiting, or out of range, are turned down */
+static void sim_units(void)
+{
+        unsigned violations = sim_violations;
+        tof_scheduler_config_t config;
+        tof_scheduler_t scheduler;
+        SIM_CHECK(tof_scheduler_default_config(NULL, 2) == NULL);
+        SIM_CHECK(tof_scheduler_default_config(&config, TOF_SCHEDULER_MAX + 1)->count == TOF_SCHEDULER_MAX);
+        tof_scheduler_default_config(&config, 2);
+        config.conflicts[0] = 0x3; // Itself, ignored
+        tof_scheduler_init(&scheduler, &config);
+        SIM_CHECK((scheduler.slots[0].conflicts == 0x2) && (scheduler.slots[1].conflicts == 0x1));
+        SIM_CHECK(!tof_scheduler_echo(&scheduler, 0, 0, 1000));
+        SIM_CHECK(!tof_scheduler_echo(&scheduler, 2, 0, 1000));
+
+        uint32_t timed_out;
+        SIM_CHECK(tof_scheduler_poll(&scheduler, 0, &timed_out) == 0x1); // Lower index first on a tie
+        SIM_CHECK(tof_scheduler_next_us(&scheduler, 0) == config.timeout_us);
+        SIM_CHECK(tof_scheduler_echo(&scheduler, 0, 1000, 1000));
+        SIM_CHECK(!tof_scheduler_echo(&scheduler, 0, 1001, 1000));
+        SIM_CHECK(tof_scheduler_poll(&scheduler, 1000 + config.min_cooldown_us + 999, NULL) == 0);
+        SIM_CHECK(tof_scheduler_poll(&scheduler, 1000 + config.min_cooldown_us + 1000, NULL) == 0x2);
+        printf("units: %s\n", (sim_violations != violations) ? "FAIL" : "OK");
+}
+
+int main(int argc, char **argv)
+{
+        int64_t duration_us = 60 * 1000 * 1000;
+        if (argc > 1)
+                duration_us = atoll(argv[1]) * 1000;
+        srand(argc > 2 ? atoi(argv[2]) : 1);
+
+        sim_units();
+        printf("%-10s %-6s %10s %10s %9s %9s %10s %5s\n", "layout", "scene", "readings/s", "serial/s", "min Hz", "max gap", "gap bound",
+               "late");
+        for (size_t l = 0; l < SIM_LAYOUTS; l++)
+        {
+                for (size_t s = 0; s < SIM_SCENES; s++)
+                {
+                        unsigned violations = sim_violations;
+                        sim_stat_t stat;
+                        sim_run(&sim_layouts[l], &sim_scenes[s], duration_us, &stat);
+                        double per_s = stat.readings * 1e6 / duration_us;
+                        double serial_per_s = 1e6 / SIM_SERIAL_PERIOD_US;
+                        if (sim_scenes[s].in_range)
+                                SIM_CHECK(per_s > serial_per_s);
+                        printf("%-10s %-6s %10.1f %10.1f %9.2f %6lld ms %7lld ms %5u  %s\n", sim_layouts[l].name, sim_scenes[s].name, per_s,
+                               serial_per_s, stat.min_rate_mhz / 1000.0, (long long)stat.max_gap_us / 1000,
+                               (long long)stat.gap_bound_us / 1000, stat.late, (sim_violations != violations) ? "FAIL" : "OK");
+                }
+        }
+
+        printf("%s, %u violation(s)\n", sim_violations ? "FAIL" : "OK", sim_violations);
+        return sim_violations ? 1 : 0;
+}
@@ -0,0 +1,273 @@
+/*
+ * Control frame latency through main/tx_sched.c under background load, in
+ * simulated time. Sources push frames at the rates of the remote: servo
+ * setpoints at 50 Hz with ESPNOW_TX_FLAG_LATEST, button edges, heartbeats
+ * at 10 Hz, ACKs, and a background of telemetry and debug text bursts
+ * that is swept upwards. One radio sends one frame per airtime and at most
+ * ESPNOW_TX_WINDOW_PEER frames are handed to it at once, as tx_task does.
+ *
+ * Each load runs twice: through tx_sched with the default config, and
+ * through one FIFO in call order, which is what every caller sending on
+ * its own amounts to. Latency is push to end of airtime.
+ *
+ * A peer whose TX window stays full must not hold up the frames of its
+ * class to other peers, and the frames to each peer must keep their order
+ * through the blocked pops and tx_sched_requeue. Exits with 1 on any
+ * violation there.
+ *
+ *   gcc -O2 -Wall -I main host/tx_sched_sim.c main/tx_sched.c -o tx_sched_sim
+ *   ./tx_sched_sim [duration_ms] [airtime_us]
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tx_sched.h"
+
+#define SIM_STEP_US (10)
+#define SIM_WINDOW (4)    // ESPNOW_TX_WINDOW_PEER
+#define SIM_FIFO_MAX (64) // Driver queue in front of the radio without the scheduler
+#define SIM_SAMPLES_MAX (1 << 16)
+
+typedef enum
+{
+        SIM_SETPOINT,
+        SIM_BUTTON,
+        SIM_HEARTBEAT,
+        SIM_ACK,
+        SIM_TELEMETRY,
+        SIM_TEXT,
+        SIM_SOURCE_MAX,
+} sim_source_t;
+
+typedef struct
+{
+        const char *name;
+        tx_sched_class_t tx_class;
+        uint8_t flags;
+        uint8_t len;
+        uint32_t period_us; // 0 for background, set per load
+        uint8_t burst;      // Frames pushed back to back per period
+} sim_source_spec_t;
+
+static const sim_source_spec_t sim_sources[SIM_SOURCE_MAX] = {
+    [SIM_SETPOINT] = {"setpoint", TX_SCHED_CLASS_CONTROL, TX_SCHED_FLAG_LATEST, 12, 20 * 1000, 1},
+    [SIM_BUTTON] = {"button", TX_SCHED_CLASS_CONTROL, 0, 8, 150 * 1000, 1},
+    [SIM_HEARTBEAT] = {"heartbeat", TX_SCHED_CLASS_HANDSHAKE, TX_SCHED_FLAG_LATEST, 8, 100 * 1000, 1},
+    [SIM_ACK] = {"ack", TX_SCHED_CLASS_ACK, 0, 0, 10 * 1000, 1},
+    [SIM_TELEMETRY] = {"telemetry", TX_SCHED_CLASS_TELEMETRY, 0, 48, 0, 1},
+    [SIM_TEXT] = {"text", TX_SCHED_CLASS_TEXT, 0, 64, 0, 8},
+};
+
+typedef struct
+{
+        uint8_t source;
+        int64_t queued_us;
+} sim_frame_t;
+
+typedef struct
+{
+        uint32_t offered;
+        uint32_t delivered;
+        uint32_t count;
+        uint32_t samples[SIM_SAMPLES_MAX];
+} sim_stat_t;
+
+static sim_stat_t sim_stats[SIM_SOURCE_MAX];
+static tx_sched_t sched;
+static unsigned airtime_us = 600;
+static unsigned sim_violations = 0;
+
+#define SIM_CHECK(cond)                                                           \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        sim_violations++;                                         \
+                }                                                                 \
+        } while (0)
+
+/* The radio: frames handed over wait here, the head is on air */
+static sim_frame_t sim_radio[SIM_FIFO_MAX];
+static size_t sim_radio_head = 0;
+static size_t sim_radio_count = 0;
+static int64_t sim_radio_done_us = 0;
+static bool sim_radio_on_air = false;
+
+static bool sim_radio_push(uint8_t source, int64_t queued_us)
+{
+        if (sim_radio_count == SIM_FIFO_MAX)
+                return false;
+        sim_radio[(sim_radio_head + sim_radio_count++) % SIM_FIFO_MAX] = (sim_frame_t){.source = source, .queued_us = queued_us};
+        return true;
+}
+
+/* Ends the frame on air, the send callback, then starts the next one */
+static void sim_radio_step(int64_t now_us)
+{
+        if (sim_radio_on_air && (now_us >= sim_radio_done_us))
+        {
+                const sim_frame_t *frame = &sim_radio[sim_radio_head];
+                sim_stat_t *stat = &sim_stats[frame->source];
+                stat->delivered++;
+                if (stat->count < SIM_SAMPLES_MAX)
+                        stat->samples[stat->count++] = now_us - frame->queued_us;
+                sim_radio_head = (sim_radio_head + 1) % SIM_FIFO_MAX;
+                sim_radio_count--;
+                sim_radio_on_air = false;
+        }
+        if (!sim_radio_on_air && (sim_radio_count > 0))
+        {
+                sim_radio_on_air = true;
+                sim_radio_done_us = now_us + airtime_us;
+        }
+}
+
+static int sim_compare(const void *a, const void *b)
+{
+        uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+        return (x > y) - (x < y);
+}
+
+static uint32_t sim_percentile(sim_stat_t *stat, unsigned permille)
+{
+        if (stat->count == 0)
+                return 0;
+        return stat->samples[(size_t)(stat->count - 1) * permille / 1000];
+}
+
+static void sim_run(bool scheduled, unsigned background_hz, int64_t duration_us)
+{
+        memset(sim_stats, 0, sizeof(sim_stats));
+        sim_radio_head = sim_radio_count = 0;
+        sim_radio_done_us = 0;
+        sim_radio_on_air = false;
+        tx_sched_config_t config;
+        tx_sched_init(&sched, tx_sched_default_config(&config), 0);
+        srand(1);
+
+        uint32_t periods[SIM_SOURCE_MAX];
+        int64_t next_us[SIM_SOURCE_MAX];
+        for (size_t i = 0; i < SIM_SOURCE_MAX; i++)
+        {
+                periods[i] = sim_sources[i].period_us;
+                if (periods[i] == 0) // Background split evenly between telemetry frames and text bursts
+                        periods[i] = background_hz ? 2 * 1000000ULL * sim_sources[i].burst / background_hz : 0;
+                next_us[i] = rand() % 1000;
+        }
+
+        for (int64_t now = 0; now < duration_us; now += SIM_STEP_US)
+        {
+                for (size_t i = 0; i < SIM_SOURCE_MAX; i++)
+                {
+                        if ((periods[i] == 0) || (now < next_us[i]))
+                                continue;
+                        next_us[i] += periods[i] / 2 + rand() % (periods[i] + 1); // Jittered around the period
+                        for (size_t n = 0; n < sim_sources[i].burst; n++)
+                        {
+                                sim_stats[i].offered++;
+                                if (!scheduled)
+                                {
+                                        sim_radio_push(i, now);
+                                        continue;
+                                }
+                                tx_sched_frame_t frame = {.type = i, .flags = sim_sources[i].flags, .len = sim_sources[i].len};
+                                tx_sched_push(&sched, sim_sources[i].tx_class, &frame, now);
+                        }
+                }
+
+                // tx_task: hands frames over while the TX window has room
+                tx_sched_frame_t frame;
+                tx_sched_class_t tx_class;
+                while (scheduled && (sim_radio_count < SIM_WINDOW) && ((tx_class = tx_sched_pop(&sched, now, NULL, &frame)) != TX_SCHED_CLASS_MAX))
+                {
+                        sim_radio_push(frame.type, frame.queued_us);
+                        tx_sched_sent(&sched, tx_class, &frame, now);
+                }
+                sim_radio_step(now);
+        }
+
+        for (size_t i = 0; i < SIM_SOURCE_MAX; i++)
+        {
+                sim_stat_t *stat = &sim_stats[i];
+                qsort(stat->samples, stat->count, sizeof(uint32_t), sim_compare);
+                printf("%-5s %6u %-10s %8u %9u %8u %8u %8u\n", scheduled ? "sched" : "fifo", background_hz, sim_sources[i].name,
+                       stat->offered, stat->delivered, sim_percentile(stat, 500), sim_percentile(stat, 990),
+                       stat->count ? stat->samples[stat->count - 1] : 0);
+        }
+}
+
+/* Peer 1 has a full window, peer 2 takes the frames of the class meanwhile, in order for each */
+static void sim_blocked(void)
+{
+        unsigned violations = sim_violations;
+        tx_sched_config_t config;
+        tx_sched_default_config(&config);
+        config.classes[TX_SCHED_CLASS_CONTROL].rate_hz = 0;
+        tx_sched_init(&sched, &config, 0);
+
+        const uint8_t peers[] = {1, 1, 2, 1, 2, 2}; // Queue order, each frame numbered within its peer
+        uint8_t numbered[3] = {0};
+        for (size_t i = 0; i < sizeof(peers); i++)
+        {
+                tx_sched_frame_t frame = {.dest = {peers[i]}, .len = 1, .payload = {numbered[peers[i]]++}};
+                SIM_CHECK(tx_sched_push(&sched, TX_SCHED_CLASS_CONTROL, &frame, 0) == TX_SCHED_QUEUED);
+        }
+
+        tx_sched_blocked_t blocked = {0};
+        tx_sched_frame_t frame;
+        SIM_CHECK(tx_sched_pop(&sched, 0, &blocked, &frame) == TX_SCHED_CLASS_CONTROL);
+        SIM_CHECK((frame.dest[0] == 1) && (frame.payload[0] == 0));
+        tx_sched_requeue(&sched, TX_SCHED_CLASS_CONTROL, &frame); // Window full
+        SIM_CHECK(tx_sched_block(&blocked, frame.dest));
+
+        uint8_t expected = 0;
+        bool full = false;
+        while (tx_sched_pop(&sched, 0, &blocked, &frame) == TX_SCHED_CLASS_CONTROL)
+        {
+                SIM_CHECK((frame.dest[0] == 2) && (frame.payload[0] == expected));
+                if ((expected == 1) && !full) // Peer 2 runs full once too, then frees up
+                {
+                        full = true;
+                        tx_sched_requeue(&sched, TX_SCHED_CLASS_CONTROL, &frame);
+                        SIM_CHECK(tx_sched_block(&blocked, frame.dest));
+                        SIM_CHECK(tx_sched_pop(&sched, 0, &blocked, &frame) == TX_SCHED_CLASS_MAX);
+                        SIM_CHECK(tx_sched_next_us(&sched, 0, &blocked) < 0);
+                        blocked.count = 1;
+                        continue;
+                }
+                expected++;
+        }
+        SIM_CHECK(expected == 3);
+        SIM_CHECK(tx_sched_pending(&sched) == 3);
+
+        blocked.count = 0; // Send callback
+        for (expected = 0; tx_sched_pop(&sched, 0, &blocked, &frame) == TX_SCHED_CLASS_CONTROL; expected++)
+                SIM_CHECK((frame.dest[0] == 1) && (frame.payload[0] == expected));
+        SIM_CHECK(expected == 3);
+        printf("blocked peer: %s\n", (sim_violations != violations) ? "FAIL" : "OK");
+}
+
+int main(int argc, char **argv)
+{
+        int64_t duration_us = 5 * 1000 * 1000;
+        if (argc > 1)
+                duration_us = atoll(argv[1]) * 1000;
+        if (argc > 2)
+                airtime_us = atoi(argv[2]);
+
+        const unsigned loads[] = {0, 400, 1000, 2000};
+        printf("airtime: %u us, radio capacity: %u frames/s, window: %d\n", airtime_us, 1000000 / airtime_us, SIM_WINDOW);
+        printf("%-5s %6s %-10s %8s %9s %8s %8s %8s\n", "mode", "bg/s", "source", "offered", "delivered", "p50 us", "p99 us", "max us");
+        for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); l++)
+        {
+                sim_run(false, loads[l], duration_us);
+                sim_run(true, loads[l], duration_us);
+        }
+        sim_blocked();
+
+        printf("%s, %u violation(s)\n", sim_violations ? "FAIL" : "OK", sim_violations);
+        return sim_violations ? 1 : 0;
+}
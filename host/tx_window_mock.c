@@ -0,0 +1,267 @@
+/*
+ * main/tx_window.c as a Linux process. Sender threads stand in for the
+ * tasks calling espnow_send_data and take a slot the way espnow_tx_acquire
+ * does, a pthread mutex for the critical section and a condition variable
+ * for the released event bit. A driver thread stands in for the Wi-Fi
+ * task: it takes frames off a queue, holds each one for a random airtime
+ * and reports it to tx_window_complete in order. A share of the frames
+ * stalls the driver past the timeout, tx_window_expire takes their slots
+ * back and their callbacks come late, as do those of the frames queued
+ * behind them.
+ *
+ * The limits are checked on every change. Every completion must report
+ * the latency of its own frame and every callback refused must belong to
+ * an expired frame, give or take the senders swapping between taking a
+ * slot and queueing the frame. The counters must add up at the end. Exits
+ * with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/tx_window_mock.c main/tx_window.c -lpthread -o tx_window_mock
+ *   ./tx_window_mock [duration_ms] [airtime_us] [late_permille] [senders] [peers]
+ * */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tx_window.h"
+
+#define MOCK_PEERS_MAX (4)
+#define MOCK_SENDERS_MAX (8)
+#define MOCK_WINDOW_PEER (4)          // ESPNOW_TX_WINDOW_PEER
+#define MOCK_WINDOW_TOTAL (8)         // ESPNOW_TX_WINDOW_TOTAL
+#define MOCK_TIMEOUT_US (100 * 1000)  // ESPNOW_TX_TIMEOUT_US
+#define MOCK_WAIT_US (20 * 1000)      // ESPNOW_SEND_WAIT_MS
+#define MOCK_DRIVER_QUEUE_MAX (64)    // More than MOCK_WINDOW_TOTAL, the window is what bounds it
+
+static pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mock_released = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t mock_queued = PTHREAD_COND_INITIALIZER;
+static tx_window_shared_t mock_shared;
+static tx_window_t mock_windows[MOCK_PEERS_MAX];
+typedef struct
+{
+        uint8_t peer;
+        int64_t sent_us; // As stamped by tx_window_acquire
+} mock_frame_t;
+
+static mock_frame_t mock_driver_queue[MOCK_DRIVER_QUEUE_MAX];
+static size_t mock_driver_head = 0;
+static size_t mock_driver_count = 0;
+static volatile bool mock_running = true;
+static unsigned mock_violations = 0;
+
+static unsigned airtime_us = 1000;
+static unsigned late_permille = 2;
+static unsigned peer_count = 2;
+
+static int64_t mock_now_us(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Called with mock_lock held */
+static void mock_check_limits(void)
+{
+        unsigned total = 0;
+        for (unsigned i = 0; i < peer_count; i++)
+        {
+                if (mock_windows[i].in_flight > mock_windows[i].limit)
+                {
+                        fprintf(stderr, "peer %u: %u in flight, limit %u\n", i, mock_windows[i].in_flight, mock_windows[i].limit);
+                        mock_violations++;
+                }
+                total += mock_windows[i].in_flight;
+        }
+        if ((mock_shared.in_flight > mock_shared.limit) || (mock_shared.in_flight != total))
+        {
+                fprintf(stderr, "shared: %u in flight, limit %u, peers %u\n", mock_shared.in_flight, mock_shared.limit, total);
+                mock_violations++;
+        }
+}
+
+/* espnow_tx_acquire: expire, try, wait for a release until the deadline */
+static bool mock_acquire(unsigned peer, int64_t *sent_us)
+{
+        const int64_t deadline = mock_now_us() + MOCK_WAIT_US;
+        bool counted = false;
+        pthread_mutex_lock(&mock_lock);
+        for (;;)
+        {
+                tx_window_expire(&mock_windows[peer], &mock_shared, mock_now_us(), MOCK_TIMEOUT_US);
+                int64_t now = mock_now_us();
+                if (tx_window_acquire(&mock_windows[peer], &mock_shared, now))
+                {
+                        *sent_us = now;
+                        break;
+                }
+                if (!counted)
+                        mock_windows[peer].waits++;
+                counted = true;
+
+                struct timespec until = {.tv_sec = deadline / 1000000, .tv_nsec = (deadline % 1000000) * 1000};
+                // CLOCK_MONOTONIC based deadline, the condition uses the same clock
+                if ((mock_now_us() >= deadline) || (pthread_cond_timedwait(&mock_released, &mock_lock, &until) == ETIMEDOUT))
+                {
+                        mock_windows[peer].timeouts++;
+                        pthread_mutex_unlock(&mock_lock);
+                        return false;
+                }
+        }
+        mock_check_limits();
+        pthread_mutex_unlock(&mock_lock);
+        return true;
+}
+
+/* esp_now_send: hands the frame to the driver, a full queue gives the slot back as espnow_tx_cancel */
+static void mock_send(unsigned peer, int64_t sent_us)
+{
+        pthread_mutex_lock(&mock_lock);
+        if (mock_driver_count == MOCK_DRIVER_QUEUE_MAX)
+        {
+                tx_window_cancel(&mock_windows[peer], &mock_shared);
+                pthread_cond_broadcast(&mock_released);
+        }
+        else
+        {
+                mock_driver_queue[(mock_driver_head + mock_driver_count++) % MOCK_DRIVER_QUEUE_MAX] = (mock_frame_t){.peer = peer, .sent_us = sent_us};
+                pthread_cond_signal(&mock_queued);
+        }
+        pthread_mutex_unlock(&mock_lock);
+}
+
+static void *mock_sender(void *arg)
+{
+        unsigned peer = (uintptr_t)arg % peer_count;
+        while (mock_running)
+        {
+                int64_t sent_us;
+                if (mock_acquire(peer, &sent_us))
+                        mock_send(peer, sent_us);
+                peer = (peer + 1) % peer_count;
+        }
+        return NULL;
+}
+
+/* The Wi-Fi task: one frame per airtime, or stalled past the timeout, then the send callback */
+static void *mock_driver(void *arg)
+{
+        while (mock_running)
+        {
+                pthread_mutex_lock(&mock_lock);
+                while (mock_running && (mock_driver_count == 0))
+                        pthread_cond_wait(&mock_queued, &mock_lock);
+                if (!mock_running)
+                {
+                        pthread_mutex_unlock(&mock_lock);
+                        break;
+                }
+                mock_frame_t frame = mock_driver_queue[mock_driver_head];
+                mock_driver_head = (mock_driver_head + 1) % MOCK_DRIVER_QUEUE_MAX;
+                mock_driver_count--;
+                pthread_mutex_unlock(&mock_lock);
+
+                if (airtime_us)
+                        usleep(airtime_us / 2 + rand() % (airtime_us + 1)); // 0.5 to 1.5 airtimes, retries included
+                if ((unsigned)(rand() % 1000) < late_permille)
+                        usleep(MOCK_TIMEOUT_US + airtime_us);
+
+                pthread_mutex_lock(&mock_lock);
+                tx_window_t *window = &mock_windows[frame.peer];
+                int64_t now = mock_now_us();
+                if (tx_window_complete(window, &mock_shared, now, (rand() % 100) != 0))
+                {
+                        // Senders may swap between taking a slot and queueing the frame, as in espnow.c, which moves
+                        // the latency by microseconds. A callback given another frame's slot is off by about a timeout.
+                        if (llabs((int64_t)window->latency_us - (now - frame.sent_us)) > MOCK_TIMEOUT_US / 10)
+                        {
+                                fprintf(stderr, "peer %u: latency %u us, frame sent %lld us ago\n", frame.peer, window->latency_us,
+                                        (long long)(now - frame.sent_us));
+                                mock_violations++;
+                        }
+                }
+                else if (now - frame.sent_us < MOCK_TIMEOUT_US - MOCK_TIMEOUT_US / 10)
+                {
+                        fprintf(stderr, "peer %u: callback refused, frame sent %lld us ago\n", frame.peer, (long long)(now - frame.sent_us));
+                        mock_violations++;
+                }
+                mock_check_limits();
+                pthread_cond_broadcast(&mock_released);
+                pthread_mutex_unlock(&mock_lock);
+        }
+        return NULL;
+}
+
+int main(int argc, char **argv)
+{
+        unsigned duration_ms = 1000;
+        unsigned sender_count = 4;
+        if (argc > 1)
+                duration_ms = atoi(argv[1]);
+        if (argc > 2)
+                airtime_us = atoi(argv[2]);
+        if (argc > 3)
+                late_permille = atoi(argv[3]);
+        if (argc > 4)
+                sender_count = atoi(argv[4]);
+        if (argc > 5)
+                peer_count = atoi(argv[5]);
+        if ((sender_count == 0) || (sender_count > MOCK_SENDERS_MAX) || (peer_count == 0) || (peer_count > MOCK_PEERS_MAX))
+        {
+                fprintf(stderr, "senders 1 to %d, peers 1 to %d\n", MOCK_SENDERS_MAX, MOCK_PEERS_MAX);
+                return 1;
+        }
+
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&mock_released, &attr);
+
+        tx_window_shared_init(&mock_shared, MOCK_WINDOW_TOTAL);
+        for (unsigned i = 0; i < peer_count; i++)
+                tx_window_reset(&mock_windows[i], &mock_shared, MOCK_WINDOW_PEER);
+
+        pthread_t driver;
+        pthread_t senders[MOCK_SENDERS_MAX];
+        pthread_create(&driver, NULL, mock_driver, NULL);
+        for (uintptr_t i = 0; i < sender_count; i++)
+                pthread_create(&senders[i], NULL, mock_sender, (void *)i);
+
+        usleep(duration_ms * 1000);
+        mock_running = false;
+        for (unsigned i = 0; i < sender_count; i++)
+                pthread_join(senders[i], NULL);
+        pthread_mutex_lock(&mock_lock);
+        pthread_cond_broadcast(&mock_queued);
+        pthread_mutex_unlock(&mock_lock);
+        pthread_join(driver, NULL);
+
+        printf("airtime: %u us, late callbacks: %u permille, senders: %u, peers: %u, shared peak: %u/%u\n", airtime_us, late_permille,
+               sender_count, peer_count, mock_shared.peak, mock_shared.limit);
+        printf("%4s %8s %9s %6s %7s %5s %7s %8s %5s %8s %8s\n", "peer", "sent", "completed", "failed", "expired", "late", "waits", "timeouts",
+               "peak", "avg us", "max us");
+        for (unsigned i = 0; i < peer_count; i++)
+        {
+                tx_window_t *window = &mock_windows[i];
+                printf("%4u %8u %9u %6u %7u %5u %7u %8u %5u %8u %8u\n", i, window->sent, window->completed, window->failed, window->expired, window->late,
+                       window->waits, window->timeouts, window->peak, window->latency_avg_us, window->latency_max_us);
+                if (window->sent != window->completed + window->expired + window->in_flight)
+                {
+                        fprintf(stderr, "peer %u: sent %u != completed %u + expired %u + in flight %u\n", i, window->sent, window->completed,
+                                window->expired, window->in_flight);
+                        mock_violations++;
+                }
+                if (window->late > window->expired)
+                {
+                        fprintf(stderr, "peer %u: %u late callbacks, %u expired\n", i, window->late, window->expired);
+                        mock_violations++;
+                }
+        }
+        mock_check_limits();
+        printf("%s, %u violation(s)\n", mock_violations ? "FAIL" : "OK", mock_violations);
+        return mock_violations ? 1 : 0;
+}
@@ -0,0 +1,335 @@
+/*
+ * main/watermark.c as a Linux process. A FIFO stands in for a FreeRTOS
+ * queue, random bursts of sends and receives go through it and report to
+ * the registry the way watermark_queue_send and watermark_queue_receive
+ * do. A reference follows the same item the registry samples, by its id,
+ * and must see the same latencies, also across the wrap of the 32-bit
+ * microsecond clock. Peaks, drops and the stack peaks of the tasks are
+ * checked against what was fed in, a reset must keep the registrations,
+ * and the table must show them.
+ *
+ * Then several producer threads and a consumer report on one queue at
+ * once, none of the counters may lose an update.
+ *
+ * Exits with 1 on any violation.
+ *
+ *   gcc -O2 -Wall -I main host/watermark_test.c main/watermark.c -lpthread -o watermark_test
+ *   ./watermark_test [operations] [seed]
+ * */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "watermark.h"
+
+#define TEST_CAPACITY (16)
+#define TEST_PRODUCERS (4)
+#define TEST_TABLE_SIZE (1024)
+#define TEST_SEND_TRIES (64) // A sender yields this often on a full queue before it drops, as a short send timeout would
+
+static unsigned test_violations = 0;
+
+#define TEST_CHECK(cond)                                                          \
+        do                                                                        \
+        {                                                                         \
+                if (!(cond))                                                      \
+                {                                                                 \
+                        printf("violation %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+                        test_violations++;                                        \
+                }                                                                 \
+        } while (0)
+
+typedef struct
+{
+        uint32_t id[TEST_CAPACITY];
+        uint32_t sent_us[TEST_CAPACITY];
+        size_t head;
+        size_t count;
+} test_fifo_t;
+
+/* What the registry should report, following one item at a time by id */
+typedef struct
+{
+        bool following;
+        uint32_t id;
+        uint32_t samples;
+        uint64_t sum_us;
+        uint32_t max_us;
+        uint32_t peak;
+        uint32_t sent;
+        uint32_t dropped;
+        uint32_t received;
+} test_reference_t;
+
+static void test_queue(watermark_queue_t queue, size_t operations, uint32_t start_us)
+{
+        unsigned violations = test_violations;
+        test_fifo_t fifo = {0};
+        test_reference_t ref = {0};
+        uint32_t now_us = start_us;
+        uint32_t next_id = 0;
+
+        watermark_queue_register(queue, TEST_CAPACITY);
+        for (size_t op = 0; op < operations; op++)
+        {
+                now_us += rand() % 500;
+                bool send = (fifo.count == 0) || ((rand() % 100) < ((op / 1000) % 2 ? 70 : 40)); // Filling and draining phases
+                if (send)
+                {
+                        if (fifo.count == TEST_CAPACITY)
+                        {
+                                watermark_queue_dropped(queue);
+                                ref.dropped++;
+                                continue;
+                        }
+                        size_t tail = (fifo.head + fifo.count) % TEST_CAPACITY;
+                        fifo.id[tail] = next_id;
+                        fifo.sent_us[tail] = now_us;
+                        fifo.count++;
+                        watermark_queue_sent(queue, fifo.count, now_us);
+                        ref.sent++;
+                        if (fifo.count > ref.peak)
+                                ref.peak = fifo.count;
+                        if (!ref.following)
+                        {
+                                ref.following = true;
+                                ref.id = next_id;
+                        }
+                        next_id++;
+                }
+                else
+                {
+                        uint32_t id = fifo.id[fifo.head];
+                        uint32_t latency_us = now_us - fifo.sent_us[fifo.head];
+                        fifo.head = (fifo.head + 1) % TEST_CAPACITY;
+                        fifo.count--;
+                        watermark_queue_received(queue, now_us);
+                        ref.received++;
+                        if (ref.following && (id == ref.id))
+                        {
+                                ref.following = false;
+                                ref.samples++;
+                                ref.sum_us += latency_us;
+                                if (latency_us > ref.max_us)
+                                        ref.max_us = latency_us;
+                        }
+                }
+        }
+
+        watermark_queue_stat_t stat;
+        TEST_CHECK(watermark_queue_get(queue, &stat));
+        TEST_CHECK(stat.capacity == TEST_CAPACITY);
+        TEST_CHECK(stat.peak == ref.peak);
+        TEST_CHECK(stat.peak <= TEST_CAPACITY);
+        TEST_CHECK(stat.sent == ref.sent);
+        TEST_CHECK(stat.dropped == ref.dropped);
+        TEST_CHECK(stat.received == ref.received);
+        TEST_CHECK(stat.latency_samples == ref.samples);
+        TEST_CHECK(stat.latency_max_us == ref.max_us);
+        TEST_CHECK(ref.samples && (stat.latency_avg_us == (uint32_t)ref.sum_us / ref.samples));
+        printf("%-16s %8u %8u %8u %5u %8u %8u %8u  %s\n", WATERMARK_QUEUE_STRING[queue], stat.sent, stat.dropped, stat.received, stat.peak,
+               stat.latency_samples, stat.latency_avg_us, stat.latency_max_us, (test_violations != violations) ? "FAIL" : "OK");
+}
+
+static void test_tasks(void)
+{
+        unsigned violations = test_violations;
+        watermark_task_stat_t stat;
+        TEST_CHECK(!watermark_task_get(0, &stat)); // Not registered
+        watermark_task_update(0, 100);             // Ignored until registered
+
+        watermark_task_register(0, "app_task", 4096);
+        watermark_task_register(1, "tx_task", 3072);
+        watermark_task_register(WATERMARK_TASK_MAX, "none", 1024);
+        TEST_CHECK(!watermark_task_get(WATERMARK_TASK_MAX, &stat));
+        TEST_CHECK(!watermark_task_get(0, NULL));
+        TEST_CHECK(watermark_task_get(0, &stat) && (stat.stack_peak == 0) && (strcmp(stat.name, "app_task") == 0));
+
+        // The high water mark only falls, a larger one later must not lower the peak
+        watermark_task_update(0, 3000);
+        watermark_task_update(0, 2500);
+        watermark_task_update(0, 3500);
+        TEST_CHECK(watermark_task_get(0, &stat) && (stat.stack_size == 4096) && (stat.stack_peak == 4096 - 2500));
+        watermark_task_update(1, 5000); // More free than the stack, as the task reports words on some ports
+        TEST_CHECK(watermark_task_get(1, &stat) && (stat.stack_peak == 0));
+        watermark_task_update(1, 0);
+        TEST_CHECK(watermark_task_get(1, &stat) && (stat.stack_peak == 3072));
+        printf("tasks: %s\n", (test_violations != violations) ? "FAIL" : "OK");
+}
+
+static void test_reset_and_format(void)
+{
+        unsigned violations = test_violations;
+        static char table[TEST_TABLE_SIZE], part[TEST_TABLE_SIZE];
+        size_t len = watermark_format(table, sizeof(table));
+        TEST_CHECK(len == strlen(table));
+        TEST_CHECK(strstr(table, "espnow_ring") != NULL);
+        TEST_CHECK(strstr(table, "app_task          4096  1596") != NULL);
+
+        // A shorter buffer holds a terminated prefix of the full table
+        for (size_t size = 1; size <= len + 1; size++)
+        {
+                memset(part, 'x', sizeof(part));
+                size_t part_len = watermark_format(part, size);
+                TEST_CHECK(part_len == strlen(part));
+                TEST_CHECK(part_len == ((size > len) ? len : size - 1));
+                TEST_CHECK(strncmp(part, table, part_len) == 0);
+        }
+
+        watermark_reset();
+        watermark_queue_stat_t stat;
+        TEST_CHECK(watermark_queue_get(WATERMARK_QUEUE_ESPNOW, &stat));
+        TEST_CHECK((stat.capacity == TEST_CAPACITY) && (stat.peak == 0) && (stat.sent == 0) && (stat.latency_samples == 0));
+        watermark_task_stat_t task;
+        TEST_CHECK(watermark_task_get(0, &task) && (task.stack_size == 4096) && (task.stack_peak == 0));
+
+        // Latency sampling starts over after a reset, an item in flight then is not followed
+        watermark_queue_received(WATERMARK_QUEUE_ESPNOW, 1000);
+        watermark_queue_sent(WATERMARK_QUEUE_ESPNOW, 1, 2000);
+        watermark_queue_received(WATERMARK_QUEUE_ESPNOW, 2300);
+        TEST_CHECK(watermark_queue_get(WATERMARK_QUEUE_ESPNOW, &stat) && (stat.latency_samples == 1) && (stat.latency_max_us == 300));
+
+        // Out of range and unregistered queues are ignored
+        watermark_queue_sent(WATERMARK_QUEUE_MAX, 1, 0);
+        watermark_queue_dropped(WATERMARK_QUEUE_MAX);
+        TEST_CHECK(!watermark_queue_get(WATERMARK_QUEUE_MAX, &stat));
+        TEST_CHECK(!watermark_queue_get(WATERMARK_QUEUE_JOYSTICK, &stat));
+        TEST_CHECK(watermark_format(table, 0) == 0);
+        printf("reset and format: %s\n", (test_violations != violations) ? "FAIL" : "OK");
+}
+
+/* Several senders and one receiver per queue on a mutex protected FIFO, the registry called outside the lock */
+typedef struct
+{
+        pthread_mutex_t lock;
+        test_fifo_t fifo;
+        size_t done;
+} test_shared_queue_t;
+
+static test_shared_queue_t test_shared = {.lock = PTHREAD_MUTEX_INITIALIZER};
+static size_t test_per_producer;
+
+static uint32_t test_clock_us(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint32_t)((uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+static void *test_producer(void *arg)
+{
+        (void)arg;
+        size_t dropped = 0;
+        for (size_t i = 0; i < test_per_producer; i++)
+        {
+                bool full = true;
+                uint32_t depth = 0;
+                for (unsigned tries = 0; full && (tries < TEST_SEND_TRIES); tries++)
+                {
+                        if (tries > 0)
+                                sched_yield();
+                        pthread_mutex_lock(&test_shared.lock);
+                        full = test_shared.fifo.count == TEST_CAPACITY;
+                        if (!full)
+                                test_shared.fifo.count++;
+                        depth = test_shared.fifo.count;
+                        pthread_mutex_unlock(&test_shared.lock);
+                }
+                if (full)
+                {
+                        watermark_queue_dropped(WATERMARK_QUEUE_RSSI);
+                        dropped++;
+                }
+                else
+                {
+                        watermark_queue_sent(WATERMARK_QUEUE_RSSI, depth, test_clock_us());
+                }
+        }
+        pthread_mutex_lock(&test_shared.lock);
+        test_shared.done++;
+        pthread_mutex_unlock(&test_shared.lock);
+        return (void *)dropped;
+}
+
+static void *test_consumer(void *arg)
+{
+        size_t *received = arg;
+        while (true)
+        {
+                pthread_mutex_lock(&test_shared.lock);
+                bool empty = test_shared.fifo.count == 0;
+                bool done = test_shared.done == TEST_PRODUCERS;
+                if (!empty)
+                        test_shared.fifo.count--;
+                pthread_mutex_unlock(&test_shared.lock);
+                if (!empty)
+                {
+                        watermark_queue_received(WATERMARK_QUEUE_RSSI, test_clock_us());
+                        (*received)++;
+                }
+                else if (done)
+                {
+                        break;
+                }
+                else
+                {
+                        sched_yield();
+                }
+        }
+        return NULL;
+}
+
+static void test_threads(size_t operations)
+{
+        unsigned violations = test_violations;
+        watermark_queue_register(WATERMARK_QUEUE_RSSI, TEST_CAPACITY);
+        watermark_reset();
+        test_per_producer = operations;
+
+        pthread_t producers[TEST_PRODUCERS], consumer;
+        size_t received = 0, dropped = 0;
+        pthread_create(&consumer, NULL, test_consumer, &received);
+        for (size_t i = 0; i < TEST_PRODUCERS; i++)
+                pthread_create(&producers[i], NULL, test_producer, NULL);
+        for (size_t i = 0; i < TEST_PRODUCERS; i++)
+        {
+                void *result;
+                pthread_join(producers[i], &result);
+                dropped += (size_t)result;
+        }
+        pthread_join(consumer, NULL);
+
+        watermark_queue_stat_t stat;
+        TEST_CHECK(watermark_queue_get(WATERMARK_QUEUE_RSSI, &stat));
+        TEST_CHECK(stat.sent + stat.dropped == TEST_PRODUCERS * operations);
+        TEST_CHECK(stat.dropped == dropped);
+        TEST_CHECK(stat.received == received);
+        TEST_CHECK(stat.received == stat.sent);
+        TEST_CHECK((stat.peak > 0) && (stat.peak <= TEST_CAPACITY));
+        TEST_CHECK(stat.latency_samples > 0);
+        TEST_CHECK(stat.latency_avg_us <= stat.latency_max_us);
+        printf("threads: %d producers, %u sent, %u dropped, peak %u, %u samples, avg %u us, max %u us, %s\n", TEST_PRODUCERS, stat.sent,
+               stat.dropped, stat.peak, stat.latency_samples, stat.latency_avg_us, stat.latency_max_us,
+               (test_violations != violations) ? "FAIL" : "OK");
+}
+
+int main(int argc, char **argv)
+{
+        size_t operations = 200000;
+        if (argc > 1)
+                operations = atoi(argv[1]);
+        srand(argc > 2 ? atoi(argv[2]) : 1);
+
+        printf("%-16s %8s %8s %8s %5s %8s %8s %8s\n", "queue", "sent", "dropped", "received", "peak", "samples", "avg_us", "max_us");
+        test_queue(WATERMARK_QUEUE_ESPNOW, operations, 0);
+        test_queue(WATERMARK_QUEUE_BUTTON, operations, UINT32_MAX - 1000000); // esp_timer_get_time truncated, wraps early on
+        test_tasks();
+        test_reset_and_format();
+        test_threads(operations / 10);
+
+        printf("%s, %u violation(s)\n", test_violations ? "FAIL" : "OK", test_violations);
+        return test_violations ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+
+#include "bundle_pack.h"
+
+#include <string.h>
+
+void bundle_pack_init(bundle_pack_t *pack, size_t capacity)
+{
+        memset(pack, 0, sizeof(bundle_pack_t));
+        pack->capacity = (capacity < BUNDLE_PACK_MAX_PAYLOAD) ? capacity : BUNDLE_PACK_MAX_PAYLOAD;
+}
+
+bundle_pack_result_t bundle_pack_add(bundle_pack_t *pack, uint8_t type, const void *data, size_t len, bool once, int64_t now_us)
+{
+        if (once && pack->pending_once)
+                return BUNDLE_PACK_COALESCED;
+
+        size_t record_len = sizeof(bundle_pack_record_t) + len;
+        if ((len > UINT8_MAX) || (pack->len + record_len > pack->capacity))
+                return BUNDLE_PACK_FULL;
+
+        if (pack->count == 0)
+                pack->first_queued_us = now_us;
+        bundle_pack_record_t *record = (bundle_pack_record_t *)(pack->buffer + pack->len);
+        record->type = type;
+        record->len = len;
+        if (len)
+                memcpy(record->payload, data, len);
+        pack->len += record_len;
+        pack->count++;
+        pack->pending_once |= once;
+        pack->queued_us += now_us;
+        return BUNDLE_PACK_ADDED;
+}
+
+/* Empties the pack once its contents are sent, returns the total time its records waited */
+int64_t bundle_pack_take(bundle_pack_t *pack, int64_t now_us)
+{
+        int64_t waited_us = pack->count * now_us - pack->queued_us;
+        pack->count = 0;
+        pack->len = 0;
+        pack->pending_once = false;
+        pack->queued_us = 0;
+        return waited_us;
+}
+
+/*
+ * Record at `*pos` of a received bundle ending at `end`, `*pos` moves past
+ * it. NULL at the end, and for a truncated record with `*pos` left on it.
+ * */
+const bundle_pack_record_t *bundle_pack_next(const uint8_t **pos, const uint8_t *end)
+{
+        if (*pos + sizeof(bundle_pack_record_t) > end)
+                return NULL;
+        const bundle_pack_record_t *record = (const bundle_pack_record_t *)*pos;
+        if (record->payload + record->len > end)
+                return NULL;
+        *pos = record->payload + record->len;
+        return record;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The record list of one ESPNOW_PARAM_TYPE_BUNDLE frame while it fills up:
+ * TLV records, a type byte, a length byte and the payload, appended until
+ * the next one would not fit in `capacity`. A record added with `once` is
+ * dropped while another one added that way is still waiting, one pending
+ * ACK per peer is enough.
+ *
+ * The queue time of every record is summed up, bundle_pack_take returns
+ * how long they waited in total when the bundle leaves.
+ *
+ * Not thread safe. No IDF headers, runs on a host as is.
+ * */
+
+#define BUNDLE_PACK_MAX_PAYLOAD (250) // ESP_NOW_MAX_DATA_LEN, the capacity is less by the frame header
+
+typedef struct
+{
+        uint8_t type; // espnow_param_type_t
+        uint8_t len;  // Length of payload, unit: byte.
+        uint8_t payload[0];
+} __attribute__((packed)) bundle_pack_record_t;
+
+typedef struct
+{
+        int64_t first_queued_us;
+        int64_t queued_us; // Sum of the queue times of the records
+        size_t capacity;
+        size_t len;
+        uint8_t count;
+        bool pending_once; // A record added with `once` is waiting
+        uint8_t buffer[BUNDLE_PACK_MAX_PAYLOAD];
+} bundle_pack_t;
+
+typedef enum
+{
+        BUNDLE_PACK_ADDED,
+        BUNDLE_PACK_COALESCED, // Dropped for a `once` record already waiting
+        BUNDLE_PACK_FULL,      // Does not fit, take the bundle and add again
+} bundle_pack_result_t;
+
+void bundle_pack_init(bundle_pack_t *pack, size_t capacity);
+bundle_pack_result_t bundle_pack_add(bundle_pack_t *pack, uint8_t type, const void *data, size_t len, bool once, int64_t now_us);
+int64_t bundle_pack_take(bundle_pack_t *pack, int64_t now_us);
+const bundle_pack_record_t *bundle_pack_next(const uint8_t **pos, const uint8_t *end);
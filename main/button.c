@@ -15,6 +15,9 @@ typedef struct
 uint64_t button_pinmask = 0;
 button_data_t button_data[BUTTON_MAX_ARRAY_SIZE];
 QueueHandle_t button_queue = NULL;
+static uint8_t button_queue_storage[BUTTON_QUEUE_DEPTH * sizeof(button_event_t)];
+static StaticQueue_t button_queue_buffer;
+_Static_assert(sizeof(button_queue_storage) + sizeof(button_queue_buffer) <= MEM_BUDGET_BUTTON_BYTES, "button queue over budget");
 TaskHandle_t button_task_handle = NULL;
 
 static void update_button(button_data_t *button)
@@ -61,7 +64,7 @@ static void button_send_event(button_data_t *button, const button_state_t prev_s
             .new_state = button->state,
         };
 
-        if (xQueueSend(button_queue, &new_state, 0) != pdTRUE)
+        if (!watermark_queue_send(WATERMARK_QUEUE_BUTTON, button_queue, &new_state))
                 LOG_WARNING("Send queue failed");
 }
 
@@ -117,7 +120,7 @@ static void button_task(void *pvParameter)
                                 button_send_event(&button_data[idx], old_state);
                         }
                 }
-                vTaskDelay(pdMS_TO_TICKS(10));
+                power_manager_wait();
         }
 }
 
@@ -130,16 +133,17 @@ QueueHandle_t button_init(void)
         }
 
         // Initialize queue
-        button_queue = xQueueCreate(BUTTON_QUEUE_DEPTH, sizeof(button_event_t)); // TODO: statically allow memory
+        button_queue = xQueueCreateStatic(BUTTON_QUEUE_DEPTH, sizeof(button_event_t), button_queue_storage, &button_queue_buffer);
         if (button_queue == NULL)
         {
                 LOG_ERROR("Create queue falied");
                 button_deinit();
                 return NULL;
         }
+        watermark_queue_register(WATERMARK_QUEUE_BUTTON, BUTTON_QUEUE_DEPTH);
 
         // Spawn a task to monitor the pins
-        xTaskCreate(button_task, "button_task", 4096, NULL, 10, &button_task_handle);
+        button_task_handle = task_table_create(TASK_ID_BUTTON, button_task, NULL);
 
         return button_queue;
 }
@@ -185,7 +189,7 @@ void button_deinit(void)
 {
         if (button_task_handle != NULL)
         {
-                vTaskDelete(button_task_handle);
+                task_table_delete(TASK_ID_BUTTON);
                 button_task_handle = NULL;
         }
         if (button_queue != NULL)
@@ -15,6 +15,8 @@
 #include "esp_timer.h"
 
 #include "logging.h"
+#include "power_manager.h"
+#include "task_table.h"
 
 #define BUTTON_PRESSED_HISTORY (0x003F)
 #define BUTTON_RELEASED_HISTORY (0xF000)
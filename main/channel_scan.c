@@ -0,0 +1,328 @@
+
+#include "channel_scan.h"
+
+static const char *TAG = "channel_scan";
+
+static channel_scan_stat_t channel_scan_stats[CHANNEL_SCORE_NUM_CHANNELS];
+static esp_timer_handle_t channel_switch_timer = NULL;
+static uint8_t channel_switch_pending = 0; // Channel the switch timer moves to
+static uint8_t channel_preferred = CHANNEL_SCAN_RENDEZVOUS_CHANNEL;
+static uint8_t channel_announced = 0;      // Last channel announced to the peers
+static int64_t channel_last_link_us = 0;
+static int64_t channel_switched_us = 0;
+static uint8_t channel_fallbacks = 0;      // From the preferred channel since the last scan or stable link
+
+static int64_t channel_switch_at_us = 0;     // When the switch timer fires
+static uint8_t channel_announce_rounds = 0;  // Rounds still to send
+static uint8_t channel_announce_missing = 0; // Registered peers, by entry bit, the current round has not reached
+static bool channel_announce_reached = false; // Some peer took an announcement
+static int64_t channel_announce_next_us = 0;
+
+_Static_assert(ESP_CONNECTION_MAX_PEERS <= 8, "channel_announce_missing holds one bit per peer");
+
+// wifi_phy_rate_t of legacy frames, unit: kbit/s
+static const uint16_t CHANNEL_SCAN_LEGACY_RATE_KBPS[16] = {
+    [0x00] = 1000, [0x01] = 2000, [0x02] = 5500, [0x03] = 11000,
+    [0x05] = 2000, [0x06] = 5500, [0x07] = 11000, [0x08] = 48000,
+    [0x09] = 24000, [0x0A] = 12000, [0x0B] = 6000, [0x0C] = 54000,
+    [0x0D] = 36000, [0x0E] = 18000, [0x0F] = 9000};
+
+// HT20 MCS0-7 with long guard interval, unit: kbit/s
+static const uint16_t CHANNEL_SCAN_HT_RATE_KBPS[8] = {6500, 13000, 19500, 26000, 39000, 52000, 58500, 65000};
+
+/* Rough airtime of a received frame: PLCP preamble plus payload at the reported rate */
+static uint32_t channel_scan_airtime_us(const wifi_pkt_rx_ctrl_t *rx_ctrl)
+{
+        uint32_t rate_kbps;
+        uint32_t preamble_us;
+        if (rx_ctrl->sig_mode == 0)
+        {
+                rate_kbps = CHANNEL_SCAN_LEGACY_RATE_KBPS[rx_ctrl->rate & 0x0F];
+                preamble_us = (rx_ctrl->rate < 0x08) ? 192 : 20; // DSSS long preamble or OFDM
+        }
+        else
+        {
+                rate_kbps = CHANNEL_SCAN_HT_RATE_KBPS[rx_ctrl->mcs & 0x07];
+                preamble_us = 36;
+        }
+        if (rate_kbps == 0)
+                rate_kbps = 1000;
+        return preamble_us + (uint32_t)rx_ctrl->sig_len * 8 * 1000 / rate_kbps;
+}
+
+static void channel_scan_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+        const wifi_promiscuous_pkt_t *ppkt = (wifi_promiscuous_pkt_t *)buf;
+        uint8_t channel = ppkt->rx_ctrl.channel;
+        if ((channel < CHANNEL_SCORE_MIN_CHANNEL) || (channel > CHANNEL_SCORE_MAX_CHANNEL))
+                return;
+
+        channel_scan_stat_t *stat = &channel_scan_stats[channel - CHANNEL_SCORE_MIN_CHANNEL];
+        stat->frames++;
+        stat->busy_us += channel_scan_airtime_us(&ppkt->rx_ctrl);
+        if (ppkt->rx_ctrl.rssi > stat->rssi_max)
+                stat->rssi_max = ppkt->rx_ctrl.rssi;
+}
+
+static void channel_switch_timer_cb(void *arg)
+{
+        if (channel_switch_pending == 0)
+                return;
+        if (espnow_set_channel(channel_switch_pending) == ESP_OK)
+        {
+                // Settled here, so neither side announces a move back
+                channel_preferred = channel_switch_pending;
+                channel_announced = channel_switch_pending;
+                channel_last_link_us = esp_timer_get_time();
+                channel_switched_us = channel_last_link_us;
+        }
+        channel_switch_pending = 0;
+}
+
+esp_err_t channel_scan_init(void)
+{
+        if (channel_switch_timer != NULL)
+        {
+                LOG_WARNING("Already initialized, timer=0x%X", (uintptr_t)channel_switch_timer);
+                return ESP_ERR_INVALID_STATE;
+        }
+
+        const esp_timer_create_args_t timer_args = {
+            .callback = channel_switch_timer_cb,
+            .name = "channel_switch",
+        };
+        return esp_timer_create(&timer_args, &channel_switch_timer);
+}
+
+/*
+ * Hops every channel for `dwell_ms` and scores them, blocks for about
+ * 13 * dwell_ms and the link is down meanwhile. Promiscuous reception is
+ * handed back to `resume_cb`, or turned off when it is NULL.
+ * */
+esp_err_t channel_scan_run(channel_scan_result_t *result, uint32_t dwell_ms, wifi_promiscuous_cb_t resume_cb)
+{
+        if (result == NULL)
+        {
+                LOG_ERROR("NULL pointer, result=0x%X", (uintptr_t)result);
+                return ESP_ERR_INVALID_ARG;
+        }
+
+        uint8_t home = espnow_get_channel();
+        for (size_t i = 0; i < CHANNEL_SCORE_NUM_CHANNELS; i++)
+        {
+                channel_scan_stats[i] = (channel_scan_stat_t){
+                    .channel = CHANNEL_SCORE_MIN_CHANNEL + i,
+                    .rssi_max = INT8_MIN,
+                };
+        }
+
+        ESP_ERROR_CHECK(esp_wifi_set_promiscuous_rx_cb(&channel_scan_rx_cb));
+        ESP_ERROR_CHECK(esp_wifi_set_promiscuous(true));
+        for (size_t i = 0; i < CHANNEL_SCORE_NUM_CHANNELS; i++)
+        {
+                ESP_ERROR_CHECK(esp_wifi_set_channel(channel_scan_stats[i].channel, WIFI_SECOND_CHAN_NONE));
+                int64_t start_us = esp_timer_get_time();
+                vTaskDelay(pdMS_TO_TICKS(dwell_ms));
+                channel_scan_stats[i].dwell_ms = (esp_timer_get_time() - start_us) / 1000;
+        }
+        ESP_ERROR_CHECK(esp_wifi_set_channel(home, WIFI_SECOND_CHAN_NONE));
+
+        if (resume_cb != NULL)
+                ESP_ERROR_CHECK(esp_wifi_set_promiscuous_rx_cb(resume_cb));
+        else
+                ESP_ERROR_CHECK(esp_wifi_set_promiscuous(false));
+
+        memcpy(result->stats, channel_scan_stats, sizeof(channel_scan_stats));
+        result->best = channel_score_pick(result->stats, CHANNEL_SCORE_NUM_CHANNELS, home);
+        for (size_t i = 0; i < CHANNEL_SCORE_NUM_CHANNELS; i++)
+        {
+                channel_scan_stat_t *stat = &result->stats[i];
+                LOG_INFO("scan ch:%2d dwell_ms:%4d frames:%5d busy_us:%7d rssi_max:%4d score:%d",
+                         stat->channel, stat->dwell_ms, stat->frames, stat->busy_us, stat->rssi_max,
+                         channel_score(result->stats, CHANNEL_SCORE_NUM_CHANNELS, i));
+        }
+        LOG_INFO("Quietest channel: %d, current: %d", result->best, home);
+        channel_preferred = result->best;
+        channel_fallbacks = 0;
+        return ESP_OK;
+}
+
+/*
+ * Takes `channel` as already agreed, for a link resumed from the pairing
+ * cache: no scan, no announce, and the usual fallback once the link stays down.
+ * */
+void channel_scan_adopt(uint8_t channel)
+{
+        LOG_INFO("Adopting channel %d, scan skipped", channel);
+        channel_preferred = channel;
+        channel_announced = channel;
+        channel_last_link_us = esp_timer_get_time();
+}
+
+static void channel_switch_schedule(uint8_t channel, uint16_t countdown_ms)
+{
+        if (channel_switch_timer == NULL)
+        {
+                LOG_ERROR("NULL pointer, channel_switch_timer=0x%X", (uintptr_t)channel_switch_timer);
+                return;
+        }
+        esp_timer_stop(channel_switch_timer);
+        channel_switch_pending = channel;
+        channel_switch_at_us = esp_timer_get_time() + (int64_t)countdown_ms * 1000;
+        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_start_once(channel_switch_timer, (uint64_t)countdown_ms * 1000));
+}
+
+static uint8_t channel_switch_registered_peers(const esp_connection_handle_t *handle)
+{
+        uint8_t peers = 0;
+        for (size_t i = 0; i < handle->size; i++)
+                if (handle->entries[i].registered)
+                        peers |= 1 << i;
+        return peers;
+}
+
+/* Sends the announcement, with the countdown left, to the registered peers the current round has not reached */
+static void channel_switch_announce_round(esp_connection_handle_t *handle, int64_t now)
+{
+        uint8_t registered = channel_switch_registered_peers(handle);
+        channel_announce_missing = (channel_announce_missing == 0) ? registered : (channel_announce_missing & registered); // A retry skips peers removed meanwhile
+
+        channel_switch_pkt_t packet = {.channel = channel_announced, .countdown_ms = (channel_switch_at_us - now) / 1000};
+        espnow_send_param_t send_param;
+        espnow_default_send_param(&send_param);
+        for (size_t i = 0; i < handle->size; i++)
+        {
+                if (!(channel_announce_missing & (1 << i)))
+                        continue;
+                esp_peer_t *peer = handle->entries + i;
+                espnow_get_send_param_unicast(&send_param, peer->mac);
+                esp_err_t ret = espnow_tx_send(TX_SCHED_CLASS_HANDSHAKE, &send_param, ESPNOW_PARAM_TYPE_CHANNEL_SWITCH, &packet, sizeof(packet),
+                                               ESPNOW_TX_FLAG_LATEST);
+                if (ret != ESP_OK)
+                {
+                        LOG_VERBOSE("Announce to " MACSTR " failed: %s, retrying", MAC2STR(peer->mac), esp_err_to_name(ret));
+                        continue;
+                }
+                channel_announce_missing &= ~(1 << i);
+                channel_announce_reached = true;
+        }
+}
+
+/* Sends the next round when it is due, calls the switch off once the countdown is too short and no peer took any */
+static void channel_switch_announce_poll(esp_connection_handle_t *handle, int64_t now)
+{
+        if ((channel_announce_rounds == 0) || (now < channel_announce_next_us))
+                return;
+
+        bool late = channel_switch_at_us - now < CHANNEL_SWITCH_ANNOUNCE_LEAD_MS * 1000;
+        if (!late)
+        {
+                channel_switch_announce_round(handle, now);
+                if (channel_announce_missing != 0)
+                {
+                        channel_announce_next_us = now + CHANNEL_SWITCH_ANNOUNCE_RETRY_MS * 1000;
+                        return;
+                }
+                channel_announce_next_us = now + CHANNEL_SWITCH_ANNOUNCE_INTERVAL_MS * 1000;
+                if (--channel_announce_rounds > 0)
+                        return;
+        }
+
+        channel_announce_rounds = 0;
+        channel_announce_missing = 0;
+        if (channel_announce_reached)
+                return;
+        LOG_WARNING("No peer took the switch to channel %d, called off", channel_announced);
+        esp_timer_stop(channel_switch_timer);
+        channel_switch_pending = 0;
+        channel_announced = 0;
+        channel_announce_next_us = now + CHANNEL_SWITCH_FALLBACK_US; // Not before the link had time to settle
+}
+
+/* Tells the registered peers to move to `channel` and follows after the countdown, the rounds are sent by channel_switch_update */
+esp_err_t channel_switch_announce(esp_connection_handle_t *handle, uint8_t channel)
+{
+        if ((handle == NULL) || (handle->entries == NULL))
+        {
+                LOG_ERROR("NULL pointer, handle=0x%X, handle->entries=0x%X", (uintptr_t)handle, (uintptr_t)handle->entries);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if ((channel < CHANNEL_SCORE_MIN_CHANNEL) || (channel > CHANNEL_SCORE_MAX_CHANNEL))
+        {
+                LOG_WARNING("Invalid channel %d", channel);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if (channel_switch_registered_peers(handle) == 0)
+        {
+                LOG_WARNING("No registered peer to announce channel %d to", channel);
+                return ESP_ERR_INVALID_STATE;
+        }
+
+        LOG_INFO("Announcing switch to channel %d in %d ms", channel, CHANNEL_SWITCH_COUNTDOWN_MS);
+        channel_announced = channel;
+        channel_announce_rounds = CHANNEL_SWITCH_ANNOUNCE_REPEAT;
+        channel_announce_missing = 0;
+        channel_announce_reached = false;
+        channel_switch_schedule(channel, CHANNEL_SWITCH_COUNTDOWN_MS);
+        channel_announce_next_us = esp_timer_get_time();
+        channel_switch_announce_poll(handle, channel_announce_next_us);
+        return ESP_OK;
+}
+
+/* Handler for ESPNOW_PARAM_TYPE_CHANNEL_SWITCH, repeated announcements just restart the countdown */
+void channel_switch_handler(esp_peer_t *peer, const void *payload, size_t len, void *arg)
+{
+        const channel_switch_pkt_t *packet = payload;
+        if ((packet->channel < CHANNEL_SCORE_MIN_CHANNEL) || (packet->channel > CHANNEL_SCORE_MAX_CHANNEL))
+        {
+                LOG_WARNING("Invalid channel %d from peer " MACSTR, packet->channel, MAC2STR(peer->mac));
+                return;
+        }
+        if (packet->channel == espnow_get_channel())
+                return;
+        LOG_INFO("Peer " MACSTR " moves to channel %d in %d ms", MAC2STR(peer->mac), packet->channel, packet->countdown_ms);
+        channel_switch_schedule(packet->channel, packet->countdown_ms);
+}
+
+/*
+ * Call periodically: sends the announcement rounds, announces the preferred
+ * channel once connected, falls back to rendezvous when the link is gone.
+ * */
+void channel_switch_update(esp_connection_handle_t *handle)
+{
+        if (handle == NULL)
+        {
+                LOG_ERROR("NULL pointer, handle=0x%X", (uintptr_t)handle);
+                return;
+        }
+
+        int64_t now = esp_timer_get_time();
+        channel_switch_announce_poll(handle, now);
+
+        uint8_t channel = espnow_get_channel();
+        if (handle->remote_connected)
+        {
+                channel_last_link_us = now;
+                if ((channel == channel_preferred) && (channel_fallbacks > 0) && (now - channel_switched_us > CHANNEL_SWITCH_STABLE_US))
+                        channel_fallbacks = 0;
+                if ((channel_preferred != channel) && (channel_preferred != channel_announced) && (channel_switch_pending == 0) &&
+                    (now >= channel_announce_next_us))
+                        channel_switch_announce(handle, channel_preferred);
+                return;
+        }
+
+        if ((channel != CHANNEL_SCAN_RENDEZVOUS_CHANNEL) && (channel_switch_pending == 0) &&
+            (now - channel_last_link_us > CHANNEL_SWITCH_FALLBACK_US))
+        {
+                // The preferred channel stays, it is announced again once the peer is found on rendezvous
+                if ((channel == channel_preferred) && (++channel_fallbacks >= CHANNEL_SWITCH_FALLBACK_LIMIT))
+                {
+                        LOG_WARNING("Link lost %d times on channel %d, staying on rendezvous until the next scan", channel_fallbacks, channel);
+                        channel_preferred = CHANNEL_SCAN_RENDEZVOUS_CHANNEL;
+                }
+                LOG_WARNING("No peer on channel %d, back to rendezvous channel %d", channel, CHANNEL_SCAN_RENDEZVOUS_CHANNEL);
+                channel_announced = 0;
+                espnow_set_channel(CHANNEL_SCAN_RENDEZVOUS_CHANNEL);
+                channel_last_link_us = now;
+        }
+}
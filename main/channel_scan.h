@@ -0,0 +1,62 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "channel_score.h"
+#include "espnow.h"
+#include "espnow_tx.h"
+#include "logging.h"
+
+/*
+ * Both ends boot on CHANNEL_SCAN_RENDEZVOUS_CHANNEL. The remote scans the band
+ * in promiscuous mode, and once a peer is connected announces the quietest
+ * channel with a countdown, then both sides switch together. A side that
+ * loses every peer after a switch falls back to the rendezvous channel and
+ * announces its preferred channel again once reconnected, up to
+ * CHANNEL_SWITCH_FALLBACK_LIMIT times before it stays on rendezvous.
+ *
+ * The announcement goes to the registered peers only, in rounds spaced by
+ * CHANNEL_SWITCH_ANNOUNCE_INTERVAL_MS, each with the countdown left. A peer
+ * whose frame the TX queue turned away is retried within the round. When
+ * no peer took any of it, the switch is called off.
+ * */
+
+#define CHANNEL_SCAN_DWELL_MS (120)
+#define CHANNEL_SCAN_RENDEZVOUS_CHANNEL (1)
+#define CHANNEL_SWITCH_COUNTDOWN_MS (300)
+#define CHANNEL_SWITCH_ANNOUNCE_REPEAT (3)
+#define CHANNEL_SWITCH_ANNOUNCE_INTERVAL_MS (80) // Between rounds, a lost frame is not followed by its repeat at once
+#define CHANNEL_SWITCH_ANNOUNCE_RETRY_MS (10)    // After the TX queue turned a frame away
+#define CHANNEL_SWITCH_ANNOUNCE_LEAD_MS (60)     // No round with less countdown left
+#define CHANNEL_SWITCH_FALLBACK_US (3 * ONE_SECOND_IN_US)
+#define CHANNEL_SWITCH_FALLBACK_LIMIT (3)        // Falls back from the preferred channel before it is given up until the next scan
+#define CHANNEL_SWITCH_STABLE_US (30 * ONE_SECOND_IN_US) // Connected on the preferred channel this long clears the fallbacks
+
+typedef struct
+{
+        uint8_t channel;
+        uint16_t countdown_ms; // Time from reception until the switch
+} __packed channel_switch_pkt_t;
+
+typedef struct
+{
+        channel_scan_stat_t stats[CHANNEL_SCORE_NUM_CHANNELS];
+        uint8_t best;
+} channel_scan_result_t;
+
+esp_err_t channel_scan_init(void);
+esp_err_t channel_scan_run(channel_scan_result_t *result, uint32_t dwell_ms, wifi_promiscuous_cb_t resume_cb);
+void channel_scan_adopt(uint8_t channel);
+esp_err_t channel_switch_announce(esp_connection_handle_t *handle, uint8_t channel);
+void channel_switch_handler(esp_peer_t *peer, const void *payload, size_t len, void *arg);
+void channel_switch_update(esp_connection_handle_t *handle);
@@ -0,0 +1,60 @@
+
+#include "channel_score.h"
+
+static uint32_t channel_score_own(const channel_scan_stat_t *stat)
+{
+        if (stat->dwell_ms == 0)
+                return UINT32_MAX / (2 * CHANNEL_SCORE_OVERLAP + 1);
+
+        uint32_t busy_permille = (uint64_t)stat->busy_us / stat->dwell_ms; // us per ms is already per-mille
+        uint32_t frames_per_s = (uint64_t)stat->frames * 1000 / stat->dwell_ms;
+        int32_t rssi_over_floor = (stat->frames && stat->rssi_max > CHANNEL_SCORE_RSSI_FLOOR) ? stat->rssi_max - CHANNEL_SCORE_RSSI_FLOOR : 0;
+
+        // Airtime dominates, frame rate catches many short frames, a loud neighbour costs retries
+        return 4 * busy_permille + frames_per_s / 2 + 2 * rssi_over_floor;
+}
+
+/* Score of stats[index], traffic on overlapping channels counts with a weight falling off with distance */
+uint32_t channel_score(const channel_scan_stat_t *stats, size_t count, size_t index)
+{
+        if ((stats == NULL) || (index >= count))
+                return UINT32_MAX;
+
+        uint32_t score = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+                int distance = (int)stats[i].channel - (int)stats[index].channel;
+                if (distance < 0)
+                        distance = -distance;
+                if (distance > CHANNEL_SCORE_OVERLAP)
+                        continue;
+                score += channel_score_own(&stats[i]) * (CHANNEL_SCORE_OVERLAP + 1 - distance) / (CHANNEL_SCORE_OVERLAP + 1);
+        }
+        return score;
+}
+
+/* Quietest channel, `current` is kept unless another one beats it by CHANNEL_SCORE_HYSTERESIS percent */
+uint8_t channel_score_pick(const channel_scan_stat_t *stats, size_t count, uint8_t current)
+{
+        if ((stats == NULL) || (count == 0))
+                return current;
+
+        size_t best = 0;
+        uint32_t best_score = UINT32_MAX;
+        uint32_t current_score = UINT32_MAX;
+        for (size_t i = 0; i < count; i++)
+        {
+                uint32_t score = channel_score(stats, count, i);
+                if (stats[i].channel == current)
+                        current_score = score;
+                if (score < best_score)
+                {
+                        best = i;
+                        best_score = score;
+                }
+        }
+
+        if ((current_score != UINT32_MAX) && ((uint64_t)best_score * 100 >= (uint64_t)current_score * (100 - CHANNEL_SCORE_HYSTERESIS)))
+                return current;
+        return stats[best].channel;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Channel scoring, kept free of IDF headers so recorded scan lines can be
+ * replayed through it on a Linux host. Lower score means quieter channel.
+ * */
+
+#define CHANNEL_SCORE_MIN_CHANNEL (1)
+#define CHANNEL_SCORE_MAX_CHANNEL (13)
+#define CHANNEL_SCORE_NUM_CHANNELS (CHANNEL_SCORE_MAX_CHANNEL - CHANNEL_SCORE_MIN_CHANNEL + 1)
+#define CHANNEL_SCORE_OVERLAP (4)      // 20 MHz channels 5 MHz apart overlap up to 4 channels away
+#define CHANNEL_SCORE_RSSI_FLOOR (-90) // Interferers below this do not count
+#define CHANNEL_SCORE_HYSTERESIS (25)  // Percent better a channel must be before leaving the current one
+
+typedef struct
+{
+        uint8_t channel;
+        uint32_t dwell_ms; // Time spent listening on the channel
+        uint32_t frames;   // Frames heard
+        uint32_t busy_us;  // Estimated airtime of those frames
+        int8_t rssi_max;   // Strongest frame heard
+} channel_scan_stat_t;
+
+uint32_t channel_score(const channel_scan_stat_t *stats, size_t count, size_t index);
+uint8_t channel_score_pick(const channel_scan_stat_t *stats, size_t count, uint8_t current);
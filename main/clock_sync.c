@@ -0,0 +1,119 @@
+
+#include "clock_sync.h"
+
+/* Loop gains as right shifts of the error, proportional on the offset and integral on the skew */
+#define CLOCK_SYNC_LOCK_KP_SHIFT (1)
+#define CLOCK_SYNC_LOCK_KI_SHIFT (2)
+#define CLOCK_SYNC_KP_SHIFT (3)
+#define CLOCK_SYNC_KI_SHIFT (6)
+
+void clock_sync_reset(clock_sync_t *sync)
+{
+        *sync = (clock_sync_t){0};
+}
+
+static int64_t clock_sync_predict(const clock_sync_t *sync, int64_t local_us)
+{
+        return sync->offset_us + (local_us - sync->at_us) * sync->skew_ppb / 1000000000;
+}
+
+/* Slowest round trip still taken as a direct one */
+static uint32_t clock_sync_rtt_limit(clock_sync_t *sync, uint32_t rtt_us)
+{
+        sync->rtt_us[sync->rtt_head] = rtt_us;
+        sync->rtt_head = (sync->rtt_head + 1) % CLOCK_SYNC_RTT_WINDOW;
+        if (sync->rtt_count < CLOCK_SYNC_RTT_WINDOW)
+                sync->rtt_count++;
+
+        // The fastest of the window, so the floor follows a path that became slower for good
+        uint32_t rtt_min = UINT32_MAX;
+        for (size_t i = 0; i < sync->rtt_count; i++)
+        {
+                if (sync->rtt_us[i] < rtt_min)
+                        rtt_min = sync->rtt_us[i];
+        }
+        sync->rtt_min_us = rtt_min;
+        uint32_t slack = rtt_min / 4;
+        return rtt_min + ((slack > CLOCK_SYNC_RTT_SLACK_US) ? slack : CLOCK_SYNC_RTT_SLACK_US);
+}
+
+/* One exchange, see clock_sync.h for the timestamps. Returns true when it moved the model */
+bool clock_sync_update(clock_sync_t *sync, int64_t t1, int64_t t2, int64_t t3, int64_t t4)
+{
+        sync->samples++;
+        int64_t rtt = (t4 - t1) - (t3 - t2);
+        if ((t4 < t1) || (t3 < t2) || (rtt < 0) || (rtt > UINT32_MAX))
+        {
+                sync->filtered++;
+                return false;
+        }
+        if (rtt > clock_sync_rtt_limit(sync, rtt))
+        {
+                sync->filtered++;
+                return false;
+        }
+
+        const int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+        const int64_t mid = t1 + (t4 - t1) / 2;
+        if (!sync->valid)
+        {
+                sync->at_us = mid;
+                sync->offset_us = offset;
+                sync->skew_ppb = 0;
+                sync->error_us = 0;
+                sync->valid = true;
+                sync->accepted++;
+                return true;
+        }
+
+        const int64_t predicted = clock_sync_predict(sync, mid);
+        const int64_t error = offset - predicted;
+        if ((error > CLOCK_SYNC_STEP_US) || (error < -CLOCK_SYNC_STEP_US))
+        {
+                // A single one is a glitch, a run of them a peer that restarted
+                if (++sync->step_count >= CLOCK_SYNC_STEP_COUNT)
+                {
+                        sync->valid = false;
+                        sync->step_count = 0;
+                        sync->accepted = 0;
+                        sync->steps++;
+                }
+                return false;
+        }
+        sync->step_count = 0;
+
+        const bool locking = sync->accepted < CLOCK_SYNC_LOCK_SAMPLES;
+        const int64_t dt = mid - sync->at_us;
+        if (dt > 0)
+        {
+                int64_t skew = sync->skew_ppb + ((error * 1000000000 / dt) >> (locking ? CLOCK_SYNC_LOCK_KI_SHIFT : CLOCK_SYNC_KI_SHIFT));
+                if (skew > CLOCK_SYNC_MAX_SKEW_PPB)
+                        skew = CLOCK_SYNC_MAX_SKEW_PPB;
+                if (skew < -CLOCK_SYNC_MAX_SKEW_PPB)
+                        skew = -CLOCK_SYNC_MAX_SKEW_PPB;
+                sync->skew_ppb = skew;
+        }
+        sync->offset_us = predicted + (error >> (locking ? CLOCK_SYNC_LOCK_KP_SHIFT : CLOCK_SYNC_KP_SHIFT));
+        sync->at_us = mid;
+        sync->error_us = error;
+        sync->accepted++;
+        return true;
+}
+
+bool clock_sync_valid(const clock_sync_t *sync)
+{
+        return sync->valid;
+}
+
+int64_t clock_sync_to_peer(const clock_sync_t *sync, int64_t local_us)
+{
+        return local_us + clock_sync_predict(sync, local_us);
+}
+
+/* Inverse of clock_sync_to_peer, the skew is small enough for a second pass to settle it */
+int64_t clock_sync_to_local(const clock_sync_t *sync, int64_t peer_us)
+{
+        int64_t local_us = peer_us - sync->offset_us;
+        local_us = peer_us - clock_sync_predict(sync, local_us);
+        return peer_us - clock_sync_predict(sync, local_us);
+}
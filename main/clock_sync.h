@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Model of a peer's esp_timer clock, NTP style. Each exchange gives four
+ * timestamps: t1 ping sent and t4 reply received on the local clock, t2 ping
+ * received and t3 reply sent on the peer clock.
+ *
+ *   round trip = (t4 - t1) - (t3 - t2)
+ *   offset     = ((t2 - t1) + (t3 - t4)) / 2, peer minus local
+ *
+ * An asymmetric path shifts the offset by half the difference, so only
+ * exchanges close to the fastest round trip seen lately are used, the others
+ * waited in a queue one way or the other.
+ *
+ * Offset and rate difference (skew) track the accepted samples through a PI
+ * loop, with high gains while locking and low ones once settled. Errors
+ * beyond CLOCK_SYNC_STEP_US several times in a row mean the peer restarted,
+ * the model starts over from the next sample.
+ *
+ * No IDF headers, runs on a host as is. Must match clockSyncSim.py.
+ * */
+
+#define CLOCK_SYNC_RTT_WINDOW (8)     // Round trips the fastest one is taken from
+#define CLOCK_SYNC_RTT_SLACK_US (150) // Above the fastest still accepted
+#define CLOCK_SYNC_STEP_US (5000)
+#define CLOCK_SYNC_STEP_COUNT (3)
+#define CLOCK_SYNC_LOCK_SAMPLES (16) // Accepted samples with the locking gains
+#define CLOCK_SYNC_MAX_SKEW_PPB (500 * 1000)
+
+typedef struct
+{
+        int64_t at_us;     // Local time of the last update
+        int64_t offset_us; // Peer minus local at `at_us`
+        int32_t skew_ppb;  // Peer clock rate minus local clock rate, parts per billion
+        uint32_t rtt_us[CLOCK_SYNC_RTT_WINDOW];
+        uint8_t rtt_head;
+        uint8_t rtt_count;
+        uint8_t step_count; // Consecutive errors beyond CLOCK_SYNC_STEP_US
+        bool valid;
+        int32_t error_us; // Of the last accepted sample against the model
+        uint32_t rtt_min_us;
+        uint32_t samples;
+        uint32_t accepted;
+        uint32_t filtered; // Round trip too slow
+        uint32_t steps;    // Restarts of the model
+} clock_sync_t;
+
+void clock_sync_reset(clock_sync_t *sync);
+bool clock_sync_update(clock_sync_t *sync, int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+bool clock_sync_valid(const clock_sync_t *sync);
+int64_t clock_sync_to_peer(const clock_sync_t *sync, int64_t local_us);
+int64_t clock_sync_to_local(const clock_sync_t *sync, int64_t peer_us);
@@ -0,0 +1,44 @@
+
+#include "dispatch_table.h"
+
+bool dispatch_table_register(dispatch_table_t *table, unsigned type, dispatch_fn_t handler, size_t payload_len, bool variable_len, void *arg)
+{
+        if ((type >= DISPATCH_TABLE_MAX_TYPES) || (handler == NULL) || (payload_len > UINT8_MAX))
+                return false;
+
+        table->entries[type] = (dispatch_entry_t){
+            .handler = handler,
+            .arg = arg,
+            .payload_len = payload_len,
+            .variable_len = variable_len,
+        };
+        return true;
+}
+
+/* NULL when nothing is registered for `type` */
+const dispatch_entry_t *dispatch_table_get(const dispatch_table_t *table, unsigned type)
+{
+        if ((type >= DISPATCH_TABLE_MAX_TYPES) || (table->entries[type].handler == NULL))
+                return NULL;
+        return &table->entries[type];
+}
+
+/* `entry` is set unless the type is unhandled, to report the expected size of a rejected payload */
+dispatch_table_result_t dispatch_table_lookup(dispatch_table_t *table, unsigned type, size_t len, const dispatch_entry_t **entry)
+{
+        *entry = dispatch_table_get(table, type);
+        if (*entry == NULL)
+        {
+                table->stat.unhandled++;
+                return DISPATCH_TABLE_UNHANDLED;
+        }
+
+        if ((*entry)->variable_len ? (len > (*entry)->payload_len) : (len != (*entry)->payload_len))
+        {
+                table->stat.bad_size++;
+                return DISPATCH_TABLE_BAD_SIZE;
+        }
+
+        table->stat.dispatched++;
+        return DISPATCH_TABLE_OK;
+}
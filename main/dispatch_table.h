@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Table of received packet handlers indexed by packet type, with the
+ * payload length each handler takes, exact or a maximum. A lookup is one
+ * index, a payload of the wrong size never reaches its handler.
+ *
+ * Handlers are kept as dispatch_fn_t, the caller casts them back to the
+ * type it registered them with, packet_handler_t on the device.
+ *
+ * Not thread safe. No IDF headers, runs on a host as is.
+ * */
+
+#define DISPATCH_TABLE_MAX_TYPES (32) // At least ESPNOW_PARAM_TYPE_MAX
+
+typedef void (*dispatch_fn_t)(void);
+
+typedef struct
+{
+        dispatch_fn_t handler;
+        void *arg;
+        uint8_t payload_len; // Exact length, or the maximum when `variable_len` is set
+        bool variable_len;
+} dispatch_entry_t;
+
+typedef struct
+{
+        size_t dispatched;
+        size_t unhandled;
+        size_t bad_size;
+} dispatch_stat_t;
+
+typedef struct
+{
+        dispatch_entry_t entries[DISPATCH_TABLE_MAX_TYPES];
+        dispatch_stat_t stat;
+} dispatch_table_t;
+
+typedef enum
+{
+        DISPATCH_TABLE_OK,
+        DISPATCH_TABLE_UNHANDLED, // Type out of range or no handler
+        DISPATCH_TABLE_BAD_SIZE,
+} dispatch_table_result_t;
+
+bool dispatch_table_register(dispatch_table_t *table, unsigned type, dispatch_fn_t handler, size_t payload_len, bool variable_len, void *arg);
+const dispatch_entry_t *dispatch_table_get(const dispatch_table_t *table, unsigned type);
+dispatch_table_result_t dispatch_table_lookup(dispatch_table_t *table, unsigned type, size_t len, const dispatch_entry_t **entry);
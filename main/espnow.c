@@ -1,12 +1,36 @@
 
 #include "espnow.h"
+#include "espnow_bundle.h"
+#include "espnow_pair.h"
+#include "espnow_tx.h"
+#include "power_manager.h"
 
 static const char *TAG = "espnow";
 
-QueueHandle_t espnow_queue;
+static espnow_event_t espnow_ring_buffer[ESPNOW_QUEUE_SIZE];
+static event_ring_t espnow_ring;
+static bool espnow_ring_ready = false;
+static uint8_t espnow_rx_frames[ESPNOW_RX_POOL_SIZE][ESPNOW_FRAME_SIZE];
+static uint8_t espnow_tx_frames[ESPNOW_TX_POOL_SIZE][ESPNOW_FRAME_SIZE];
+static frame_pool_t espnow_rx_pool;
+static frame_pool_t espnow_tx_pool;
+static esp_peer_t esp_connection_entries[ESP_CONNECTION_MAX_PEERS];
+static portMUX_TYPE espnow_tx_lock = portMUX_INITIALIZER_UNLOCKED; // Taken by senders and the Wi-Fi task, held for a few instructions
+static tx_window_shared_t espnow_tx_shared;
+static EventGroupHandle_t espnow_tx_events = NULL;
+static StaticEventGroup_t espnow_tx_events_buffer;
+
+_Static_assert(sizeof(espnow_ring_buffer) + sizeof(espnow_rx_frames) + sizeof(espnow_tx_frames) + sizeof(esp_connection_entries) +
+                       sizeof(espnow_tx_events_buffer) <=
+                   MEM_BUDGET_ESPNOW_BYTES,
+               "ESP-NOW storage over budget");
 static const uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 static esp_connection_handle_t *esp_connection_handle;
 static espnow_config_t *espnow_config;
+static _Atomic(espnow_send_hook_t) espnow_send_hook = NULL;
+static uint8_t espnow_session = 0; // Drawn in espnow_init, tells the peers this boot from the last one
+
+#define ESPNOW_TX_RELEASED_BIT BIT0
 
 espnow_config_t *espnow_wifi_default_config(espnow_config_t *config)
 {
@@ -15,12 +39,12 @@ espnow_config_t *espnow_wifi_default_config(espnow_config_t *config)
                 LOG_ERROR("NULL pointer, config=0x%X", (uintptr_t)config);
                 return NULL;
         }
-        char pmk[] = "pmk1234567890123";
-        char lmk[] = "lmk1234567890123";
-        config->mode = WIFI_MODE_AP;
-        config->wifi_interface = WIFI_IF_AP;
+        static char pmk[] = "pmk1234567890123"; // Kept by the config, and the LMK by the pairing cache
+        static char lmk[] = "lmk1234567890123";
+        config->mode = WIFI_MODE_STA; // Never connects, a station lets the power manager sleep between ESP-NOW wake windows
+        config->wifi_interface = WIFI_IF_STA;
         config->wifi_phy_rate = WIFI_PHY_RATE_LORA_250K;
-        config->esp_interface = ESP_IF_WIFI_AP;
+        config->esp_interface = ESP_IF_WIFI_STA;
         config->channel = 1;
         config->long_range = true;
         config->lmk = lmk;
@@ -39,6 +63,7 @@ espnow_send_param_t *espnow_default_send_param(espnow_send_param_t *send_param)
         memset(send_param, 0, sizeof(espnow_send_param_t));
         send_param->broadcast = ESPNOW_DATA_BROADCAST;
         memcpy(send_param->dest_mac, broadcast_mac, ESP_NOW_ETH_ALEN);
+        send_param->wait_ms = ESPNOW_SEND_WAIT_MS;
         return send_param;
 }
 
@@ -63,35 +88,151 @@ void espnow_wifi_init(espnow_config_t *espnow_config)
                 ESP_ERROR_CHECK(esp_wifi_set_protocol(espnow_config->esp_interface, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N | WIFI_PROTOCOL_LR));
 }
 
+/* Pairing cache entry of `peer` with the channel, rate and key the link runs on now */
+static pair_cache_entry_t *espnow_pair_entry(pair_cache_entry_t *entry, const esp_peer_t *peer)
+{
+        memset(entry, 0, sizeof(pair_cache_entry_t));
+        memcpy(entry->mac, peer->mac, ESP_NOW_ETH_ALEN);
+        entry->channel = espnow_get_channel();
+        entry->phy_rate = espnow_get_phy_rate();
+        entry->encrypt = false; // Peers are registered unencrypted, the LMK is kept for when they are not
+        if ((espnow_config != NULL) && (espnow_config->lmk != NULL))
+                memcpy(entry->lmk, espnow_config->lmk, PAIR_CACHE_KEY_LEN);
+        return entry;
+}
+
+/* Registers `mac` with the driver on the current channel, encrypted with `lmk` unless NULL */
+esp_err_t espnow_add_peer(const uint8_t *mac, const uint8_t *lmk)
+{
+        if ((espnow_config == NULL) || (mac == NULL))
+        {
+                LOG_ERROR("NULL pointer, espnow_config=0x%X, mac=0x%X", (uintptr_t)espnow_config, (uintptr_t)mac);
+                return ESP_ERR_INVALID_STATE;
+        }
+        if (esp_now_is_peer_exist(mac))
+                return ESP_OK;
+
+        esp_now_peer_info_t peer_info = {
+            .channel = espnow_config->channel,
+            .encrypt = (lmk != NULL),
+            .ifidx = espnow_config->esp_interface,
+        };
+        memcpy(peer_info.peer_addr, mac, ESP_NOW_ETH_ALEN);
+        if (lmk != NULL)
+                memcpy(peer_info.lmk, lmk, ESP_NOW_KEY_LEN);
+        esp_err_t ret = esp_now_add_peer(&peer_info);
+        if (ret != ESP_OK)
+                LOG_WARNING("Add peer " MACSTR " failed: %s", MAC2STR(mac), esp_err_to_name(ret));
+        return ret;
+}
+
+/* Moves the radio and every registered ESP-NOW peer to `channel` */
+esp_err_t espnow_set_channel(uint8_t channel)
+{
+        if (espnow_config == NULL)
+        {
+                LOG_ERROR("NULL pointer, espnow_config=0x%X", (uintptr_t)espnow_config);
+                return ESP_ERR_INVALID_STATE;
+        }
+
+        esp_err_t ret = esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+        if (ret != ESP_OK)
+        {
+                LOG_WARNING("Set channel %d failed: %s", channel, esp_err_to_name(ret));
+                return ret;
+        }
+        LOG_INFO("Channel %d --> %d", espnow_config->channel, channel);
+        espnow_config->channel = channel;
+
+        if (esp_connection_handle == NULL)
+                return ESP_OK;
+        for (size_t i = 0; i < esp_connection_handle->size; i++)
+        {
+                esp_peer_t *peer = esp_connection_handle->entries + i;
+                if (!esp_now_is_peer_exist(peer->mac))
+                        continue;
+                esp_now_peer_info_t peer_info = {
+                    .channel = channel,
+                    .encrypt = false,
+                    .ifidx = espnow_config->esp_interface,
+                };
+                memcpy(peer_info.peer_addr, peer->mac, ESP_NOW_ETH_ALEN);
+                ESP_ERROR_CHECK_WITHOUT_ABORT(esp_now_mod_peer(&peer_info));
+        }
+        return ESP_OK;
+}
+
+uint8_t espnow_get_channel(void)
+{
+        return (espnow_config == NULL) ? 0 : espnow_config->channel;
+}
+
+/* PHY rate of the frames this side sends, the peer picks its own */
+esp_err_t espnow_set_phy_rate(wifi_phy_rate_t rate)
+{
+        if (espnow_config == NULL)
+        {
+                LOG_ERROR("NULL pointer, espnow_config=0x%X", (uintptr_t)espnow_config);
+                return ESP_ERR_INVALID_STATE;
+        }
+
+        esp_err_t ret = esp_wifi_config_espnow_rate(espnow_config->wifi_interface, rate);
+        if (ret != ESP_OK)
+        {
+                LOG_WARNING("Set PHY rate %d failed: %s", rate, esp_err_to_name(ret));
+                return ret;
+        }
+        espnow_config->wifi_phy_rate = rate;
+        return ESP_OK;
+}
+
+wifi_phy_rate_t espnow_get_phy_rate(void)
+{
+        return (espnow_config == NULL) ? WIFI_PHY_RATE_MAX : espnow_config->wifi_phy_rate;
+}
+
 void espnow_deinit(espnow_send_param_t *send_param)
 {
+        // `send_param` belongs to the caller, only a frame still attached to it goes back to the pool
         if (send_param != NULL)
         {
-                if (send_param->buffer != NULL)
-                {
-                        free(send_param->buffer);
-                }
-                else
-                {
-                        LOG_WARNING("NULL pointer, send_param->buffer=0x%X", (uintptr_t)send_param->buffer);
-                }
-                free(send_param);
+                frame_pool_free(&espnow_tx_pool, send_param->buffer);
+                send_param->buffer = NULL;
         }
         else
         {
                 LOG_WARNING("NULL pointer, send_param=0x%X", (uintptr_t)send_param);
         }
 
-        if (espnow_queue != NULL)
+        esp_now_deinit();
+        if (espnow_ring_ready)
         {
-                vQueueDelete(espnow_queue);
-                espnow_queue = NULL;
+                // Callbacks are gone, the ring has no producer left to race with
+                espnow_event_t evt;
+                while (event_ring_pop_batch(&espnow_ring, &evt, 1))
+                        if (evt.id == ESPNOW_RECV_CB)
+                                espnow_recv_data_free(&evt.info.recv_cb);
+                espnow_ring_ready = false;
         }
         else
         {
-                LOG_WARNING("NULL queue, espnow_queue=0x%X", (uintptr_t)espnow_queue);
+                LOG_WARNING("Ring not initialized");
         }
-        esp_now_deinit();
+}
+
+/* Gives a received frame back to the pool once app_task is done with it */
+void espnow_recv_data_free(espnow_event_recv_cb_t *recv_cb)
+{
+        if (recv_cb == NULL)
+                return;
+        frame_pool_free(&espnow_rx_pool, recv_cb->data);
+        recv_cb->data = NULL;
+}
+
+/* One hook at a time, NULL removes it */
+void espnow_set_send_hook(espnow_send_hook_t hook)
+{
+        atomic_store(&espnow_send_hook, hook);
 }
 
 /* ESPNOW sending or receiving callback function is called in WiFi task.
@@ -108,13 +249,25 @@ static void espnow_send_cb(const uint8_t *mac_addr, esp_now_send_status_t status
                 return;
         }
 
+        esp_peer_t *peer = esp_connection_mac_lookup(esp_connection_handle, mac_addr);
+        if (peer != NULL)
+        {
+                portENTER_CRITICAL(&espnow_tx_lock);
+                tx_window_complete(&peer->tx_window, &espnow_tx_shared, esp_timer_get_time(), status == ESP_NOW_SEND_SUCCESS);
+                portEXIT_CRITICAL(&espnow_tx_lock);
+                xEventGroupSetBits(espnow_tx_events, ESPNOW_TX_RELEASED_BIT);
+                espnow_tx_released();
+        }
+
+        espnow_send_hook_t hook = atomic_load(&espnow_send_hook);
+        if (hook != NULL)
+                hook(mac_addr, status);
+
         evt.id = ESPNOW_SEND_CB;
         memcpy(send_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
         send_cb->status = status;
-        if (xQueueSend(espnow_queue, &evt, 0) != pdTRUE)
-        {
-                LOG_WARNING("Send callback failed to send queue");
-        }
+        // A full ring is counted by the watermark, no logging from the Wi-Fi task
+        event_ring_push(&espnow_ring, &evt);
 }
 
 static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *data, int len)
@@ -122,6 +275,7 @@ static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *
         espnow_event_t evt;
         espnow_event_recv_cb_t *recv_cb = &evt.info.recv_cb;
         uint8_t *mac_addr = recv_info->src_addr;
+        recv_cb->rx_time_us = esp_timer_get_time();
 
         if (mac_addr == NULL || data == NULL || len <= 0)
         {
@@ -131,20 +285,20 @@ static void espnow_recv_cb(const esp_now_recv_info_t *recv_info, const uint8_t *
 
         evt.id = ESPNOW_RECV_CB;
         memcpy(recv_cb->mac_addr, mac_addr, ESP_NOW_ETH_ALEN);
-        recv_cb->data = malloc(len + 1);
-        if (recv_cb->data == NULL)
-        {
-                LOG_WARNING("malloc failed");
+        if (len > ESP_NOW_MAX_DATA_LEN)
                 return;
-        }
+        recv_cb->data = frame_pool_alloc(&espnow_rx_pool);
+        if (recv_cb->data == NULL)
+                return; // Counted in espnow_rx_pool.failures, no logging from the Wi-Fi task
         memcpy(recv_cb->data, data, len);
         recv_cb->data[len] = '\0';
         recv_cb->data_len = len;
-        if (xQueueSend(espnow_queue, &evt, 0) != pdTRUE)
+        if (!event_ring_push(&espnow_ring, &evt))
         {
-                LOG_WARNING("Receive callback failed to send queue");
-                free(recv_cb->data);
+                frame_pool_free(&espnow_rx_pool, recv_cb->data);
+                return;
         }
+        power_manager_wake();
 }
 
 /* Parse received ESPNOW data. */
@@ -202,11 +356,16 @@ espnow_send_param_t *espnow_payload_create(espnow_send_param_t *send_param, void
                 return NULL;
         }
 
+        if (sizeof(espnow_data_t) + len > ESP_NOW_MAX_DATA_LEN)
+        {
+                LOG_ERROR("Payload too long, len=%d", len);
+                return NULL;
+        }
         send_param->len = sizeof(espnow_data_t) + len;
-        send_param->buffer = malloc(send_param->len);
+        send_param->buffer = frame_pool_alloc(&espnow_tx_pool);
         if (send_param->buffer == NULL)
         {
-                LOG_WARNING("malloc failed");
+                LOG_WARNING("No free frame, %d in use", frame_pool_in_use(&espnow_tx_pool));
                 return NULL;
         }
 
@@ -217,7 +376,7 @@ espnow_send_param_t *espnow_payload_create(espnow_send_param_t *send_param, void
                 return NULL;
         }
 
-        packet->salt = esp_random();
+        packet->session = espnow_session;
         packet->type = send_param->type;
         packet->broadcast = send_param->broadcast;
         packet->seq_num = send_param->seq_num;
@@ -241,12 +400,56 @@ espnow_send_param_t *espnow_payload_cleanup(espnow_send_param_t *send_param)
                 return NULL;
         }
 
-        free(send_param->buffer);
+        frame_pool_free(&espnow_tx_pool, send_param->buffer);
         send_param->buffer = NULL;
         send_param->len = 0;
         return send_param;
 }
 
+/*
+ * Takes a TX slot for `peer`, waits up to `wait_ms` for a send callback to
+ * free one. Slots whose callback is overdue are taken back on the way.
+ * */
+static esp_err_t espnow_tx_acquire(esp_peer_t *peer, uint16_t wait_ms)
+{
+        const TickType_t start = xTaskGetTickCount();
+        const TickType_t wait = pdMS_TO_TICKS(wait_ms);
+        bool counted = false;
+        for (;;)
+        {
+                // Cleared before the check, so a release after it still ends the wait below at once
+                xEventGroupClearBits(espnow_tx_events, ESPNOW_TX_RELEASED_BIT);
+                portENTER_CRITICAL(&espnow_tx_lock);
+                tx_window_expire(&peer->tx_window, &espnow_tx_shared, esp_timer_get_time(), ESPNOW_TX_TIMEOUT_US);
+                bool acquired = tx_window_acquire(&peer->tx_window, &espnow_tx_shared, esp_timer_get_time());
+                if (!acquired && !counted)
+                        peer->tx_window.waits++;
+                portEXIT_CRITICAL(&espnow_tx_lock);
+                if (acquired)
+                        return ESP_OK;
+                counted = true;
+
+                TickType_t elapsed = xTaskGetTickCount() - start;
+                if (elapsed >= wait)
+                        break;
+                xEventGroupWaitBits(espnow_tx_events, ESPNOW_TX_RELEASED_BIT, pdFALSE, pdFALSE, wait - elapsed);
+        }
+
+        portENTER_CRITICAL(&espnow_tx_lock);
+        peer->tx_window.timeouts++;
+        portEXIT_CRITICAL(&espnow_tx_lock);
+        LOG_VERBOSE("TX window full for " MACSTR ", %d in flight, %d total", MAC2STR(peer->mac), peer->tx_window.in_flight, espnow_tx_shared.in_flight);
+        return ESP_ERR_TIMEOUT;
+}
+
+static void espnow_tx_cancel(esp_peer_t *peer)
+{
+        portENTER_CRITICAL(&espnow_tx_lock);
+        tx_window_cancel(&peer->tx_window, &espnow_tx_shared);
+        portEXIT_CRITICAL(&espnow_tx_lock);
+        xEventGroupSetBits(espnow_tx_events, ESPNOW_TX_RELEASED_BIT);
+}
+
 esp_err_t espnow_send_data(espnow_send_param_t *send_param, espnow_param_type_t type, void *data, size_t len)
 {
         if (send_param == NULL)
@@ -257,6 +460,9 @@ esp_err_t espnow_send_data(espnow_send_param_t *send_param, espnow_param_type_t
 
         esp_peer_t *peer = esp_connection_mac_lookup(esp_connection_handle, send_param->dest_mac);
         if (peer == NULL) return ESP_FAIL;
+        esp_err_t ret = espnow_tx_acquire(peer, send_param->wait_ms);
+        if (ret != ESP_OK)
+                return ret;
         send_param->seq_num = peer->seq_tx;
         send_param->type = type;
         peer->seq_tx++;
@@ -264,31 +470,51 @@ esp_err_t espnow_send_data(espnow_send_param_t *send_param, espnow_param_type_t
                 peer->lastsent_unicast_us = esp_timer_get_time();
         }
 
-        esp_err_t ret;
         espnow_payload_create(send_param, data, len);
         espnow_data_t *packet = (espnow_data_t *)send_param->buffer;
         if (packet == NULL)
         {
                 LOG_WARNING("NULL pointer, packet=0x%X", (uintptr_t)packet);
+                espnow_tx_cancel(peer);
                 return ESP_ERR_INVALID_STATE;
         }
         LOG_VERBOSE("Send %s to " MACSTR " , seq:%d, len:%d", ESPNOW_PARAM_TYPE_STRING[send_param->type], MAC2STR(send_param->dest_mac), packet->seq_num, packet->len);
         ret = esp_now_send(send_param->dest_mac, send_param->buffer, send_param->len);
+        if (ret != ESP_OK)
+                espnow_tx_cancel(peer); // No send callback follows
         espnow_payload_cleanup(send_param);
         return ret;
 }
 
 esp_err_t espnow_send_text(espnow_send_param_t *send_param, char *text)
 {
-        return espnow_send_data(send_param, ESPNOW_PARAM_TYPE_TEXT, text, strlen(text));
+        return espnow_tx_send(TX_SCHED_CLASS_TEXT, send_param, ESPNOW_PARAM_TYPE_TEXT, text, strlen(text), ESPNOW_TX_FLAG_NONE);
 }
 
 esp_err_t espnow_reply(espnow_send_param_t *send_param)
 {
-        return espnow_send_data(send_param, ESPNOW_PARAM_TYPE_ACK, 0, 0);
+        return espnow_tx_send(TX_SCHED_CLASS_ACK, send_param, ESPNOW_PARAM_TYPE_ACK, NULL, 0, ESPNOW_TX_FLAG_NONE);
 }
 
-QueueHandle_t espnow_init(espnow_config_t *espnow_config, esp_connection_handle_t *conn_handle)
+/* Send time of a heartbeat, taken as it leaves the TX queue */
+static bool espnow_stamp_ping(void *payload, size_t len, int64_t now_us)
+{
+        if (len != sizeof(clock_ping_pkt_t))
+                return false;
+        ((clock_ping_pkt_t *)payload)->t1_us = now_us;
+        return true;
+}
+
+/* Reply time of a clock ACK, a plain ACK carries none and may be bundled */
+static bool espnow_stamp_ack(void *payload, size_t len, int64_t now_us)
+{
+        if (len != sizeof(clock_ack_pkt_t))
+                return false;
+        ((clock_ack_pkt_t *)payload)->t3_us = now_us;
+        return true;
+}
+
+event_ring_t *espnow_init(espnow_config_t *espnow_config, esp_connection_handle_t *conn_handle)
 {
         if ((espnow_config == NULL) || (conn_handle == NULL))
         {
@@ -297,17 +523,25 @@ QueueHandle_t espnow_init(espnow_config_t *espnow_config, esp_connection_handle_
         }
 
         esp_connection_handle = conn_handle;
-        espnow_queue = xQueueCreate(ESPNOW_QUEUE_SIZE, sizeof(espnow_event_t));
-        if (espnow_queue == NULL)
+        espnow_session = esp_random();
+        if (event_ring_init(&espnow_ring, espnow_ring_buffer, sizeof(espnow_event_t), ESPNOW_QUEUE_SIZE, WATERMARK_QUEUE_ESPNOW) != ESP_OK)
         {
-                LOG_ERROR("Create queue failed");
+                LOG_ERROR("Init ring failed");
                 return NULL;
         }
+        espnow_ring_ready = true;
+        frame_pool_init(&espnow_rx_pool, espnow_rx_frames, ESPNOW_FRAME_SIZE, ESPNOW_RX_POOL_SIZE);
+        frame_pool_init(&espnow_tx_pool, espnow_tx_frames, ESPNOW_FRAME_SIZE, ESPNOW_TX_POOL_SIZE);
+        tx_window_shared_init(&espnow_tx_shared, ESPNOW_TX_WINDOW_TOTAL);
+        if (espnow_tx_events == NULL)
+                espnow_tx_events = xEventGroupCreateStatic(&espnow_tx_events_buffer);
 
         /* Initialize ESPNOW and register sending and receiving callback function. */
         ESP_ERROR_CHECK(esp_now_init());
         ESP_ERROR_CHECK(esp_wifi_config_espnow_rate(espnow_config->wifi_interface, espnow_config->wifi_phy_rate));
         ESP_ERROR_CHECK(esp_now_register_send_cb(espnow_send_cb));
+        espnow_tx_register_stamp(ESPNOW_PARAM_TYPE_PING, espnow_stamp_ping);
+        espnow_tx_register_stamp(ESPNOW_PARAM_TYPE_ACK, espnow_stamp_ack);
         ESP_ERROR_CHECK(esp_now_register_recv_cb(espnow_recv_cb));
 #if CONFIG_ESP_WIFI_STA_DISCONNECTED_PM_ENABLE
         ESP_ERROR_CHECK(esp_now_set_wake_window(65535));
@@ -325,7 +559,7 @@ QueueHandle_t espnow_init(espnow_config_t *espnow_config, esp_connection_handle_
         ESP_ERROR_CHECK(esp_now_add_peer(&peer));
         esp_connection_mac_add_to_entry(esp_connection_handle, peer.peer_addr);
 
-        return espnow_queue;
+        return &espnow_ring;
 }
 
 espnow_send_param_t *espnow_get_send_param_broadcast(espnow_send_param_t *send_param)
@@ -338,6 +572,7 @@ espnow_send_param_t *espnow_get_send_param_broadcast(espnow_send_param_t *send_p
 
         send_param->broadcast = ESPNOW_DATA_BROADCAST;
         memcpy(send_param->dest_mac, broadcast_mac, ESP_NOW_ETH_ALEN);
+        send_param->wait_ms = ESPNOW_SEND_WAIT_MS;
         return send_param;
 }
 
@@ -350,6 +585,7 @@ espnow_send_param_t *espnow_get_send_param_unicast(espnow_send_param_t *send_par
         }
         send_param->broadcast = ESPNOW_DATA_UNICAST;
         memcpy(send_param->dest_mac, mac, ESP_NOW_ETH_ALEN);
+        send_param->wait_ms = ESPNOW_SEND_WAIT_MS;
         return send_param;
 }
 
@@ -379,12 +615,7 @@ void esp_connection_handle_init(esp_connection_handle_t *handle)
         handle->size = 0;
         handle->limit = -1;
         handle->remote_connected = false;
-        handle->entries = malloc(sizeof(esp_peer_t));
-        if (handle->entries == NULL)
-        {
-                LOG_ERROR("malloc failed, cannot create node entries");
-                return;
-        }
+        handle->entries = esp_connection_entries;
 }
 
 void esp_connection_handle_clear(esp_connection_handle_t *handle)
@@ -399,7 +630,8 @@ void esp_connection_handle_clear(esp_connection_handle_t *handle)
                 LOG_WARNING("NULL pointer, handle->entries=0x%X", (uintptr_t)handle->entries);
                 return;
         }
-        free(handle->entries);
+        handle->entries = NULL;
+        handle->size = 0;
 }
 
 void esp_connection_handle_update(esp_connection_handle_t *handle)
@@ -430,7 +662,15 @@ void esp_connection_handle_update(esp_connection_handle_t *handle)
                         break;
                 case ESP_PEER_STATUS_CONNECTED:
                         if (esp_timer_get_time() - peer->lastseen_unicast_us > ONE_SECOND_IN_US)
+                        {
                                 esp_peer_set_status(peer, ESP_PEER_STATUS_LOST);
+                                break;
+                        }
+                        pair_cache_entry_t entry; // After a channel switch or a rate change
+                        espnow_pair_refresh(espnow_pair_entry(&entry, peer));
+                        break;
+                case ESP_PEER_STATUS_RESUMING:
+                        espnow_pair_update(peer);
                         break;
                 case ESP_PEER_STATUS_CONNECTING:
                         if (esp_timer_get_time() - peer->connect_time_us > ONE_SECOND_IN_US)
@@ -447,7 +687,7 @@ void esp_connection_handle_update(esp_connection_handle_t *handle)
                         espnow_send_param_t send_param;
                         espnow_default_send_param(&send_param);
                         espnow_get_send_param_unicast(&send_param, peer->mac);
-                        espnow_send_data(&send_param, ESP_PEER_PACKET_CONNECT, NULL, 0);
+                        espnow_tx_send(TX_SCHED_CLASS_HANDSHAKE, &send_param, ESP_PEER_PACKET_CONNECT, NULL, 0, ESPNOW_TX_FLAG_NONE);
                         esp_peer_set_status(peer, ESP_PEER_STATUS_CONNECTING);
                         break;
                 case ESP_PEER_STATUS_REJECTED:
@@ -467,16 +707,19 @@ void esp_connection_update_rssi(esp_connection_handle_t *handle, const rssi_even
                 return;
         }
 
-        esp_peer_t *peer = esp_connection_mac_add_to_entry(handle, rssi_event->recv_mac);
+        // Only peers already heard over ESP-NOW, sniffed frames alone never take a table entry
+        esp_peer_t *peer = esp_connection_mac_lookup(handle, rssi_event->recv_mac);
+        if (peer == NULL)
+                return;
         peer->rssi = rssi_event->rssi;
 
         const int rssi_min = -20;
-        if (rssi_event->rssi > rssi_min)
+        if ((rssi_event->rssi > rssi_min) || espnow_pair_known(peer->mac)) // A peer paired before is trusted at any range
         {
                 if (peer->status == ESP_PEER_STATUS_CONNECTED)
                         peer->lastseen_unicast_us = esp_timer_get_time();
 
-                if (peer != NULL && peer->status == ESP_PEER_STATUS_IN_RANGE)
+                if (peer->status == ESP_PEER_STATUS_IN_RANGE)
                 {
                         peer->lastseen_broadcast_us = esp_timer_get_time();
                         esp_peer_set_status(peer, ESP_PEER_STATUS_AVAILABLE);
@@ -484,13 +727,7 @@ void esp_connection_update_rssi(esp_connection_handle_t *handle, const rssi_even
                         /* Add unicast peer information to peer list. */
                         if (!esp_now_is_peer_exist(peer->mac))
                         {
-                                esp_now_peer_info_t peer_info = {
-                                    .channel = espnow_config->channel,
-                                    .encrypt = false,
-                                    .ifidx = espnow_config->esp_interface,
-                                };
-                                memcpy(peer_info.peer_addr, peer->mac, ESP_NOW_ETH_ALEN);
-                                ESP_ERROR_CHECK(esp_now_add_peer(&peer_info));
+                                ESP_ERROR_CHECK(espnow_add_peer(peer->mac, NULL));
                                 peer->registered = true;
                         }
                 }
@@ -568,13 +805,38 @@ void esp_connection_peer_init(esp_peer_t *peer, const uint8_t *mac)
         peer->conn_retry = 0;
         peer->lastseen_broadcast_us = esp_timer_get_time();
         peer->lastseen_unicast_us = esp_timer_get_time();
-        peer->seq_rx = 0;
         peer->seq_tx = 0;
+        seq_window_reset(&peer->rx_window[ESPNOW_DATA_BROADCAST]);
+        seq_window_reset(&peer->rx_window[ESPNOW_DATA_UNICAST]);
+        clock_sync_reset(&peer->clock);
+        portENTER_CRITICAL(&espnow_tx_lock);
+        tx_window_reset(&peer->tx_window, &espnow_tx_shared, ESPNOW_TX_WINDOW_PEER);
+        portEXIT_CRITICAL(&espnow_tx_lock);
         peer->rssi = -200;
         peer->status = ESP_PEER_STATUS_UNKNOWN;
         peer->registered = false;
 }
 
+/* Least recently heard entry that is neither registered with the driver nor on its way to a link, NULL when there is none */
+static esp_peer_t *esp_connection_stalest_unregistered(esp_connection_handle_t *handle)
+{
+        esp_peer_t *stalest = NULL;
+        int64_t stalest_us = INT64_MAX;
+        for (size_t i = 0; i < handle->size; i++)
+        {
+                esp_peer_t *peer = handle->entries + i;
+                if (peer->registered || ((peer->status >= ESP_PEER_STATUS_RESUMING) && (peer->status <= ESP_PEER_STATUS_CONNECTED)))
+                        continue;
+                int64_t lastseen_us = (peer->lastseen_broadcast_us > peer->lastseen_unicast_us) ? peer->lastseen_broadcast_us : peer->lastseen_unicast_us;
+                if (lastseen_us < stalest_us)
+                {
+                        stalest = peer;
+                        stalest_us = lastseen_us;
+                }
+        }
+        return stalest;
+}
+
 esp_peer_t *esp_connection_mac_add_to_entry(esp_connection_handle_t *handle, const uint8_t *mac)
 {
         if ((handle == NULL) || (handle->entries == NULL))
@@ -591,15 +853,20 @@ esp_peer_t *esp_connection_mac_add_to_entry(esp_connection_handle_t *handle, con
                 return peer;
         }
 
-        size_t new_capacity = handle->size + 1;
-        esp_peer_t *new_addr = realloc(handle->entries, sizeof(esp_peer_t) * new_capacity);
-        if (new_addr == NULL)
+        if (handle->size >= ESP_CONNECTION_MAX_PEERS)
         {
-                LOG_ERROR("realloc failed, cannot add peer " MACSTR "to node list", MAC2STR(mac));
-                return NULL;
+                esp_peer_t *stale = esp_connection_stalest_unregistered(handle);
+                if (stale == NULL)
+                {
+                        LOG_ERROR("Peer table full, cannot add peer " MACSTR " to node list", MAC2STR(mac));
+                        return NULL;
+                }
+                LOG_INFO("Peer table full, " MACSTR " replaces " MACSTR, MAC2STR(mac), MAC2STR(stale->mac));
+                esp_connection_peer_init(stale, mac);
+                return stale;
         }
 
-        handle->entries = new_addr;
+        size_t new_capacity = handle->size + 1;
         esp_peer_t *new_peer = handle->entries + handle->size;
         if (peer != NULL)
         {
@@ -633,6 +900,19 @@ void esp_connection_show_entries(esp_connection_handle_t *handle)
                         return;
                 }
                 LOG_INFO("    id: %d, addr: " MACSTR ", rssi: %4d, status: %s", i, MAC2STR(peer->mac), peer->rssi, ESP_PEER_STATUS_STRING[peer->status]);
+                seq_window_t *window = &peer->rx_window[ESPNOW_DATA_UNICAST];
+                LOG_INFO("        rx: %d, dup: %d, reorder: %d, stale: %d, lost: %d (%.1f%%)",
+                         window->accepted, window->duplicates, window->reordered, window->stale, window->gaps,
+                         window->accepted ? 100.0 * window->gaps / (window->accepted + window->gaps) : 0.0);
+                const clock_sync_t *clock = &peer->clock;
+                const int64_t now = esp_timer_get_time();
+                const tx_window_t *tx = &peer->tx_window;
+                LOG_INFO("        tx: %d, done: %d, failed: %d, expired: %d, late: %d, waits: %d, timeouts: %d, in flight: %d/%d peak %d, latency us: %d avg %d max %d",
+                         tx->sent, tx->completed, tx->failed, tx->expired, tx->late, tx->waits, tx->timeouts, tx->in_flight, tx->limit,
+                         tx->peak, tx->latency_us, tx->latency_avg_us, tx->latency_max_us);
+                LOG_INFO("        clock: %s, offset: %lld us, skew: %.1f ppm, rtt min: %d us, error: %d us, used: %d/%d",
+                         clock->valid ? "synced" : "none", clock_sync_to_peer(clock, now) - now,
+                         clock->skew_ppb / 1000.0, clock->rtt_min_us, clock->error_us, clock->accepted, clock->samples);
         }
         if (handle->size == 0)
         {
@@ -658,16 +938,97 @@ void esp_peer_set_status(esp_peer_t *peer, esp_peer_status_t new_status)
                 return;
         }
         LOG_INFO("peer " MACSTR " status [%s --> %s]", MAC2STR(peer->mac), ESP_PEER_STATUS_STRING[peer->status], ESP_PEER_STATUS_STRING[new_status]);
+        // A link that ends or starts over counts its frames afresh, whatever the peer numbered them before
+        if ((new_status != peer->status) &&
+            ((new_status == ESP_PEER_STATUS_LOST) || (new_status == ESP_PEER_STATUS_RESUMING) || (new_status == ESP_PEER_STATUS_CONNECTED)))
+        {
+                seq_window_reset(&peer->rx_window[ESPNOW_DATA_BROADCAST]);
+                seq_window_reset(&peer->rx_window[ESPNOW_DATA_UNICAST]);
+        }
         peer->status = new_status;
+        pair_cache_entry_t entry;
+        if (new_status == ESP_PEER_STATUS_CONNECTED)
+                espnow_pair_remember(espnow_pair_entry(&entry, peer));
+}
+
+/* A ping gets its timestamps back unbundled, t3 taken as the ACK leaves the TX queue, anything else a plain ACK */
+static void esp_peer_reply(espnow_send_param_t *send_param, const espnow_data_t *recv_data, int64_t rx_time_us)
+{
+        if ((recv_data->type != ESPNOW_PARAM_TYPE_PING) || (recv_data->len != sizeof(clock_ping_pkt_t)))
+        {
+                espnow_reply(send_param);
+                return;
+        }
+        const clock_ping_pkt_t *ping = (const clock_ping_pkt_t *)recv_data->payload;
+        clock_ack_pkt_t ack = {
+            .t1_us = ping->t1_us,
+            .t2_us = rx_time_us,
+            .t3_us = esp_timer_get_time(),
+        };
+        espnow_tx_send(TX_SCHED_CLASS_ACK, send_param, ESPNOW_PARAM_TYPE_ACK, &ack, sizeof(ack), ESPNOW_TX_FLAG_NONE);
 }
 
-void esp_peer_process_received(esp_peer_t *peer, espnow_data_t *recv_data)
+/*
+ * What ACK, NACK and RESUME do to the peer, from a frame of their own or a
+ * record of a bundle. Clock sync takes only `timed` ACKs, the wait of a
+ * record in its bundle is unknown. Returns false when it is used up here.
+ * */
+static bool esp_peer_process_control(esp_peer_t *peer, espnow_data_type_t broadcast, espnow_param_type_t type, const uint8_t *payload, size_t len,
+                                     bool timed)
+{
+        switch (type)
+        {
+        case ESPNOW_PARAM_TYPE_RESUME:
+                espnow_pair_resume_request(peer);
+                return false;
+        case ESPNOW_PARAM_TYPE_ACK:
+                if (timed && (len == sizeof(clock_ack_pkt_t)))
+                {
+                        const clock_ack_pkt_t *ack = (const clock_ack_pkt_t *)payload;
+                        clock_sync_update(&peer->clock, ack->t1_us, ack->t2_us, ack->t3_us, peer->lastrx_us);
+                }
+                if ((peer->status == ESP_PEER_STATUS_RESUMING) && (broadcast == ESPNOW_DATA_UNICAST))
+                        espnow_pair_resume_answer(peer, true);
+                return true;
+        case ESPNOW_PARAM_TYPE_NACK:
+                if (peer->status != ESP_PEER_STATUS_RESUMING)
+                        return true;
+                espnow_pair_resume_answer(peer, false);
+                return false;
+        default:
+                return true;
+        }
+}
+
+/* Returns false when the frame is a duplicate or too old and should not be dispatched */
+bool esp_peer_process_received(esp_peer_t *peer, espnow_data_t *recv_data, int64_t rx_time_us)
 {
         if ((peer == NULL) || (recv_data == NULL))
         {
                 LOG_ERROR("NULL pointer, peer=0x%X, recv_data=0x%X", (uintptr_t)peer, (uintptr_t)recv_data);
-                return;
+                return false;
+        }
+
+        if ((recv_data->broadcast != ESPNOW_DATA_BROADCAST) && (recv_data->broadcast != ESPNOW_DATA_UNICAST))
+        {
+                LOG_WARNING("Receive error data from: " MACSTR "", MAC2STR(peer->mac));
+                return false;
+        }
+
+        // Ahead of the window, a rebooted peer numbers its frames from the start again
+        if (recv_data->type == ESPNOW_PARAM_TYPE_RESUME)
+        {
+                peer->lastrx_us = rx_time_us;
+                return esp_peer_process_control(peer, recv_data->broadcast, recv_data->type, recv_data->payload, recv_data->len, true);
+        }
+
+        if (!seq_window_check(&peer->rx_window[recv_data->broadcast], recv_data->session, recv_data->seq_num))
+        {
+                LOG_VERBOSE("Drop duplicate seq:%d from peer " MACSTR, recv_data->seq_num, MAC2STR(peer->mac));
+                return false;
         }
+        peer->lastrx_us = rx_time_us;
+        peer->rx_broadcast = recv_data->broadcast;
 
         espnow_send_param_t send_param;
         espnow_get_send_param(&send_param, peer);
@@ -675,26 +1036,29 @@ void esp_peer_process_received(esp_peer_t *peer, espnow_data_t *recv_data)
         if (recv_data->type == ESPNOW_PARAM_TYPE_ACK)
         {
                 LOG_VERBOSE("packet id:[%04d] acknowledged from peer " MACSTR, recv_data->seq_num, MAC2STR(peer->mac));
-                return;
+                return esp_peer_process_control(peer, recv_data->broadcast, recv_data->type, recv_data->payload, recv_data->len, true);
         }
 
+        if ((recv_data->type == ESPNOW_PARAM_TYPE_NACK) && (peer->status == ESP_PEER_STATUS_RESUMING))
+                return esp_peer_process_control(peer, recv_data->broadcast, recv_data->type, recv_data->payload, recv_data->len, true);
+
         if (peer->status < ESP_PEER_STATUS_IN_RANGE)
                 esp_peer_set_status(peer, ESP_PEER_STATUS_IN_RANGE);
 
         if (recv_data->broadcast == ESPNOW_DATA_BROADCAST)
         {
                 peer->lastseen_broadcast_us = esp_timer_get_time();
-                espnow_reply(&send_param);
+                esp_peer_reply(&send_param, recv_data, rx_time_us);
                 LOG_VERBOSE("Receive %dth broadcast data from: " MACSTR ", len: %d",
                             recv_data->seq_num,
                             MAC2STR(peer->mac),
                             recv_data->len);
                 // print_mem(recv_data->payload, recv_data->len);
         }
-        else if (recv_data->broadcast == ESPNOW_DATA_UNICAST)
+        else
         {
                 peer->lastseen_unicast_us = esp_timer_get_time();
-                espnow_reply(&send_param);
+                esp_peer_reply(&send_param, recv_data, rx_time_us);
                 peer->lastsent_unicast_us = esp_timer_get_time();
                 if (peer->status == ESP_PEER_STATUS_CONNECTING)
                 {
@@ -706,10 +1070,23 @@ void esp_peer_process_received(esp_peer_t *peer, espnow_data_t *recv_data)
                             recv_data->len);
                 // print_mem(recv_data->payload, recv_data->len);
         }
-        else
+        return true;
+}
+
+/*
+ * A record of a bundle from `peer`, the frame around it has been through
+ * esp_peer_process_received. ACK, NACK and RESUME get what a frame of their
+ * own would, apart from clock sync. A ping gets no clock reply, its wait in
+ * the bundle is unknown. Returns false when the record is not to be dispatched.
+ * */
+bool esp_peer_process_record(esp_peer_t *peer, espnow_param_type_t type, const void *payload, size_t len)
+{
+        if ((peer == NULL) || ((payload == NULL) && (len != 0)))
         {
-                LOG_WARNING("Receive error data from: " MACSTR "", MAC2STR(peer->mac));
+                LOG_ERROR("NULL pointer, peer=0x%X, payload=0x%X", (uintptr_t)peer, (uintptr_t)payload);
+                return false;
         }
+        return esp_peer_process_control(peer, peer->rx_broadcast, type, payload, len, false);
 }
 
 void esp_connection_send_heartbeat(esp_connection_handle_t *handle)
@@ -731,13 +1108,25 @@ void esp_connection_send_heartbeat(esp_connection_handle_t *handle)
                         return;
                 }
 
-                // if (peer->registered == true)
-                if (peer->status >= ESP_PEER_STATUS_CONNECTING)
+                // Unicast only, to the peer's own MAC and numbered by its entry, the receiver checks it against its unicast window
+                if (peer->registered && ((peer->status == ESP_PEER_STATUS_CONNECTING) || (peer->status == ESP_PEER_STATUS_CONNECTED)))
                 {
                         LOG_VERBOSE("Sending heartbeat to peer " MACSTR, MAC2STR(peer->mac));
-                        espnow_get_send_param(&send_param, peer);
-                        send_param.broadcast = ESPNOW_DATA_UNICAST;
-                        espnow_send_text(&send_param, "ping");
+                        espnow_get_send_param_unicast(&send_param, peer->mac);
+                        // Stamped again as it leaves the TX queue, unbundled, so t1 is not off by the time it waited
+                        clock_ping_pkt_t ping = {.t1_us = esp_timer_get_time()};
+                        espnow_tx_send(TX_SCHED_CLASS_HANDSHAKE, &send_param, ESPNOW_PARAM_TYPE_PING, &ping, sizeof(ping), ESPNOW_TX_FLAG_LATEST);
                 }
         }
-}
\ No newline at end of file
+}
+
+/* Local esp_timer time as read on the peer's esp_timer, meaningful once peer->clock is valid */
+int64_t esp_peer_to_peer_time(const esp_peer_t *peer, int64_t local_us)
+{
+        return clock_sync_to_peer(&peer->clock, local_us);
+}
+
+int64_t esp_peer_to_local_time(const esp_peer_t *peer, int64_t peer_us)
+{
+        return clock_sync_to_local(&peer->clock, peer_us);
+}
@@ -6,10 +6,13 @@
 #include <time.h>
 #include <string.h>
 #include <assert.h>
+#include <stdatomic.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <sys/cdefs.h>
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/timers.h"
@@ -30,12 +33,28 @@
 #include "esp_timer.h"
 
 #include "mem_probe.h"
+#include "frame_pool.h"
 #include "logging.h"
+#include "mem_budget.h"
 #include "rssi.h"
+#include "clock_sync.h"
+#include "tx_window.h"
+#include "pair_cache.h"
+#include "seq_window.h"
 
 #define ONE_SECOND_IN_US (1 * 1e6)
 
-#define ESPNOW_QUEUE_SIZE (64)
+#define ESPNOW_QUEUE_SIZE (64) // Power of two, backs an event_ring
+#define ESPNOW_RX_POOL_SIZE (16) // Received frames waiting for app_task, see the espnow_ring watermark
+#define ESPNOW_TX_POOL_SIZE (4)  // Frames being sent at once, one per sending task
+#define ESPNOW_FRAME_SIZE ((ESP_NOW_MAX_DATA_LEN + 1 + 3) & ~3) // Room for a terminating '\0', word aligned
+#define ESP_CONNECTION_MAX_PEERS (8) // Broadcast entry included
+
+/* Frames handed to the driver and not yet reported by the send callback, see tx_window.h */
+#define ESPNOW_TX_WINDOW_PEER (4)
+#define ESPNOW_TX_WINDOW_TOTAL (8)
+#define ESPNOW_TX_TIMEOUT_US (100 * 1000) // A slot whose send callback never came is taken back
+#define ESPNOW_SEND_WAIT_MS (20)           // Default wait of a sender for a free slot, see espnow_send_param_t
 
 typedef struct
 {
@@ -55,31 +74,36 @@ typedef enum
         ESPNOW_RECV_CB,
 } espnow_event_id_t;
 
+/* Events never leave the chip, fields are ordered by size to keep them aligned without padding in between */
 typedef struct
 {
+        esp_now_send_status_t status;
         uint8_t mac_addr[ESP_NOW_ETH_ALEN];
-        esp_now_send_status_t status : 8;
-} __packed espnow_event_send_cb_t;
+} espnow_event_send_cb_t;
+
+/* Runs in the Wi-Fi task for every send callback, ahead of the event ring, so it must be short and must not block */
+typedef void (*espnow_send_hook_t)(const uint8_t *mac_addr, esp_now_send_status_t status);
 
 typedef struct
 {
-        uint8_t mac_addr[ESP_NOW_ETH_ALEN];
-        size_t data_len;
+        int64_t rx_time_us; // Taken in the receive callback, before any queueing
         uint8_t *data;
-} __packed espnow_event_recv_cb_t;
+        size_t data_len;
+        uint8_t mac_addr[ESP_NOW_ETH_ALEN];
+} espnow_event_recv_cb_t;
 
 typedef union
 {
         espnow_event_send_cb_t send_cb;
         espnow_event_recv_cb_t recv_cb;
-} __packed espnow_event_info_t;
+} espnow_event_info_t;
 
 /* When ESPNOW sending or receiving callback function is called, post event to ESPNOW task. */
 typedef struct
 {
-        espnow_event_id_t id : 8;
         espnow_event_info_t info;
-} __packed espnow_event_t;
+        espnow_event_id_t id;
+} espnow_event_t;
 
 typedef enum
 {
@@ -93,6 +117,15 @@ typedef enum
         ESPNOW_PARAM_TYPE_PING,
         ESPNOW_PARAM_TYPE_ACK,
         ESPNOW_PARAM_TYPE_NACK,
+        ESPNOW_PARAM_TYPE_BUNDLE,
+        ESPNOW_PARAM_TYPE_CHANNEL_SWITCH,
+        ESPNOW_PARAM_TYPE_SERVO_TARGET,
+        ESPNOW_PARAM_TYPE_SERVO_SETPOINT,
+        ESPNOW_PARAM_TYPE_MOTOR_STAT_DELTA,
+        ESPNOW_PARAM_TYPE_PROBE,
+        ESPNOW_PARAM_TYPE_PROBE_ECHO,
+        ESPNOW_PARAM_TYPE_BULK, // Throughput filler, no handler on purpose
+        ESPNOW_PARAM_TYPE_RESUME, // Unicast, from a peer back from a reboot with this side in its pairing cache
         ESPNOW_PARAM_TYPE_MAX,
 } espnow_param_type_t;
 
@@ -107,6 +140,15 @@ static const char __attribute__((unused)) * ESPNOW_PARAM_TYPE_STRING[] = {
     "ESPNOW_PARAM_TYPE_PING",
     "ESPNOW_PARAM_TYPE_ACK",
     "ESPNOW_PARAM_TYPE_NACK",
+    "ESPNOW_PARAM_TYPE_BUNDLE",
+    "ESPNOW_PARAM_TYPE_CHANNEL_SWITCH",
+    "ESPNOW_PARAM_TYPE_SERVO_TARGET",
+    "ESPNOW_PARAM_TYPE_SERVO_SETPOINT",
+    "ESPNOW_PARAM_TYPE_MOTOR_STAT_DELTA",
+    "ESPNOW_PARAM_TYPE_PROBE",
+    "ESPNOW_PARAM_TYPE_PROBE_ECHO",
+    "ESPNOW_PARAM_TYPE_BULK",
+    "ESPNOW_PARAM_TYPE_RESUME",
     "ESPNOW_PARAM_TYPE_MAX"};
 
 typedef enum
@@ -128,11 +170,31 @@ typedef struct
         uint16_t crc;                 // CRC16 value of ESPNOW data.
         espnow_data_type_t broadcast; // 0: broadcast, 1: unicast
         espnow_param_type_t type;     //
-        uint8_t salt;                 // random bits
+        uint8_t session;              // Random per boot, a restarted sender starts a new window, see seq_window.h
         uint8_t len;                  // Length of payload, unit: byte.
         uint8_t payload[0];           // Real payload of ESPNOW data.
 } espnow_data_t;
 
+/*
+ * The heartbeat is a ping with its send time, the peer answers it at once with
+ * a timestamped ACK, see clock_sync.h for the four timestamps. A plain ACK
+ * carries no payload.
+ * */
+typedef struct
+{
+        int64_t t1_us; // Ping sent, sender clock
+} __packed clock_ping_pkt_t;
+
+typedef struct
+{
+        int64_t t1_us; // Echoed from the ping
+        int64_t t2_us; // Ping received, replier clock
+        int64_t t3_us; // ACK sent, replier clock
+} __packed clock_ack_pkt_t;
+
+_Static_assert(sizeof(clock_ping_pkt_t) == 8, "clock_ping_pkt_t wire size changed");
+_Static_assert(sizeof(clock_ack_pkt_t) == 24, "clock_ack_pkt_t wire size changed");
+
 /* Parameters of sending ESPNOW data. */
 typedef struct
 {
@@ -142,6 +204,7 @@ typedef struct
         int len;                            // Length of ESPNOW data to be sent, unit: byte.
         uint8_t *buffer;                    // Buffer pointing to ESPNOW data.
         uint8_t dest_mac[ESP_NOW_ETH_ALEN]; // MAC address of destination device.
+        uint16_t wait_ms;                   // For a free TX slot, 0 from timer callbacks, ESP_ERR_TIMEOUT when none came
 } espnow_send_param_t;
 
 typedef enum
@@ -152,6 +215,7 @@ typedef enum
         ESP_PEER_STATUS_NOREPLY,
         ESP_PEER_STATUS_IN_RANGE,
         ESP_PEER_STATUS_AVAILABLE,
+        ESP_PEER_STATUS_RESUMING, // Restored from the pairing cache, see espnow_pair.h
         ESP_PEER_STATUS_CONNECTING,
         ESP_PEER_STATUS_CONNECTED,
         ESP_PEER_STATUS_REJECTED,
@@ -165,6 +229,7 @@ static const char __attribute__((unused)) * ESP_PEER_STATUS_STRING[] = {
     "ESP_PEER_STATUS_NOREPLY",
     "ESP_PEER_STATUS_IN_RANGE",
     "ESP_PEER_STATUS_AVAILABLE",
+    "ESP_PEER_STATUS_RESUMING",
     "ESP_PEER_STATUS_CONNECTING",
     "ESP_PEER_STATUS_CONNECTED",
     "ESP_PEER_STATUS_REJECTED",
@@ -192,9 +257,14 @@ typedef struct
         int64_t lastseen_unicast_us;
         int64_t lastsent_unicast_us;
         int64_t connect_time_us;
+        int64_t lastrx_us; // Receive callback time of the frame being processed, see espnow_event_recv_cb_t
+        espnow_data_type_t rx_broadcast; // Of the frame being processed, for the records of a bundle
         size_t conn_retry;
-        size_t seq_rx;
         size_t seq_tx;
+        seq_window_t rx_window[2];        // Broadcast and unicast frames are numbered separately
+        clock_sync_t clock;               // Peer esp_timer clock, updated by the heartbeat exchanges
+        tx_window_t tx_window;            // Guarded by the TX lock of espnow.c
+        pair_resume_t resume;             // While ESP_PEER_STATUS_RESUMING
         esp_peer_status_t status;
         int rssi;
         bool registered;
@@ -212,8 +282,15 @@ espnow_config_t *espnow_wifi_default_config(espnow_config_t *config);
 espnow_send_param_t *espnow_default_send_param(espnow_send_param_t *send_param);
 
 void espnow_wifi_init(espnow_config_t *espnow_config);
-QueueHandle_t espnow_init(espnow_config_t *espnow_config, esp_connection_handle_t *conn_handle);
+esp_err_t espnow_add_peer(const uint8_t *mac, const uint8_t *lmk);
+esp_err_t espnow_set_channel(uint8_t channel);
+uint8_t espnow_get_channel(void);
+esp_err_t espnow_set_phy_rate(wifi_phy_rate_t rate);
+wifi_phy_rate_t espnow_get_phy_rate(void);
+event_ring_t *espnow_init(espnow_config_t *espnow_config, esp_connection_handle_t *conn_handle);
 void espnow_deinit(espnow_send_param_t *send_param);
+void espnow_recv_data_free(espnow_event_recv_cb_t *recv_cb);
+void espnow_set_send_hook(espnow_send_hook_t hook);
 
 espnow_data_t *espnow_data_parse(espnow_data_t *recv_data, espnow_event_recv_cb_t *recv_cb);
 
@@ -239,4 +316,8 @@ void esp_connection_send_heartbeat(esp_connection_handle_t *handle);
 
 void esp_connection_set_peer_limit(esp_connection_handle_t *handle, int8_t new_limit);
 void esp_peer_set_status(esp_peer_t *peer, esp_peer_status_t new_status);
-void esp_peer_process_received(esp_peer_t *peer, espnow_data_t *recv_data);
+bool esp_peer_process_received(esp_peer_t *peer, espnow_data_t *recv_data, int64_t rx_time_us);
+bool esp_peer_process_record(esp_peer_t *peer, espnow_param_type_t type, const void *payload, size_t len);
+int64_t esp_peer_to_peer_time(const esp_peer_t *peer, int64_t local_us);
+int64_t esp_peer_to_local_time(const esp_peer_t *peer, int64_t peer_us);
+
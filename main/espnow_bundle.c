@@ -0,0 +1,240 @@
+
+#include "espnow_bundle.h"
+#include "packet_dispatch.h"
+
+static const char *TAG = "espnow_bundle";
+
+static espnow_bundle_slot_t espnow_bundle_slots[ESPNOW_BUNDLE_MAX_PEERS];
+static espnow_bundle_stat_t espnow_bundle_stat;
+static SemaphoreHandle_t espnow_bundle_lock = NULL;
+static StaticSemaphore_t espnow_bundle_lock_buffer;
+static esp_timer_handle_t espnow_bundle_timer = NULL;
+static int64_t espnow_bundle_window_us = 0;
+
+_Static_assert(sizeof(espnow_bundle_slots) + sizeof(espnow_bundle_lock_buffer) <= MEM_BUDGET_ESPNOW_BUNDLE_BYTES, "Bundle slots over budget");
+_Static_assert(ESPNOW_BUNDLE_MAX_PAYLOAD <= BUNDLE_PACK_MAX_PAYLOAD, "Bundle buffer shorter than a frame");
+
+static esp_err_t espnow_bundle_flush_slot(espnow_bundle_slot_t *slot)
+{
+        bundle_pack_t *pack = &slot->pack;
+        if (pack->count == 0)
+                return ESP_OK;
+
+        espnow_send_param_t send_param;
+        espnow_default_send_param(&send_param);
+        memcpy(send_param.dest_mac, slot->dest_mac, ESP_NOW_ETH_ALEN);
+        send_param.broadcast = slot->broadcast;
+        send_param.wait_ms = 0; // Never waits holding the lock, a full TX window keeps the records for the next try
+
+        esp_err_t ret;
+        if (pack->count == 1)
+        {
+                bundle_pack_record_t *record = (bundle_pack_record_t *)pack->buffer;
+                ret = espnow_send_data(&send_param, record->type, record->payload, record->len);
+        }
+        else
+        {
+                LOG_VERBOSE("Bundle of %d records, %d bytes to " MACSTR, pack->count, pack->len, MAC2STR(slot->dest_mac));
+                ret = espnow_send_data(&send_param, ESPNOW_PARAM_TYPE_BUNDLE, pack->buffer, pack->len);
+        }
+
+        if (ret == ESP_ERR_TIMEOUT)
+        {
+                espnow_bundle_stat.deferred++;
+                return ret;
+        }
+
+        espnow_bundle_stat.frames++;
+        espnow_bundle_stat.latency_us += bundle_pack_take(pack, esp_timer_get_time());
+        return ret;
+}
+
+/* Runs in the esp_timer task, sends whatever has waited for a full window and re-arms for the rest */
+static void espnow_bundle_timer_cb(void *arg)
+{
+        xSemaphoreTake(espnow_bundle_lock, portMAX_DELAY);
+        int64_t now = esp_timer_get_time();
+        int64_t next_us = INT64_MAX;
+        for (size_t i = 0; i < ESPNOW_BUNDLE_MAX_PEERS; i++)
+        {
+                espnow_bundle_slot_t *slot = &espnow_bundle_slots[i];
+                if (slot->pack.count == 0)
+                        continue;
+                int64_t deadline = slot->pack.first_queued_us + espnow_bundle_window_us;
+                if (deadline <= now)
+                {
+                        esp_err_t ret = espnow_bundle_flush_slot(slot);
+                        if (ret == ESP_ERR_TIMEOUT)
+                                deadline = now + ESPNOW_BUNDLE_RETRY_US; // Keeps coalescing until a send callback frees a slot
+                        else
+                                ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
+                }
+                if ((slot->pack.count != 0) && (deadline - now < next_us))
+                        next_us = deadline - now;
+        }
+        if (next_us != INT64_MAX)
+                esp_timer_start_once(espnow_bundle_timer, next_us);
+        xSemaphoreGive(espnow_bundle_lock);
+}
+
+esp_err_t espnow_bundle_init(int64_t window_us)
+{
+        if (espnow_bundle_lock != NULL)
+        {
+                LOG_WARNING("Already initialized, lock=0x%X", (uintptr_t)espnow_bundle_lock);
+                return ESP_ERR_INVALID_STATE;
+        }
+
+        espnow_bundle_lock = xSemaphoreCreateMutexStatic(&espnow_bundle_lock_buffer);
+        if (espnow_bundle_lock == NULL)
+        {
+                LOG_ERROR("Create mutex failed");
+                return ESP_ERR_NO_MEM;
+        }
+
+        const esp_timer_create_args_t timer_args = {
+            .callback = espnow_bundle_timer_cb,
+            .name = "espnow_bundle",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &espnow_bundle_timer));
+        for (size_t i = 0; i < ESPNOW_BUNDLE_MAX_PEERS; i++)
+                bundle_pack_init(&espnow_bundle_slots[i].pack, ESPNOW_BUNDLE_MAX_PAYLOAD);
+        espnow_bundle_window_us = window_us;
+        return ESP_OK;
+}
+
+static espnow_bundle_slot_t *espnow_bundle_get_slot(const uint8_t *mac)
+{
+        espnow_bundle_slot_t *free_slot = NULL;
+        espnow_bundle_slot_t *oldest = &espnow_bundle_slots[0];
+        for (size_t i = 0; i < ESPNOW_BUNDLE_MAX_PEERS; i++)
+        {
+                espnow_bundle_slot_t *slot = &espnow_bundle_slots[i];
+                if (slot->pack.count == 0)
+                {
+                        if (free_slot == NULL)
+                                free_slot = slot;
+                        continue;
+                }
+                if (memcmp(slot->dest_mac, mac, ESP_NOW_ETH_ALEN) == 0)
+                        return slot;
+                if (slot->pack.first_queued_us < oldest->pack.first_queued_us)
+                        oldest = slot;
+        }
+        if (free_slot != NULL)
+                return free_slot;
+
+        // Out of slots, make room by sending the oldest bundle early
+        esp_err_t ret = espnow_bundle_flush_slot(oldest);
+        if (ret == ESP_ERR_TIMEOUT)
+                return NULL;
+        ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
+        return oldest;
+}
+
+esp_err_t espnow_bundle_send(espnow_send_param_t *send_param, espnow_param_type_t type, const void *data, size_t len)
+{
+        if (send_param == NULL)
+        {
+                LOG_WARNING("NULL pointer, send_param=0x%X", (uintptr_t)send_param);
+                return ESP_ERR_INVALID_ARG;
+        }
+
+        size_t record_len = sizeof(bundle_pack_record_t) + len;
+        if ((espnow_bundle_lock == NULL) || (espnow_bundle_window_us <= 0) || (record_len > ESPNOW_BUNDLE_MAX_PAYLOAD))
+                return espnow_send_data(send_param, type, (void *)data, len);
+
+        esp_err_t ret = ESP_OK;
+        xSemaphoreTake(espnow_bundle_lock, portMAX_DELAY);
+        espnow_bundle_stat.records++;
+
+        // A slot that could not be flushed for a full TX window refuses the record, the caller sees ESP_ERR_TIMEOUT
+        espnow_bundle_slot_t *slot = espnow_bundle_get_slot(send_param->dest_mac);
+        if ((slot != NULL) && (slot->pack.count != 0) && (slot->broadcast != send_param->broadcast))
+                ret = espnow_bundle_flush_slot(slot);
+        if ((slot == NULL) || ((slot->pack.count != 0) && (slot->broadcast != send_param->broadcast)))
+        {
+                espnow_bundle_stat.refused++;
+                xSemaphoreGive(espnow_bundle_lock);
+                return ESP_ERR_TIMEOUT;
+        }
+
+        // An ACK carries no payload, one pending ACK per peer is enough
+        bool once = (type == ESPNOW_PARAM_TYPE_ACK);
+        int64_t now = esp_timer_get_time();
+        bundle_pack_result_t result = bundle_pack_add(&slot->pack, type, data, len, once, now);
+        if (result == BUNDLE_PACK_FULL)
+        {
+                ret = espnow_bundle_flush_slot(slot);
+                if (slot->pack.count == 0)
+                        result = bundle_pack_add(&slot->pack, type, data, len, once, now);
+        }
+
+        switch (result)
+        {
+        case BUNDLE_PACK_FULL:
+                espnow_bundle_stat.refused++;
+                break;
+        case BUNDLE_PACK_COALESCED:
+                espnow_bundle_stat.acks_coalesced++;
+                break;
+        case BUNDLE_PACK_ADDED:
+                if (slot->pack.count == 1)
+                {
+                        memcpy(slot->dest_mac, send_param->dest_mac, ESP_NOW_ETH_ALEN);
+                        slot->broadcast = send_param->broadcast;
+                        esp_timer_start_once(espnow_bundle_timer, espnow_bundle_window_us); // no-op when already armed
+                }
+                break;
+        }
+
+        xSemaphoreGive(espnow_bundle_lock);
+        return ret;
+}
+
+/* Sends the pending bundle for `mac` right away, or every pending bundle when `mac` is NULL */
+esp_err_t espnow_bundle_flush(const uint8_t *mac)
+{
+        if (espnow_bundle_lock == NULL)
+                return ESP_ERR_INVALID_STATE;
+
+        esp_err_t ret = ESP_OK;
+        xSemaphoreTake(espnow_bundle_lock, portMAX_DELAY);
+        for (size_t i = 0; i < ESPNOW_BUNDLE_MAX_PEERS; i++)
+        {
+                espnow_bundle_slot_t *slot = &espnow_bundle_slots[i];
+                if ((slot->pack.count != 0) && ((mac == NULL) || (memcmp(slot->dest_mac, mac, ESP_NOW_ETH_ALEN) == 0)))
+                        ret = espnow_bundle_flush_slot(slot);
+        }
+        xSemaphoreGive(espnow_bundle_lock);
+        return ret;
+}
+
+/* Handler for ESPNOW_PARAM_TYPE_BUNDLE, hands every record to the receive path for control types, then to the dispatch table */
+void espnow_bundle_unpack(esp_peer_t *peer, const void *payload, size_t len, void *arg)
+{
+        const uint8_t *pos = payload;
+        const uint8_t *end = pos + len;
+        const bundle_pack_record_t *record;
+        while ((record = bundle_pack_next(&pos, end)) != NULL)
+        {
+                if (record->type == ESPNOW_PARAM_TYPE_BUNDLE)
+                {
+                        LOG_WARNING("Nested bundle ignored");
+                }
+                else if (esp_peer_process_record(peer, record->type, record->payload, record->len))
+                {
+                        packet_dispatch_payload(peer, record->type, record->payload, record->len);
+                }
+        }
+        if (pos != end)
+                LOG_WARNING("Truncated bundle record, %d of %d bytes left", end - pos, len);
+}
+
+void espnow_bundle_show_stat(void)
+{
+        espnow_bundle_stat_t *stat = &espnow_bundle_stat;
+        LOG_INFO("records: %d, frames: %d, acks coalesced: %d, deferred: %d, refused: %d, avg latency: %lld us",
+                 stat->records, stat->frames, stat->acks_coalesced, stat->deferred, stat->refused,
+                 stat->records ? stat->latency_us / stat->records : 0);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_timer.h"
+
+#include "bundle_pack.h"
+#include "espnow.h"
+#include "logging.h"
+#include "mem_budget.h"
+
+/*
+ * Small messages bound for the same peer are held for up to `window_us` and
+ * sent together as one ESPNOW_PARAM_TYPE_BUNDLE frame, a list of
+ * bundle_pack_record_t TLV records. A lone record goes out as a plain
+ * frame, so a peer that does not know bundles still understands it.
+ * A window of 0 sends everything immediately.
+ *
+ * On reception the control types among the records, ACK, NACK, PING and
+ * RESUME, go through esp_peer_process_record first, as they would through
+ * esp_peer_process_received in a frame of their own.
+ * */
+
+#define ESPNOW_BUNDLE_DEFAULT_WINDOW_US (4 * 1000)
+#define ESPNOW_BUNDLE_MAX_PEERS (4)
+#define ESPNOW_BUNDLE_RETRY_US (1000) // After a flush put off by a full TX window
+#define ESPNOW_BUNDLE_MAX_PAYLOAD (ESP_NOW_MAX_DATA_LEN - sizeof(espnow_data_t))
+
+typedef struct
+{
+        uint8_t dest_mac[ESP_NOW_ETH_ALEN];
+        espnow_data_type_t broadcast;
+        bundle_pack_t pack;
+} espnow_bundle_slot_t;
+
+typedef struct
+{
+        size_t records;        // Records handed to `espnow_bundle_send`
+        size_t frames;         // Frames actually sent
+        size_t acks_coalesced; // ACKs dropped because one was already pending
+        size_t deferred;       // Flushes put off by a full TX window, the records stay and more join them
+        size_t refused;        // Records turned away by a bundle that could neither grow nor be sent
+        int64_t latency_us;    // Total time records spent waiting
+} espnow_bundle_stat_t;
+
+esp_err_t espnow_bundle_init(int64_t window_us);
+esp_err_t espnow_bundle_send(espnow_send_param_t *send_param, espnow_param_type_t type, const void *data, size_t len);
+esp_err_t espnow_bundle_flush(const uint8_t *mac);
+void espnow_bundle_unpack(esp_peer_t *peer, const void *payload, size_t len, void *arg);
+void espnow_bundle_show_stat(void);
@@ -0,0 +1,200 @@
+
+#include "espnow_pair.h"
+
+static const char *TAG = "espnow_pair";
+
+static pair_cache_t espnow_pair_cache;
+static nvs_handle_t espnow_pair_nvs = 0;
+static bool espnow_pair_ready = false;
+
+_Static_assert(sizeof(espnow_pair_cache) + sizeof(pair_cache_blob_t) <= MEM_BUDGET_ESPNOW_PAIR_BYTES, "Pairing cache over budget");
+
+static bool espnow_pair_nvs_read(void *ctx, void *blob, size_t *len)
+{
+        esp_err_t ret = nvs_get_blob(espnow_pair_nvs, ESPNOW_PAIR_NVS_KEY, blob, len);
+        if ((ret != ESP_OK) && (ret != ESP_ERR_NVS_NOT_FOUND))
+                LOG_WARNING("Read %s failed: %s", ESPNOW_PAIR_NVS_KEY, esp_err_to_name(ret));
+        return ret == ESP_OK;
+}
+
+/* nvs_set_blob replaces the old blob atomically, a power cut leaves either one */
+static bool espnow_pair_nvs_write(void *ctx, const void *blob, size_t len)
+{
+        esp_err_t ret = nvs_set_blob(espnow_pair_nvs, ESPNOW_PAIR_NVS_KEY, blob, len);
+        if (ret == ESP_OK)
+                ret = nvs_commit(espnow_pair_nvs);
+        if (ret != ESP_OK)
+                LOG_WARNING("Write %s failed: %s", ESPNOW_PAIR_NVS_KEY, esp_err_to_name(ret));
+        return ret == ESP_OK;
+}
+
+/* After nvs_flash_init, loads the cache */
+esp_err_t espnow_pair_init(void)
+{
+        if (espnow_pair_ready)
+        {
+                LOG_WARNING("Already initialized");
+                return ESP_ERR_INVALID_STATE;
+        }
+        esp_err_t ret = nvs_open(ESPNOW_PAIR_NVS_NAMESPACE, NVS_READWRITE, &espnow_pair_nvs);
+        if (ret != ESP_OK)
+        {
+                LOG_ERROR("Open NVS namespace %s failed: %s", ESPNOW_PAIR_NVS_NAMESPACE, esp_err_to_name(ret));
+                return ret;
+        }
+        const pair_cache_store_t store = {
+            .read = espnow_pair_nvs_read,
+            .write = espnow_pair_nvs_write,
+        };
+        size_t count = pair_cache_init(&espnow_pair_cache, &store);
+        if (espnow_pair_cache.load_errors)
+                LOG_WARNING("Stored peers unreadable, starting empty");
+        LOG_INFO("%d cached peer(s)", count);
+        espnow_pair_ready = true;
+        return ESP_OK;
+}
+
+/*
+ * Tunes to the channel and PHY rate of the most recent peer and starts a
+ * resume to each cached peer, no more than the handle's peer limit.
+ * Returns how many, 0 leaves everything to discovery.
+ * */
+size_t espnow_pair_restore(esp_connection_handle_t *handle)
+{
+        if (handle == NULL)
+        {
+                LOG_ERROR("NULL pointer, handle=0x%X", (uintptr_t)handle);
+                return 0;
+        }
+        if (!espnow_pair_ready || (espnow_pair_cache.count == 0))
+                return 0;
+
+        const pair_cache_entry_t *newest = &espnow_pair_cache.entries[0];
+        if ((newest->channel != espnow_get_channel()) && (espnow_set_channel(newest->channel) != ESP_OK))
+                return 0;
+        if (newest->phy_rate != espnow_get_phy_rate())
+                ESP_ERROR_CHECK_WITHOUT_ABORT(espnow_set_phy_rate(newest->phy_rate));
+
+        size_t restored = 0;
+        for (size_t i = 0; i < espnow_pair_cache.count; i++)
+        {
+                if ((handle->limit != -1) && (restored >= handle->limit))
+                        break;
+                const pair_cache_entry_t *entry = &espnow_pair_cache.entries[i];
+                if (entry->channel != newest->channel)
+                        continue; // Only one channel at a time, discovery finds it on its own
+                if (espnow_add_peer(entry->mac, entry->encrypt ? entry->lmk : NULL) != ESP_OK)
+                        continue;
+                esp_peer_t *peer = esp_connection_mac_add_to_entry(handle, entry->mac);
+                if (peer == NULL)
+                        break;
+                peer->registered = true;
+                pair_resume_start(&peer->resume, esp_timer_get_time());
+                esp_peer_set_status(peer, ESP_PEER_STATUS_RESUMING);
+                restored++;
+        }
+        LOG_INFO("Resuming %d peer(s) on channel %d", restored, newest->channel);
+        return restored;
+}
+
+bool espnow_pair_known(const uint8_t *mac)
+{
+        return espnow_pair_ready && (pair_cache_find(&espnow_pair_cache, mac) != NULL);
+}
+
+/* Called on every connect, writes to NVS only when the entry or the order changed */
+void espnow_pair_remember(const pair_cache_entry_t *entry)
+{
+        if (!espnow_pair_ready || (entry == NULL))
+                return;
+        if (!pair_cache_remember(&espnow_pair_cache, entry))
+                LOG_WARNING("Peer " MACSTR " not saved, it resumes only until the next reboot", MAC2STR(entry->mac));
+}
+
+/* Called while connected, saves a cached peer whose channel or rate changed and leaves the order alone otherwise */
+void espnow_pair_refresh(const pair_cache_entry_t *entry)
+{
+        if (!espnow_pair_ready || (entry == NULL))
+                return;
+        const pair_cache_entry_t *cached = pair_cache_find(&espnow_pair_cache, entry->mac);
+        if ((cached != NULL) && (memcmp(cached, entry, sizeof(pair_cache_entry_t)) != 0))
+                espnow_pair_remember(entry);
+}
+
+/* From esp_connection_handle_update for a peer in ESP_PEER_STATUS_RESUMING */
+void espnow_pair_update(esp_peer_t *peer)
+{
+        switch (pair_resume_poll(&peer->resume, esp_timer_get_time()))
+        {
+        case PAIR_RESUME_ACTION_SEND:
+        {
+                espnow_send_param_t send_param;
+                espnow_default_send_param(&send_param);
+                espnow_get_send_param_unicast(&send_param, peer->mac);
+                espnow_tx_send(TX_SCHED_CLASS_HANDSHAKE, &send_param, ESPNOW_PARAM_TYPE_RESUME, NULL, 0, ESPNOW_TX_FLAG_LATEST);
+                break;
+        }
+        case PAIR_RESUME_ACTION_GIVE_UP:
+                LOG_WARNING("Peer " MACSTR " did not answer %d resume requests, back to discovery", MAC2STR(peer->mac), peer->resume.attempts);
+                peer->lastseen_broadcast_us = esp_timer_get_time();
+                esp_peer_set_status(peer, ESP_PEER_STATUS_NOREPLY);
+                break;
+        case PAIR_RESUME_ACTION_NONE:
+                break;
+        }
+}
+
+/*
+ * ESPNOW_PARAM_TYPE_RESUME received: a cached peer rebooted. It is taken
+ * back as connected with fresh sequence windows, its numbers restarted.
+ * */
+void espnow_pair_resume_request(esp_peer_t *peer)
+{
+        espnow_send_param_t send_param;
+        espnow_default_send_param(&send_param);
+        espnow_get_send_param_unicast(&send_param, peer->mac);
+        if (espnow_add_peer(peer->mac, NULL) != ESP_OK) // Unicast needs the peer registered, an answer either way
+                return;
+        peer->registered = true;
+        if (!espnow_pair_known(peer->mac))
+        {
+                LOG_INFO("Resume from unknown peer " MACSTR " refused", MAC2STR(peer->mac));
+                espnow_tx_send(TX_SCHED_CLASS_HANDSHAKE, &send_param, ESPNOW_PARAM_TYPE_NACK, NULL, 0, ESPNOW_TX_FLAG_NONE);
+                return;
+        }
+        seq_window_reset(&peer->rx_window[ESPNOW_DATA_BROADCAST]);
+        seq_window_reset(&peer->rx_window[ESPNOW_DATA_UNICAST]);
+        peer->lastseen_unicast_us = esp_timer_get_time();
+        if (peer->status != ESP_PEER_STATUS_CONNECTED)
+                esp_peer_set_status(peer, ESP_PEER_STATUS_CONNECTED);
+        espnow_tx_send(TX_SCHED_CLASS_HANDSHAKE, &send_param, ESPNOW_PARAM_TYPE_ACK, NULL, 0, ESPNOW_TX_FLAG_NONE);
+}
+
+/* ACK or NACK from a peer in ESP_PEER_STATUS_RESUMING */
+void espnow_pair_resume_answer(esp_peer_t *peer, bool accepted)
+{
+        if (!accepted)
+        {
+                pair_resume_rejected(&peer->resume);
+                LOG_WARNING("Peer " MACSTR " no longer knows us, forgotten", MAC2STR(peer->mac));
+                pair_cache_forget(&espnow_pair_cache, peer->mac);
+                peer->lastseen_broadcast_us = esp_timer_get_time();
+                esp_peer_set_status(peer, ESP_PEER_STATUS_NOREPLY);
+                return;
+        }
+        pair_resume_accepted(&peer->resume, esp_timer_get_time());
+        LOG_INFO("Peer " MACSTR " resumed after %d request(s), %d us", MAC2STR(peer->mac), peer->resume.attempts, peer->resume.elapsed_us);
+        peer->lastseen_unicast_us = esp_timer_get_time();
+        esp_peer_set_status(peer, ESP_PEER_STATUS_CONNECTED);
+}
+
+void espnow_pair_show(void)
+{
+        LOG_INFO("cached peers: %d, saves: %d, save errors: %d, load errors: %d", espnow_pair_cache.count, espnow_pair_cache.saves,
+                 espnow_pair_cache.save_errors, espnow_pair_cache.load_errors);
+        for (size_t i = 0; i < espnow_pair_cache.count; i++)
+        {
+                const pair_cache_entry_t *entry = &espnow_pair_cache.entries[i];
+                LOG_INFO("    " MACSTR ", channel: %d, phy rate: %d, encrypt: %d", MAC2STR(entry->mac), entry->channel, entry->phy_rate, entry->encrypt);
+        }
+}
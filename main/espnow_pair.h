@@ -0,0 +1,46 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "espnow.h"
+#include "espnow_tx.h"
+#include "logging.h"
+#include "mem_budget.h"
+#include "pair_cache.h"
+
+/*
+ * pair_cache in NVS, and the fast resume it allows. Every peer that
+ * reaches ESP_PEER_STATUS_CONNECTED is remembered with the channel, PHY
+ * rate and key it used. After a reboot espnow_pair_restore tunes to the
+ * most recent peer's channel and rate, registers the cached peers and puts
+ * them in ESP_PEER_STATUS_RESUMING, which skips the RSSI gate, the
+ * discovery timeouts and the channel scan.
+ *
+ * A resuming peer is sent ESPNOW_PARAM_TYPE_RESUME by unicast every
+ * PAIR_RESUME_RETRY_US. The other end answers with an ACK when it has this
+ * side in its own cache, and both are connected, or with a NACK, and the
+ * entry is forgotten. Without an answer within PAIR_RESUME_TIMEOUT_US the
+ * peer goes through discovery as usual, a cached peer still needs no RSSI
+ * above rssi_min for it.
+ * */
+
+#define ESPNOW_PAIR_NVS_NAMESPACE "espnow_pair"
+#define ESPNOW_PAIR_NVS_KEY "peers"
+
+esp_err_t espnow_pair_init(void);
+size_t espnow_pair_restore(esp_connection_handle_t *handle);
+bool espnow_pair_known(const uint8_t *mac);
+void espnow_pair_remember(const pair_cache_entry_t *entry);
+void espnow_pair_refresh(const pair_cache_entry_t *entry);
+void espnow_pair_update(esp_peer_t *peer);
+void espnow_pair_resume_request(esp_peer_t *peer);
+void espnow_pair_resume_answer(esp_peer_t *peer, bool accepted);
+void espnow_pair_show(void);
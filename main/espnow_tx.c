@@ -0,0 +1,182 @@
+
+#include "espnow_tx.h"
+#include "espnow_bundle.h"
+
+static const char *TAG = "espnow_tx";
+
+static tx_sched_t espnow_tx_sched;
+static portMUX_TYPE espnow_tx_sched_lock = portMUX_INITIALIZER_UNLOCKED;
+static espnow_tx_stamp_t espnow_tx_stamps[ESPNOW_PARAM_TYPE_MAX];
+static TaskHandle_t espnow_tx_task_handle = NULL;
+static atomic_bool espnow_tx_slot_released = false; // Set by the send callback, tx_task tries the blocked peers again
+static atomic_uint espnow_tx_direct = 0; // Frames over TX_SCHED_MAX_PAYLOAD, sent around the queues
+
+_Static_assert(sizeof(espnow_tx_sched) + sizeof(espnow_tx_stamps) <= MEM_BUDGET_ESPNOW_TX_BYTES, "TX queues over budget");
+
+/* Classes whose frames may wait for the bundle window, a stamped frame never does */
+static const bool espnow_tx_bundled[TX_SCHED_CLASS_MAX] = {
+    [TX_SCHED_CLASS_ACK] = true,
+    [TX_SCHED_CLASS_TEXT] = true,
+};
+
+static void espnow_tx_wait_us(int64_t wait_us)
+{
+        TickType_t ticks = (wait_us < 0) ? portMAX_DELAY : pdMS_TO_TICKS((wait_us + 999) / 1000);
+        ulTaskNotifyTake(pdTRUE, (ticks == 0) ? 1 : ticks);
+}
+
+/* The only caller of espnow_send_data for queued traffic, woken by espnow_tx_send and the send callback */
+static void espnow_tx_task(void *pvParameter)
+{
+        tx_sched_blocked_t blocked = {0}; // Peers whose TX window was full, their frames wait while others go
+        while (true)
+        {
+                if (atomic_exchange(&espnow_tx_slot_released, false))
+                        blocked.count = 0;
+
+                tx_sched_frame_t frame;
+                portENTER_CRITICAL(&espnow_tx_sched_lock);
+                tx_sched_class_t tx_class = tx_sched_pop(&espnow_tx_sched, esp_timer_get_time(), &blocked, &frame);
+                int64_t next_us = tx_sched_next_us(&espnow_tx_sched, esp_timer_get_time(), &blocked);
+                portEXIT_CRITICAL(&espnow_tx_sched_lock);
+                if (tx_class == TX_SCHED_CLASS_MAX)
+                {
+                        // Frames left only for blocked peers, until a send callback frees a slot or a slot expires
+                        if ((blocked.count > 0) && ((next_us < 0) || (next_us > ESPNOW_SEND_WAIT_MS * 1000)))
+                                next_us = ESPNOW_SEND_WAIT_MS * 1000;
+                        espnow_tx_wait_us(next_us);
+                        blocked.count = 0;
+                        continue;
+                }
+
+                espnow_send_param_t send_param;
+                espnow_default_send_param(&send_param);
+                memcpy(send_param.dest_mac, frame.dest, ESP_NOW_ETH_ALEN);
+                send_param.broadcast = frame.broadcast;
+                send_param.wait_ms = 0; // A full window blocks the peer, see below
+
+                espnow_tx_stamp_t stamp = (frame.type < ESPNOW_PARAM_TYPE_MAX) ? espnow_tx_stamps[frame.type] : NULL;
+                esp_err_t ret;
+                if ((stamp != NULL) && stamp(frame.payload, frame.len, esp_timer_get_time()))
+                        ret = espnow_send_data(&send_param, frame.type, frame.payload, frame.len);
+                else if (espnow_tx_bundled[tx_class])
+                        ret = espnow_bundle_send(&send_param, frame.type, frame.payload, frame.len);
+                else
+                        ret = espnow_send_data(&send_param, frame.type, frame.payload, frame.len);
+
+                portENTER_CRITICAL(&espnow_tx_sched_lock);
+                if (ret == ESP_ERR_TIMEOUT)
+                        tx_sched_requeue(&espnow_tx_sched, tx_class, &frame);
+                else if (ret == ESP_OK)
+                        tx_sched_sent(&espnow_tx_sched, tx_class, &frame, esp_timer_get_time());
+                portEXIT_CRITICAL(&espnow_tx_sched_lock);
+
+                if ((ret == ESP_ERR_TIMEOUT) && !tx_sched_block(&blocked, frame.dest))
+                        espnow_tx_wait_us(ESPNOW_SEND_WAIT_MS * 1000); // More peers blocked than tracked, until a send callback frees a slot
+                else if ((ret != ESP_OK) && (ret != ESP_ERR_TIMEOUT))
+                        LOG_WARNING("Send %s failed: %s", TX_SCHED_CLASS_STRING[tx_class], esp_err_to_name(ret));
+        }
+}
+
+esp_err_t espnow_tx_init(const tx_sched_config_t *config)
+{
+        if (config == NULL)
+        {
+                LOG_ERROR("NULL pointer, config=0x%X", (uintptr_t)config);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if (espnow_tx_task_handle != NULL)
+        {
+                LOG_WARNING("Already initialized");
+                return ESP_ERR_INVALID_STATE;
+        }
+        if (!tx_sched_init(&espnow_tx_sched, config, esp_timer_get_time()))
+        {
+                LOG_ERROR("Invalid config, depth 1 to %d and a burst of at least 1 per class", TX_SCHED_DEPTH_MAX);
+                return ESP_ERR_INVALID_ARG;
+        }
+        espnow_tx_task_handle = task_table_create(TASK_ID_TX, espnow_tx_task, NULL);
+        return (espnow_tx_task_handle != NULL) ? ESP_OK : ESP_FAIL;
+}
+
+/*
+ * Queues a copy of the frame for tx_task and returns at once, safe from
+ * esp_timer callbacks. Before espnow_tx_init the frame is sent directly.
+ * ESP_ERR_NO_MEM when the class queue is full and keeps its frames.
+ * */
+esp_err_t espnow_tx_send(espnow_tx_class_t tx_class, const espnow_send_param_t *send_param, espnow_param_type_t type,
+                         const void *data, size_t len, uint8_t flags)
+{
+        if ((send_param == NULL) || ((data == NULL) && (len != 0)))
+        {
+                LOG_ERROR("NULL pointer, send_param=0x%X, data=0x%X", (uintptr_t)send_param, (uintptr_t)data);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if (tx_class >= TX_SCHED_CLASS_MAX)
+        {
+                LOG_ERROR("Invalid class %d", tx_class);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if ((espnow_tx_task_handle == NULL) || (len > TX_SCHED_MAX_PAYLOAD))
+        {
+                if (espnow_tx_task_handle != NULL)
+                {
+                        atomic_fetch_add(&espnow_tx_direct, 1);
+                        LOG_VERBOSE("%s type %d, len %d over the queue slot of %d, sent directly", TX_SCHED_CLASS_STRING[tx_class], type, len, TX_SCHED_MAX_PAYLOAD);
+                }
+                espnow_send_param_t direct = *send_param;
+                esp_err_t ret = espnow_send_data(&direct, type, (void *)data, len);
+                if (ret != ESP_OK)
+                        LOG_WARNING("Send %s type %d, len %d failed: %s", TX_SCHED_CLASS_STRING[tx_class], type, len, esp_err_to_name(ret));
+                return ret;
+        }
+
+        tx_sched_frame_t frame = {
+            .broadcast = send_param->broadcast,
+            .type = type,
+            .flags = flags,
+            .len = len,
+        };
+        memcpy(frame.dest, send_param->dest_mac, ESP_NOW_ETH_ALEN);
+        if (len)
+                memcpy(frame.payload, data, len);
+
+        portENTER_CRITICAL(&espnow_tx_sched_lock);
+        tx_sched_result_t result = tx_sched_push(&espnow_tx_sched, tx_class, &frame, esp_timer_get_time());
+        portEXIT_CRITICAL(&espnow_tx_sched_lock);
+        if (result == TX_SCHED_FULL)
+                return ESP_ERR_NO_MEM;
+        xTaskNotifyGive(espnow_tx_task_handle);
+        return ESP_OK;
+}
+
+esp_err_t espnow_tx_register_stamp(espnow_param_type_t type, espnow_tx_stamp_t stamp)
+{
+        if (type >= ESPNOW_PARAM_TYPE_MAX)
+        {
+                LOG_ERROR("Invalid type %d", type);
+                return ESP_ERR_INVALID_ARG;
+        }
+        espnow_tx_stamps[type] = stamp;
+        return ESP_OK;
+}
+
+/* From the send callback, a TX slot opened */
+void espnow_tx_released(void)
+{
+        atomic_store(&espnow_tx_slot_released, true);
+        if (espnow_tx_task_handle != NULL)
+                xTaskNotifyGive(espnow_tx_task_handle);
+}
+
+void espnow_tx_show_stat(void)
+{
+        LOG_INFO("sent directly, over %d bytes: %d", TX_SCHED_MAX_PAYLOAD, atomic_load(&espnow_tx_direct));
+        for (size_t i = 0; i < TX_SCHED_CLASS_MAX; i++)
+        {
+                const tx_sched_stat_t *stat = &espnow_tx_sched.queues[i].stat;
+                LOG_INFO("%s: queued: %d, sent: %d, superseded: %d, dropped: %d, expired: %d, requeued: %d, peak: %d, latency avg: %d us, max: %d us",
+                         TX_SCHED_CLASS_STRING[i], stat->queued, stat->sent, stat->superseded, stat->dropped, stat->expired, stat->requeued,
+                         stat->peak, stat->latency_avg_us, stat->latency_max_us);
+        }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_timer.h"
+
+#include "espnow.h"
+#include "logging.h"
+#include "mem_budget.h"
+#include "task_table.h"
+#include "tx_sched.h"
+
+/*
+ * Single sender for the application's ESP-NOW traffic. Inputs, ACKs,
+ * heartbeats, handshakes and debug text are handed to espnow_tx_send with
+ * a class and go out from tx_task through tx_sched, in strict priority
+ * order and within each class's rate, so a burst of text or heartbeats
+ * can no longer hold up a control frame.
+ *
+ * Frames of the ACK and text classes go through espnow_bundle_send and are
+ * still coalesced, control frames are sent on their own right away. A full
+ * TX window puts the frame back in front of its class and blocks its peer,
+ * tx_task goes on with the frames to other peers, and a control frame
+ * queued meanwhile still goes first. The next send callback unblocks the
+ * peers.
+ *
+ * A type with a stamp registered gets it filled in just before it is sent,
+ * for timestamps that must not include the time spent in the queue.
+ *
+ * Queue slots hold TX_SCHED_MAX_PAYLOAD bytes, which covers every
+ * control, handshake and ACK frame. A longer frame, up to the ESP-NOW
+ * limit, is sent directly as before the scheduler, without its priority,
+ * and counted in espnow_tx_show_stat.
+ *
+ * The link benchmarks keep calling espnow_send_data, they measure the path
+ * below the scheduler.
+ * */
+
+#define ESPNOW_TX_FLAG_NONE (0)
+#define ESPNOW_TX_FLAG_LATEST TX_SCHED_FLAG_LATEST // Replaces a queued frame of the same type to the same peer
+
+typedef tx_sched_class_t espnow_tx_class_t;
+
+/* Fills time fields of `payload` in place right before it is sent, false when the frame has none */
+typedef bool (*espnow_tx_stamp_t)(void *payload, size_t len, int64_t now_us);
+
+esp_err_t espnow_tx_init(const tx_sched_config_t *config);
+esp_err_t espnow_tx_send(espnow_tx_class_t tx_class, const espnow_send_param_t *send_param, espnow_param_type_t type,
+                         const void *data, size_t len, uint8_t flags);
+esp_err_t espnow_tx_register_stamp(espnow_param_type_t type, espnow_tx_stamp_t stamp);
+void espnow_tx_released(void);
+void espnow_tx_show_stat(void);
@@ -0,0 +1,73 @@
+
+#include "event_ring.h"
+
+static const char __attribute__((unused)) *TAG = "event_ring";
+
+/* `buffer` holds `capacity` items, `capacity` must be a power of two */
+esp_err_t event_ring_init(event_ring_t *event_ring, void *buffer, size_t item_size, size_t capacity, watermark_queue_t watermark)
+{
+        if ((event_ring == NULL) || (buffer == NULL))
+        {
+                LOG_ERROR("NULL pointer, event_ring=0x%X, buffer=0x%X", (uintptr_t)event_ring, (uintptr_t)buffer);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if (!spsc_ring_init(&event_ring->ring, buffer, item_size, capacity))
+        {
+                LOG_ERROR("Invalid ring, item_size=%d, capacity=%d", item_size, capacity);
+                return ESP_ERR_INVALID_ARG;
+        }
+        event_ring->consumer = NULL;
+        event_ring->watermark = watermark;
+        watermark_queue_register(watermark, capacity);
+        return ESP_OK;
+}
+
+static bool event_ring_store(event_ring_t *event_ring, const void *item)
+{
+        if (!spsc_ring_push(&event_ring->ring, item))
+        {
+                watermark_queue_dropped(event_ring->watermark);
+                return false;
+        }
+        watermark_queue_sent(event_ring->watermark, spsc_ring_count(&event_ring->ring), (uint32_t)esp_timer_get_time());
+        return true;
+}
+
+/* Producer, task context. Returns false when the ring is full */
+bool event_ring_push(event_ring_t *event_ring, const void *item)
+{
+        if (!event_ring_store(event_ring, item))
+                return false;
+        if (spsc_ring_take_waiter(&event_ring->ring))
+                xTaskNotifyGive(event_ring->consumer);
+        return true;
+}
+
+bool event_ring_push_from_isr(event_ring_t *event_ring, const void *item, BaseType_t *higher_priority_task_woken)
+{
+        if (!event_ring_store(event_ring, item))
+                return false;
+        if (spsc_ring_take_waiter(&event_ring->ring))
+                vTaskNotifyGiveFromISR(event_ring->consumer, higher_priority_task_woken);
+        return true;
+}
+
+/* Consumer. Never blocks, returns the number of items copied into `items` */
+size_t event_ring_pop_batch(event_ring_t *event_ring, void *items, size_t max)
+{
+        size_t count = spsc_ring_pop_batch(&event_ring->ring, items, max);
+        uint32_t now_us = (uint32_t)esp_timer_get_time();
+        for (size_t i = 0; i < count; i++)
+                watermark_queue_received(event_ring->watermark, now_us);
+        return count;
+}
+
+/* Consumer. Sleeps up to `ticks`, a push ends it early. Returns at once if the ring is not empty */
+void event_ring_wait(event_ring_t *event_ring, TickType_t ticks)
+{
+        event_ring->consumer = xTaskGetCurrentTaskHandle();
+        if (!spsc_ring_prepare_wait(&event_ring->ring))
+                return;
+        ulTaskNotifyTake(pdTRUE, ticks);
+        spsc_ring_finish_wait(&event_ring->ring);
+}
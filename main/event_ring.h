@@ -0,0 +1,35 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "logging.h"
+#include "spsc_ring.h"
+#include "watermark.h"
+
+/*
+ * spsc_ring paired with a task notification, for events handed from one
+ * producer (a Wi-Fi callback, an ISR) to one task. The push is lock-free and
+ * only notifies when the consumer is asleep in event_ring_wait().
+ * Every push and pop is counted in the ring's watermark entry.
+ * */
+
+typedef struct
+{
+        spsc_ring_t ring;
+        TaskHandle_t consumer; // Set by event_ring_wait
+        watermark_queue_t watermark;
+} event_ring_t;
+
+esp_err_t event_ring_init(event_ring_t *event_ring, void *buffer, size_t item_size, size_t capacity, watermark_queue_t watermark);
+bool event_ring_push(event_ring_t *event_ring, const void *item);
+bool event_ring_push_from_isr(event_ring_t *event_ring, const void *item, BaseType_t *higher_priority_task_woken);
+size_t event_ring_pop_batch(event_ring_t *event_ring, void *items, size_t max);
+void event_ring_wait(event_ring_t *event_ring, TickType_t ticks);
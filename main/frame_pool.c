@@ -0,0 +1,60 @@
+
+#include "frame_pool.h"
+
+static uint_fast32_t frame_pool_all_free(size_t count)
+{
+        return (count >= 32) ? UINT32_MAX : (((uint_fast32_t)1 << count) - 1);
+}
+
+/* `storage` holds `count` blocks of `block_size` bytes, `count` is at most FRAME_POOL_MAX_BLOCKS */
+bool frame_pool_init(frame_pool_t *pool, void *storage, size_t block_size, size_t count)
+{
+        if ((pool == NULL) || (storage == NULL) || (block_size == 0) || (count == 0) || (count > FRAME_POOL_MAX_BLOCKS))
+                return false;
+        pool->storage = storage;
+        pool->block_size = block_size;
+        pool->count = count;
+        atomic_init(&pool->free_mask, frame_pool_all_free(count));
+        atomic_init(&pool->in_use_peak, 0);
+        atomic_init(&pool->failures, 0);
+        return true;
+}
+
+/* Returns NULL when every block is taken */
+void *frame_pool_alloc(frame_pool_t *pool)
+{
+        uint_fast32_t mask = atomic_load(&pool->free_mask);
+        for (;;)
+        {
+                if (mask == 0)
+                {
+                        atomic_fetch_add(&pool->failures, 1);
+                        return NULL;
+                }
+                uint_fast32_t bit = mask & (~mask + 1); // Lowest free block
+                if (atomic_compare_exchange_weak(&pool->free_mask, &mask, mask & ~bit))
+                {
+                        uint32_t in_use = pool->count - __builtin_popcount(mask & ~bit);
+                        uint_fast32_t peak = atomic_load(&pool->in_use_peak);
+                        while ((in_use > peak) && !atomic_compare_exchange_weak(&pool->in_use_peak, &peak, in_use))
+                                ;
+                        return pool->storage + __builtin_ctz(bit) * pool->block_size;
+                }
+        }
+}
+
+/* `block` must come from frame_pool_alloc on the same pool, NULL is ignored */
+void frame_pool_free(frame_pool_t *pool, void *block)
+{
+        if (block == NULL)
+                return;
+        size_t offset = (uint8_t *)block - pool->storage;
+        if ((offset % pool->block_size) || (offset / pool->block_size >= pool->count))
+                return;
+        atomic_fetch_or(&pool->free_mask, (uint_fast32_t)1 << (offset / pool->block_size));
+}
+
+size_t frame_pool_in_use(frame_pool_t *pool)
+{
+        return pool->count - __builtin_popcount(atomic_load(&pool->free_mask));
+}
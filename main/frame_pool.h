@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Fixed size blocks handed out from caller provided static storage, for
+ * buffers that used to come from malloc on every frame. Allocation claims a
+ * bit of `free_mask` with a compare and swap, so any task or callback may
+ * allocate and free without a lock. No IDF headers.
+ * */
+
+#define FRAME_POOL_MAX_BLOCKS (32)
+
+typedef struct
+{
+        uint8_t *storage;
+        size_t block_size; // Unit: byte
+        size_t count;
+        atomic_uint_fast32_t free_mask; // Bit set when the block is free
+        atomic_uint_fast32_t in_use_peak;
+        atomic_uint_fast32_t failures; // Allocations refused because every block was taken
+} frame_pool_t;
+
+bool frame_pool_init(frame_pool_t *pool, void *storage, size_t block_size, size_t count);
+void *frame_pool_alloc(frame_pool_t *pool);
+void frame_pool_free(frame_pool_t *pool, void *block);
+size_t frame_pool_in_use(frame_pool_t *pool);
@@ -18,6 +18,9 @@ uint64_t joystick_pinmask = 0;
 static esp_adc_cal_characteristics_t adc1_chars = {0};
 joystick_data_t joystick_data[BUTTON_MAX_ARRAY_SIZE];
 QueueHandle_t joystick_queue = NULL;
+static uint8_t joystick_queue_storage[BUTTON_QUEUE_DEPTH * sizeof(button_event_t)];
+static StaticQueue_t joystick_queue_buffer;
+_Static_assert(sizeof(joystick_queue_storage) + sizeof(joystick_queue_buffer) <= MEM_BUDGET_JOYSTICK_BYTES, "joystick queue over budget");
 TaskHandle_t joystick_task_handle = NULL;
 
 static bool adc1_calibration_init(void)
@@ -55,7 +58,7 @@ static void joystick_send_event(int pin, button_state_t state, const button_stat
             .new_state = state,
         };
 
-        if (xQueueSend(joystick_queue, &new_state, 0) != pdTRUE)
+        if (!watermark_queue_send(WATERMARK_QUEUE_JOYSTICK, joystick_queue, &new_state))
                 LOG_WARNING("Send queue failed");
 }
 
@@ -107,7 +110,7 @@ static void joystick_task(void *pvParameter)
                 uint8_t num_joysticks = count_num_joysticks(joystick_pinmask);
                 for (int idx = 0; idx < num_joysticks; idx++)
                         update_joystick(&joystick_data[idx]);
-                vTaskDelay(pdMS_TO_TICKS(10));
+                power_manager_wait();
         }
 }
 
@@ -120,16 +123,17 @@ QueueHandle_t joystick_init(void)
         }
 
         // Initialize queue
-        joystick_queue = xQueueCreate(BUTTON_QUEUE_DEPTH, sizeof(button_event_t)); // TODO: statically allow memory
+        joystick_queue = xQueueCreateStatic(BUTTON_QUEUE_DEPTH, sizeof(button_event_t), joystick_queue_storage, &joystick_queue_buffer);
         if (joystick_queue == NULL)
         {
                 LOG_ERROR("Create queue falied");
                 joystick_deinit();
                 return NULL;
         }
+        watermark_queue_register(WATERMARK_QUEUE_JOYSTICK, BUTTON_QUEUE_DEPTH);
 
         // Spawn a task to monitor the pins
-        xTaskCreate(joystick_task, "joystick_task", 4096, NULL, 10, &joystick_task_handle);
+        joystick_task_handle = task_table_create(TASK_ID_JOYSTICK, joystick_task, NULL);
 
         return joystick_queue;
 }
@@ -157,7 +161,7 @@ void joystick_deinit(void)
 {
         if (joystick_task_handle != NULL)
         {
-                vTaskDelete(joystick_task_handle);
+                task_table_delete(TASK_ID_JOYSTICK);
                 joystick_task_handle = NULL;
         }
         if (joystick_queue != NULL)
@@ -168,4 +172,10 @@ void joystick_deinit(void)
 
         // TODO
         joystick_pinmask = 0;
+}
+
+/* Fresh calibrated reading of `channel`, unit: mV. Safe beside joystick_task, the ADC driver serializes reads */
+int joystick_sample_mv(adc1_channel_t channel)
+{
+        return esp_adc_cal_raw_to_voltage(adc1_get_raw(channel), &adc1_chars);
 }
\ No newline at end of file
@@ -17,8 +17,11 @@
 #include "esp_timer.h"
 
 #include "logging.h"
+#include "power_manager.h"
+#include "task_table.h"
 #include "button.h"
 
 QueueHandle_t joystick_init(void);
 void joystick_register(const gpio_num_t high_pin, const gpio_num_t low_pin, const adc_channel_t channel, const bool inverted);
 void joystick_deinit(void);
+int joystick_sample_mv(adc1_channel_t channel);
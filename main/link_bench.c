@@ -0,0 +1,198 @@
+
+#include "link_bench.h"
+
+#include <string.h>
+
+link_bench_config_t *link_bench_default_config(link_bench_config_t *config)
+{
+        if (config == NULL)
+                return NULL;
+        config->rate_hz = 50;
+        config->payload_len = 32;
+        config->count = 1000;
+        config->timeout_us = 500 * 1000; // Far past any retry chain, a slower echo is as good as lost
+        return config;
+}
+
+void link_bench_init(link_bench_t *bench, const link_bench_config_t *config, const link_bench_link_t *link)
+{
+        memset(bench, 0, sizeof(link_bench_t));
+        bench->config = *config;
+        if (bench->config.rate_hz == 0)
+                bench->config.rate_hz = 1;
+        if (bench->config.payload_len < sizeof(link_probe_pkt_t))
+                bench->config.payload_len = sizeof(link_probe_pkt_t);
+        if (bench->config.payload_len > LINK_BENCH_MAX_PAYLOAD)
+                bench->config.payload_len = LINK_BENCH_MAX_PAYLOAD;
+        bench->link = *link;
+        bench->next_us = link->now_us(link->ctx);
+        bench->result.min_us = UINT32_MAX;
+}
+
+static size_t link_bench_bucket(uint32_t rtt_us)
+{
+        size_t shift = 0;
+        for (uint32_t top = rtt_us >> LINK_BENCH_SUB_BITS; top > 1; top >>= 1)
+                shift++;
+        if (shift > LINK_BENCH_MAX_SHIFT)
+                return LINK_BENCH_BUCKETS - 1;
+        return shift * LINK_BENCH_SUB_BUCKETS + (rtt_us >> shift);
+}
+
+/* Middle of the bucket's range */
+static uint32_t link_bench_bucket_value(size_t bucket)
+{
+        if (bucket < 2 * LINK_BENCH_SUB_BUCKETS)
+                return bucket;
+        size_t shift = bucket / LINK_BENCH_SUB_BUCKETS - 1;
+        return ((bucket - shift * LINK_BENCH_SUB_BUCKETS) << shift) + (1UL << shift) / 2;
+}
+
+static void link_bench_expire(link_bench_t *bench, int64_t now_us)
+{
+        for (size_t i = 0; i < LINK_BENCH_INFLIGHT; i++)
+        {
+                link_bench_slot_t *slot = &bench->slots[i];
+                if (slot->pending && (now_us - slot->sent_us >= bench->config.timeout_us))
+                {
+                        slot->pending = false;
+                        bench->result.lost++;
+                }
+        }
+}
+
+/*
+ * Sends the probes that are due and expires the unanswered ones. Returns
+ * when to call again, or -1 once the run is over.
+ * */
+int64_t link_bench_poll(link_bench_t *bench)
+{
+        const link_bench_link_t *link = &bench->link;
+        const int64_t now = link->now_us(link->ctx);
+        const int64_t period_us = 1000000 / bench->config.rate_hz;
+        link_bench_expire(bench, now);
+
+        // Late calls catch up by one probe at a time, never in a burst
+        if ((bench->next_seq < bench->config.count) && (now >= bench->next_us))
+        {
+                uint8_t frame[LINK_BENCH_MAX_PAYLOAD];
+                link_probe_pkt_t *probe = (link_probe_pkt_t *)frame;
+                for (size_t i = sizeof(link_probe_pkt_t); i < bench->config.payload_len; i++)
+                        frame[i] = i;
+                probe->seq = bench->next_seq++;
+
+                link_bench_slot_t *slot = &bench->slots[probe->seq % LINK_BENCH_INFLIGHT];
+                if (slot->pending)
+                        bench->result.lost++; // Overtaken by the timeout of a faster rate
+                probe->sent_us = link->now_us(link->ctx);
+                *slot = (link_bench_slot_t){.seq = probe->seq, .sent_us = probe->sent_us, .pending = true};
+                if (link->send(link->ctx, false, frame, bench->config.payload_len))
+                {
+                        bench->result.sent++;
+                }
+                else
+                {
+                        slot->pending = false;
+                        bench->result.send_failed++;
+                }
+                bench->next_us += period_us;
+                if (bench->next_us < now)
+                        bench->next_us = now;
+        }
+
+        if (bench->next_seq < bench->config.count)
+                return bench->next_us;
+        for (size_t i = 0; i < LINK_BENCH_INFLIGHT; i++)
+        {
+                if (bench->slots[i].pending)
+                        return bench->slots[i].sent_us + bench->config.timeout_us;
+        }
+        return -1;
+}
+
+/* An echo received at `rx_us` */
+void link_bench_echo(link_bench_t *bench, const void *frame, size_t len, int64_t rx_us)
+{
+        if (len < sizeof(link_probe_pkt_t))
+                return;
+        const link_probe_pkt_t *probe = frame;
+        link_bench_slot_t *slot = &bench->slots[probe->seq % LINK_BENCH_INFLIGHT];
+        if ((probe->seq >= bench->next_seq) || (slot->seq != probe->seq) || (slot->sent_us != probe->sent_us))
+        {
+                bench->result.late++; // Slot taken by a newer probe, this one was lost long ago
+                return;
+        }
+        if (!slot->pending)
+        {
+                if (rx_us - slot->sent_us >= bench->config.timeout_us)
+                        bench->result.late++;
+                else
+                        bench->result.duplicates++;
+                return;
+        }
+
+        slot->pending = false;
+        int64_t rtt = rx_us - slot->sent_us;
+        uint32_t rtt_us = (rtt < 0) ? 0 : (rtt > UINT32_MAX) ? UINT32_MAX : rtt;
+        bench->histogram[link_bench_bucket(rtt_us)]++;
+        bench->rtt_sum_us += rtt_us;
+        bench->result.received++;
+        if (rtt_us < bench->result.min_us)
+                bench->result.min_us = rtt_us;
+        if (rtt_us > bench->result.max_us)
+                bench->result.max_us = rtt_us;
+}
+
+/* Responder side, a probe goes straight back as an echo */
+bool link_bench_reflect(const link_bench_link_t *link, const void *frame, size_t len)
+{
+        if ((len < sizeof(link_probe_pkt_t)) || (len > LINK_BENCH_MAX_PAYLOAD))
+                return false;
+        return link->send(link->ctx, true, frame, len);
+}
+
+bool link_bench_done(const link_bench_t *bench)
+{
+        if (bench->next_seq < bench->config.count)
+                return false;
+        for (size_t i = 0; i < LINK_BENCH_INFLIGHT; i++)
+        {
+                if (bench->slots[i].pending)
+                        return false;
+        }
+        return true;
+}
+
+/* Smallest round trip with at least `per_million` of the echoes at or below it */
+static uint32_t link_bench_percentile(const link_bench_t *bench, uint32_t per_million)
+{
+        const uint64_t rank = ((uint64_t)bench->result.received * per_million + 999999) / 1000000;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < LINK_BENCH_BUCKETS; i++)
+        {
+                seen += bench->histogram[i];
+                if ((seen >= rank) && (seen > 0))
+                {
+                        uint32_t value = link_bench_bucket_value(i);
+                        if (value < bench->result.min_us)
+                                return bench->result.min_us;
+                        return (value > bench->result.max_us) ? bench->result.max_us : value;
+                }
+        }
+        return bench->result.max_us;
+}
+
+void link_bench_result(const link_bench_t *bench, link_bench_result_t *result)
+{
+        *result = bench->result;
+        if (result->received == 0)
+        {
+                result->min_us = 0;
+                return;
+        }
+        result->p50_us = link_bench_percentile(bench, 500000);
+        result->p90_us = link_bench_percentile(bench, 900000);
+        result->p99_us = link_bench_percentile(bench, 990000);
+        result->p999_us = link_bench_percentile(bench, 999000);
+        result->mean_us = bench->rtt_sum_us / result->received;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+/*
+ * Round trip benchmark of a link. The sender stamps probes with a sequence
+ * number and its send time, the other side sends each one straight back as
+ * an echo, the sender matches echoes to probes by sequence number.
+ *
+ * A probe unanswered after `timeout_us` is lost, an echo of it arriving
+ * later is counted as late and kept out of the histogram. Round trips land
+ * in a log-linear histogram, LINK_BENCH_SUB_BUCKETS per power of two, so a
+ * percentile is within 1/16 of the true value at any scale.
+ *
+ * The link is reached through link_bench_link_t only, the firmware binds it
+ * to ESP-NOW, host/link_bench_loopback.c to a UDP socket on a Linux host.
+ * No IDF headers.
+ * */
+
+#ifndef __packed
+#define __packed __attribute__((packed)) // Host builds, IDF's sys/cdefs.h has it
+#endif
+
+#define LINK_BENCH_INFLIGHT (64)      // Probes awaiting their echo, older ones are lost
+#define LINK_BENCH_SUB_BITS (4)       // Sub-buckets per power of two as a shift
+#define LINK_BENCH_SUB_BUCKETS (1 << LINK_BENCH_SUB_BITS)
+#define LINK_BENCH_MAX_SHIFT (16)     // Top octave is 1 to 2 s in 65 ms steps, slower goes in its last bucket
+#define LINK_BENCH_BUCKETS ((LINK_BENCH_MAX_SHIFT + 2) * LINK_BENCH_SUB_BUCKETS)
+#define LINK_BENCH_MAX_PAYLOAD (200)
+
+typedef struct
+{
+        uint32_t seq;
+        int64_t sent_us; // Sender clock
+        uint8_t fill[];  // Up to `payload_len`, echoed untouched
+} __packed link_probe_pkt_t;
+
+_Static_assert(sizeof(link_probe_pkt_t) == 12, "link_probe_pkt_t wire size changed");
+
+/* What the benchmark needs from the link, `send` returns false when the frame could not go out */
+typedef struct
+{
+        bool (*send)(void *ctx, bool echo, const void *frame, size_t len);
+        int64_t (*now_us)(void *ctx);
+        void *ctx;
+} link_bench_link_t;
+
+typedef struct
+{
+        uint16_t rate_hz;
+        uint16_t payload_len; // Probe size, from sizeof(link_probe_pkt_t) to LINK_BENCH_MAX_PAYLOAD
+        uint32_t count;       // Probes per run
+        uint32_t timeout_us;
+} link_bench_config_t;
+
+typedef struct
+{
+        uint32_t sent;
+        uint32_t received;
+        uint32_t lost;       // Not echoed within the timeout
+        uint32_t late;       // Echoes of lost probes
+        uint32_t duplicates; // Echoes of probes already answered
+        uint32_t send_failed;
+        uint32_t min_us;
+        uint32_t p50_us;
+        uint32_t p90_us;
+        uint32_t p99_us;
+        uint32_t p999_us;
+        uint32_t max_us;
+        uint32_t mean_us;
+} link_bench_result_t;
+
+typedef struct
+{
+        int64_t sent_us;
+        uint32_t seq;
+        bool pending;
+} link_bench_slot_t;
+
+typedef struct
+{
+        link_bench_config_t config;
+        link_bench_link_t link;
+        int64_t next_us; // Next probe
+        uint32_t next_seq;
+        uint64_t rtt_sum_us;
+        link_bench_result_t result; // Counters, percentiles are filled in by link_bench_result
+        link_bench_slot_t slots[LINK_BENCH_INFLIGHT];
+        uint32_t histogram[LINK_BENCH_BUCKETS];
+} link_bench_t;
+
+link_bench_config_t *link_bench_default_config(link_bench_config_t *config);
+void link_bench_init(link_bench_t *bench, const link_bench_config_t *config, const link_bench_link_t *link);
+int64_t link_bench_poll(link_bench_t *bench);
+void link_bench_echo(link_bench_t *bench, const void *frame, size_t len, int64_t rx_us);
+bool link_bench_reflect(const link_bench_link_t *link, const void *frame, size_t len);
+bool link_bench_done(const link_bench_t *bench);
+void link_bench_result(const link_bench_t *bench, link_bench_result_t *result);
@@ -0,0 +1,231 @@
+
+#include "link_bench_espnow.h"
+#include "link_throughput_espnow.h"
+
+static const char *TAG = "link_bench";
+
+typedef struct
+{
+        int64_t rx_us;
+        uint8_t frame[sizeof(link_probe_pkt_t)]; // Matching needs the header only
+} link_bench_echo_t;
+
+static link_bench_sweep_config_t link_bench_config;
+static link_bench_t link_bench;
+static espnow_send_param_t link_bench_send_param;
+static spsc_ring_t link_bench_echo_ring;
+static link_bench_echo_t link_bench_echo_buffer[LINK_BENCH_ECHO_RING_SIZE];
+static esp_timer_handle_t link_bench_timer = NULL;
+static atomic_bool link_bench_requested = false;
+static atomic_bool link_bench_active = false; // Set by the app task, cleared by the timer once the sweep is over
+static bool link_bench_starting = false;      // Next timer call starts the run of `link_bench_rate_index`
+static uint8_t link_bench_rate_index = 0;
+static wifi_phy_rate_t link_bench_restore_rate = WIFI_PHY_RATE_MAX;
+
+_Static_assert(sizeof(link_bench_config) + sizeof(link_bench) + sizeof(link_bench_send_param) + sizeof(link_bench_echo_ring) +
+                       sizeof(link_bench_echo_buffer) <=
+                   MEM_BUDGET_LINK_BENCH_ESPNOW_BYTES,
+               "Link benchmark over budget");
+
+#define LINK_BENCH_DRAIN_US (10 * 1000) // Longest wait between echo checks, ends a run soon after its last echo
+
+link_bench_sweep_config_t *link_bench_default_sweep_config(link_bench_sweep_config_t *config)
+{
+        if (config == NULL)
+        {
+                LOG_ERROR("NULL pointer, config=0x%X", (uintptr_t)config);
+                return NULL;
+        }
+        link_bench_default_config(&config->run);
+        // Long range rates first, then the 802.11b and OFDM floors
+        config->phy_rates[0] = WIFI_PHY_RATE_LORA_250K;
+        config->phy_rates[1] = WIFI_PHY_RATE_LORA_500K;
+        config->phy_rates[2] = WIFI_PHY_RATE_1M_L;
+        config->phy_rates[3] = WIFI_PHY_RATE_6M;
+        config->phy_rate_count = 4;
+        return config;
+}
+
+static bool link_bench_send(void *ctx, bool echo, const void *frame, size_t len)
+{
+        espnow_param_type_t type = echo ? ESPNOW_PARAM_TYPE_PROBE_ECHO : ESPNOW_PARAM_TYPE_PROBE;
+        return espnow_send_data((espnow_send_param_t *)ctx, type, (void *)frame, len) == ESP_OK;
+}
+
+static int64_t link_bench_now_us(void *ctx)
+{
+        return esp_timer_get_time();
+}
+
+/* Handler for ESPNOW_PARAM_TYPE_PROBE, answered from the app task whether or not this side benchmarks */
+static void link_bench_probe_handler(esp_peer_t *peer, const void *payload, size_t len, void *arg)
+{
+        espnow_send_param_t send_param;
+        espnow_get_send_param(&send_param, peer);
+        send_param.wait_ms = 0; // Never stalls the app task, a dropped echo is counted as lost
+        const link_bench_link_t link = {.send = link_bench_send, .now_us = link_bench_now_us, .ctx = &send_param};
+        if (!link_bench_reflect(&link, payload, len))
+                LOG_VERBOSE("Echo to " MACSTR " failed, len:%d", MAC2STR(peer->mac), len);
+}
+
+/* Handler for ESPNOW_PARAM_TYPE_PROBE_ECHO, timed by the receive callback */
+static void link_bench_echo_handler(esp_peer_t *peer, const void *payload, size_t len, void *arg)
+{
+        if ((len < sizeof(link_probe_pkt_t)) || !atomic_load(&link_bench_active) || (memcmp(peer->mac, link_bench_send_param.dest_mac, ESP_NOW_ETH_ALEN) != 0))
+                return;
+
+        link_bench_echo_t echo = {.rx_us = peer->lastrx_us};
+        memcpy(echo.frame, payload, sizeof(echo.frame));
+        if (!spsc_ring_push(&link_bench_echo_ring, &echo))
+                LOG_VERBOSE("Echo ring full, counted as lost");
+}
+
+static void link_bench_publish(const link_bench_result_t *result)
+{
+        const link_bench_record_t record = {
+            .phy_rate = link_bench_config.phy_rates[link_bench_rate_index],
+            .channel = espnow_get_channel(),
+            .payload_len = link_bench.config.payload_len,
+            .rate_hz = link_bench.config.rate_hz,
+            .sent = result->sent,
+            .received = result->received,
+            .lost = result->lost,
+            .late = result->late,
+            .duplicates = result->duplicates,
+            .min_us = result->min_us,
+            .p50_us = result->p50_us,
+            .p90_us = result->p90_us,
+            .p99_us = result->p99_us,
+            .p999_us = result->p999_us,
+            .max_us = result->max_us,
+            .mean_us = result->mean_us,
+        };
+        telemetry_send(TELEMETRY_RECORD_LINK_BENCH, &record, sizeof(record));
+        LOG_INFO("bench rate:0x%02X ch:%d len:%d sent:%d recv:%d lost:%d late:%d dup:%d fail:%d | rtt_us min:%d p50:%d p90:%d p99:%d p99.9:%d max:%d mean:%d",
+                 record.phy_rate, record.channel, record.payload_len, result->sent, result->received, result->lost,
+                 result->late, result->duplicates, result->send_failed, result->min_us, result->p50_us, result->p90_us,
+                 result->p99_us, result->p999_us, result->max_us, result->mean_us);
+}
+
+static void link_bench_timer_cb(void *arg)
+{
+        link_bench_echo_t echo;
+        if (link_bench_starting)
+        {
+                link_bench_starting = false;
+                while (spsc_ring_pop(&link_bench_echo_ring, &echo)) // Stragglers of the previous run
+                        ;
+                espnow_set_phy_rate(link_bench_config.phy_rates[link_bench_rate_index]);
+                const link_bench_link_t link = {.send = link_bench_send, .now_us = link_bench_now_us, .ctx = &link_bench_send_param};
+                link_bench_init(&link_bench, &link_bench_config.run, &link);
+        }
+
+        while (spsc_ring_pop(&link_bench_echo_ring, &echo))
+                link_bench_echo(&link_bench, echo.frame, sizeof(echo.frame), echo.rx_us);
+
+        int64_t next_us = link_bench_poll(&link_bench);
+        if (next_us >= 0)
+        {
+                int64_t wait_us = next_us - esp_timer_get_time();
+                wait_us = (wait_us < 0) ? 0 : (wait_us > LINK_BENCH_DRAIN_US) ? LINK_BENCH_DRAIN_US : wait_us;
+                esp_timer_start_once(link_bench_timer, wait_us);
+                return;
+        }
+
+        link_bench_result_t result;
+        link_bench_result(&link_bench, &result);
+        link_bench_publish(&result);
+        if (++link_bench_rate_index < link_bench_config.phy_rate_count)
+        {
+                link_bench_starting = true;
+                esp_timer_start_once(link_bench_timer, 0);
+                return;
+        }
+
+        espnow_set_phy_rate(link_bench_restore_rate);
+        atomic_store(&link_bench_active, false);
+        LOG_INFO("Benchmark sweep done");
+}
+
+esp_err_t link_bench_espnow_init(const link_bench_sweep_config_t *config)
+{
+        if (config == NULL)
+        {
+                LOG_ERROR("NULL pointer, config=0x%X", (uintptr_t)config);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if (link_bench_timer != NULL)
+        {
+                LOG_WARNING("Already initialized, timer=0x%X", (uintptr_t)link_bench_timer);
+                return ESP_ERR_INVALID_STATE;
+        }
+        if ((config->phy_rate_count == 0) || (config->phy_rate_count > LINK_BENCH_MAX_RATES))
+        {
+                LOG_ERROR("Invalid config, phy_rate_count=%d", config->phy_rate_count);
+                return ESP_ERR_INVALID_ARG;
+        }
+
+        link_bench_config = *config;
+        spsc_ring_init(&link_bench_echo_ring, link_bench_echo_buffer, sizeof(link_bench_echo_t), LINK_BENCH_ECHO_RING_SIZE);
+        ESP_ERROR_CHECK(packet_dispatch_register(ESPNOW_PARAM_TYPE_PROBE, link_bench_probe_handler, LINK_BENCH_MAX_PAYLOAD, PACKET_DISPATCH_VARIABLE_LEN, NULL));
+        ESP_ERROR_CHECK(packet_dispatch_register(ESPNOW_PARAM_TYPE_PROBE_ECHO, link_bench_echo_handler, LINK_BENCH_MAX_PAYLOAD, PACKET_DISPATCH_VARIABLE_LEN, NULL));
+
+        const esp_timer_create_args_t timer_args = {
+            .callback = link_bench_timer_cb,
+            .name = "link_bench",
+        };
+        return esp_timer_create(&timer_args, &link_bench_timer);
+}
+
+/* From the console task, the sweep starts on the next link_bench_update with a peer connected */
+void link_bench_request(void)
+{
+        atomic_store(&link_bench_requested, true);
+}
+
+bool link_bench_running(void)
+{
+        return atomic_load(&link_bench_active);
+}
+
+/* Call periodically from the app task */
+void link_bench_update(esp_connection_handle_t *handle)
+{
+        if ((handle == NULL) || (handle->entries == NULL))
+        {
+                LOG_ERROR("NULL pointer, handle=0x%X, handle->entries=0x%X", (uintptr_t)handle, (uintptr_t)handle->entries);
+                return;
+        }
+        if (!atomic_exchange(&link_bench_requested, false))
+                return;
+        if (link_bench_timer == NULL)
+        {
+                LOG_WARNING("Not initialized");
+                return;
+        }
+        if (atomic_load(&link_bench_active) || link_throughput_running())
+        {
+                LOG_WARNING("A benchmark is already running");
+                return;
+        }
+
+        for (size_t i = 0; i < handle->size; i++)
+        {
+                esp_peer_t *peer = handle->entries + i;
+                if (peer->status != ESP_PEER_STATUS_CONNECTED)
+                        continue;
+
+                LOG_INFO("Benchmark of " MACSTR ", %d PHY rates, %d probes of %d bytes at %d Hz each", MAC2STR(peer->mac),
+                         link_bench_config.phy_rate_count, link_bench_config.run.count, link_bench_config.run.payload_len,
+                         link_bench_config.run.rate_hz);
+                espnow_get_send_param(&link_bench_send_param, peer);
+                link_bench_send_param.wait_ms = 0; // Sent from the timer callback
+                link_bench_restore_rate = espnow_get_phy_rate();
+                link_bench_rate_index = 0;
+                link_bench_starting = true;
+                atomic_store(&link_bench_active, true);
+                esp_timer_start_once(link_bench_timer, 0);
+                return;
+        }
+        LOG_WARNING("No connected peer to benchmark");
+}
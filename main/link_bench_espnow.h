@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "espnow.h"
+#include "link_bench.h"
+#include "logging.h"
+#include "mem_budget.h"
+#include "packet_dispatch.h"
+#include "spsc_ring.h"
+#include "telemetry.h"
+
+/*
+ * link_bench over ESP-NOW. Typing LINK_BENCH_COMMAND on the console runs one
+ * benchmark per PHY rate of the sweep against the connected peer, each one
+ * ends in a TELEMETRY_RECORD_LINK_BENCH record and a log line.
+ *
+ * Probes and echoes skip the bundle window, it would add up to its length
+ * to every round trip. Echoes are timed in the receive callback, handed from
+ * the app task to the benchmark timer through a ring. Only the local TX rate
+ * is swept, the channel is the current one and is recorded with each run.
+ * */
+
+#define LINK_BENCH_COMMAND "bench" // Typed on the console, starts a sweep
+#define LINK_BENCH_MAX_RATES (4)
+#define LINK_BENCH_ECHO_RING_SIZE (16)
+
+typedef struct
+{
+        link_bench_config_t run;
+        wifi_phy_rate_t phy_rates[LINK_BENCH_MAX_RATES];
+        uint8_t phy_rate_count;
+} link_bench_sweep_config_t;
+
+typedef struct
+{
+        uint8_t phy_rate; // wifi_phy_rate_t
+        uint8_t channel;
+        uint16_t payload_len;
+        uint16_t rate_hz;
+        uint32_t sent;
+        uint32_t received;
+        uint32_t lost;
+        uint32_t late;
+        uint32_t duplicates;
+        uint32_t min_us;
+        uint32_t p50_us;
+        uint32_t p90_us;
+        uint32_t p99_us;
+        uint32_t p999_us;
+        uint32_t max_us;
+        uint32_t mean_us;
+} __packed link_bench_record_t;
+
+_Static_assert(sizeof(link_bench_record_t) == 54, "link_bench_record_t wire size changed, update telemetryDecoder.py");
+
+link_bench_sweep_config_t *link_bench_default_sweep_config(link_bench_sweep_config_t *config);
+esp_err_t link_bench_espnow_init(const link_bench_sweep_config_t *config);
+void link_bench_request(void);
+void link_bench_update(esp_connection_handle_t *handle);
+bool link_bench_running(void);
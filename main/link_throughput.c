@@ -0,0 +1,134 @@
+
+#include "link_throughput.h"
+
+#include <string.h>
+
+#define LINK_THROUGHPUT_DRAIN_US (200 * 1000) // Send callbacks still missing after this never come
+
+link_throughput_config_t *link_throughput_default_config(link_throughput_config_t *config)
+{
+        if (config == NULL)
+                return NULL;
+        config->payload_len = 64;
+        config->window = 4;
+        config->duration_us = 1000 * 1000;
+        return config;
+}
+
+void link_throughput_init(link_throughput_t *bench, const link_throughput_config_t *config, const link_throughput_link_t *link)
+{
+        memset(&bench->result, 0, sizeof(bench->result));
+        bench->config = *config;
+        if (bench->config.payload_len > LINK_THROUGHPUT_MAX_PAYLOAD)
+                bench->config.payload_len = LINK_THROUGHPUT_MAX_PAYLOAD;
+        if (bench->config.window == 0)
+                bench->config.window = 1;
+        if (bench->config.window > LINK_THROUGHPUT_MAX_WINDOW)
+                bench->config.window = LINK_THROUGHPUT_MAX_WINDOW;
+        bench->link = *link;
+        atomic_store(&bench->completed_ok, 0);
+        atomic_store(&bench->completed_fail, 0);
+        for (size_t i = 0; i < sizeof(bench->frame); i++)
+                bench->frame[i] = i;
+        bench->start_us = link->now_us(link->ctx);
+        bench->end_us = bench->start_us + bench->config.duration_us;
+}
+
+/* From the send callback of a frame this run submitted */
+void link_throughput_complete(link_throughput_t *bench, bool success)
+{
+        atomic_fetch_add(success ? &bench->completed_ok : &bench->completed_fail, 1);
+}
+
+uint32_t link_throughput_in_flight(link_throughput_t *bench)
+{
+        uint32_t completed = atomic_load(&bench->completed_ok) + atomic_load(&bench->completed_fail);
+        return (bench->result.accepted > completed) ? bench->result.accepted - completed : 0;
+}
+
+bool link_throughput_done(link_throughput_t *bench)
+{
+        return bench->result.elapsed_us != 0;
+}
+
+/*
+ * Offers frames until the window is full, a stage refuses one or `window`
+ * went out, the last so a slow submit cannot hog the caller. Returns false
+ * once the run is over. Call again on every completion, and soon after a
+ * refusal.
+ * */
+bool link_throughput_poll(link_throughput_t *bench)
+{
+        if (link_throughput_done(bench))
+                return false;
+
+        const link_throughput_link_t *link = &bench->link;
+        int64_t now = link->now_us(link->ctx);
+        if (now >= bench->end_us)
+        {
+                if ((link_throughput_in_flight(bench) > 0) && (now < bench->end_us + LINK_THROUGHPUT_DRAIN_US))
+                        return true;
+                int64_t elapsed = now - bench->start_us;
+                bench->result.elapsed_us = (elapsed > 0) ? elapsed : 1;
+                return false;
+        }
+
+        bench->result.polls++;
+        for (size_t sent = 0; sent < bench->config.window; sent++)
+        {
+                if (link_throughput_in_flight(bench) >= bench->config.window)
+                {
+                        bench->result.window_full++;
+                        break;
+                }
+
+                bench->result.offered++;
+                link_throughput_submit_t ret = link->submit(link->ctx, bench->frame, bench->config.payload_len);
+                if (ret == LINK_THROUGHPUT_SUBMIT_OK)
+                {
+                        bench->result.accepted++;
+                        continue;
+                }
+                if (ret == LINK_THROUGHPUT_SUBMIT_NO_BUFFER)
+                        bench->result.no_buffer++;
+                else if (ret == LINK_THROUGHPUT_SUBMIT_QUEUE_FULL)
+                        bench->result.queue_full++;
+                else
+                        bench->result.submit_error++;
+                break;
+        }
+        return true;
+}
+
+void link_throughput_result(link_throughput_t *bench, link_throughput_result_t *result)
+{
+        *result = bench->result;
+        result->completed_ok = atomic_load(&bench->completed_ok);
+        result->completed_fail = atomic_load(&bench->completed_fail);
+}
+
+/* `count` over the run, unit: per second */
+uint32_t link_throughput_rate(const link_throughput_result_t *result, uint32_t count)
+{
+        if (result->elapsed_us == 0)
+                return 0;
+        return (uint64_t)count * 1000000 / result->elapsed_us;
+}
+
+/* Stage the run saturated at, the most upstream one that refused a notable share */
+link_throughput_limit_t link_throughput_limit(const link_throughput_result_t *result, uint16_t cpu_permille)
+{
+        const uint64_t offered = (result->offered > 0) ? result->offered : 1;
+        const uint64_t completed = result->completed_ok + result->completed_fail;
+        if (cpu_permille >= LINK_THROUGHPUT_CPU_LIMIT_PERMILLE)
+                return LINK_THROUGHPUT_LIMIT_CPU;
+        if (result->no_buffer * 1000 >= offered * LINK_THROUGHPUT_REFUSED_PERMILLE)
+                return LINK_THROUGHPUT_LIMIT_BUFFER;
+        if (result->queue_full * 1000 >= offered * LINK_THROUGHPUT_REFUSED_PERMILLE)
+                return LINK_THROUGHPUT_LIMIT_QUEUE;
+        if ((completed > 0) && (result->completed_fail * 1000 >= completed * LINK_THROUGHPUT_FAILED_PERMILLE))
+                return LINK_THROUGHPUT_LIMIT_AIR;
+        if (result->window_full * 2 >= result->polls)
+                return LINK_THROUGHPUT_LIMIT_WINDOW;
+        return LINK_THROUGHPUT_LIMIT_SENDER;
+}
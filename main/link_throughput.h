@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Saturation throughput of a send path. The sender keeps up to `window`
+ * frames in flight, submitted but not yet reported back by the send
+ * callback, and offers a new one whenever the window has room, for
+ * `duration_us`.
+ *
+ * Every stage that can refuse a frame has its own counter: no free frame
+ * buffer, driver queue full, send callback reporting a failure. The stage
+ * that refused most, or the window itself when nothing refused, is where
+ * the path saturated, see link_throughput_limit().
+ *
+ * The send path is reached through link_throughput_link_t only, the
+ * firmware binds it to ESP-NOW, host/link_throughput_mock.c to a mock of
+ * the stack on a Linux host. link_throughput_complete() may be called from
+ * any thread. No IDF headers.
+ * */
+
+#define LINK_THROUGHPUT_MAX_PAYLOAD (250)
+#define LINK_THROUGHPUT_MAX_WINDOW (32)
+#define LINK_THROUGHPUT_CPU_LIMIT_PERMILLE (900) // Sending core busier than this is the limit itself
+#define LINK_THROUGHPUT_REFUSED_PERMILLE (10)    // Share of offered frames a stage refuses before it is the limit
+#define LINK_THROUGHPUT_FAILED_PERMILLE (100)    // Share of send callbacks failing before the air is the limit
+
+typedef enum
+{
+        LINK_THROUGHPUT_SUBMIT_OK,
+        LINK_THROUGHPUT_SUBMIT_NO_BUFFER,  // No frame to build it in
+        LINK_THROUGHPUT_SUBMIT_QUEUE_FULL, // Driver queue full
+        LINK_THROUGHPUT_SUBMIT_ERROR,
+} link_throughput_submit_t;
+
+typedef enum
+{
+        LINK_THROUGHPUT_LIMIT_SENDER, // Never filled the window, the sender loop is the bottleneck
+        LINK_THROUGHPUT_LIMIT_WINDOW, // Waiting on send callbacks, airtime and acknowledgments
+        LINK_THROUGHPUT_LIMIT_BUFFER,
+        LINK_THROUGHPUT_LIMIT_QUEUE,
+        LINK_THROUGHPUT_LIMIT_AIR, // Frames go out but are not acknowledged
+        LINK_THROUGHPUT_LIMIT_CPU,
+        LINK_THROUGHPUT_LIMIT_MAX,
+} link_throughput_limit_t;
+
+static const char __attribute__((unused)) * LINK_THROUGHPUT_LIMIT_STRING[] = {
+    "sender",
+    "window",
+    "buffer",
+    "queue",
+    "air",
+    "cpu",
+    "LINK_THROUGHPUT_LIMIT_MAX"};
+
+typedef struct
+{
+        link_throughput_submit_t (*submit)(void *ctx, const void *frame, size_t len);
+        int64_t (*now_us)(void *ctx);
+        void *ctx;
+} link_throughput_link_t;
+
+typedef struct
+{
+        uint16_t payload_len; // Up to LINK_THROUGHPUT_MAX_PAYLOAD
+        uint8_t window;       // Frames in flight, 1 to LINK_THROUGHPUT_MAX_WINDOW
+        uint32_t duration_us;
+} link_throughput_config_t;
+
+typedef struct
+{
+        uint32_t elapsed_us; // From the first offer to the last completion
+        uint32_t offered;    // Submit attempts
+        uint32_t accepted;
+        uint32_t no_buffer;
+        uint32_t queue_full;
+        uint32_t submit_error;
+        uint32_t completed_ok;   // Send callbacks reporting success
+        uint32_t completed_fail; // Send callbacks reporting failure
+        uint32_t polls;
+        uint32_t window_full; // Polls that stopped on a full window
+} link_throughput_result_t;
+
+typedef struct
+{
+        link_throughput_config_t config;
+        link_throughput_link_t link;
+        int64_t start_us;
+        int64_t end_us; // Offers stop here, the run ends once the window drained
+        link_throughput_result_t result;
+        atomic_uint_fast32_t completed_ok;
+        atomic_uint_fast32_t completed_fail;
+        uint8_t frame[LINK_THROUGHPUT_MAX_PAYLOAD];
+} link_throughput_t;
+
+link_throughput_config_t *link_throughput_default_config(link_throughput_config_t *config);
+void link_throughput_init(link_throughput_t *bench, const link_throughput_config_t *config, const link_throughput_link_t *link);
+bool link_throughput_poll(link_throughput_t *bench);
+void link_throughput_complete(link_throughput_t *bench, bool success);
+uint32_t link_throughput_in_flight(link_throughput_t *bench);
+bool link_throughput_done(link_throughput_t *bench);
+void link_throughput_result(link_throughput_t *bench, link_throughput_result_t *result);
+uint32_t link_throughput_rate(const link_throughput_result_t *result, uint32_t count);
+link_throughput_limit_t link_throughput_limit(const link_throughput_result_t *result, uint16_t cpu_permille);
@@ -0,0 +1,342 @@
+
+#include "link_throughput_espnow.h"
+
+static const char *TAG = "link_throughput";
+
+typedef struct
+{
+        uint32_t idle[portNUM_PROCESSORS];
+        uint32_t total;
+} link_throughput_cpu_t;
+
+static link_throughput_sweep_config_t link_throughput_config;
+static link_throughput_t link_throughput;
+static espnow_send_param_t link_throughput_send_param;
+static esp_timer_handle_t link_throughput_timer = NULL;
+static atomic_bool link_throughput_requested = false;
+static atomic_bool link_throughput_active = false;  // Set by the app task, cleared by the timer once the sweep is over
+static atomic_bool link_throughput_waiting = false; // Timer parked on a full window, the send hook wakes it
+static bool link_throughput_starting = false;       // Next timer call starts the run at the indices below
+static uint8_t link_throughput_rate_index = 0;
+static uint8_t link_throughput_payload_index = 0;
+static uint8_t link_throughput_window_index = 0;
+static wifi_phy_rate_t link_throughput_restore_rate = WIFI_PHY_RATE_MAX;
+static link_throughput_cpu_t link_throughput_cpu_start;
+static uint32_t link_throughput_ring_dropped_start = 0;
+static uint32_t link_throughput_window_rate[LINK_THROUGHPUT_MAX_WINDOWS]; // Completions per second of each window at this payload size
+static uint8_t link_throughput_window_limit[LINK_THROUGHPUT_MAX_WINDOWS];
+
+_Static_assert(sizeof(link_throughput_config) + sizeof(link_throughput) + sizeof(link_throughput_send_param) + sizeof(link_throughput_window_rate) +
+                       sizeof(link_throughput_window_limit) <=
+                   MEM_BUDGET_LINK_THROUGHPUT_ESPNOW_BYTES,
+               "Throughput benchmark over budget");
+
+#define LINK_THROUGHPUT_WAIT_US (2 * 1000) // Fallback when a send callback never wakes the timer
+#define LINK_THROUGHPUT_RETRY_US (200)     // After a refused frame, gives the stage time to drain
+#define LINK_THROUGHPUT_KNEE_PERMILLE (950)
+
+link_throughput_sweep_config_t *link_throughput_default_sweep_config(link_throughput_sweep_config_t *config)
+{
+        if (config == NULL)
+        {
+                LOG_ERROR("NULL pointer, config=0x%X", (uintptr_t)config);
+                return NULL;
+        }
+        *config = (link_throughput_sweep_config_t){
+            .duration_us = 1000 * 1000,
+            .phy_rates = {WIFI_PHY_RATE_LORA_250K, WIFI_PHY_RATE_LORA_500K, WIFI_PHY_RATE_1M_L, WIFI_PHY_RATE_6M},
+            .payload_lens = {0, 64, 128, LINK_THROUGHPUT_ESPNOW_MAX_PAYLOAD},
+            .windows = {1, 2, 4, 8},
+            .phy_rate_count = 4,
+            .payload_count = 4,
+            .window_count = 4,
+        };
+        return config;
+}
+
+static link_throughput_submit_t link_throughput_submit(void *ctx, const void *frame, size_t len)
+{
+        esp_err_t ret = espnow_send_data((espnow_send_param_t *)ctx, ESPNOW_PARAM_TYPE_BULK, (void *)frame, len);
+        switch (ret)
+        {
+        case ESP_OK:
+                return LINK_THROUGHPUT_SUBMIT_OK;
+        case ESP_ERR_INVALID_STATE: // No frame from the TX pool
+                return LINK_THROUGHPUT_SUBMIT_NO_BUFFER;
+        case ESP_ERR_TIMEOUT: // TX window of espnow.c full
+        case ESP_ERR_ESPNOW_NO_MEM:
+                return LINK_THROUGHPUT_SUBMIT_QUEUE_FULL;
+        default:
+                return LINK_THROUGHPUT_SUBMIT_ERROR;
+        }
+}
+
+static int64_t link_throughput_now_us(void *ctx)
+{
+        return esp_timer_get_time();
+}
+
+/* From the Wi-Fi task */
+static void link_throughput_send_hook(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+        if (!atomic_load(&link_throughput_active) || (memcmp(mac_addr, link_throughput_send_param.dest_mac, ESP_NOW_ETH_ALEN) != 0))
+                return;
+        link_throughput_complete(&link_throughput, status == ESP_NOW_SEND_SUCCESS);
+        if (atomic_exchange(&link_throughput_waiting, false))
+        {
+                esp_timer_stop(link_throughput_timer);
+                esp_timer_start_once(link_throughput_timer, 0);
+        }
+}
+
+static void link_throughput_cpu_sample(link_throughput_cpu_t *sample)
+{
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        for (size_t core = 0; core < portNUM_PROCESSORS; core++)
+        {
+                TaskStatus_t status;
+                vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(core), &status, pdFALSE, eInvalid);
+                sample->idle[core] = status.ulRunTimeCounter;
+        }
+        sample->total = portGET_RUN_TIME_COUNTER_VALUE();
+#else
+        *sample = (link_throughput_cpu_t){0};
+#endif
+}
+
+/* Busy share of `core` since `start`, counters wrap */
+static uint16_t link_throughput_cpu_load(const link_throughput_cpu_t *start, const link_throughput_cpu_t *end, size_t core)
+{
+        uint32_t total = end->total - start->total;
+        uint32_t idle = end->idle[core] - start->idle[core];
+        if ((total == 0) || (idle >= total))
+                return 0;
+        return 1000 - (uint64_t)idle * 1000 / total;
+}
+
+static uint32_t link_throughput_ring_dropped(void)
+{
+        watermark_queue_stat_t stat;
+        return watermark_queue_get(WATERMARK_QUEUE_ESPNOW, &stat) ? stat.dropped : 0;
+}
+
+static void link_throughput_start_run(void)
+{
+        const link_throughput_config_t config = {
+            .payload_len = link_throughput_config.payload_lens[link_throughput_payload_index],
+            .window = link_throughput_config.windows[link_throughput_window_index],
+            .duration_us = link_throughput_config.duration_us,
+        };
+        const link_throughput_link_t link = {.submit = link_throughput_submit, .now_us = link_throughput_now_us, .ctx = &link_throughput_send_param};
+        if ((link_throughput_payload_index == 0) && (link_throughput_window_index == 0))
+                espnow_set_phy_rate(link_throughput_config.phy_rates[link_throughput_rate_index]);
+        link_throughput_ring_dropped_start = link_throughput_ring_dropped();
+        link_throughput_cpu_sample(&link_throughput_cpu_start);
+        link_throughput_init(&link_throughput, &config, &link);
+}
+
+static void link_throughput_finish_run(void)
+{
+        link_throughput_cpu_t cpu_end;
+        link_throughput_cpu_sample(&cpu_end);
+        link_throughput_result_t result;
+        link_throughput_result(&link_throughput, &result);
+
+        link_throughput_record_t record = {
+            .phy_rate = link_throughput_config.phy_rates[link_throughput_rate_index],
+            .channel = espnow_get_channel(),
+            .payload_len = link_throughput.config.payload_len,
+            .window = link_throughput.config.window,
+            .elapsed_us = result.elapsed_us,
+            .offered = result.offered,
+            .accepted = result.accepted,
+            .no_buffer = result.no_buffer,
+            .queue_full = result.queue_full,
+            .submit_error = result.submit_error,
+            .completed_ok = result.completed_ok,
+            .completed_fail = result.completed_fail,
+            .ring_dropped = link_throughput_ring_dropped() - link_throughput_ring_dropped_start,
+        };
+        for (size_t core = 0; (core < portNUM_PROCESSORS) && (core < 2); core++)
+                record.cpu_permille[core] = link_throughput_cpu_load(&link_throughput_cpu_start, &cpu_end, core);
+        record.limit = link_throughput_limit(&result, record.cpu_permille[0]); // Wi-Fi and esp_timer tasks both live on core 0
+        telemetry_send(TELEMETRY_RECORD_LINK_THROUGHPUT, &record, sizeof(record));
+
+        const uint32_t completed = link_throughput_rate(&result, result.completed_ok + result.completed_fail);
+        LOG_INFO("throughput rate:0x%02X len:%3d window:%2d | offered/s:%5d accepted/s:%5d complete/s:%5d ok:%d fail:%d | no_buffer:%d queue_full:%d error:%d ring_dropped:%d | cpu:%d,%d | limit:%s",
+                 record.phy_rate, record.payload_len, record.window, link_throughput_rate(&result, result.offered),
+                 link_throughput_rate(&result, result.accepted), completed, result.completed_ok, result.completed_fail,
+                 result.no_buffer, result.queue_full, result.submit_error, record.ring_dropped, record.cpu_permille[0],
+                 record.cpu_permille[1], LINK_THROUGHPUT_LIMIT_STRING[record.limit]);
+        link_throughput_window_rate[link_throughput_window_index] = completed;
+        link_throughput_window_limit[link_throughput_window_index] = record.limit;
+}
+
+/* After the last window of a payload size: the smallest window that got within reach of the best rate */
+static void link_throughput_show_knee(void)
+{
+        uint32_t best = 0;
+        for (size_t i = 0; i < link_throughput_config.window_count; i++)
+        {
+                if (link_throughput_window_rate[i] > best)
+                        best = link_throughput_window_rate[i];
+        }
+        for (size_t i = 0; i < link_throughput_config.window_count; i++)
+        {
+                if ((uint64_t)link_throughput_window_rate[i] * 1000 >= (uint64_t)best * LINK_THROUGHPUT_KNEE_PERMILLE)
+                {
+                        LOG_INFO("throughput rate:0x%02X len:%3d saturates at window %d, %d frames/s, limit:%s",
+                                 link_throughput_config.phy_rates[link_throughput_rate_index],
+                                 link_throughput_config.payload_lens[link_throughput_payload_index], link_throughput_config.windows[i],
+                                 link_throughput_window_rate[i], LINK_THROUGHPUT_LIMIT_STRING[link_throughput_window_limit[i]]);
+                        return;
+                }
+        }
+}
+
+/* Moves to the next setting, window fastest, then payload size, then PHY rate. Returns false after the last */
+static bool link_throughput_next(void)
+{
+        if (++link_throughput_window_index < link_throughput_config.window_count)
+                return true;
+        link_throughput_show_knee();
+        link_throughput_window_index = 0;
+        if (++link_throughput_payload_index < link_throughput_config.payload_count)
+                return true;
+        link_throughput_payload_index = 0;
+        return ++link_throughput_rate_index < link_throughput_config.phy_rate_count;
+}
+
+static void link_throughput_timer_cb(void *arg)
+{
+        if (link_throughput_starting)
+        {
+                link_throughput_starting = false;
+                link_throughput_start_run();
+        }
+
+        const link_throughput_result_t *result = &link_throughput.result;
+        const uint32_t refused = result->no_buffer + result->queue_full + result->submit_error;
+        if (link_throughput_poll(&link_throughput))
+        {
+                if (result->no_buffer + result->queue_full + result->submit_error != refused)
+                {
+                        esp_timer_start_once(link_throughput_timer, LINK_THROUGHPUT_RETRY_US);
+                }
+                else if (link_throughput_in_flight(&link_throughput) >= link_throughput.config.window)
+                {
+                        // Already armed when the send hook got in between, either way one call follows
+                        atomic_store(&link_throughput_waiting, true);
+                        esp_timer_start_once(link_throughput_timer, LINK_THROUGHPUT_WAIT_US);
+                }
+                else
+                {
+                        esp_timer_start_once(link_throughput_timer, 0);
+                }
+                return;
+        }
+
+        atomic_store(&link_throughput_waiting, false);
+        link_throughput_finish_run();
+        if (link_throughput_next())
+        {
+                link_throughput_starting = true;
+                esp_timer_start_once(link_throughput_timer, 0);
+                return;
+        }
+
+        espnow_set_send_hook(NULL);
+        espnow_set_phy_rate(link_throughput_restore_rate);
+        atomic_store(&link_throughput_active, false);
+        LOG_INFO("Throughput sweep done");
+}
+
+esp_err_t link_throughput_espnow_init(const link_throughput_sweep_config_t *config)
+{
+        if (config == NULL)
+        {
+                LOG_ERROR("NULL pointer, config=0x%X", (uintptr_t)config);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if (link_throughput_timer != NULL)
+        {
+                LOG_WARNING("Already initialized, timer=0x%X", (uintptr_t)link_throughput_timer);
+                return ESP_ERR_INVALID_STATE;
+        }
+        if ((config->phy_rate_count == 0) || (config->phy_rate_count > LINK_THROUGHPUT_MAX_RATES) || (config->payload_count == 0) ||
+            (config->payload_count > LINK_THROUGHPUT_MAX_SIZES) || (config->window_count == 0) || (config->window_count > LINK_THROUGHPUT_MAX_WINDOWS))
+        {
+                LOG_ERROR("Invalid config, phy_rate_count=%d, payload_count=%d, window_count=%d", config->phy_rate_count,
+                          config->payload_count, config->window_count);
+                return ESP_ERR_INVALID_ARG;
+        }
+
+        link_throughput_config = *config;
+        for (size_t i = 0; i < link_throughput_config.payload_count; i++)
+        {
+                if (link_throughput_config.payload_lens[i] > LINK_THROUGHPUT_ESPNOW_MAX_PAYLOAD)
+                        link_throughput_config.payload_lens[i] = LINK_THROUGHPUT_ESPNOW_MAX_PAYLOAD;
+        }
+
+        const esp_timer_create_args_t timer_args = {
+            .callback = link_throughput_timer_cb,
+            .name = "link_throughput",
+        };
+        return esp_timer_create(&timer_args, &link_throughput_timer);
+}
+
+/* From the console task, the sweep starts on the next link_throughput_update with a peer connected */
+void link_throughput_request(void)
+{
+        atomic_store(&link_throughput_requested, true);
+}
+
+bool link_throughput_running(void)
+{
+        return atomic_load(&link_throughput_active);
+}
+
+/* Call periodically from the app task */
+void link_throughput_update(esp_connection_handle_t *handle)
+{
+        if ((handle == NULL) || (handle->entries == NULL))
+        {
+                LOG_ERROR("NULL pointer, handle=0x%X, handle->entries=0x%X", (uintptr_t)handle, (uintptr_t)handle->entries);
+                return;
+        }
+        if (!atomic_exchange(&link_throughput_requested, false))
+                return;
+        if (link_throughput_timer == NULL)
+        {
+                LOG_WARNING("Not initialized");
+                return;
+        }
+        if (atomic_load(&link_throughput_active) || link_bench_running())
+        {
+                LOG_WARNING("A benchmark is already running");
+                return;
+        }
+
+        for (size_t i = 0; i < handle->size; i++)
+        {
+                esp_peer_t *peer = handle->entries + i;
+                if (peer->status != ESP_PEER_STATUS_CONNECTED)
+                        continue;
+
+                LOG_INFO("Throughput of " MACSTR ", %d PHY rates x %d payload sizes x %d windows, %d ms each", MAC2STR(peer->mac),
+                         link_throughput_config.phy_rate_count, link_throughput_config.payload_count, link_throughput_config.window_count,
+                         link_throughput_config.duration_us / 1000);
+                espnow_get_send_param(&link_throughput_send_param, peer);
+                link_throughput_send_param.wait_ms = 0; // Sent from the timer callback, a full TX window is a refusal
+                link_throughput_restore_rate = espnow_get_phy_rate();
+                link_throughput_rate_index = 0;
+                link_throughput_payload_index = 0;
+                link_throughput_window_index = 0;
+                link_throughput_starting = true;
+                atomic_store(&link_throughput_active, true);
+                espnow_set_send_hook(link_throughput_send_hook);
+                esp_timer_start_once(link_throughput_timer, 0);
+                return;
+        }
+        LOG_WARNING("No connected peer to benchmark");
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "espnow.h"
+#include "link_bench_espnow.h"
+#include "link_throughput.h"
+#include "logging.h"
+#include "mem_budget.h"
+#include "telemetry.h"
+#include "watermark.h"
+
+/*
+ * link_throughput over ESP-NOW. Typing LINK_THROUGHPUT_COMMAND on the
+ * console floods the connected peer with ESPNOW_PARAM_TYPE_BULK frames,
+ * one run per PHY rate, payload size and window of the sweep, each ending
+ * in a TELEMETRY_RECORD_LINK_THROUGHPUT record.
+ *
+ * Frames go through espnow_send_data, so a run exercises the TX frame pool
+ * (no buffer), the TX window and esp_now_send (both queue full) and the
+ * send callback, seen through espnow_set_send_hook before the event ring.
+ * Ring drops and the load of both cores are sampled around each run. After
+ * the last window of a payload size the log names the smallest window
+ * within 5 % of the best rate, where more frames in flight stop paying off.
+ *
+ * The sender runs in an esp_timer callback on core 0, woken by the send
+ * hook whenever the window opens. Other unicast traffic to the peer shows
+ * up as extra completions.
+ * */
+
+#define LINK_THROUGHPUT_COMMAND "throughput" // Typed on the console, starts a sweep
+#define LINK_THROUGHPUT_MAX_RATES (4)
+#define LINK_THROUGHPUT_MAX_SIZES (6)
+#define LINK_THROUGHPUT_MAX_WINDOWS (6)
+#define LINK_THROUGHPUT_ESPNOW_MAX_PAYLOAD (ESP_NOW_MAX_DATA_LEN - sizeof(espnow_data_t))
+
+typedef struct
+{
+        uint32_t duration_us; // Per run
+        wifi_phy_rate_t phy_rates[LINK_THROUGHPUT_MAX_RATES];
+        uint16_t payload_lens[LINK_THROUGHPUT_MAX_SIZES];
+        uint8_t windows[LINK_THROUGHPUT_MAX_WINDOWS]; // Ascending
+        uint8_t phy_rate_count;
+        uint8_t payload_count;
+        uint8_t window_count;
+} link_throughput_sweep_config_t;
+
+typedef struct
+{
+        uint8_t phy_rate; // wifi_phy_rate_t
+        uint8_t channel;
+        uint16_t payload_len;
+        uint8_t window;
+        uint8_t limit;            // link_throughput_limit_t
+        uint16_t cpu_permille[2]; // Per core, 0 without run time stats
+        uint32_t elapsed_us;
+        uint32_t offered;
+        uint32_t accepted;
+        uint32_t no_buffer;
+        uint32_t queue_full;
+        uint32_t submit_error;
+        uint32_t completed_ok;
+        uint32_t completed_fail;
+        uint32_t ring_dropped; // Events lost by the espnow ring during the run
+} __packed link_throughput_record_t;
+
+_Static_assert(sizeof(link_throughput_record_t) == 46, "link_throughput_record_t wire size changed, update telemetryDecoder.py");
+
+link_throughput_sweep_config_t *link_throughput_default_sweep_config(link_throughput_sweep_config_t *config);
+esp_err_t link_throughput_espnow_init(const link_throughput_sweep_config_t *config);
+void link_throughput_request(void);
+void link_throughput_update(esp_connection_handle_t *handle);
+bool link_throughput_running(void);
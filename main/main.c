@@ -14,15 +14,35 @@
 
 #include "logging.h"
 #include "mathop.h"
+#include "motor_stat_codec.h"
 #include "packets.h"
 #include "joystick.h"
+#include "link_bench_espnow.h"
+#include "link_throughput_espnow.h"
+#include "packet_dispatch.h"
+#include "espnow_bundle.h"
+#include "espnow_pair.h"
+#include "espnow_tx.h"
+#include "channel_scan.h"
+#include "power_manager.h"
+#include "servo_stream.h"
+#include "task_table.h"
+#include "telemetry.h"
 
 static const char __attribute__((unused)) *TAG = "app_main";
 
+#define APP_EVENT_BATCH (8) // Events taken off a ring at once
+
 static espnow_send_param_t espnow_send_param;
 static esp_connection_handle_t esp_connection_handle;
+static event_ring_t *espnow_event_ring;
+static QueueHandle_t button_event_queue;
+static QueueHandle_t joystick_event_queue;
+static servo_stream_config_t servo_stream_config;
+static motor_stat_decoder_t motor_stat_decoder;
+static ws2812_handle_t ws2812_handle;
 
-void motor_controller_print_stat(motor_group_stat_pkt_t *motor_stat)
+void motor_controller_print_stat(const motor_group_stat_pkt_t *motor_stat)
 {
 	LOG_INFO("Lcnt:%6d, Rcnt:%6d | Lspd:%6.3f, Rspd:%6.3f | Lacc:%6.3f, Racc:%6.3f | Lpwm:%6.3f, Rpwm:%6.3f | Δd: %6.3f | Δs: %6.3f",
 			 motor_stat->left_motor.counter, motor_stat->right_motor.counter,
@@ -33,50 +53,71 @@ void motor_controller_print_stat(motor_group_stat_pkt_t *motor_stat)
 			 motor_stat->delta_velocity);
 }
 
-void rssi_task()
+void motor_stat_handler(esp_peer_t *peer, const void *payload, size_t len, void *arg)
+{
+	const motor_group_stat_pkt_t *motor_stat = payload;
+	telemetry_send(TELEMETRY_RECORD_MOTOR_STAT, motor_stat, len);
+	motor_controller_print_stat(motor_stat);
+}
+
+/* Compact stats, forwarded undecoded so the serial link gains as much as the radio */
+void motor_stat_delta_handler(esp_peer_t *peer, const void *payload, size_t len, void *arg)
+{
+	telemetry_send(TELEMETRY_RECORD_MOTOR_STAT_DELTA, payload, len);
+
+	motor_group_stat_pkt_t motor_stat;
+	motor_stat_codec_result_t result = motor_stat_decode(&motor_stat_decoder, payload, len, &motor_stat);
+	if (result == MOTOR_STAT_CODEC_OK)
+		motor_controller_print_stat(&motor_stat);
+	else if (result == MOTOR_STAT_CODEC_BAD_FRAME)
+		LOG_WARNING("Bad motor stat frame, len:%d", len);
+}
+
+void rssi_task(void *pvParameter)
 {
 	ws2812_hsv_t hsv = {.h = 350, .s = 75, .v = 0};
-	ws2812_handle_t ws2812_handle;
-	ws2812_default_config(&ws2812_handle);
-	ws2812_init(&ws2812_handle);
 	ws2812_set_hsv(&ws2812_handle, &hsv);
 	ws2812_update(&ws2812_handle);
 
-	QueueHandle_t rssi_event_queue = rssi_init();
-	uint8_t countdown = 0;
-	uint8_t ping_count = 0;
-	const uint8_t ping_reset = 30;
+	event_ring_t *rssi_event_ring = rssi_init();
+	// Time based, the poll period stretches while the power manager is idle
+	const int64_t heartbeat_interval_us = 300 * 1000;
+	const int64_t led_hold_us = 3 * heartbeat_interval_us;
+	int64_t last_heartbeat_us = 0;
+	int64_t led_hold_until_us = 0;
 	for (;;)
 	{
-		if (ping_count)
-			ping_count--;
-		else
+		int64_t now = esp_timer_get_time();
+		if (now - last_heartbeat_us >= heartbeat_interval_us)
 		{
-			ping_count = ping_reset;
+			last_heartbeat_us = now;
 			esp_connection_send_heartbeat(&esp_connection_handle);
 			// espnow_send_text(&espnow_send_param, "ping");
 			// esp_connection_show_entries(&esp_connection_handle);
 		}
-		rssi_event_t rssi_event;
-		while (xQueueReceive(rssi_event_queue, &rssi_event, 0))
+		rssi_event_t rssi_events[APP_EVENT_BATCH];
+		size_t rssi_event_count;
+		while ((rssi_event_count = event_ring_pop_batch(rssi_event_ring, rssi_events, APP_EVENT_BATCH)) > 0)
 		{
-			// print_rssi_event(&rssi_event);
-			esp_connection_update_rssi(&esp_connection_handle, &rssi_event);
-
-			const int rssi_min = -20;
-			if (rssi_event.rssi > rssi_min)
+			for (size_t i = 0; i < rssi_event_count; i++)
 			{
-				countdown = ping_reset * 3;
-				float led_volume = map(rssi_event.rssi, 0, rssi_min, 50, 0);
-				led_volume = constrain(led_volume, 0, 100);
-				hsv.v = led_volume;
-				ws2812_set_hsv(&ws2812_handle, &hsv);
-				ws2812_update(&ws2812_handle);
+				const rssi_event_t *rssi_event = &rssi_events[i];
+				// print_rssi_event(rssi_event);
+				esp_connection_update_rssi(&esp_connection_handle, rssi_event);
+
+				const int rssi_min = -20;
+				if (rssi_event->rssi > rssi_min)
+				{
+					led_hold_until_us = now + led_hold_us;
+					float led_volume = map(rssi_event->rssi, 0, rssi_min, 50, 0);
+					led_volume = constrain(led_volume, 0, 100);
+					hsv.v = led_volume;
+					ws2812_set_hsv(&ws2812_handle, &hsv);
+					ws2812_update(&ws2812_handle);
+				}
 			}
 		}
-		if (countdown)
-			countdown--;
-		else
+		if (now >= led_hold_until_us)
 		{
 			if (esp_connection_handle.remote_connected)
 				hsv.v = 3 * esp_connection_handle.remote_connected;
@@ -85,7 +126,95 @@ void rssi_task()
 			ws2812_set_hsv(&ws2812_handle, &hsv);
 			ws2812_update(&ws2812_handle);
 		}
-		vTaskDelay(pdMS_TO_TICKS(10));
+		event_ring_wait(rssi_event_ring, power_manager_poll_ticks());
+	}
+}
+
+static void app_handle_espnow_event(espnow_event_t *espnow_evt)
+{
+	espnow_data_t *recv_data = NULL;
+	switch (espnow_evt->id)
+	{
+	case ESPNOW_SEND_CB:
+		espnow_event_send_cb_t *send_cb = &espnow_evt->info.send_cb;
+		if (send_cb->status != ESP_NOW_SEND_SUCCESS)
+		{
+			LOG_WARNING("Send data to peer " MACSTR " failed", MAC2STR(send_cb->mac_addr));
+		}
+		else
+		{
+			LOG_VERBOSE("Send data to peer " MACSTR " success", MAC2STR(send_cb->mac_addr));
+		}
+		break;
+	case ESPNOW_RECV_CB:
+		espnow_event_recv_cb_t *recv_cb = &espnow_evt->info.recv_cb;
+		if (!(recv_data = espnow_data_parse(recv_data, recv_cb)))
+		{
+			LOG_WARNING("bad data packet from peer " MACSTR, MAC2STR(recv_cb->mac_addr));
+			espnow_recv_data_free(recv_cb);
+			break;
+		}
+
+		esp_peer_t *peer = esp_connection_mac_add_to_entry(&esp_connection_handle, recv_cb->mac_addr);
+		espnow_get_send_param(&espnow_send_param, peer);
+		if (esp_peer_process_received(peer, recv_data, recv_cb->rx_time_us))
+			packet_dispatch(peer, recv_data);
+
+		espnow_recv_data_free(recv_cb);
+		break;
+	default:
+		LOG_ERROR("Callback type error: %d", espnow_evt->id);
+		break;
+	}
+}
+
+/* Input to radio path, pinned next to the input tasks and away from the Wi-Fi task */
+void app_task(void *pvParameter)
+{
+	while (true)
+	{
+		button_event_t button_event;
+
+		while (watermark_queue_receive(WATERMARK_QUEUE_JOYSTICK, joystick_event_queue, &button_event))
+		{
+			LOG_INFO("GPIO event: pin %d, state = %s --> %s", button_event.pin, BUTTON_STATE_STRING[button_event.prev_state], BUTTON_STATE_STRING[button_event.new_state]);
+			power_manager_activity();
+
+			// Every edge counts, so no ESPNOW_TX_FLAG_LATEST, and no bundle window in front of an input
+			esp_err_t ret;
+			ret = espnow_tx_send(TX_SCHED_CLASS_CONTROL, &espnow_send_param, ESP_PEER_PACKET_TEXT, &button_event, sizeof(button_event), ESPNOW_TX_FLAG_NONE);
+			ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
+		}
+
+		while (watermark_queue_receive(WATERMARK_QUEUE_BUTTON, button_event_queue, &button_event))
+		{
+			LOG_INFO("GPIO event: pin %d, state = %s --> %s", button_event.pin, BUTTON_STATE_STRING[button_event.prev_state], BUTTON_STATE_STRING[button_event.new_state]);
+			power_manager_activity();
+
+			esp_err_t ret;
+			ret = espnow_tx_send(TX_SCHED_CLASS_CONTROL, &espnow_send_param, ESP_PEER_PACKET_TEXT, &button_event, sizeof(button_event), ESPNOW_TX_FLAG_NONE);
+			ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
+		}
+
+		espnow_event_t espnow_events[APP_EVENT_BATCH];
+		size_t espnow_event_count;
+		while ((espnow_event_count = event_ring_pop_batch(espnow_event_ring, espnow_events, APP_EVENT_BATCH)) > 0)
+			for (size_t i = 0; i < espnow_event_count; i++)
+				app_handle_espnow_event(&espnow_events[i]);
+
+		esp_connection_handle_update(&esp_connection_handle);
+		channel_switch_update(&esp_connection_handle);
+		link_bench_update(&esp_connection_handle);
+		link_throughput_update(&esp_connection_handle);
+
+		// Analog setpoints stream only while a car is connected
+		if (esp_connection_handle.remote_connected && !servo_stream_running())
+			servo_stream_start(&servo_stream_config, &espnow_send_param);
+		else if (!esp_connection_handle.remote_connected && servo_stream_running())
+			servo_stream_stop();
+
+		power_manager_update();
+		power_manager_wait();
 	}
 }
 
@@ -106,7 +235,32 @@ void app_main(void)
 	espnow_default_send_param(&espnow_send_param);
 	esp_connection_handle_init(&esp_connection_handle);
 	esp_connection_set_peer_limit(&esp_connection_handle, 1);
-	QueueHandle_t espnow_event_queue = espnow_init(&espnow_config, &esp_connection_handle);
+	espnow_event_ring = espnow_init(&espnow_config, &esp_connection_handle);
+	packet_dispatch_register(ESPNOW_PARAM_TYPE_MOTOR_STAT, motor_stat_handler, sizeof(motor_group_stat_pkt_t), PACKET_DISPATCH_FIXED_LEN, NULL);
+	motor_stat_decoder_init(&motor_stat_decoder);
+	packet_dispatch_register(ESPNOW_PARAM_TYPE_MOTOR_STAT_DELTA, motor_stat_delta_handler, MOTOR_STAT_CODEC_MAX_FRAME, PACKET_DISPATCH_VARIABLE_LEN, NULL);
+	packet_dispatch_register(ESPNOW_PARAM_TYPE_BUNDLE, espnow_bundle_unpack, ESPNOW_BUNDLE_MAX_PAYLOAD, PACKET_DISPATCH_VARIABLE_LEN, NULL);
+	ESP_ERROR_CHECK(espnow_bundle_init(ESPNOW_BUNDLE_DEFAULT_WINDOW_US));
+	tx_sched_config_t tx_sched_config;
+	ESP_ERROR_CHECK(espnow_tx_init(tx_sched_default_config(&tx_sched_config)));
+	packet_dispatch_register(ESPNOW_PARAM_TYPE_CHANNEL_SWITCH, channel_switch_handler, sizeof(channel_switch_pkt_t), PACKET_DISPATCH_FIXED_LEN, NULL);
+	ESP_ERROR_CHECK(channel_scan_init());
+	link_bench_sweep_config_t link_bench_config;
+	ESP_ERROR_CHECK(link_bench_espnow_init(link_bench_default_sweep_config(&link_bench_config)));
+	link_throughput_sweep_config_t link_throughput_config;
+	ESP_ERROR_CHECK(link_throughput_espnow_init(link_throughput_default_sweep_config(&link_throughput_config)));
+
+	// Back on the channel of the last link when a peer is cached, else pick the quietest channel before the link comes up, it is announced once a peer connects
+	ESP_ERROR_CHECK(espnow_pair_init());
+	if (espnow_pair_restore(&esp_connection_handle) > 0)
+	{
+		channel_scan_adopt(espnow_get_channel());
+	}
+	else
+	{
+		channel_scan_result_t channel_scan_result;
+		channel_scan_run(&channel_scan_result, CHANNEL_SCAN_DWELL_MS, NULL);
+	}
 
 	ret = espnow_send_text(&espnow_send_param, "device init");
 	if (ret != ESP_OK)
@@ -117,7 +271,7 @@ void app_main(void)
 		vTaskDelete(NULL);
 	}
 
-	QueueHandle_t button_event_queue = button_init();
+	button_event_queue = button_init();
 	button_register(GPIO_BUTTON_UP, BUTTON_CONFIG_ACTIVE_LOW);
 	button_register(GPIO_BUTTON_DOWN, BUTTON_CONFIG_ACTIVE_LOW);
 	button_register(GPIO_BUTTON_LEFT, BUTTON_CONFIG_ACTIVE_LOW);
@@ -126,114 +280,30 @@ void app_main(void)
 	button_register(GPIO_BUTTON_TILT_LEFT, BUTTON_CONFIG_ACTIVE_LOW);
 	button_register(GPIO_BUTTON_TILT_RIGHT, BUTTON_CONFIG_ACTIVE_LOW);
 
-	QueueHandle_t joystick_event_queue = joystick_init();
+	power_manager_config_t power_config;
+	power_manager_default_config(&power_config);
+	ESP_ERROR_CHECK(power_manager_init(&power_config));
+	const gpio_num_t wake_pins[] = {GPIO_BUTTON_UP, GPIO_BUTTON_DOWN, GPIO_BUTTON_LEFT, GPIO_BUTTON_RIGHT,
+					GPIO_BUTTON_SHOOT, GPIO_BUTTON_TILT_LEFT, GPIO_BUTTON_TILT_RIGHT};
+	for (size_t i = 0; i < sizeof(wake_pins) / sizeof(wake_pins[0]); i++)
+		power_manager_register_wake_gpio(wake_pins[i], true);
+
+	joystick_event_queue = joystick_init();
 	joystick_register(GPIO_BUTTON_UP, GPIO_BUTTON_DOWN, ADC1_CHANNEL_8, false);
 	joystick_register(GPIO_BUTTON_RIGHT, GPIO_BUTTON_LEFT, ADC1_CHANNEL_9, true);
+	servo_stream_config.count = 2;
+	servo_stream_config.rate_multiplier = 1;
+	servo_stream_config.axes[0].channel = ADC1_CHANNEL_8;
+	servo_stream_default_curve(&servo_stream_config.axes[0].curve, 90, false);
+	servo_stream_config.axes[1].channel = ADC1_CHANNEL_9;
+	servo_stream_default_curve(&servo_stream_config.axes[1].curve, 90, true);
+	ESP_ERROR_CHECK(servo_stream_init());
 
-	xTaskCreate(rssi_task, "rssi_task", 4096, NULL, 4, NULL);
-
-	while (true)
-	{
-		button_event_t button_event;
-
-		while (xQueueReceive(joystick_event_queue, &button_event, 0))
-		{
-			LOG_INFO("GPIO event: pin %d, state = %s --> %s", button_event.pin, BUTTON_STATE_STRING[button_event.prev_state], BUTTON_STATE_STRING[button_event.new_state]);
-
-			esp_err_t ret;
-			ret = espnow_send_data(&espnow_send_param, ESP_PEER_PACKET_TEXT, &button_event, sizeof(button_event));
-			ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
-		}
-
-		while (xQueueReceive(button_event_queue, &button_event, 0))
-		{
-			LOG_INFO("GPIO event: pin %d, state = %s --> %s", button_event.pin, BUTTON_STATE_STRING[button_event.prev_state], BUTTON_STATE_STRING[button_event.new_state]);
-
-			esp_err_t ret;
-			ret = espnow_send_data(&espnow_send_param, ESP_PEER_PACKET_TEXT, &button_event, sizeof(button_event));
-			ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
-
-			char temp[64];
-			switch (button_event.pin)
-			{
-			case GPIO_BUTTON_UP:
-				snprintf(temp, 64, "GPIO_BUTTON_UP, %s", BUTTON_STATE_STRING[button_event.new_state]);
-				break;
-			case GPIO_BUTTON_DOWN:
-				snprintf(temp, 64, "GPIO_BUTTON_DOWN, %s", BUTTON_STATE_STRING[button_event.new_state]);
-				break;
-			case GPIO_BUTTON_LEFT:
-				snprintf(temp, 64, "GPIO_BUTTON_LEFT, %s", BUTTON_STATE_STRING[button_event.new_state]);
-				break;
-			case GPIO_BUTTON_RIGHT:
-				snprintf(temp, 64, "GPIO_BUTTON_RIGHT, %s", BUTTON_STATE_STRING[button_event.new_state]);
-				break;
-			case GPIO_BUTTON_SHOOT:
-				snprintf(temp, 64, "GPIO_BUTTON_SHOOT, %s", BUTTON_STATE_STRING[button_event.new_state]);
-				break;
-			case GPIO_BUTTON_TILT_LEFT:
-				snprintf(temp, 64, "GPIO_BUTTON_TILT_LEFT, %s", BUTTON_STATE_STRING[button_event.new_state]);
-				break;
-			case GPIO_BUTTON_TILT_RIGHT:
-				snprintf(temp, 64, "GPIO_BUTTON_TILT_RIGHT, %s", BUTTON_STATE_STRING[button_event.new_state]);
-				break;
-			default:
-				break;
-			}
-			// espnow_send_text(&espnow_send_param, temp);
-		}
-
-		espnow_event_t espnow_evt;
-		while (xQueueReceive(espnow_event_queue, &espnow_evt, 0))
-		{
-			espnow_data_t *recv_data = NULL;
-			switch (espnow_evt.id)
-			{
-			case ESPNOW_SEND_CB:
-				espnow_event_send_cb_t *send_cb = &espnow_evt.info.send_cb;
-				if (send_cb->status != ESP_NOW_SEND_SUCCESS)
-				{
-					LOG_WARNING("Send data to peer " MACSTR " failed", MAC2STR(send_cb->mac_addr));
-				}
-				else
-				{
-					LOG_VERBOSE("Send data to peer " MACSTR " success", MAC2STR(send_cb->mac_addr));
-				}
-				break;
-			case ESPNOW_RECV_CB:
-				espnow_event_recv_cb_t *recv_cb = &espnow_evt.info.recv_cb;
-				if (!(recv_data = espnow_data_parse(recv_data, recv_cb)))
-				{
-					LOG_WARNING("bad data packet from peer " MACSTR, MAC2STR(recv_cb->mac_addr));
-					free(recv_cb->data);
-					break;
-				}
-
-				esp_peer_t *peer = esp_connection_mac_add_to_entry(&esp_connection_handle, recv_cb->mac_addr);
-				espnow_get_send_param(&espnow_send_param, peer);
-				esp_peer_process_received(peer, recv_data);
-
-				if (recv_data->type == ESPNOW_PARAM_TYPE_MOTOR_STAT)
-				{
-					if (recv_data->len == sizeof(motor_group_stat_pkt_t))
-					{
-						static motor_group_stat_pkt_t motor_stat;
-						memccpy(&motor_stat, recv_data->payload, sizeof(motor_group_stat_pkt_t), recv_data->len);
-						motor_controller_print_stat(&motor_stat);
-					}
-
-					// print_mem(recv_data->payload, recv_data->len);
-				}
-
-				free(recv_cb->data);
-				break;
-			default:
-				LOG_ERROR("Callback type error: %d", espnow_evt.id);
-				break;
-			}
-		}
+	// RMT channel and encoder come off the heap, set up here rather than when rssi_task starts
+	ws2812_default_config(&ws2812_handle);
+	ws2812_init(&ws2812_handle);
 
-		esp_connection_handle_update(&esp_connection_handle);
-		vTaskDelay(1);
-	}
+	task_table_create(TASK_ID_RSSI, rssi_task, NULL);
+	task_table_create(TASK_ID_APP, app_task, NULL);
+	task_table_stats_start(TASK_STATS_DEFAULT_PERIOD_MS);
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+ * Compile-time RAM budget of every long-lived object. Queues, task stacks
+ * and TCBs, rings, frame pools and the peer table are all static, each module
+ * asserts its storage fits its line below. Nothing is taken from the heap
+ * after init, so long matches cannot fragment it.
+ *
+ * memReport.py reads the budgets from this file and compares them with what
+ * the linker map of a build actually placed, per module and per subsystem.
+ * */
+
+#define MEM_BUDGET_TASK_TABLE_BYTES (26 * 1024) // Task stacks and TCBs
+#define MEM_BUDGET_ESPNOW_BYTES (12 * 1024)     // Event ring, frame pools, peer table
+#define MEM_BUDGET_ESPNOW_BUNDLE_BYTES (2 * 1024)
+#define MEM_BUDGET_ESPNOW_TX_BYTES (4 * 1024)   // Priority class queues
+#define MEM_BUDGET_ESPNOW_PAIR_BYTES (512)      // Pairing cache and its NVS blob
+#define MEM_BUDGET_RSSI_BYTES (2 * 1024)
+#define MEM_BUDGET_BUTTON_BYTES (1 * 1024)
+#define MEM_BUDGET_JOYSTICK_BYTES (1 * 1024)
+#define MEM_BUDGET_POWER_MANAGER_BYTES (256)
+#define MEM_BUDGET_SERVO_GROUP_BYTES (3 * 1024) // Profiles and angle to duty tables
+#define MEM_BUDGET_TOF_SENSOR_BYTES (6 * 1024)  // Task stack and TCB, result queue, per sensor filters and scheduler
+#define MEM_BUDGET_LINK_BENCH_ESPNOW_BYTES (3 * 1024) // Probe slots, histogram and echo ring
+#define MEM_BUDGET_LINK_THROUGHPUT_ESPNOW_BYTES (1 * 1024)
+
+#define MEM_BUDGET_TOTAL_BYTES (MEM_BUDGET_TASK_TABLE_BYTES + MEM_BUDGET_ESPNOW_BYTES + MEM_BUDGET_ESPNOW_BUNDLE_BYTES + \
+                                MEM_BUDGET_ESPNOW_TX_BYTES + MEM_BUDGET_RSSI_BYTES + MEM_BUDGET_BUTTON_BYTES +     \
+                                MEM_BUDGET_JOYSTICK_BYTES + MEM_BUDGET_POWER_MANAGER_BYTES +                       \
+                                MEM_BUDGET_SERVO_GROUP_BYTES + MEM_BUDGET_TOF_SENSOR_BYTES +                       \
+                                MEM_BUDGET_LINK_BENCH_ESPNOW_BYTES + MEM_BUDGET_LINK_THROUGHPUT_ESPNOW_BYTES +     \
+                                MEM_BUDGET_ESPNOW_PAIR_BYTES)
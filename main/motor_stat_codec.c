@@ -0,0 +1,198 @@
+
+#include "motor_stat_codec.h"
+
+/* Steps per unit of each field in packet order, 0 for the counters, which are not quantized */
+static const uint16_t motor_stat_codec_scale[MOTOR_STAT_CODEC_FIELDS] = {
+    0, 1000, 1000, 100, 1000, // Left: counter, set velocity, velocity, acceleration, duty cycle
+    0, 1000, 1000, 100, 1000, // Right
+    1000, 1000,               // Delta distance, delta velocity
+};
+
+static int32_t motor_stat_codec_quantize(float value, uint16_t scale)
+{
+        float scaled = value * scale;
+        if (scaled != scaled)
+                return 0; // NaN
+        if (scaled >= INT16_MAX)
+                return INT16_MAX;
+        if (scaled <= INT16_MIN)
+                return INT16_MIN;
+        return (int32_t)(scaled + ((scaled >= 0) ? 0.5f : -0.5f));
+}
+
+static void motor_stat_codec_load(const motor_group_stat_pkt_t *stat, int32_t *values)
+{
+        const motor_stat_t *motors[] = {&stat->left_motor, &stat->right_motor};
+        for (size_t i = 0; i < 2; i++)
+        {
+                int32_t *motor = &values[5 * i];
+                const uint16_t *scale = &motor_stat_codec_scale[5 * i];
+                motor[0] = motors[i]->counter;
+                motor[1] = motor_stat_codec_quantize(motors[i]->set_velocity, scale[1]);
+                motor[2] = motor_stat_codec_quantize(motors[i]->velocity, scale[2]);
+                motor[3] = motor_stat_codec_quantize(motors[i]->acceleration, scale[3]);
+                motor[4] = motor_stat_codec_quantize(motors[i]->duty_cycle, scale[4]);
+        }
+        values[10] = motor_stat_codec_quantize(stat->delta_distance, motor_stat_codec_scale[10]);
+        values[11] = motor_stat_codec_quantize(stat->delta_velocity, motor_stat_codec_scale[11]);
+}
+
+static void motor_stat_codec_store(const int32_t *values, motor_group_stat_pkt_t *stat)
+{
+        motor_stat_t *motors[] = {&stat->left_motor, &stat->right_motor};
+        for (size_t i = 0; i < 2; i++)
+        {
+                const int32_t *motor = &values[5 * i];
+                const uint16_t *scale = &motor_stat_codec_scale[5 * i];
+                motors[i]->counter = motor[0];
+                motors[i]->set_velocity = (float)motor[1] / scale[1];
+                motors[i]->velocity = (float)motor[2] / scale[2];
+                motors[i]->acceleration = (float)motor[3] / scale[3];
+                motors[i]->duty_cycle = (float)motor[4] / scale[4];
+        }
+        stat->delta_distance = (float)values[10] / motor_stat_codec_scale[10];
+        stat->delta_velocity = (float)values[11] / motor_stat_codec_scale[11];
+}
+
+/* Zigzag, small differences of either sign take few bytes */
+static size_t motor_stat_codec_put_varint(uint8_t *out, int32_t value)
+{
+        uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+        size_t len = 0;
+        for (; zigzag >= 0x80; zigzag >>= 7)
+                out[len++] = (zigzag & 0x7F) | 0x80;
+        out[len++] = zigzag;
+        return len;
+}
+
+/* Bytes taken, 0 when the varint runs past `end` or is longer than 5 bytes */
+static size_t motor_stat_codec_get_varint(const uint8_t *in, const uint8_t *end, int32_t *value)
+{
+        uint32_t zigzag = 0;
+        for (size_t len = 0; (len < 5) && (in + len < end); len++)
+        {
+                zigzag |= (uint32_t)(in[len] & 0x7F) << (7 * len);
+                if ((in[len] & 0x80) == 0)
+                {
+                        *value = (int32_t)((zigzag >> 1) ^ (0 - (zigzag & 1)));
+                        return len + 1;
+                }
+        }
+        return 0;
+}
+
+void motor_stat_encoder_init(motor_stat_encoder_t *encoder, uint16_t keyframe_interval)
+{
+        *encoder = (motor_stat_encoder_t){
+            .keyframe_interval = (keyframe_interval == 0) ? 1 : keyframe_interval,
+            .keyframe_due = true,
+        };
+}
+
+/* Next frame is a keyframe, after a reconnect or a decoder restart */
+void motor_stat_encoder_request_keyframe(motor_stat_encoder_t *encoder)
+{
+        encoder->keyframe_due = true;
+}
+
+/* Writes one frame of at most MOTOR_STAT_CODEC_MAX_FRAME bytes, returns its length */
+size_t motor_stat_encode(motor_stat_encoder_t *encoder, const motor_group_stat_pkt_t *stat, uint8_t *frame)
+{
+        int32_t values[MOTOR_STAT_CODEC_FIELDS];
+        motor_stat_codec_load(stat, values);
+
+        bool keyframe = encoder->keyframe_due || (encoder->since_keyframe + 1 >= encoder->keyframe_interval);
+        if (keyframe)
+        {
+                for (size_t i = 0; i < MOTOR_STAT_CODEC_FIELDS; i++)
+                        encoder->values[i] = 0;
+                encoder->keyframe_due = false;
+                encoder->since_keyframe = 0;
+        }
+        else
+        {
+                encoder->since_keyframe++;
+        }
+
+        uint16_t mask = keyframe ? MOTOR_STAT_CODEC_KEYFRAME : 0;
+        size_t len = MOTOR_STAT_CODEC_HEADER_SIZE;
+        for (size_t i = 0; i < MOTOR_STAT_CODEC_FIELDS; i++)
+        {
+                // Wrapping difference, a counter passing INT32_MAX still costs a byte or two
+                int32_t delta = (int32_t)((uint32_t)values[i] - (uint32_t)encoder->values[i]);
+                if (delta == 0)
+                        continue;
+                mask |= 1U << i;
+                len += motor_stat_codec_put_varint(frame + len, delta);
+                encoder->values[i] = values[i];
+        }
+        frame[0] = encoder->seq++;
+        frame[1] = mask & 0xFF;
+        frame[2] = mask >> 8;
+        return len;
+}
+
+void motor_stat_decoder_init(motor_stat_decoder_t *decoder)
+{
+        *decoder = (motor_stat_decoder_t){0};
+}
+
+/* `stat` is only written on MOTOR_STAT_CODEC_OK */
+motor_stat_codec_result_t motor_stat_decode(motor_stat_decoder_t *decoder, const uint8_t *frame, size_t len, motor_group_stat_pkt_t *stat)
+{
+        if (len < MOTOR_STAT_CODEC_HEADER_SIZE)
+        {
+                decoder->bad++;
+                return MOTOR_STAT_CODEC_BAD_FRAME;
+        }
+        const uint8_t seq = frame[0];
+        const uint16_t mask = frame[1] | (frame[2] << 8);
+        const bool keyframe = mask & MOTOR_STAT_CODEC_KEYFRAME;
+
+        if (decoder->synced && (seq != (uint8_t)(decoder->seq + 1)))
+        {
+                decoder->lost += (uint8_t)(seq - decoder->seq - 1);
+                decoder->synced = false;
+        }
+        decoder->seq = seq;
+        if (!keyframe && !decoder->synced)
+        {
+                decoder->dropped++;
+                return MOTOR_STAT_CODEC_NEED_KEYFRAME;
+        }
+
+        // Decoded aside, a malformed frame leaves the state as it was
+        int32_t values[MOTOR_STAT_CODEC_FIELDS];
+        const uint8_t *in = frame + MOTOR_STAT_CODEC_HEADER_SIZE;
+        const uint8_t *end = frame + len;
+        bool bad = mask & ~MOTOR_STAT_CODEC_KEYFRAME & ~((1U << MOTOR_STAT_CODEC_FIELDS) - 1);
+        for (size_t i = 0; !bad && (i < MOTOR_STAT_CODEC_FIELDS); i++)
+        {
+                values[i] = keyframe ? 0 : decoder->values[i];
+                if ((mask & (1U << i)) == 0)
+                        continue;
+                int32_t delta;
+                size_t used = motor_stat_codec_get_varint(in, end, &delta);
+                if (used == 0)
+                {
+                        bad = true;
+                        continue;
+                }
+                values[i] = (int32_t)((uint32_t)values[i] + (uint32_t)delta);
+                in += used;
+        }
+        if (bad || (in != end))
+        {
+                decoder->bad++;
+                decoder->synced = false;
+                return MOTOR_STAT_CODEC_BAD_FRAME;
+        }
+
+        for (size_t i = 0; i < MOTOR_STAT_CODEC_FIELDS; i++)
+                decoder->values[i] = values[i];
+        decoder->synced = true;
+        decoder->frames++;
+        decoder->keyframes += keyframe;
+        motor_stat_codec_store(values, stat);
+        return MOTOR_STAT_CODEC_OK;
+}
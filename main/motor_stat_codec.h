@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packets.h"
+
+/*
+ * Compact wire format of motor_group_stat_pkt_t, for a higher stats rate at
+ * the same air time.
+ *
+ * The floats are quantized to int16 with a fixed scale per field, see
+ * motor_stat_codec_scale, values past the int16 range saturate. Within range
+ * the decoded value is off by at most half a step. The counters stay exact.
+ *
+ * Every field is sent as the difference to the previous frame's quantized
+ * value, zigzag varint coded, and left out when unchanged. A keyframe holds
+ * the difference to all zeros, so it decodes alone. The encoder sends one
+ * every `keyframe_interval` frames. After a lost frame the decoder drops the
+ * deltas until the next keyframe, never shows a value built on a gap.
+ *
+ * Frame: seq (u8) | mask (u16 little endian) | varint per set bit of the mask
+ * Mask bits 0 to 11 are the fields in packet order, bit 15 flags a keyframe.
+ *
+ * No IDF headers, encoder and decoder run on a host as is. Must match
+ * motorStatCodec.py.
+ * */
+
+#define MOTOR_STAT_CODEC_FIELDS (12)
+#define MOTOR_STAT_CODEC_HEADER_SIZE (3)
+#define MOTOR_STAT_CODEC_MAX_FRAME (MOTOR_STAT_CODEC_HEADER_SIZE + 2 * 5 + 10 * 3) // Counters up to 5 varint bytes, others 3
+#define MOTOR_STAT_CODEC_KEYFRAME (0x8000)
+#define MOTOR_STAT_CODEC_DEFAULT_KEYFRAME_INTERVAL (25) // Half a second at 50 Hz
+
+typedef enum
+{
+        MOTOR_STAT_CODEC_OK,
+        MOTOR_STAT_CODEC_NEED_KEYFRAME, // Delta without a base, dropped
+        MOTOR_STAT_CODEC_BAD_FRAME,
+} motor_stat_codec_result_t;
+
+static const char __attribute__((unused)) * MOTOR_STAT_CODEC_RESULT_STRING[] = {
+    "MOTOR_STAT_CODEC_OK",
+    "MOTOR_STAT_CODEC_NEED_KEYFRAME",
+    "MOTOR_STAT_CODEC_BAD_FRAME"};
+
+typedef struct
+{
+        int32_t values[MOTOR_STAT_CODEC_FIELDS]; // Last frame sent, quantized
+        uint8_t seq;
+        uint16_t keyframe_interval;
+        uint16_t since_keyframe;
+        bool keyframe_due;
+} motor_stat_encoder_t;
+
+typedef struct
+{
+        int32_t values[MOTOR_STAT_CODEC_FIELDS];
+        uint8_t seq;
+        bool synced;
+        uint32_t frames;
+        uint32_t keyframes;
+        uint32_t lost;    // Frames missing from the sequence
+        uint32_t dropped; // Deltas received while out of sync
+        uint32_t bad;
+} motor_stat_decoder_t;
+
+void motor_stat_encoder_init(motor_stat_encoder_t *encoder, uint16_t keyframe_interval);
+void motor_stat_encoder_request_keyframe(motor_stat_encoder_t *encoder);
+size_t motor_stat_encode(motor_stat_encoder_t *encoder, const motor_group_stat_pkt_t *stat, uint8_t *frame);
+void motor_stat_decoder_init(motor_stat_decoder_t *decoder);
+motor_stat_codec_result_t motor_stat_decode(motor_stat_decoder_t *decoder, const uint8_t *frame, size_t len, motor_group_stat_pkt_t *stat);
@@ -0,0 +1,57 @@
+
+#include "packet_dispatch.h"
+
+static const char *TAG = "packet_dispatch";
+
+_Static_assert(ESPNOW_PARAM_TYPE_MAX <= DISPATCH_TABLE_MAX_TYPES, "DISPATCH_TABLE_MAX_TYPES too small for the packet types");
+
+static dispatch_table_t packet_dispatch_table;
+
+esp_err_t packet_dispatch_register(espnow_param_type_t type, packet_handler_t handler, size_t payload_len, bool variable_len, void *arg)
+{
+        if ((type >= ESPNOW_PARAM_TYPE_MAX) || (handler == NULL) || (payload_len > UINT8_MAX))
+        {
+                LOG_ERROR("Invalid handler, type=%d, handler=0x%X, len=%d", type, (uintptr_t)handler, payload_len);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if (dispatch_table_get(&packet_dispatch_table, type) != NULL)
+                LOG_WARNING("Replacing handler for %s", ESPNOW_PARAM_TYPE_STRING[type]);
+
+        dispatch_table_register(&packet_dispatch_table, type, (dispatch_fn_t)handler, payload_len, variable_len, arg);
+        return ESP_OK;
+}
+
+/* `packet` must already be validated by `espnow_data_parse` */
+esp_err_t packet_dispatch(esp_peer_t *peer, const espnow_data_t *packet)
+{
+        if (packet == NULL)
+        {
+                LOG_ERROR("NULL pointer, packet=0x%X", (uintptr_t)packet);
+                return ESP_ERR_INVALID_ARG;
+        }
+        return packet_dispatch_payload(peer, packet->type, packet->payload, packet->len);
+}
+
+esp_err_t packet_dispatch_payload(esp_peer_t *peer, espnow_param_type_t type, const void *payload, size_t len)
+{
+        const dispatch_entry_t *entry;
+        switch (dispatch_table_lookup(&packet_dispatch_table, type, len, &entry))
+        {
+        case DISPATCH_TABLE_UNHANDLED:
+                LOG_VERBOSE("No handler for packet type %d", type);
+                return ESP_ERR_NOT_FOUND;
+        case DISPATCH_TABLE_BAD_SIZE:
+                LOG_WARNING("Rejected %s, len:%d, expected:%s%d", ESPNOW_PARAM_TYPE_STRING[type], len, entry->variable_len ? "<=" : "", entry->payload_len);
+                return ESP_ERR_INVALID_SIZE;
+        case DISPATCH_TABLE_OK:
+                break;
+        }
+
+        ((packet_handler_t)entry->handler)(peer, payload, len, entry->arg); // Registered as a packet_handler_t
+        return ESP_OK;
+}
+
+const packet_dispatch_stat_t *packet_dispatch_get_stat(void)
+{
+        return &packet_dispatch_table.stat;
+}
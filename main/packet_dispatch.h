@@ -0,0 +1,24 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "dispatch_table.h"
+#include "espnow.h"
+#include "logging.h"
+
+#define PACKET_DISPATCH_VARIABLE_LEN (true)
+#define PACKET_DISPATCH_FIXED_LEN (false)
+
+/* `payload` points straight into the receive buffer, it is only valid during the call */
+typedef void (*packet_handler_t)(esp_peer_t *peer, const void *payload, size_t len, void *arg);
+
+typedef dispatch_stat_t packet_dispatch_stat_t;
+
+esp_err_t packet_dispatch_register(espnow_param_type_t type, packet_handler_t handler, size_t payload_len, bool variable_len, void *arg);
+esp_err_t packet_dispatch(esp_peer_t *peer, const espnow_data_t *packet);
+esp_err_t packet_dispatch_payload(esp_peer_t *peer, espnow_param_type_t type, const void *payload, size_t len);
+const packet_dispatch_stat_t *packet_dispatch_get_stat(void);
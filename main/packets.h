@@ -1,15 +1,27 @@
-
 #pragma once
 
+#include <sys/cdefs.h>
+
+#ifndef __packed
+#define __packed __attribute__((packed)) // Host builds, IDF's sys/cdefs.h has it
+#endif
+
+/* Payload structs are sent as-is over ESP-NOW and read in place from the
+ * receive buffer, which gives no alignment guarantee, hence `__packed`.
+ * The size checks pin the wire format shared with the car firmware. */
+
 typedef struct
 {
     int counter;
     float set_velocity;
     float velocity, acceleration, duty_cycle;
-} motor_stat_t;
+} __packed motor_stat_t;
 
 typedef struct
 {
     motor_stat_t left_motor, right_motor;
     float delta_distance, delta_velocity;
-} motor_group_stat_pkt_t;
+} __packed motor_group_stat_pkt_t;
+
+_Static_assert(sizeof(motor_stat_t) == 20, "motor_stat_t wire size changed");
+_Static_assert(sizeof(motor_group_stat_pkt_t) == 48, "motor_group_stat_pkt_t wire size changed");
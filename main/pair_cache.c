@@ -0,0 +1,136 @@
+
+#include "pair_cache.h"
+
+#include <string.h>
+
+/* Reflected CCITT polynomial bit by bit, the same result as the ROM's esp_crc16_le */
+uint16_t pair_cache_crc16(uint16_t crc, const void *data, size_t len)
+{
+        const uint8_t *bytes = data;
+        crc = ~crc;
+        while (len--)
+        {
+                crc ^= *bytes++;
+                for (int bit = 0; bit < 8; bit++)
+                        crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+        return ~crc;
+}
+
+/* Loads the stored peers, returns how many */
+size_t pair_cache_init(pair_cache_t *cache, const pair_cache_store_t *store)
+{
+        if ((cache == NULL) || (store == NULL))
+                return 0;
+        memset(cache, 0, sizeof(pair_cache_t));
+        cache->store = *store;
+
+        pair_cache_blob_t blob;
+        size_t len = sizeof(blob);
+        if ((store->read == NULL) || !store->read(store->ctx, &blob, &len))
+                return 0;
+        if ((len != sizeof(blob)) || (blob.version != PAIR_CACHE_VERSION) || (blob.count > PAIR_CACHE_MAX) ||
+            (blob.crc != pair_cache_crc16(UINT16_MAX, &blob, offsetof(pair_cache_blob_t, crc))))
+        {
+                cache->load_errors++;
+                return 0;
+        }
+        memcpy(cache->entries, blob.entries, sizeof(cache->entries));
+        cache->count = blob.count;
+        return cache->count;
+}
+
+static bool pair_cache_save(pair_cache_t *cache)
+{
+        pair_cache_blob_t blob;
+        memset(&blob, 0, sizeof(blob)); // Padding too, it is under the CRC
+        blob.version = PAIR_CACHE_VERSION;
+        blob.count = cache->count;
+        memcpy(blob.entries, cache->entries, cache->count * sizeof(pair_cache_entry_t));
+        blob.crc = pair_cache_crc16(UINT16_MAX, &blob, offsetof(pair_cache_blob_t, crc));
+
+        if ((cache->store.write == NULL) || !cache->store.write(cache->store.ctx, &blob, sizeof(blob)))
+        {
+                cache->save_errors++;
+                return false;
+        }
+        cache->saves++;
+        return true;
+}
+
+static size_t pair_cache_index(const pair_cache_t *cache, const uint8_t *mac)
+{
+        for (size_t i = 0; i < cache->count; i++)
+                if (memcmp(cache->entries[i].mac, mac, PAIR_CACHE_ADDR_LEN) == 0)
+                        return i;
+        return PAIR_CACHE_MAX;
+}
+
+const pair_cache_entry_t *pair_cache_find(const pair_cache_t *cache, const uint8_t *mac)
+{
+        size_t index = pair_cache_index(cache, mac);
+        return (index < cache->count) ? &cache->entries[index] : NULL;
+}
+
+/* Moves `entry` to the front, the least recent peer makes room. False only when a needed save failed */
+bool pair_cache_remember(pair_cache_t *cache, const pair_cache_entry_t *entry)
+{
+        size_t index = pair_cache_index(cache, entry->mac);
+        if ((index == 0) && (memcmp(&cache->entries[0], entry, sizeof(pair_cache_entry_t)) == 0))
+                return true;
+
+        if (index >= cache->count)
+                index = (cache->count < PAIR_CACHE_MAX) ? cache->count++ : PAIR_CACHE_MAX - 1;
+        memmove(&cache->entries[1], &cache->entries[0], index * sizeof(pair_cache_entry_t));
+        cache->entries[0] = *entry;
+        return pair_cache_save(cache);
+}
+
+bool pair_cache_forget(pair_cache_t *cache, const uint8_t *mac)
+{
+        size_t index = pair_cache_index(cache, mac);
+        if (index >= cache->count)
+                return true;
+        memmove(&cache->entries[index], &cache->entries[index + 1], (cache->count - index - 1) * sizeof(pair_cache_entry_t));
+        cache->count--;
+        return pair_cache_save(cache);
+}
+
+void pair_resume_start(pair_resume_t *resume, int64_t now_us)
+{
+        *resume = (pair_resume_t){
+            .state = PAIR_RESUME_PENDING,
+            .started_us = now_us,
+            .next_us = now_us,
+        };
+}
+
+pair_resume_action_t pair_resume_poll(pair_resume_t *resume, int64_t now_us)
+{
+        if (resume->state != PAIR_RESUME_PENDING)
+                return PAIR_RESUME_ACTION_NONE;
+        if (now_us - resume->started_us >= PAIR_RESUME_TIMEOUT_US)
+        {
+                resume->state = PAIR_RESUME_FAILED;
+                return PAIR_RESUME_ACTION_GIVE_UP;
+        }
+        if (now_us < resume->next_us)
+                return PAIR_RESUME_ACTION_NONE;
+        resume->attempts++;
+        resume->next_us = now_us + PAIR_RESUME_RETRY_US;
+        return PAIR_RESUME_ACTION_SEND;
+}
+
+void pair_resume_accepted(pair_resume_t *resume, int64_t now_us)
+{
+        if (resume->state != PAIR_RESUME_PENDING)
+                return;
+        resume->state = PAIR_RESUME_DONE;
+        resume->elapsed_us = now_us - resume->started_us;
+}
+
+void pair_resume_rejected(pair_resume_t *resume)
+{
+        if (resume->state == PAIR_RESUME_PENDING)
+                resume->state = PAIR_RESUME_FAILED;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Peers this device has been connected to, most recent first, kept in one
+ * blob of persistent storage so a reboot or a brownout can skip discovery.
+ * The blob carries a version and a CRC, a missing, old or damaged one
+ * loads as an empty cache. pair_cache_remember only writes when the cache
+ * actually changed, a reconnect to the same peer on the same channel costs
+ * no flash wear.
+ *
+ * pair_resume_t is the timing of the fast resume handshake to one cached
+ * peer: a unicast request right away, repeated every
+ * PAIR_RESUME_RETRY_US until the peer answers or PAIR_RESUME_TIMEOUT_US
+ * runs out and discovery takes over.
+ *
+ * Storage goes through pair_cache_store_t, NVS on the device and memory on
+ * a host. Not thread safe, no IDF headers.
+ * */
+
+#define PAIR_CACHE_MAX (4)
+#define PAIR_CACHE_ADDR_LEN (6)
+#define PAIR_CACHE_KEY_LEN (16) // ESP_NOW_KEY_LEN
+#define PAIR_CACHE_VERSION (1)
+#define PAIR_RESUME_RETRY_US (20 * 1000) // The rate of the handshake TX class
+#define PAIR_RESUME_TIMEOUT_US (300 * 1000)
+
+typedef struct
+{
+        uint8_t mac[PAIR_CACHE_ADDR_LEN];
+        uint8_t channel;
+        uint8_t phy_rate; // wifi_phy_rate_t
+        uint8_t encrypt;  // Register the peer with `lmk`
+        uint8_t lmk[PAIR_CACHE_KEY_LEN];
+} pair_cache_entry_t;
+
+typedef struct
+{
+        /* Copies the stored blob into `blob`, false when there is none. `len` in: capacity, out: stored length */
+        bool (*read)(void *ctx, void *blob, size_t *len);
+        bool (*write)(void *ctx, const void *blob, size_t len);
+        void *ctx;
+} pair_cache_store_t;
+
+typedef struct
+{
+        uint16_t version;
+        uint16_t count;
+        pair_cache_entry_t entries[PAIR_CACHE_MAX];
+        uint16_t crc; // Over everything above
+} pair_cache_blob_t;
+
+typedef struct
+{
+        pair_cache_entry_t entries[PAIR_CACHE_MAX]; // Most recent first
+        size_t count;
+        pair_cache_store_t store;
+        uint32_t saves;
+        uint32_t save_errors;
+        uint32_t load_errors; // Blobs rejected for their length, version or CRC
+} pair_cache_t;
+
+typedef enum
+{
+        PAIR_RESUME_IDLE,
+        PAIR_RESUME_PENDING,
+        PAIR_RESUME_DONE,
+        PAIR_RESUME_FAILED, // Timed out or rejected, discovery takes over
+        PAIR_RESUME_MAX,
+} pair_resume_state_t;
+
+static const char __attribute__((unused)) * PAIR_RESUME_STATE_STRING[] = {
+    "PAIR_RESUME_IDLE",
+    "PAIR_RESUME_PENDING",
+    "PAIR_RESUME_DONE",
+    "PAIR_RESUME_FAILED",
+    "PAIR_RESUME_MAX"};
+
+typedef enum
+{
+        PAIR_RESUME_ACTION_NONE,
+        PAIR_RESUME_ACTION_SEND,    // Send a resume request now
+        PAIR_RESUME_ACTION_GIVE_UP, // Once, after the last request went unanswered
+} pair_resume_action_t;
+
+typedef struct
+{
+        pair_resume_state_t state;
+        uint8_t attempts;
+        int64_t started_us;
+        int64_t next_us;
+        uint32_t elapsed_us; // Start to answer of the last resume
+} pair_resume_t;
+
+size_t pair_cache_init(pair_cache_t *cache, const pair_cache_store_t *store);
+const pair_cache_entry_t *pair_cache_find(const pair_cache_t *cache, const uint8_t *mac);
+bool pair_cache_remember(pair_cache_t *cache, const pair_cache_entry_t *entry);
+bool pair_cache_forget(pair_cache_t *cache, const uint8_t *mac);
+uint16_t pair_cache_crc16(uint16_t crc, const void *data, size_t len);
+
+void pair_resume_start(pair_resume_t *resume, int64_t now_us);
+pair_resume_action_t pair_resume_poll(pair_resume_t *resume, int64_t now_us);
+void pair_resume_accepted(pair_resume_t *resume, int64_t now_us);
+void pair_resume_rejected(pair_resume_t *resume);
@@ -0,0 +1,235 @@
+
+#include "power_manager.h"
+
+static const char *TAG = "power_manager";
+
+#define POWER_MANAGER_WAKE_BIT (1 << 0)     // Cleared by whoever wakes on it
+#define POWER_MANAGER_ACTIVITY_BIT (1 << 1) // Cleared by `power_manager_update`
+
+static power_manager_config_t power_manager_config;
+static power_state_t power_manager_state = POWER_STATE_ACTIVE;
+static EventGroupHandle_t power_manager_events = NULL;
+static StaticEventGroup_t power_manager_events_buffer;
+_Static_assert(sizeof(power_manager_events_buffer) <= MEM_BUDGET_POWER_MANAGER_BYTES, "Power manager over budget");
+static int64_t power_manager_last_activity_us = 0;
+static uint32_t power_manager_poll_ms[POWER_STATE_MAX];
+
+static gpio_num_t power_manager_wake_gpio[POWER_MANAGER_MAX_WAKE_GPIO];
+static size_t power_manager_num_wake_gpio = 0;
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t power_manager_cpu_lock = NULL;
+static esp_pm_lock_handle_t power_manager_no_sleep_lock = NULL;
+static bool power_manager_hold_no_sleep = false;
+#endif
+
+power_manager_config_t *power_manager_default_config(power_manager_config_t *config)
+{
+        if (config == NULL)
+        {
+                LOG_ERROR("NULL pointer, config=0x%X", (uintptr_t)config);
+                return NULL;
+        }
+        config->latency_budget_ms = 20;
+        config->idle_timeout_ms = 5 * 1000;
+        config->deep_idle_timeout_ms = 60 * 1000;
+        config->idle_poll_ms = 100;
+        config->deep_idle_poll_ms = 1000;
+        config->idle_wake_window_ms = 50;
+        config->deep_idle_wake_window_ms = 10;
+        config->wake_interval_ms = 100;
+        config->max_freq_mhz = 240;
+        config->min_freq_mhz = 40;
+        return config;
+}
+
+/* Level interrupt of a wake pin, disabled on the first hit until the next idle state */
+static void IRAM_ATTR power_manager_gpio_isr(void *arg)
+{
+        gpio_intr_disable((gpio_num_t)(uintptr_t)arg);
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        xEventGroupSetBitsFromISR(power_manager_events, POWER_MANAGER_WAKE_BIT | POWER_MANAGER_ACTIVITY_BIT, &higher_priority_task_woken);
+        portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+static void power_manager_set_wake_window(uint16_t window_ms)
+{
+#if CONFIG_ESP_WIFI_STA_DISCONNECTED_PM_ENABLE
+        wifi_mode_t mode;
+        if ((esp_wifi_get_mode(&mode) != ESP_OK) || (mode != WIFI_MODE_STA))
+                return;
+        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_now_set_wake_window(window_ms));
+        ESP_ERROR_CHECK_WITHOUT_ABORT(esp_wifi_connectionless_module_set_wake_interval(power_manager_config.wake_interval_ms));
+#endif
+}
+
+static void power_manager_enter(power_state_t new_state)
+{
+        LOG_INFO("%s --> %s", POWER_STATE_STRING[power_manager_state], POWER_STATE_STRING[new_state]);
+
+        if (new_state == POWER_STATE_ACTIVE)
+        {
+#if CONFIG_PM_ENABLE
+                esp_pm_lock_acquire(power_manager_cpu_lock);
+                if (power_manager_hold_no_sleep)
+                        esp_pm_lock_acquire(power_manager_no_sleep_lock);
+#endif
+                for (size_t i = 0; i < power_manager_num_wake_gpio; i++)
+                        gpio_intr_disable(power_manager_wake_gpio[i]);
+                power_manager_set_wake_window(UINT16_MAX);
+        }
+        else
+        {
+                if (power_manager_state == POWER_STATE_ACTIVE)
+                {
+#if CONFIG_PM_ENABLE
+                        esp_pm_lock_release(power_manager_cpu_lock);
+                        if (power_manager_hold_no_sleep)
+                                esp_pm_lock_release(power_manager_no_sleep_lock);
+#endif
+                        for (size_t i = 0; i < power_manager_num_wake_gpio; i++)
+                                gpio_intr_enable(power_manager_wake_gpio[i]);
+                }
+                power_manager_set_wake_window((new_state == POWER_STATE_IDLE) ? power_manager_config.idle_wake_window_ms
+                                                                                : power_manager_config.deep_idle_wake_window_ms);
+        }
+        power_manager_state = new_state;
+}
+
+esp_err_t power_manager_init(const power_manager_config_t *config)
+{
+        if (config == NULL)
+        {
+                LOG_ERROR("NULL pointer, config=0x%X", (uintptr_t)config);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if (power_manager_events != NULL)
+        {
+                LOG_WARNING("Already initialized, events=0x%X", (uintptr_t)power_manager_events);
+                return ESP_ERR_INVALID_STATE;
+        }
+
+        power_manager_events = xEventGroupCreateStatic(&power_manager_events_buffer);
+        if (power_manager_events == NULL)
+        {
+                LOG_ERROR("Create event group failed");
+                return ESP_ERR_NO_MEM;
+        }
+
+        power_manager_config = *config;
+        power_manager_poll_ms[POWER_STATE_ACTIVE] = POWER_MANAGER_ACTIVE_POLL_MS;
+        power_manager_poll_ms[POWER_STATE_IDLE] = config->idle_poll_ms;
+        power_manager_poll_ms[POWER_STATE_DEEP_IDLE] = config->deep_idle_poll_ms;
+        power_manager_last_activity_us = esp_timer_get_time();
+
+#if CONFIG_PM_ENABLE
+        // A poll that lands in light sleep is late by the wake up time, only allow it when the budget covers that
+        power_manager_hold_no_sleep = (POWER_MANAGER_ACTIVE_POLL_MS + POWER_MANAGER_LIGHT_SLEEP_WAKE_MS > config->latency_budget_ms);
+        LOG_INFO("Latency budget %d ms, light sleep while active: %s", config->latency_budget_ms, power_manager_hold_no_sleep ? "no" : "yes");
+        wifi_mode_t mode;
+        if ((esp_wifi_get_mode(&mode) == ESP_OK) && (mode != WIFI_MODE_NULL) && (mode != WIFI_MODE_STA))
+        {
+                LOG_WARNING("Wi-Fi mode %d keeps the radio on and blocks light sleep, idle only scales the frequency", mode);
+        }
+
+        esp_pm_config_t pm_config = {
+            .max_freq_mhz = config->max_freq_mhz,
+            .min_freq_mhz = config->min_freq_mhz,
+            .light_sleep_enable = true,
+        };
+        ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+        ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "power_active", &power_manager_cpu_lock));
+        ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "power_latency", &power_manager_no_sleep_lock));
+        esp_pm_lock_acquire(power_manager_cpu_lock);
+        if (power_manager_hold_no_sleep)
+                esp_pm_lock_acquire(power_manager_no_sleep_lock);
+#else
+        LOG_WARNING("CONFIG_PM_ENABLE is not set, running at full power");
+#endif
+
+        ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+        esp_err_t ret = gpio_install_isr_service(0);
+        if ((ret != ESP_OK) && (ret != ESP_ERR_INVALID_STATE)) // Already installed by another driver
+                return ret;
+        return ESP_OK;
+}
+
+/* Call after the pin is configured as an input, e.g. by `button_register` */
+esp_err_t power_manager_register_wake_gpio(gpio_num_t pin, bool active_low)
+{
+        if (power_manager_num_wake_gpio >= POWER_MANAGER_MAX_WAKE_GPIO)
+        {
+                LOG_WARNING("Too many wake gpio, ignoring gpio [%d]", pin);
+                return ESP_ERR_NO_MEM;
+        }
+
+        gpio_int_type_t level = active_low ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL;
+        ESP_ERROR_CHECK(gpio_set_intr_type(pin, level));
+        ESP_ERROR_CHECK(gpio_wakeup_enable(pin, level));
+        ESP_ERROR_CHECK(gpio_isr_handler_add(pin, power_manager_gpio_isr, (void *)(uintptr_t)pin));
+        if (power_manager_state == POWER_STATE_ACTIVE)
+                gpio_intr_disable(pin);
+
+        power_manager_wake_gpio[power_manager_num_wake_gpio++] = pin;
+        return ESP_OK;
+}
+
+/* User input was seen, restarts the inactivity timeout */
+void power_manager_activity(void)
+{
+        if (power_manager_events != NULL)
+                xEventGroupSetBits(power_manager_events, POWER_MANAGER_WAKE_BIT | POWER_MANAGER_ACTIVITY_BIT);
+}
+
+/* Cuts the current poll short without counting as user input, e.g. on a received packet */
+void power_manager_wake(void)
+{
+        if (power_manager_events != NULL)
+                xEventGroupSetBits(power_manager_events, POWER_MANAGER_WAKE_BIT);
+}
+
+/* Poll period of the current state, for tasks that sleep on something else than power_manager_wait */
+TickType_t power_manager_poll_ticks(void)
+{
+        TickType_t ticks = pdMS_TO_TICKS(power_manager_poll_ms[power_manager_state]);
+        return (ticks == 0) ? 1 : ticks;
+}
+
+/* Replaces the fixed `vTaskDelay` of polling tasks, sleeps one poll period of the current state */
+void power_manager_wait(void)
+{
+        TickType_t ticks = power_manager_poll_ticks();
+
+        // Debouncing counts on a steady sample rate while active
+        if ((power_manager_events == NULL) || (power_manager_state == POWER_STATE_ACTIVE))
+        {
+                vTaskDelay(ticks);
+                return;
+        }
+        xEventGroupWaitBits(power_manager_events, POWER_MANAGER_WAKE_BIT, pdTRUE, pdFALSE, ticks);
+}
+
+void power_manager_update(void)
+{
+        if (power_manager_events == NULL)
+                return;
+
+        int64_t now = esp_timer_get_time();
+        if (xEventGroupClearBits(power_manager_events, POWER_MANAGER_ACTIVITY_BIT) & POWER_MANAGER_ACTIVITY_BIT)
+                power_manager_last_activity_us = now;
+
+        int64_t inactive_ms = (now - power_manager_last_activity_us) / 1000;
+        power_state_t new_state = POWER_STATE_ACTIVE;
+        if (inactive_ms >= power_manager_config.deep_idle_timeout_ms)
+                new_state = POWER_STATE_DEEP_IDLE;
+        else if (inactive_ms >= power_manager_config.idle_timeout_ms)
+                new_state = POWER_STATE_IDLE;
+
+        if (new_state != power_manager_state)
+                power_manager_enter(new_state);
+}
+
+power_state_t power_manager_get_state(void)
+{
+        return power_manager_state;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+#include "driver/gpio.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+#include "logging.h"
+#include "mem_budget.h"
+
+/*
+ * ACTIVE polls at POWER_MANAGER_ACTIVE_POLL_MS and only blocks light sleep
+ * when its wake up time would break the latency budget. After
+ * `idle_timeout_ms` without input the pollers slow down to `idle_poll_ms`,
+ * after `deep_idle_timeout_ms` to `deep_idle_poll_ms`. In both idle states a
+ * button level interrupt wakes the chip and the pollers at once.
+ *
+ * ESP-NOW wake windows only apply while the Wi-Fi interface is a station,
+ * which espnow_wifi_default_config sets up without ever connecting. The
+ * radio then listens `*_wake_window_ms` out of every `wake_interval_ms`
+ * and the chip light sleeps in between. In AP mode the radio stays on and
+ * the Wi-Fi driver keeps automatic light sleep from ever being entered,
+ * power_manager_init warns about it: idle time is then spent clock gated
+ * at `min_freq_mhz`, saving the poll wake ups and the frequency scaling
+ * only. powerSim.py models both modes.
+ * */
+
+#define POWER_MANAGER_ACTIVE_POLL_MS (10)
+#define POWER_MANAGER_LIGHT_SLEEP_WAKE_MS (2) // Worst case light sleep exit, CPU power down included
+#define POWER_MANAGER_MAX_WAKE_GPIO (8)
+
+typedef enum
+{
+        POWER_STATE_ACTIVE,
+        POWER_STATE_IDLE,
+        POWER_STATE_DEEP_IDLE,
+        POWER_STATE_MAX,
+} power_state_t;
+
+static const char __attribute__((unused)) * POWER_STATE_STRING[] = {
+    "POWER_STATE_ACTIVE",
+    "POWER_STATE_IDLE",
+    "POWER_STATE_DEEP_IDLE",
+    "POWER_STATE_MAX"};
+
+typedef struct
+{
+        uint32_t latency_budget_ms;        // Input to handling while active
+        uint32_t idle_timeout_ms;          // No input for this long enters POWER_STATE_IDLE
+        uint32_t deep_idle_timeout_ms;     // No input for this long enters POWER_STATE_DEEP_IDLE
+        uint32_t idle_poll_ms;             // Poll period of POWER_STATE_IDLE
+        uint32_t deep_idle_poll_ms;        // Poll period of POWER_STATE_DEEP_IDLE
+        uint16_t idle_wake_window_ms;      // ESP-NOW listen time per wake interval
+        uint16_t deep_idle_wake_window_ms; // Same in POWER_STATE_DEEP_IDLE
+        uint16_t wake_interval_ms;         // Period of the ESP-NOW wake windows
+        int max_freq_mhz;                  // Dynamic frequency scaling range
+        int min_freq_mhz;
+} power_manager_config_t;
+
+power_manager_config_t *power_manager_default_config(power_manager_config_t *config);
+esp_err_t power_manager_init(const power_manager_config_t *config);
+esp_err_t power_manager_register_wake_gpio(gpio_num_t pin, bool active_low);
+
+void power_manager_activity(void);
+void power_manager_wake(void);
+TickType_t power_manager_poll_ticks(void);
+void power_manager_wait(void);
+void power_manager_update(void);
+power_state_t power_manager_get_state(void);
@@ -0,0 +1,104 @@
+
+#include "range_filter.h"
+
+range_filter_config_t *range_filter_default_config(range_filter_config_t *config)
+{
+        if (config == NULL)
+                return NULL;
+        config->window = 5;
+        config->tolerance_mm = 30; // About 10 SR04 resolution steps
+        config->tolerance_percent = 5;
+        return config;
+}
+
+void range_filter_init(range_filter_t *filter, const range_filter_config_t *config)
+{
+        filter->config = *config;
+        if ((filter->config.window == 0) || (filter->config.window > RANGE_FILTER_MAX_WINDOW))
+                filter->config.window = RANGE_FILTER_MAX_WINDOW;
+        filter->config.window |= 1; // Odd, so a full window has a middle reading
+        if (filter->config.window > RANGE_FILTER_MAX_WINDOW)
+                filter->config.window -= 2;
+        range_filter_reset(filter);
+}
+
+void range_filter_reset(range_filter_t *filter)
+{
+        for (size_t i = 0; i < RANGE_FILTER_MAX_WINDOW; i++)
+                filter->readings[i] = 0;
+        filter->head = 0;
+        filter->count = 0;
+}
+
+/* Insertion sort, the window is a handful of readings */
+static void range_filter_sort(uint32_t *values, size_t count)
+{
+        for (size_t i = 1; i < count; i++)
+        {
+                uint32_t value = values[i];
+                size_t j = i;
+                for (; (j > 0) && (values[j - 1] > value); j--)
+                        values[j] = values[j - 1];
+                values[j] = value;
+        }
+}
+
+/* Lower middle on an even count, always a distance that was actually measured */
+static uint32_t range_filter_median(const uint32_t *sorted, size_t count)
+{
+        return sorted[(count - 1) / 2];
+}
+
+static uint32_t range_filter_tolerance(const range_filter_config_t *config, uint32_t distance_mm)
+{
+        return config->tolerance_mm + distance_mm * config->tolerance_percent / 100;
+}
+
+/* Adds a reading, `valid` false for a timeout or an out of range echo */
+void range_filter_push(range_filter_t *filter, uint32_t distance_mm, bool valid, range_filter_result_t *result)
+{
+        const uint8_t window = filter->config.window;
+        filter->readings[filter->head] = valid ? distance_mm : 0;
+        filter->head = (filter->head + 1 < window) ? filter->head + 1 : 0;
+        if (filter->count < window)
+                filter->count++;
+
+        uint32_t good[RANGE_FILTER_MAX_WINDOW];
+        size_t votes = 0;
+        for (size_t i = 0; i < filter->count; i++)
+        {
+                if (filter->readings[i] != 0)
+                        good[votes++] = filter->readings[i];
+        }
+        *result = (range_filter_result_t){0};
+        if (votes == 0)
+                return;
+
+        range_filter_sort(good, votes);
+        uint32_t median = range_filter_median(good, votes);
+        uint32_t tolerance = range_filter_tolerance(&filter->config, median);
+
+        uint32_t deviations[RANGE_FILTER_MAX_WINDOW];
+        for (size_t i = 0; i < votes; i++)
+                deviations[i] = (good[i] > median) ? good[i] - median : median - good[i];
+        range_filter_sort(deviations, votes);
+        uint32_t spread = range_filter_median(deviations, votes);
+
+        result->distance_mm = median;
+        result->outlier = valid && (votes >= RANGE_FILTER_MIN_VOTES) &&
+                          (((distance_mm > median) ? distance_mm - median : median - distance_mm) > tolerance);
+
+        // Share of good readings, scaled down linearly until the spread reaches the tolerance
+        uint32_t share = 100 * votes / window;
+        uint32_t steadiness = (spread >= tolerance) ? 0 : 100 - 100 * spread / tolerance;
+        result->confidence = share * steadiness / 100;
+        if (result->outlier)
+                result->confidence /= 2;
+}
+
+/* Round trip echo time to distance, speed of sound 331.3 + 0.606 * T m/s */
+uint32_t range_filter_echo_to_mm(uint32_t echo_ns, int8_t temperature_c)
+{
+        uint64_t speed_mm_per_s = 331300 + 606 * (int32_t)temperature_c;
+        return (uint32_t)(((uint64_t)echo_ns * speed_mm_per_s + 1000000000ULL) / 2000000000ULL);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Median filter with outlier rejection for ultrasonic ranges. Keeps the last
+ * `window` readings, failed ones included, and reports the median of the good
+ * ones. A reading further than the tolerance from that median is an outlier:
+ * it still enters the window, so a real jump wins once it repeats, but the
+ * median is reported in its place.
+ *
+ * Confidence, 0 to 100, is the share of good readings in the window scaled
+ * down by their spread (median absolute deviation) against the tolerance.
+ * No IDF headers, runs on a host as is.
+ * */
+
+#define RANGE_FILTER_MAX_WINDOW (9)
+#define RANGE_FILTER_MIN_VOTES (3) // Good readings needed before anything is called an outlier
+
+typedef struct
+{
+        uint8_t window;             // Readings kept, odd, up to RANGE_FILTER_MAX_WINDOW
+        uint16_t tolerance_mm;      // Deviation from the median allowed at any distance
+        uint8_t tolerance_percent;  // Extra allowance growing with distance
+} range_filter_config_t;
+
+typedef struct
+{
+        range_filter_config_t config;
+        uint32_t readings[RANGE_FILTER_MAX_WINDOW]; // mm, 0 for a failed reading
+        uint8_t head;
+        uint8_t count;
+} range_filter_t;
+
+typedef struct
+{
+        uint32_t distance_mm; // Median of the good readings, 0 when there are none
+        uint8_t confidence;   // Percent
+        bool outlier;         // Latest reading rejected
+} range_filter_result_t;
+
+range_filter_config_t *range_filter_default_config(range_filter_config_t *config);
+void range_filter_init(range_filter_t *filter, const range_filter_config_t *config);
+void range_filter_reset(range_filter_t *filter);
+void range_filter_push(range_filter_t *filter, uint32_t distance_mm, bool valid, range_filter_result_t *result);
+uint32_t range_filter_echo_to_mm(uint32_t echo_ns, int8_t temperature_c);
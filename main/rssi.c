@@ -3,9 +3,11 @@
 
 static const char *TAG = "rssi";
 
-QueueHandle_t rssi_queue;
+static rssi_event_t rssi_ring_buffer[RSSI_QUEUE_SIZE];
+static event_ring_t rssi_ring;
+_Static_assert(sizeof(rssi_ring_buffer) + sizeof(rssi_ring) <= MEM_BUDGET_RSSI_BYTES, "RSSI ring over budget");
 
-static void wifi_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type)
+void rssi_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type)
 {
 
         // All espnow traffic uses action frames which are a subtype of the mgmnt frames so filter out everything else.
@@ -13,14 +15,20 @@ static void wifi_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type)
                 return;
 
         static const uint8_t ACTION_SUBTYPE = 0xd0;
-        // static const uint8_t ESPRESSIF_OUI[] = {0x18, 0xfe, 0x34};
+        static const uint8_t ESPRESSIF_OUI[] = {0x18, 0xfe, 0x34};
 
         const wifi_promiscuous_pkt_t *ppkt = (wifi_promiscuous_pkt_t *)buf;
         const wifi_ieee80211_packet_t *ipkt = (wifi_ieee80211_packet_t *)ppkt->payload;
         const wifi_ieee80211_mac_hdr_t *hdr = &ipkt->hdr;
+        if ((ACTION_SUBTYPE != (hdr->frame_ctrl & 0xFF)) || (ppkt->rx_ctrl.sig_len < RSSI_ESPNOW_MIN_LEN))
+                return;
 
-        // Only continue processing if this is an action frame containing the Espressif OUI.
-        if ((ACTION_SUBTYPE == (hdr->frame_ctrl & 0xFF)))
+        // Only continue processing if this is an ESP-NOW action frame, other vendors' action frames would fill the peer table
+        const uint8_t *body = ppkt->payload + RSSI_MGMT_HDR_LEN; // Management frames have no addr4
+        const uint8_t *element = body + RSSI_ACTION_HDR_LEN;
+        if ((body[0] == RSSI_CATEGORY_VENDOR) && (memcmp(&body[1], ESPRESSIF_OUI, sizeof(ESPRESSIF_OUI)) == 0) &&
+            (element[0] == RSSI_ELEMENT_VENDOR) && (memcmp(&element[2], ESPRESSIF_OUI, sizeof(ESPRESSIF_OUI)) == 0) &&
+            (element[5] == RSSI_ESPNOW_TYPE))
         {
                 // print_mem(hdr, sizeof(wifi_ieee80211_mac_hdr_t));
                 rssi_event_t event = {
@@ -28,25 +36,22 @@ static void wifi_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type)
                     .time_us = esp_timer_get_time()};
                 memcpy(event.recv_mac, hdr->addr2, ESP_NOW_ETH_ALEN);
 
-                if (xQueueSend(rssi_queue, &event, 0) != pdTRUE)
-                {
-                        LOG_WARNING("Wi-Fi callback failed to send queue");
-                }
+                // A full ring is counted by the watermark, no logging from the Wi-Fi task
+                event_ring_push(&rssi_ring, &event);
         }
 }
 
 // call after `esp_wifi_init`
-QueueHandle_t rssi_init(void)
+event_ring_t *rssi_init(void)
 {
-        ESP_ERROR_CHECK(esp_wifi_set_promiscuous(true));
-        ESP_ERROR_CHECK(esp_wifi_set_promiscuous_rx_cb(&wifi_promiscuous_rx_cb));
-        rssi_queue = xQueueCreate(RSSI_QUEUE_SIZE, sizeof(rssi_event_t));
-        if (rssi_queue == NULL)
+        if (event_ring_init(&rssi_ring, rssi_ring_buffer, sizeof(rssi_event_t), RSSI_QUEUE_SIZE, WATERMARK_QUEUE_RSSI) != ESP_OK)
         {
-                LOG_ERROR("Failed to create queue");
+                LOG_ERROR("Failed to init ring");
                 return NULL;
         }
-        return rssi_queue;
+        ESP_ERROR_CHECK(esp_wifi_set_promiscuous(true));
+        ESP_ERROR_CHECK(esp_wifi_set_promiscuous_rx_cb(&rssi_promiscuous_rx_cb));
+        return &rssi_ring;
 }
 
 void print_rssi_event(rssi_event_t *event)
@@ -4,7 +4,6 @@
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 
 #include "esp_wifi.h"
 #include "esp_wifi_types.h"
@@ -13,9 +12,22 @@
 #include "esp_timer.h"
 #include "esp_now.h"
 
+#include "event_ring.h"
 #include "logging.h"
+#include "mem_budget.h"
 
-#define RSSI_QUEUE_SIZE (64)
+#define RSSI_QUEUE_SIZE (64) // Power of two, backs an event_ring
+
+/*
+ * ESP-NOW vendor specific action frame: category, Espressif OUI and 4
+ * random bytes, then a vendor element of ID, length, OUI, type and version.
+ * */
+#define RSSI_MGMT_HDR_LEN (24)
+#define RSSI_ACTION_HDR_LEN (8)
+#define RSSI_CATEGORY_VENDOR (127)
+#define RSSI_ELEMENT_VENDOR (221)
+#define RSSI_ESPNOW_TYPE (4)
+#define RSSI_ESPNOW_MIN_LEN (RSSI_MGMT_HDR_LEN + RSSI_ACTION_HDR_LEN + 7)
 
 // Estructuras para calcular los paquetes, el RSSI, etc
 typedef struct
@@ -37,10 +49,11 @@ typedef struct
 
 typedef struct
 {
-        uint8_t recv_mac[6];
-        int rssi;
         int64_t time_us;
-} __packed rssi_event_t;
+        int rssi;
+        uint8_t recv_mac[6];
+} rssi_event_t;
 
-QueueHandle_t rssi_init(void);
+event_ring_t *rssi_init(void);
+void rssi_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type);
 void print_rssi_event(rssi_event_t *event);
\ No newline at end of file
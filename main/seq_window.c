@@ -0,0 +1,53 @@
+
+#include "seq_window.h"
+
+#include <string.h>
+
+void seq_window_reset(seq_window_t *window)
+{
+        memset(window, 0, sizeof(seq_window_t));
+}
+
+/* Returns true when `seq` has not been seen before and is recent enough to be processed */
+bool seq_window_check(seq_window_t *window, uint8_t session, uint16_t seq)
+{
+        int16_t diff = (int16_t)(seq - window->top); // Serial number arithmetic, survives wrap around
+        if (!window->valid || (session != window->session) || (diff > SEQ_WINDOW_RESYNC_DISTANCE))
+        {
+                window->resyncs += window->valid;
+                window->valid = true;
+                window->session = session;
+                window->top = seq;
+                window->bitmap = 1;
+                window->accepted++;
+                return true;
+        }
+
+        if (diff > 0)
+        {
+                window->gaps += diff - 1;
+                window->bitmap = (diff >= SEQ_WINDOW_SIZE) ? 0 : window->bitmap << diff;
+                window->bitmap |= 1;
+                window->top = seq;
+                window->accepted++;
+                return true;
+        }
+
+        if (-diff >= SEQ_WINDOW_SIZE)
+        {
+                window->stale++;
+                return false;
+        }
+
+        uint64_t mask = (uint64_t)1 << -diff;
+        if (window->bitmap & mask)
+        {
+                window->duplicates++;
+                return false;
+        }
+        window->bitmap |= mask;
+        window->reordered++;
+        window->gaps -= (window->gaps > 0);
+        window->accepted++;
+        return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Anti-replay window over the 16-bit sequence numbers of one sender, bit i of
+ * `bitmap` is set when `top - i` has been accepted. Frames older than the
+ * window or already marked are dropped in constant time.
+ *
+ * A sender that restarts numbers its frames from the start again, which
+ * the window would take as stale. Every frame carries the sender's session,
+ * drawn at boot, and a new session restarts the window at once. A forward
+ * jump beyond SEQ_WINDOW_RESYNC_DISTANCE does the same, for a restart that
+ * drew the same session again. A frame behind the window is stale however
+ * old it is, a replay never moves `top` back.
+ *
+ * Not thread safe. No IDF headers, runs on a host as is.
+ * */
+
+#define SEQ_WINDOW_SIZE (64)
+#define SEQ_WINDOW_RESYNC_DISTANCE (1024)
+
+typedef struct
+{
+        uint64_t bitmap;
+        uint16_t top;      // Highest sequence number accepted
+        uint8_t session;   // Of the sender, see espnow_data_t
+        bool valid;        // Set once the first frame is seen
+        size_t accepted;   // Frames passed through
+        size_t duplicates; // Frames already marked in the window
+        size_t reordered;  // Frames accepted behind `top`, filling a gap
+        size_t stale;      // Frames older than the window
+        size_t gaps;       // Sequence numbers skipped and not filled yet
+        size_t resyncs;    // Window restarts after a new session or a large jump
+} seq_window_t;
+
+void seq_window_reset(seq_window_t *window);
+bool seq_window_check(seq_window_t *window, uint8_t session, uint16_t seq);
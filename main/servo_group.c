@@ -0,0 +1,242 @@
+
+#include "servo_group.h"
+
+static const char *TAG = "servo_group";
+
+typedef struct
+{
+        servo_handle_t handle;
+        servo_profile_t profile;
+        atomic_int_least32_t target; // Q16 degree, written by any task
+        atomic_int_least32_t angle;  // Q16 degree, output of the last frame
+        uint32_t duty;
+        uint16_t range_deg;
+        uint16_t duty_table[SERVO_GROUP_MAX_RANGE_DEG + 1]; // Duty at every whole degree
+} servo_group_servo_t;
+
+static servo_group_servo_t servo_group_servos[SERVO_GROUP_MAX];
+static size_t servo_group_count = 0;
+static atomic_uint servo_group_moving = 0; // Bit i while servo i is off its target
+static esp_timer_handle_t servo_group_timer = NULL;
+static atomic_int_least64_t servo_group_frame_us = 0;       // When the latest frame ran
+static atomic_int_least32_t servo_group_phase_shift_us = 0; // Delay wanted on the next frame
+static bool servo_group_period_stretched = false;
+
+_Static_assert(sizeof(servo_group_servos) <= MEM_BUDGET_SERVO_GROUP_BYTES, "Servo group over budget");
+
+servo_group_config_t *servo_group_default_config(servo_group_config_t *config, gpio_num_t pin)
+{
+        if (config == NULL)
+        {
+                LOG_ERROR("NULL pointer, config=0x%X", (uintptr_t)config);
+                return NULL;
+        }
+        config->pin = pin;
+        config->min_pulse_us = 1000;
+        config->max_pulse_us = 2000;
+        config->range_deg = 90; // Same mapping as `servo_default_config`
+        config->max_velocity_dps = 180;
+        config->max_acceleration_dps2 = 720;
+        config->jerk_dps3 = 7200;
+        return config;
+}
+
+static void servo_group_build_table(servo_group_servo_t *servo, const servo_group_config_t *config)
+{
+        const uint32_t period_us = 1000 * 1000 / servo->handle.freq_hz;
+        const uint32_t duty_max = (1UL << servo->handle.duty_resolution) - 1;
+        const uint32_t span_us = config->max_pulse_us - config->min_pulse_us;
+        for (size_t deg = 0; deg <= config->range_deg; deg++)
+        {
+                uint32_t pulse_us = config->min_pulse_us + (span_us * deg + config->range_deg / 2) / config->range_deg;
+                servo->duty_table[deg] = ((uint64_t)pulse_us * duty_max + period_us / 2) / period_us;
+        }
+}
+
+/* Linear between the two table entries around `angle`, which is clamped to the range */
+static uint32_t servo_group_angle_to_duty(const servo_group_servo_t *servo, int32_t angle)
+{
+        if (angle <= 0)
+                return servo->duty_table[0];
+        if (angle >= ((int32_t)servo->range_deg << SERVO_PROFILE_FRAC_BITS))
+                return servo->duty_table[servo->range_deg];
+
+        uint32_t deg = (uint32_t)angle >> SERVO_PROFILE_FRAC_BITS;
+        uint32_t frac = (uint32_t)angle & (SERVO_PROFILE_ONE - 1);
+        int32_t low = servo->duty_table[deg];
+        int32_t high = servo->duty_table[deg + 1];
+        return low + (((high - low) * (int32_t)frac) >> SERVO_PROFILE_FRAC_BITS);
+}
+
+/* Once per PWM frame: step every profile, write the new duties, then latch them back to back */
+static void servo_group_frame_cb(void *arg)
+{
+        atomic_store_explicit(&servo_group_frame_us, esp_timer_get_time(), memory_order_relaxed);
+        uint32_t changed = 0;
+        uint32_t moving = 0;
+        for (size_t i = 0; i < servo_group_count; i++)
+        {
+                servo_group_servo_t *servo = &servo_group_servos[i];
+                servo_profile_set_target(&servo->profile, atomic_load_explicit(&servo->target, memory_order_relaxed));
+                int32_t angle = servo_profile_step(&servo->profile);
+                atomic_store_explicit(&servo->angle, angle, memory_order_relaxed);
+                if (!servo_profile_done(&servo->profile))
+                        moving |= 1UL << i;
+
+                uint32_t duty = servo_group_angle_to_duty(servo, angle);
+                if (duty == servo->duty)
+                        continue;
+                servo->duty = duty;
+                ESP_ERROR_CHECK_WITHOUT_ABORT(ledc_set_duty(LEDC_LOW_SPEED_MODE, servo->handle.channel, duty));
+                changed |= 1UL << i;
+        }
+        for (size_t i = 0; i < servo_group_count; i++)
+        {
+                if (changed & (1UL << i))
+                        ESP_ERROR_CHECK_WITHOUT_ABORT(ledc_update_duty(LEDC_LOW_SPEED_MODE, servo_group_servos[i].handle.channel));
+        }
+        atomic_store_explicit(&servo_group_moving, moving, memory_order_relaxed);
+
+        // A phase shift stretches or shrinks one period, the next frame restores it
+        int32_t shift = atomic_exchange_explicit(&servo_group_phase_shift_us, 0, memory_order_relaxed);
+        if (servo_group_period_stretched || (shift != 0))
+        {
+                ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_restart(servo_group_timer, SERVO_GROUP_FRAME_US + shift));
+                servo_group_period_stretched = (shift != 0);
+        }
+}
+
+/*
+ * Servo i goes on LEDC channel i, all on LEDC_TIMER_0. Every servo starts
+ * at 0 degree, the position `servo_init` drives it to.
+ * */
+esp_err_t servo_group_init(const servo_group_config_t *configs, size_t count)
+{
+        if (configs == NULL)
+        {
+                LOG_ERROR("NULL pointer, configs=0x%X", (uintptr_t)configs);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if (servo_group_timer != NULL)
+        {
+                LOG_WARNING("Already initialized, timer=0x%X", (uintptr_t)servo_group_timer);
+                return ESP_ERR_INVALID_STATE;
+        }
+        if ((count == 0) || (count > SERVO_GROUP_MAX))
+        {
+                LOG_ERROR("Invalid servo count %d, max %d", count, SERVO_GROUP_MAX);
+                return ESP_ERR_INVALID_ARG;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+                const servo_group_config_t *config = &configs[i];
+                servo_group_servo_t *servo = &servo_group_servos[i];
+                servo_profile_limits_t limits;
+                if ((config->range_deg == 0) || (config->range_deg > SERVO_GROUP_MAX_RANGE_DEG) ||
+                    (config->min_pulse_us >= config->max_pulse_us) ||
+                    !servo_profile_limits_from(&limits, config->max_velocity_dps, config->max_acceleration_dps2,
+                                               config->jerk_dps3, SERVO_GROUP_FRAME_HZ))
+                {
+                        LOG_ERROR("Invalid config of servo %d", i);
+                        return ESP_ERR_INVALID_ARG;
+                }
+
+                servo_default_config(&servo->handle);
+                servo_init(&servo->handle, LEDC_TIMER_0, LEDC_CHANNEL_0 + i, config->pin);
+                servo->range_deg = config->range_deg;
+                servo_group_build_table(servo, config);
+                servo_profile_init(&servo->profile, &limits, 0);
+                atomic_store(&servo->target, 0);
+                atomic_store(&servo->angle, 0);
+                servo->duty = servo->duty_table[0];
+                ESP_ERROR_CHECK(ledc_set_duty(LEDC_LOW_SPEED_MODE, servo->handle.channel, servo->duty));
+                ESP_ERROR_CHECK(ledc_update_duty(LEDC_LOW_SPEED_MODE, servo->handle.channel));
+                LOG_INFO("Servo %d: %d-%d us over %d deg, %d dps, %d dps2, smoothing %d frames", i, config->min_pulse_us,
+                         config->max_pulse_us, config->range_deg, config->max_velocity_dps, config->max_acceleration_dps2,
+                         limits.smoothing);
+        }
+        servo_group_count = count;
+
+        const esp_timer_create_args_t timer_args = {
+            .callback = servo_group_frame_cb,
+            .name = "servo_group",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &servo_group_timer));
+        return esp_timer_start_periodic(servo_group_timer, SERVO_GROUP_FRAME_US);
+}
+
+/* Safe from any task, taken up at the next frame. `angle_q16` is clamped to the servo range */
+esp_err_t servo_group_set_target(size_t index, int32_t angle_q16)
+{
+        if (index >= servo_group_count)
+        {
+                LOG_WARNING("Invalid servo %d, count %d", index, servo_group_count);
+                return ESP_ERR_INVALID_ARG;
+        }
+        servo_group_servo_t *servo = &servo_group_servos[index];
+        int32_t max = (int32_t)servo->range_deg << SERVO_PROFILE_FRAC_BITS;
+        angle_q16 = (angle_q16 < 0) ? 0 : (angle_q16 > max) ? max : angle_q16;
+        atomic_store_explicit(&servo->target, angle_q16, memory_order_relaxed);
+        if (angle_q16 != atomic_load_explicit(&servo->angle, memory_order_relaxed))
+                atomic_fetch_or_explicit(&servo_group_moving, 1UL << index, memory_order_relaxed);
+        return ESP_OK;
+}
+
+/* Angle output in the last frame, Q16 degree */
+int32_t servo_group_get_angle(size_t index)
+{
+        if (index >= servo_group_count)
+                return 0;
+        return atomic_load_explicit(&servo_group_servos[index].angle, memory_order_relaxed);
+}
+
+/* Time the latest frame ran, unit: us since boot */
+int64_t servo_group_frame_time_us(void)
+{
+        return atomic_load_explicit(&servo_group_frame_us, memory_order_relaxed);
+}
+
+/* Moves the frames later by `delay_us`, or earlier when negative, applied at the next frame */
+void servo_group_shift_phase(int32_t delay_us)
+{
+        if (delay_us == 0)
+                return;
+        int32_t shift = atomic_fetch_add_explicit(&servo_group_phase_shift_us, delay_us, memory_order_relaxed) + delay_us;
+        const int32_t max_shift = SERVO_GROUP_FRAME_US / 2;
+        if ((shift > max_shift) || (shift < -max_shift))
+                atomic_store_explicit(&servo_group_phase_shift_us, (shift > 0) ? max_shift : -max_shift, memory_order_relaxed);
+}
+
+/* True once every servo rests on its target */
+bool servo_group_settled(void)
+{
+        return atomic_load_explicit(&servo_group_moving, memory_order_relaxed) == 0;
+}
+
+esp_err_t servo_target_send(espnow_send_param_t *send_param, uint8_t mask, const int16_t *angle_centideg)
+{
+        if ((send_param == NULL) || (angle_centideg == NULL))
+        {
+                LOG_ERROR("NULL pointer, send_param=0x%X, angle_centideg=0x%X", (uintptr_t)send_param, (uintptr_t)angle_centideg);
+                return ESP_ERR_INVALID_ARG;
+        }
+        servo_target_pkt_t packet = {.mask = mask};
+        memcpy(packet.angle_centideg, angle_centideg, sizeof(packet.angle_centideg));
+        return espnow_tx_send(TX_SCHED_CLASS_CONTROL, send_param, ESPNOW_PARAM_TYPE_SERVO_TARGET, &packet, sizeof(packet), ESPNOW_TX_FLAG_LATEST);
+}
+
+/* Handler for ESPNOW_PARAM_TYPE_SERVO_TARGET, only moves targets, the frame timer does the rest */
+void servo_target_handler(esp_peer_t *peer, const void *payload, size_t len, void *arg)
+{
+        servo_target_pkt_t packet;
+        memcpy(&packet, payload, sizeof(packet));
+        for (size_t i = 0; i < SERVO_GROUP_MAX; i++)
+        {
+                if (!(packet.mask & (1 << i)))
+                        continue;
+                int32_t angle_q16 = (int32_t)packet.angle_centideg[i] * SERVO_PROFILE_ONE / 100;
+                if (servo_group_set_target(i, angle_q16) != ESP_OK)
+                        LOG_WARNING("Target for servo %d from peer " MACSTR " ignored", i, MAC2STR(peer->mac));
+        }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "espnow.h"
+#include "espnow_tx.h"
+#include "logging.h"
+#include "mem_budget.h"
+#include "servo.h"
+#include "servo_profile.h"
+
+/*
+ * Up to SERVO_GROUP_MAX servos on one LEDC timer, stepped together once per
+ * 50 Hz PWM frame. Every channel shares the timer, so duties written in the
+ * same frame are latched by the hardware at the same period boundary.
+ *
+ * Callers only set targets, each servo then follows its own trapezoid or
+ * S-curve profile. Angle to duty goes through a table built at init, one
+ * entry per degree, interpolated in fixed point, no float in the frame.
+ * */
+
+#define SERVO_GROUP_MAX (4)
+#define SERVO_GROUP_FRAME_HZ (50)
+#define SERVO_GROUP_FRAME_US (1000 * 1000 / SERVO_GROUP_FRAME_HZ)
+#define SERVO_GROUP_MAX_RANGE_DEG (180)
+
+typedef struct
+{
+        gpio_num_t pin;
+        uint16_t min_pulse_us; // Pulse at 0 degree
+        uint16_t max_pulse_us; // Pulse at `range_deg`
+        uint16_t range_deg;
+        uint16_t max_velocity_dps;
+        uint16_t max_acceleration_dps2;
+        uint16_t jerk_dps3; // 0 for a trapezoid, an S-curve otherwise
+} servo_group_config_t;
+
+/* Targets of the servos set in `mask`, bit i for servo i */
+typedef struct
+{
+        uint8_t mask;
+        int16_t angle_centideg[SERVO_GROUP_MAX];
+} __packed servo_target_pkt_t;
+
+_Static_assert(sizeof(servo_target_pkt_t) == 9, "servo_target_pkt_t wire size changed");
+
+servo_group_config_t *servo_group_default_config(servo_group_config_t *config, gpio_num_t pin);
+esp_err_t servo_group_init(const servo_group_config_t *configs, size_t count);
+esp_err_t servo_group_set_target(size_t index, int32_t angle_q16);
+int32_t servo_group_get_angle(size_t index);
+bool servo_group_settled(void);
+int64_t servo_group_frame_time_us(void);
+void servo_group_shift_phase(int32_t delay_us);
+esp_err_t servo_target_send(espnow_send_param_t *send_param, uint8_t mask, const int16_t *angle_centideg);
+void servo_target_handler(esp_peer_t *peer, const void *payload, size_t len, void *arg);
@@ -0,0 +1,133 @@
+
+#include "servo_profile.h"
+
+static uint32_t servo_profile_isqrt(uint64_t value)
+{
+        uint64_t root = 0;
+        uint64_t bit = 1ULL << 62;
+        while (bit > value)
+                bit >>= 2;
+        while (bit != 0)
+        {
+                if (value >= root + bit)
+                {
+                        value -= root + bit;
+                        root = (root >> 1) + bit;
+                }
+                else
+                {
+                        root >>= 1;
+                }
+                bit >>= 2;
+        }
+        return root;
+}
+
+/*
+ * Fastest speed that still stops within `distance` while braking by `acceleration`
+ * every frame. Braking from v = k * a + r moves r + (r + a) + ... + (r + k * a)
+ * = (k + 1) * r + a * k * (k + 1) / 2, take the largest k that fits, then r.
+ * */
+static int32_t servo_profile_braking_velocity(uint32_t distance, int32_t acceleration)
+{
+        uint64_t a = acceleration;
+        uint64_t k = (servo_profile_isqrt(a * a + 8 * a * distance) - a) / (2 * a);
+        while (a * (k + 1) * (k + 2) / 2 <= distance)
+                k++;
+        while ((k > 0) && (a * k * (k + 1) / 2 > distance))
+                k--;
+        uint64_t r = (distance - a * k * (k + 1) / 2) / (k + 1);
+        if (r >= a)
+                r = a - 1;
+        uint64_t speed = k * a + r;
+        return (speed > INT32_MAX) ? INT32_MAX : (int32_t)speed;
+}
+
+static int32_t servo_profile_clamp(int32_t value, int32_t min, int32_t max)
+{
+        return (value < min) ? min : (value > max) ? max : value;
+}
+
+/*
+ * Converts limits in degree per second units to per frame ones. A `jerk_dps3`
+ * of 0 gives a trapezoid, otherwise the smoothing that keeps jerk under it,
+ * except on the short moves that never cruise, see servo_profile.h.
+ * Returns false when a limit rounds to 0 at this frame rate.
+ * */
+bool servo_profile_limits_from(servo_profile_limits_t *limits, uint32_t velocity_dps, uint32_t acceleration_dps2,
+                               uint32_t jerk_dps3, uint32_t frame_hz)
+{
+        if ((limits == NULL) || (frame_hz == 0))
+                return false;
+        limits->max_velocity = (int32_t)(((uint64_t)velocity_dps << SERVO_PROFILE_FRAC_BITS) / frame_hz);
+        limits->max_acceleration = (int32_t)(((uint64_t)acceleration_dps2 << SERVO_PROFILE_FRAC_BITS) / ((uint64_t)frame_hz * frame_hz));
+
+        uint32_t smoothing = 1;
+        if (jerk_dps3 != 0)
+                smoothing = ((uint64_t)acceleration_dps2 * frame_hz + jerk_dps3 - 1) / jerk_dps3; // Box of n frames, jerk = a / (n * dt)
+        limits->smoothing = servo_profile_clamp(smoothing, 1, SERVO_PROFILE_MAX_SMOOTHING);
+        return (limits->max_velocity > 0) && (limits->max_acceleration > 0);
+}
+
+/* Starts at rest on `position` */
+void servo_profile_init(servo_profile_t *profile, const servo_profile_limits_t *limits, int32_t position)
+{
+        profile->limits = *limits;
+        if (profile->limits.smoothing == 0)
+                profile->limits.smoothing = 1;
+        if (profile->limits.smoothing > SERVO_PROFILE_MAX_SMOOTHING)
+                profile->limits.smoothing = SERVO_PROFILE_MAX_SMOOTHING;
+        profile->target = position;
+        profile->position = position;
+        profile->velocity = 0;
+        profile->output = position;
+        for (size_t i = 0; i < profile->limits.smoothing; i++)
+                profile->history[i] = position;
+        profile->history_sum = (int64_t)position * profile->limits.smoothing;
+        profile->history_head = 0;
+}
+
+void servo_profile_set_target(servo_profile_t *profile, int32_t target)
+{
+        profile->target = target;
+}
+
+/* Advances one frame, returns the angle to output for it */
+int32_t servo_profile_step(servo_profile_t *profile)
+{
+        const int32_t a = profile->limits.max_acceleration;
+        int64_t distance = (int64_t)profile->target - profile->position;
+        uint32_t remaining = (distance < 0) ? -distance : distance;
+
+        if ((remaining <= (uint32_t)a) && (distance - profile->velocity >= -a) && (distance - profile->velocity <= a))
+        {
+                // Within one frame of braking, land on the target. The step is the velocity of this frame, the next one stops
+                profile->position = profile->target;
+                profile->velocity = distance;
+        }
+        else
+        {
+                int32_t speed = servo_profile_braking_velocity(remaining, a);
+                if (speed > profile->limits.max_velocity)
+                        speed = profile->limits.max_velocity;
+                int32_t desired = (distance < 0) ? -speed : speed;
+                profile->velocity += servo_profile_clamp(desired - profile->velocity, -a, a);
+                profile->position += profile->velocity;
+        }
+
+        // Box filter over the last `smoothing` positions, a trapezoid in, an S-curve out
+        uint8_t head = profile->history_head;
+        profile->history_sum += (int64_t)profile->position - profile->history[head];
+        profile->history[head] = profile->position;
+        profile->history_head = (head + 1 < profile->limits.smoothing) ? head + 1 : 0;
+        int64_t n = profile->limits.smoothing;
+        int64_t sum = profile->history_sum;
+        profile->output = (int32_t)((sum >= 0) ? (sum + n / 2) / n : -((-sum + n / 2) / n));
+        return profile->output;
+}
+
+bool servo_profile_done(const servo_profile_t *profile)
+{
+        return (profile->velocity == 0) && (profile->position == profile->target) && (profile->output == profile->target) &&
+               (profile->history_sum == (int64_t)profile->target * profile->limits.smoothing);
+}
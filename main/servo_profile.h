@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Motion profile of one servo, stepped once per PWM frame. Angles are
+ * Q16.16 degrees, velocity is per frame and acceleration per frame squared,
+ * so a step is integer adds and one integer square root.
+ *
+ * The trapezoid stage accelerates toward the target up to `max_velocity`
+ * and brakes just in time to stop on it, the target may move at any time.
+ * An S-curve is the trapezoid run through a box filter of `smoothing`
+ * frames, which limits jerk to max_acceleration / smoothing per frame and
+ * still ends exactly on the target. A short move that goes from speeding up
+ * straight to braking sees twice that at the turn. No IDF headers, runs on
+ * a host as is.
+ * */
+
+#define SERVO_PROFILE_FRAC_BITS (16)
+#define SERVO_PROFILE_ONE (1L << SERVO_PROFILE_FRAC_BITS)
+#define SERVO_PROFILE_MAX_SMOOTHING (16) // Frames, 320 ms at 50 Hz
+
+typedef struct
+{
+        int32_t max_velocity;     // Q16 degree per frame
+        int32_t max_acceleration; // Q16 degree per frame^2
+        uint8_t smoothing;        // Frames, 1 for a plain trapezoid
+} servo_profile_limits_t;
+
+typedef struct
+{
+        servo_profile_limits_t limits;
+        int32_t target;
+        int32_t position; // Trapezoid stage
+        int32_t velocity;
+        int32_t output; // After smoothing
+        int32_t history[SERVO_PROFILE_MAX_SMOOTHING];
+        int64_t history_sum;
+        uint8_t history_head;
+} servo_profile_t;
+
+bool servo_profile_limits_from(servo_profile_limits_t *limits, uint32_t velocity_dps, uint32_t acceleration_dps2,
+                               uint32_t jerk_dps3, uint32_t frame_hz);
+void servo_profile_init(servo_profile_t *profile, const servo_profile_limits_t *limits, int32_t position);
+void servo_profile_set_target(servo_profile_t *profile, int32_t target);
+int32_t servo_profile_step(servo_profile_t *profile);
+bool servo_profile_done(const servo_profile_t *profile);
@@ -0,0 +1,168 @@
+
+#include "servo_stream.h"
+
+static const char *TAG = "servo_stream";
+
+static servo_stream_config_t servo_stream_config;
+static espnow_send_param_t servo_stream_send_param;
+static esp_timer_handle_t servo_stream_timer = NULL;
+static uint16_t servo_stream_seq = 0;
+static setpoint_phase_t servo_stream_phase;
+static bool servo_stream_receiving = false;
+static servo_stream_stat_t servo_stream_stat;
+
+/* Joystick thresholds of joystick.c: rest around 1.65 V, stops near 0.15 V and 3.1 V */
+setpoint_curve_t *servo_stream_default_curve(setpoint_curve_t *curve, uint16_t range_deg, bool inverted)
+{
+        if (curve == NULL)
+        {
+                LOG_ERROR("NULL pointer, curve=0x%X", (uintptr_t)curve);
+                return NULL;
+        }
+        *curve = (setpoint_curve_t){
+            .in_min = 150,
+            .in_center = 1650,
+            .in_max = 3100,
+            .deadband = 80,
+            .expo = 64,
+            .inverted = inverted,
+            .out_min = 0,
+            .out_center = ((int32_t)range_deg << 16) / 2,
+            .out_max = (int32_t)range_deg << 16,
+        };
+        return curve;
+}
+
+static int16_t servo_stream_to_centideg(int32_t angle_q16)
+{
+        int64_t centideg = ((int64_t)angle_q16 * 100 + (SETPOINT_Q16_ONE / 2)) >> 16;
+        return (centideg > INT16_MAX) ? INT16_MAX : (centideg < INT16_MIN) ? INT16_MIN : (int16_t)centideg;
+}
+
+/* Sample, map and send in one go, so every setpoint is as fresh as the period allows */
+static void servo_stream_timer_cb(void *arg)
+{
+        servo_setpoint_pkt_t packet = {
+            .seq = servo_stream_seq++,
+            .mask = (1 << servo_stream_config.count) - 1,
+        };
+        for (size_t i = 0; i < servo_stream_config.count; i++)
+        {
+                const servo_stream_axis_t *axis = &servo_stream_config.axes[i];
+                int32_t angle = setpoint_curve_apply(&axis->curve, joystick_sample_mv(axis->channel));
+                packet.angle_centideg[i] = servo_stream_to_centideg(angle);
+        }
+
+        // A setpoint still queued from the last period is stale, this one takes its place
+        if (espnow_tx_send(TX_SCHED_CLASS_CONTROL, &servo_stream_send_param, ESPNOW_PARAM_TYPE_SERVO_SETPOINT, &packet, sizeof(packet),
+                           ESPNOW_TX_FLAG_LATEST) == ESP_OK)
+                servo_stream_stat.sent++;
+        else
+                servo_stream_stat.send_failed++;
+}
+
+/* Remote side, creates the stream timer, the heap is off limits once running */
+esp_err_t servo_stream_init(void)
+{
+        if (servo_stream_timer != NULL)
+        {
+                LOG_WARNING("Already initialized, timer=0x%X", (uintptr_t)servo_stream_timer);
+                return ESP_ERR_INVALID_STATE;
+        }
+        const esp_timer_create_args_t timer_args = {
+            .callback = servo_stream_timer_cb,
+            .name = "servo_stream",
+            .skip_unhandled_events = true, // A late period is skipped, never sent twice in a row
+        };
+        return esp_timer_create(&timer_args, &servo_stream_timer);
+}
+
+/* Streams to the destination of `send_param` until servo_stream_stop, after servo_stream_init */
+esp_err_t servo_stream_start(const servo_stream_config_t *config, const espnow_send_param_t *send_param)
+{
+        if ((config == NULL) || (send_param == NULL))
+        {
+                LOG_ERROR("NULL pointer, config=0x%X, send_param=0x%X", (uintptr_t)config, (uintptr_t)send_param);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if ((config->count == 0) || (config->count > SERVO_GROUP_MAX) || (config->rate_multiplier == 0) ||
+            (config->rate_multiplier > SERVO_STREAM_MAX_RATE_MULTIPLIER))
+        {
+                LOG_ERROR("Invalid config, count=%d, rate_multiplier=%d", config->count, config->rate_multiplier);
+                return ESP_ERR_INVALID_ARG;
+        }
+        if (servo_stream_timer == NULL)
+        {
+                LOG_ERROR("Not initialized, call servo_stream_init first");
+                return ESP_ERR_INVALID_STATE;
+        }
+        if (servo_stream_running())
+        {
+                LOG_WARNING("Already streaming to " MACSTR, MAC2STR(servo_stream_send_param.dest_mac));
+                return ESP_ERR_INVALID_STATE;
+        }
+
+        servo_stream_config = *config;
+        servo_stream_send_param = *send_param;
+        LOG_INFO("Streaming %d axes to " MACSTR " at %d Hz", config->count, MAC2STR(send_param->dest_mac),
+                 SERVO_GROUP_FRAME_HZ * config->rate_multiplier);
+        return esp_timer_start_periodic(servo_stream_timer, SERVO_GROUP_FRAME_US / config->rate_multiplier);
+}
+
+void servo_stream_stop(void)
+{
+        if (!servo_stream_running())
+                return;
+        esp_timer_stop(servo_stream_timer);
+        LOG_INFO("Stream stopped, sent: %d, failed: %d", servo_stream_stat.sent, servo_stream_stat.send_failed);
+}
+
+bool servo_stream_running(void)
+{
+        return (servo_stream_timer != NULL) && esp_timer_is_active(servo_stream_timer);
+}
+
+/* Car side, call after servo_group_init with the rate multiplier of the remote */
+esp_err_t servo_stream_receiver_init(uint8_t rate_multiplier)
+{
+        if ((rate_multiplier == 0) || (rate_multiplier > SERVO_STREAM_MAX_RATE_MULTIPLIER))
+        {
+                LOG_ERROR("Invalid rate_multiplier %d", rate_multiplier);
+                return ESP_ERR_INVALID_ARG;
+        }
+        setpoint_phase_init(&servo_stream_phase, SERVO_GROUP_FRAME_US / rate_multiplier, SERVO_STREAM_LEAD_US, SERVO_STREAM_MAX_STEP_US);
+        setpoint_seq_reset(&servo_stream_stat.rx);
+        servo_stream_receiving = true;
+        return ESP_OK;
+}
+
+/* Handler for ESPNOW_PARAM_TYPE_SERVO_SETPOINT, a setpoint older than the last applied one is dropped */
+void servo_setpoint_handler(esp_peer_t *peer, const void *payload, size_t len, void *arg)
+{
+        int64_t arrival_us = esp_timer_get_time();
+        if (!servo_stream_receiving)
+                return;
+
+        servo_setpoint_pkt_t packet;
+        memcpy(&packet, payload, sizeof(packet));
+        if (!setpoint_seq_accept(&servo_stream_stat.rx, packet.seq))
+        {
+                LOG_VERBOSE("Late setpoint seq:%d from peer " MACSTR ", newest %d", packet.seq, MAC2STR(peer->mac), servo_stream_stat.rx.last);
+                return;
+        }
+
+        setpoint_phase_arrival(&servo_stream_phase, arrival_us, servo_group_frame_time_us());
+        servo_group_shift_phase(setpoint_phase_correction(&servo_stream_phase));
+        servo_stream_stat.phase_error_us = servo_stream_phase.error_q4 / 16;
+
+        for (size_t i = 0; i < SERVO_GROUP_MAX; i++)
+        {
+                if (packet.mask & (1 << i))
+                        servo_group_set_target(i, (int32_t)packet.angle_centideg[i] * SETPOINT_Q16_ONE / 100);
+        }
+}
+
+const servo_stream_stat_t *servo_stream_get_stat(void)
+{
+        return &servo_stream_stat;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "driver/adc.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "espnow.h"
+#include "espnow_tx.h"
+#include "joystick.h"
+#include "logging.h"
+#include "servo_group.h"
+#include "setpoint_stream.h"
+
+/*
+ * Continuous joystick to servo setpoints. The remote samples its analog axes
+ * from a timer at the servo frame rate, or a multiple of it, maps them through
+ * calibrated curves and sends one compact packet per period. The timer skips
+ * periods it could not serve on time rather than sending a burst of old ones.
+ *
+ * The car keeps only the newest setpoint, as servo targets, and delays its
+ * servo frames until setpoints arrive SERVO_STREAM_LEAD_US before the frame
+ * that applies them. Arrival is taken when the packet is dispatched, the
+ * receive callback wakes the dispatching task at once.
+ *
+ * streamSim.py models the whole path on a host and reports the jitter.
+ * */
+
+#define SERVO_STREAM_LEAD_US (5000)
+#define SERVO_STREAM_MAX_STEP_US (500) // Frame delay per setpoint, 2.5% of a frame
+#define SERVO_STREAM_MAX_RATE_MULTIPLIER (4)
+
+typedef struct
+{
+        adc1_channel_t channel;
+        setpoint_curve_t curve;
+} servo_stream_axis_t;
+
+typedef struct
+{
+        servo_stream_axis_t axes[SERVO_GROUP_MAX]; // Axis i drives servo i
+        uint8_t count;
+        uint8_t rate_multiplier; // Setpoints per servo frame
+} servo_stream_config_t;
+
+typedef struct
+{
+        uint16_t seq;
+        uint8_t mask;
+        int16_t angle_centideg[SERVO_GROUP_MAX];
+} __packed servo_setpoint_pkt_t;
+
+_Static_assert(sizeof(servo_setpoint_pkt_t) == 11, "servo_setpoint_pkt_t wire size changed");
+
+typedef struct
+{
+        uint32_t sent;
+        uint32_t send_failed;
+        setpoint_seq_t rx;     // Received, late and resync counts
+        int32_t phase_error_us; // Averaged arrival error, 0 once locked
+} servo_stream_stat_t;
+
+setpoint_curve_t *servo_stream_default_curve(setpoint_curve_t *curve, uint16_t range_deg, bool inverted);
+esp_err_t servo_stream_init(void);
+esp_err_t servo_stream_start(const servo_stream_config_t *config, const espnow_send_param_t *send_param);
+void servo_stream_stop(void);
+bool servo_stream_running(void);
+
+esp_err_t servo_stream_receiver_init(uint8_t rate_multiplier);
+void servo_setpoint_handler(esp_peer_t *peer, const void *payload, size_t len, void *arg);
+const servo_stream_stat_t *servo_stream_get_stat(void);
@@ -0,0 +1,99 @@
+
+#include "setpoint_stream.h"
+
+/* Q16 input in [0, 1] to Q16 output in [0, 1], blend of x and x^3 by `expo` / 256 */
+static int32_t setpoint_expo(int32_t x, uint8_t expo)
+{
+        int64_t cube = ((((int64_t)x * x) >> 16) * x) >> 16;
+        return (int32_t)(((int64_t)x * (256 - expo) + cube * expo) >> 8);
+}
+
+int32_t setpoint_curve_apply(const setpoint_curve_t *curve, int32_t mv)
+{
+        int32_t offset = mv - curve->in_center;
+        int32_t magnitude = (offset < 0) ? -offset : offset;
+        if (magnitude <= curve->deadband)
+                return curve->out_center;
+
+        int32_t span = ((offset > 0) ? curve->in_max - curve->in_center : curve->in_center - curve->in_min) - curve->deadband;
+        if (span <= 0)
+                return curve->out_center;
+        int64_t x = ((int64_t)(magnitude - curve->deadband) << 16) / span;
+        int32_t y = setpoint_expo((x > SETPOINT_Q16_ONE) ? SETPOINT_Q16_ONE : (int32_t)x, curve->expo);
+
+        if ((offset > 0) != curve->inverted)
+                return curve->out_center + (int32_t)(((int64_t)(curve->out_max - curve->out_center) * y) >> 16);
+        return curve->out_center - (int32_t)(((int64_t)(curve->out_center - curve->out_min) * y) >> 16);
+}
+
+void setpoint_seq_reset(setpoint_seq_t *seq)
+{
+        *seq = (setpoint_seq_t){0};
+}
+
+/* True when `number` is newer than the last accepted setpoint */
+bool setpoint_seq_accept(setpoint_seq_t *seq, uint16_t number)
+{
+        int16_t diff = (int16_t)(number - seq->last); // Serial number arithmetic, survives wrap around
+        if (seq->valid && (diff <= 0) && (diff >= -SETPOINT_SEQ_RESYNC_DISTANCE))
+        {
+                seq->late++;
+                return false;
+        }
+        seq->resyncs += seq->valid && (diff < 0);
+        seq->valid = true;
+        seq->last = number;
+        seq->accepted++;
+        return true;
+}
+
+void setpoint_phase_init(setpoint_phase_t *phase, uint32_t period_us, uint32_t lead_us, uint32_t max_step_us)
+{
+        *phase = (setpoint_phase_t){
+            .period_us = period_us,
+            .lead_us = (lead_us < period_us) ? lead_us : period_us / 2,
+            .max_step_us = max_step_us,
+        };
+}
+
+/* Records a setpoint received at `arrival_us`, `frame_us` is when the receiver's latest frame ran */
+void setpoint_phase_arrival(setpoint_phase_t *phase, int64_t arrival_us, int64_t frame_us)
+{
+        const int32_t period = phase->period_us;
+        int32_t offset = (int32_t)((arrival_us - frame_us) % period);
+        if (offset < 0)
+                offset += period;
+
+        // Distance from the wanted arrival, folded into [-period / 2, period / 2)
+        int32_t error = offset - (period - (int32_t)phase->lead_us);
+        if (error >= period / 2)
+                error -= period;
+        else if (error < -period / 2)
+                error += period;
+
+        if (phase->samples == 0)
+                phase->error_q4 = error * 16;
+        else
+                phase->error_q4 += (error * 16 - phase->error_q4) >> SETPOINT_PHASE_AVERAGE_SHIFT;
+        phase->samples++;
+}
+
+/*
+ * Delay to add to the receiver's next frame, unit: us. A positive error means
+ * setpoints land late, so frames move later. The correction comes off the
+ * average at once, later arrivals are measured against the moved frames.
+ * */
+int32_t setpoint_phase_correction(setpoint_phase_t *phase)
+{
+        if (phase->samples < SETPOINT_PHASE_MIN_SAMPLES)
+                return 0;
+
+        int32_t correction = phase->error_q4 / 16;
+        const int32_t max_step = phase->max_step_us;
+        if (correction > max_step)
+                correction = max_step;
+        else if (correction < -max_step)
+                correction = -max_step;
+        phase->error_q4 -= correction * 16;
+        return correction;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Pieces of the joystick to servo setpoint stream that need no IDF, so the
+ * whole path can be simulated on a Linux host.
+ *
+ * Curve: ADC millivolts to a Q16.16 degree setpoint, with the rest position,
+ * a deadband around it and an expo blend for finer control near center.
+ *
+ * Sequence: the newest setpoint wins, one older than the last applied is
+ * late and dropped. A jump back of more than SETPOINT_SEQ_RESYNC_DISTANCE
+ * means the sender restarted, the counter resyncs.
+ *
+ * Phase: the sender is the phase master. The receiver watches where in its
+ * own frame the setpoints land and delays its frame timer, a bounded step at
+ * a time, until they arrive `lead_us` ahead of the frame that applies them.
+ * */
+
+#define SETPOINT_Q16_ONE (1L << 16)
+#define SETPOINT_SEQ_RESYNC_DISTANCE (64)
+#define SETPOINT_PHASE_MIN_SAMPLES (8) // Arrivals averaged before the first correction
+#define SETPOINT_PHASE_AVERAGE_SHIFT (3) // Arrival error averaged over ~8 packets
+
+typedef struct
+{
+        int32_t in_min, in_center, in_max; // ADC mV at both stops and at rest
+        int32_t deadband;                  // mV on either side of `in_center` read as center
+        uint8_t expo;                      // 0 linear, 255 almost cubic
+        bool inverted;
+        int32_t out_min, out_center, out_max; // Q16 degree
+} setpoint_curve_t;
+
+typedef struct
+{
+        uint16_t last;
+        bool valid;
+        uint32_t accepted;
+        uint32_t late; // Older than the last applied, dropped
+        uint32_t resyncs;
+} setpoint_seq_t;
+
+typedef struct
+{
+        uint32_t period_us;   // Setpoint period, the frame period or a fraction of it
+        uint32_t lead_us;     // Wanted time from arrival to the next frame
+        uint32_t max_step_us; // Largest frame delay per correction
+        int32_t error_q4;     // Averaged arrival error, Q4 us, positive when late
+        uint32_t samples;
+} setpoint_phase_t;
+
+int32_t setpoint_curve_apply(const setpoint_curve_t *curve, int32_t mv);
+
+void setpoint_seq_reset(setpoint_seq_t *seq);
+bool setpoint_seq_accept(setpoint_seq_t *seq, uint16_t number);
+
+void setpoint_phase_init(setpoint_phase_t *phase, uint32_t period_us, uint32_t lead_us, uint32_t max_step_us);
+void setpoint_phase_arrival(setpoint_phase_t *phase, int64_t arrival_us, int64_t frame_us);
+int32_t setpoint_phase_correction(setpoint_phase_t *phase);
@@ -0,0 +1,111 @@
+
+#include <string.h>
+
+#include "spsc_ring.h"
+
+/* `buffer` holds `capacity` items of `item_size` bytes, `capacity` must be a power of two */
+bool spsc_ring_init(spsc_ring_t *ring, void *buffer, size_t item_size, size_t capacity)
+{
+        if ((ring == NULL) || (buffer == NULL) || (item_size == 0) || (capacity == 0) || (capacity & (capacity - 1)))
+                return false;
+        ring->buffer = buffer;
+        ring->item_size = item_size;
+        ring->mask = capacity - 1;
+        atomic_init(&ring->head, 0);
+        ring->tail_cache = 0;
+        atomic_init(&ring->tail, 0);
+        ring->head_cache = 0;
+        atomic_init(&ring->waiting, false);
+        return true;
+}
+
+/* Producer only. Returns false when the ring is full, the item is not stored */
+bool spsc_ring_push(spsc_ring_t *ring, const void *item)
+{
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        if (head - ring->tail_cache > ring->mask)
+        {
+                ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+                if (head - ring->tail_cache > ring->mask)
+                        return false;
+        }
+        memcpy(ring->buffer + (head & ring->mask) * ring->item_size, item, ring->item_size);
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+        return true;
+}
+
+/* Consumer only. Copies up to `max` items into `items`, returns how many */
+size_t spsc_ring_pop_batch(spsc_ring_t *ring, void *items, size_t max)
+{
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t available = ring->head_cache - tail;
+        if (available < max)
+        {
+                ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+                available = ring->head_cache - tail;
+        }
+        size_t count = (available < max) ? available : max;
+        if (count == 0)
+                return 0;
+
+        // At most two copies, the second one when the run wraps past the end of the buffer
+        size_t start = tail & ring->mask;
+        size_t first = ring->mask + 1 - start;
+        if (first > count)
+                first = count;
+        memcpy(items, ring->buffer + start * ring->item_size, first * ring->item_size);
+        if (count > first)
+                memcpy((uint8_t *)items + first * ring->item_size, ring->buffer, (count - first) * ring->item_size);
+
+        atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+        return count;
+}
+
+bool spsc_ring_pop(spsc_ring_t *ring, void *item)
+{
+        return spsc_ring_pop_batch(ring, item, 1) == 1;
+}
+
+/* Exact from either side while the other one is idle, a snapshot otherwise */
+size_t spsc_ring_count(spsc_ring_t *ring)
+{
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        return atomic_load_explicit(&ring->head, memory_order_acquire) - tail;
+}
+
+size_t spsc_ring_capacity(const spsc_ring_t *ring)
+{
+        return ring->mask + 1;
+}
+
+/*
+ * Consumer, before sleeping. Returns false when an item is already there and
+ * the consumer must not sleep. Both sides fence between their store and their
+ * load, so either this check sees the new item or the producer sees the flag.
+ * */
+bool spsc_ring_prepare_wait(spsc_ring_t *ring)
+{
+        atomic_store_explicit(&ring->waiting, true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&ring->head, memory_order_relaxed) != atomic_load_explicit(&ring->tail, memory_order_relaxed))
+        {
+                atomic_store(&ring->waiting, false);
+                return false;
+        }
+        return true;
+}
+
+/* Consumer, after waking up for any reason */
+void spsc_ring_finish_wait(spsc_ring_t *ring)
+{
+        atomic_store_explicit(&ring->waiting, false, memory_order_relaxed);
+}
+
+/* Producer, after a push. True at most once per wait, the caller then wakes the consumer */
+bool spsc_ring_take_waiter(spsc_ring_t *ring)
+{
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!atomic_load_explicit(&ring->waiting, memory_order_relaxed))
+                return false;
+        return atomic_exchange(&ring->waiting, false);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Lock-free ring for one producer and one consumer, e.g. a Wi-Fi callback
+ * feeding a task. Items are copied in and out, the capacity is a power of
+ * two so indices run freely and wrap by masking.
+ *
+ * Producer and consumer indices sit on separate cache lines, each side keeps
+ * a cached copy of the other's index and only reloads it when the ring looks
+ * full (producer) or empty (consumer).
+ *
+ * The consumer may sleep: spsc_ring_prepare_wait() flags it before the last
+ * emptiness check, the producer calls spsc_ring_take_waiter() after a push
+ * and wakes the consumer when it returns true. No IDF headers, the wakeup
+ * itself is up to the caller.
+ * */
+
+#ifndef SPSC_RING_CACHE_LINE
+#define SPSC_RING_CACHE_LINE (32) // CONFIG_ESP32S3_DATA_CACHE_LINE_SIZE
+#endif
+
+typedef struct
+{
+        // Read only after init
+        alignas(SPSC_RING_CACHE_LINE) uint8_t *buffer;
+        size_t item_size; // Unit: byte
+        size_t mask;      // Capacity - 1
+
+        // Producer side
+        alignas(SPSC_RING_CACHE_LINE) atomic_size_t head;
+        size_t tail_cache;
+
+        // Consumer side
+        alignas(SPSC_RING_CACHE_LINE) atomic_size_t tail;
+        size_t head_cache;
+        atomic_bool waiting;
+} spsc_ring_t;
+
+bool spsc_ring_init(spsc_ring_t *ring, void *buffer, size_t item_size, size_t capacity);
+bool spsc_ring_push(spsc_ring_t *ring, const void *item);
+bool spsc_ring_pop(spsc_ring_t *ring, void *item);
+size_t spsc_ring_pop_batch(spsc_ring_t *ring, void *items, size_t max);
+size_t spsc_ring_count(spsc_ring_t *ring);
+size_t spsc_ring_capacity(const spsc_ring_t *ring);
+
+bool spsc_ring_prepare_wait(spsc_ring_t *ring);
+void spsc_ring_finish_wait(spsc_ring_t *ring);
+bool spsc_ring_take_waiter(spsc_ring_t *ring);
@@ -0,0 +1,92 @@
+
+#include <stdio.h>
+#include <string.h>
+
+#include "task_stats.h"
+
+static const task_stats_sample_t *task_stats_lookup(const task_stats_sample_t *samples, size_t count, uint32_t number)
+{
+        for (size_t i = 0; i < count; i++)
+                if (samples[i].number == number)
+                        return &samples[i];
+        return NULL;
+}
+
+/*
+ * Load of every task in `cur` over the `elapsed` run-time ticks since `prev`,
+ * a task missing from `prev` was created in between and is counted from 0.
+ * Output is sorted by core, then by load. Returns the number of entries.
+ * */
+size_t task_stats_aggregate(const task_stats_sample_t *prev, size_t prev_count,
+                            const task_stats_sample_t *cur, size_t cur_count,
+                            uint32_t elapsed, task_stats_entry_t *out)
+{
+        if ((cur == NULL) || (out == NULL))
+                return 0;
+        if (cur_count > TASK_STATS_MAX_TASKS)
+                cur_count = TASK_STATS_MAX_TASKS;
+
+        for (size_t i = 0; i < cur_count; i++)
+        {
+                const task_stats_sample_t *before = (prev != NULL) ? task_stats_lookup(prev, prev_count, cur[i].number) : NULL;
+                uint32_t delta = cur[i].runtime - (before ? before->runtime : 0); // Unsigned, survives one wrap
+
+                task_stats_entry_t entry = {
+                    .number = cur[i].number,
+                    .stack_hwm = cur[i].stack_hwm,
+                    .cpu_permille = elapsed ? (uint16_t)(((uint64_t)delta * 1000 + elapsed / 2) / elapsed) : 0,
+                    .core = cur[i].core,
+                    .priority = cur[i].priority,
+                };
+                memcpy(entry.name, cur[i].name, TASK_STATS_NAME_LEN);
+                entry.name[TASK_STATS_NAME_LEN - 1] = '\0';
+
+                // Insertion sort, a few dozen tasks at most
+                size_t pos = i;
+                while ((pos > 0) && ((out[pos - 1].core > entry.core) ||
+                                     ((out[pos - 1].core == entry.core) && (out[pos - 1].cpu_permille < entry.cpu_permille))))
+                {
+                        out[pos] = out[pos - 1];
+                        pos--;
+                }
+                out[pos] = entry;
+        }
+        return cur_count;
+}
+
+const task_stats_entry_t *task_stats_find(const task_stats_entry_t *entries, size_t count, const char *name)
+{
+        if ((entries == NULL) || (name == NULL))
+                return NULL;
+        for (size_t i = 0; i < count; i++)
+                if (strncmp(entries[i].name, name, TASK_STATS_NAME_LEN) == 0)
+                        return &entries[i];
+        return NULL;
+}
+
+/* One line per task, truncated to `size`. Returns the length written, like snprintf */
+size_t task_stats_format(char *buf, size_t size, const task_stats_entry_t *entries, size_t count)
+{
+        if ((buf == NULL) || (size == 0))
+                return 0;
+
+        int n = snprintf(buf, size, "%-16s %4s %4s %6s %6s\n", "task", "core", "prio", "cpu%", "stack");
+        if (n < 0)
+                return 0;
+        size_t len = n;
+        for (size_t i = 0; (i < count) && (len < size); i++)
+        {
+                const task_stats_entry_t *entry = &entries[i];
+                char core[5] = "any";
+                if (entry->core != TASK_STATS_NO_AFFINITY)
+                        snprintf(core, sizeof(core), "%d", entry->core);
+                n = snprintf(buf + len, size - len, "%-16s %4s %4u %3u.%u %6lu\n",
+                             entry->name, core, entry->priority,
+                             entry->cpu_permille / 10, entry->cpu_permille % 10,
+                             (unsigned long)entry->stack_hwm);
+                if (n < 0)
+                        break;
+                len += n;
+        }
+        return (len < size) ? len : size - 1;
+}
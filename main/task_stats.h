@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Turns two snapshots of FreeRTOS run-time counters into per-task CPU load.
+ * Kept free of IDF headers so the aggregation and the table format can be
+ * exercised on a Linux host with hand made snapshots.
+ * */
+
+#define TASK_STATS_NAME_LEN (16)
+#define TASK_STATS_MAX_TASKS (32)
+#define TASK_STATS_NO_AFFINITY (-1)
+
+typedef struct
+{
+        char name[TASK_STATS_NAME_LEN];
+        uint32_t number;    // xTaskNumber, unique for the lifetime of a task
+        uint32_t runtime;   // ulRunTimeCounter, wraps around
+        uint32_t stack_hwm; // Unused stack, unit: byte
+        int8_t core;        // TASK_STATS_NO_AFFINITY when unpinned
+        uint8_t priority;
+} task_stats_sample_t;
+
+typedef struct
+{
+        char name[TASK_STATS_NAME_LEN];
+        uint32_t number;
+        uint32_t stack_hwm;
+        uint16_t cpu_permille; // Of one core over the interval
+        int8_t core;
+        uint8_t priority;
+} task_stats_entry_t;
+
+size_t task_stats_aggregate(const task_stats_sample_t *prev, size_t prev_count,
+                            const task_stats_sample_t *cur, size_t cur_count,
+                            uint32_t elapsed, task_stats_entry_t *out);
+const task_stats_entry_t *task_stats_find(const task_stats_entry_t *entries, size_t count, const char *name);
+size_t task_stats_format(char *buf, size_t size, const task_stats_entry_t *entries, size_t count);
@@ -0,0 +1,247 @@
+
+#include "task_table.h"
+#include "link_bench_espnow.h"
+#include "link_throughput_espnow.h"
+
+static const char *TAG = "task_table";
+
+#define TASK_STATS_CONSOLE_POLL_MS (200)
+#define TASK_STATS_LINE_LEN (48)
+
+static StackType_t task_stack_button[4096];
+static StackType_t task_stack_joystick[4096];
+static StackType_t task_stack_rssi[4096];
+static StackType_t task_stack_tx[3072];
+static StackType_t task_stack_app[4096];
+static StackType_t task_stack_stats[3072];
+static StaticTask_t task_table_tcbs[TASK_ID_MAX];
+
+_Static_assert(sizeof(task_stack_button) + sizeof(task_stack_joystick) + sizeof(task_stack_rssi) + sizeof(task_stack_tx) + sizeof(task_stack_app) +
+                       sizeof(task_stack_stats) + sizeof(task_table_tcbs) <=
+                   MEM_BUDGET_TASK_TABLE_BYTES,
+               "Task stacks over budget");
+
+static const task_spec_t task_table[TASK_ID_MAX] = {
+    [TASK_ID_BUTTON] = {.name = "button_task", .stack = task_stack_button, .stack_size = sizeof(task_stack_button), .priority = 10, .core = 1},
+    [TASK_ID_JOYSTICK] = {.name = "joystick_task", .stack = task_stack_joystick, .stack_size = sizeof(task_stack_joystick), .priority = 10, .core = 1},
+    [TASK_ID_RSSI] = {.name = "rssi_task", .stack = task_stack_rssi, .stack_size = sizeof(task_stack_rssi), .priority = 4, .core = 0},
+    [TASK_ID_TX] = {.name = "tx_task", .stack = task_stack_tx, .stack_size = sizeof(task_stack_tx), .priority = 5, .core = 0},
+    [TASK_ID_APP] = {.name = "app_task", .stack = task_stack_app, .stack_size = sizeof(task_stack_app), .priority = 9, .core = 1},
+    [TASK_ID_STATS] = {.name = "task_stats", .stack = task_stack_stats, .stack_size = sizeof(task_stack_stats), .priority = 1, .core = 1},
+};
+
+static TaskHandle_t task_table_handles[TASK_ID_MAX];
+
+static uint32_t task_stats_period_ms = TASK_STATS_DEFAULT_PERIOD_MS;
+static TaskStatus_t task_stats_status[TASK_STATS_MAX_TASKS];
+static task_stats_sample_t task_stats_samples[2][TASK_STATS_MAX_TASKS]; // Previous and current snapshot
+static size_t task_stats_sample_count[2];
+static size_t task_stats_current = 0;
+static uint32_t task_stats_last_total = 0;
+static uint32_t task_stats_elapsed = 0;
+static task_stats_entry_t task_stats_entries[TASK_STATS_MAX_TASKS];
+static size_t task_stats_entry_count = 0;
+
+TaskHandle_t task_table_create(task_id_t id, TaskFunction_t function, void *arg)
+{
+        if ((id >= TASK_ID_MAX) || (function == NULL))
+        {
+                LOG_ERROR("Invalid task, id=%d, function=0x%X", id, (uintptr_t)function);
+                return NULL;
+        }
+        if (task_table_handles[id] != NULL)
+        {
+                LOG_WARNING("Task %s already running", task_table[id].name);
+                return NULL;
+        }
+
+        const task_spec_t *spec = &task_table[id];
+        task_table_handles[id] = xTaskCreateStaticPinnedToCore(function, spec->name, spec->stack_size, arg, spec->priority,
+                                                               spec->stack, &task_table_tcbs[id], spec->core);
+        if (task_table_handles[id] == NULL)
+        {
+                LOG_ERROR("Create task %s failed", spec->name);
+                return NULL;
+        }
+        watermark_task_register(id, spec->name, spec->stack_size);
+        LOG_VERBOSE("Created %s, core: %d, priority: %d", spec->name, spec->core, spec->priority);
+        return task_table_handles[id];
+}
+
+void task_table_delete(task_id_t id)
+{
+        if ((id >= TASK_ID_MAX) || (task_table_handles[id] == NULL))
+                return;
+        vTaskDelete(task_table_handles[id]);
+        task_table_handles[id] = NULL;
+}
+
+TaskHandle_t task_table_get_handle(task_id_t id)
+{
+        return (id < TASK_ID_MAX) ? task_table_handles[id] : NULL;
+}
+
+/* Non-blocking send that keeps the queue's watermark, returns false when the queue is full */
+bool watermark_queue_send(watermark_queue_t id, QueueHandle_t queue, const void *item)
+{
+        if (xQueueSend(queue, item, 0) != pdTRUE)
+        {
+                watermark_queue_dropped(id);
+                return false;
+        }
+        watermark_queue_sent(id, uxQueueMessagesWaiting(queue), (uint32_t)esp_timer_get_time());
+        return true;
+}
+
+bool watermark_queue_receive(watermark_queue_t id, QueueHandle_t queue, void *item)
+{
+        if (xQueueReceive(queue, item, 0) != pdTRUE)
+                return false;
+        watermark_queue_received(id, (uint32_t)esp_timer_get_time());
+        return true;
+}
+
+static void watermark_publish(void)
+{
+        watermark_record_t record = {0};
+        for (size_t i = 0; i < WATERMARK_QUEUE_MAX; i++)
+        {
+                watermark_queue_stat_t stat;
+                watermark_queue_get(i, &stat);
+                record.queue[i] = (watermark_queue_record_t){
+                    .capacity = stat.capacity,
+                    .peak = stat.peak,
+                    .sent = stat.sent,
+                    .dropped = stat.dropped,
+                    .latency_avg_us = stat.latency_avg_us,
+                    .latency_max_us = stat.latency_max_us,
+                };
+        }
+        for (size_t id = 0; id < TASK_ID_MAX; id++)
+        {
+                if (task_table_handles[id] != NULL)
+                        watermark_task_update(id, uxTaskGetStackHighWaterMark(task_table_handles[id]));
+                watermark_task_stat_t stat;
+                if (watermark_task_get(id, &stat))
+                        record.stack_peak[id] = stat.stack_peak;
+        }
+        telemetry_send(TELEMETRY_RECORD_WATERMARK, &record, sizeof(record));
+}
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static uint16_t task_stats_load(const char *name, int8_t core)
+{
+        for (size_t i = 0; i < task_stats_entry_count; i++)
+        {
+                const task_stats_entry_t *entry = &task_stats_entries[i];
+                if ((strncmp(entry->name, name, strlen(name)) == 0) && ((core == TASK_STATS_NO_AFFINITY) || (entry->core == core)))
+                        return entry->cpu_permille;
+        }
+        return 0;
+}
+
+static void task_stats_sample(void)
+{
+        uint32_t total = 0;
+        size_t count = uxTaskGetSystemState(task_stats_status, TASK_STATS_MAX_TASKS, &total);
+
+        size_t previous = task_stats_current;
+        task_stats_current ^= 1;
+        task_stats_sample_t *samples = task_stats_samples[task_stats_current];
+        for (size_t i = 0; i < count; i++)
+        {
+                TaskStatus_t *status = &task_stats_status[i];
+                samples[i] = (task_stats_sample_t){
+                    .number = status->xTaskNumber,
+                    .runtime = status->ulRunTimeCounter,
+                    .stack_hwm = status->usStackHighWaterMark,
+                    .core = (status->xCoreID < portNUM_PROCESSORS) ? status->xCoreID : TASK_STATS_NO_AFFINITY,
+                    .priority = status->uxCurrentPriority,
+                };
+                strncpy(samples[i].name, status->pcTaskName, TASK_STATS_NAME_LEN - 1);
+        }
+        task_stats_sample_count[task_stats_current] = count;
+
+        task_stats_elapsed = total - task_stats_last_total;
+        task_stats_last_total = total;
+        task_stats_entry_count = task_stats_aggregate(task_stats_samples[previous], task_stats_sample_count[previous],
+                                                      samples, count, task_stats_elapsed, task_stats_entries);
+
+        task_stat_record_t record = {
+            .idle = {task_stats_load("IDLE", 0), task_stats_load("IDLE", 1)},
+            .wifi = task_stats_load("wifi", TASK_STATS_NO_AFFINITY),
+            .esp_timer = task_stats_load("esp_timer", TASK_STATS_NO_AFFINITY),
+        };
+        for (size_t id = 0; id < TASK_ID_MAX; id++)
+                record.task[id] = task_stats_load(task_table[id].name, TASK_STATS_NO_AFFINITY);
+        telemetry_send(TELEMETRY_RECORD_TASK_STAT, &record, sizeof(record));
+}
+#endif
+
+/* Reads the console without blocking, runs TASK_STATS_COMMAND, LINK_BENCH_COMMAND or LINK_THROUGHPUT_COMMAND when a full line matches */
+static void task_stats_poll_console(void)
+{
+        static char line[16];
+        static size_t len = 0;
+        int c;
+        while ((c = getchar()) != EOF)
+        {
+                if ((c != '\r') && (c != '\n'))
+                {
+                        if (len < sizeof(line) - 1)
+                                line[len++] = c;
+                        continue;
+                }
+                line[len] = '\0';
+                if (strcmp(line, TASK_STATS_COMMAND) == 0)
+                        task_table_show_stats();
+                else if (strcmp(line, LINK_BENCH_COMMAND) == 0)
+                        link_bench_request();
+                else if (strcmp(line, LINK_THROUGHPUT_COMMAND) == 0)
+                        link_throughput_request();
+                len = 0;
+        }
+        clearerr(stdin);
+}
+
+static void task_stats_task(void *pvParameter)
+{
+        fcntl(fileno(stdin), F_SETFL, O_NONBLOCK);
+        int64_t next_sample_us = esp_timer_get_time();
+        for (;;)
+        {
+                if (esp_timer_get_time() >= next_sample_us)
+                {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+                        task_stats_sample();
+#endif
+                        watermark_publish();
+                        next_sample_us += (int64_t)task_stats_period_ms * 1000;
+                }
+                task_stats_poll_console();
+                vTaskDelay(pdMS_TO_TICKS(TASK_STATS_CONSOLE_POLL_MS));
+        }
+}
+
+/*
+ * Samples run-time stats and watermarks every `period_ms`, they go out as
+ * TELEMETRY_RECORD_TASK_STAT and TELEMETRY_RECORD_WATERMARK records
+ * */
+esp_err_t task_table_stats_start(uint32_t period_ms)
+{
+#if !CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        LOG_WARNING("CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS is not set, watermarks only");
+#endif
+        task_stats_period_ms = period_ms;
+        return task_table_create(TASK_ID_STATS, task_stats_task, NULL) ? ESP_OK : ESP_FAIL;
+}
+
+/* Prints the latest sample, meant for the stats task itself */
+void task_table_show_stats(void)
+{
+        static char table[TASK_STATS_LINE_LEN * (TASK_STATS_MAX_TASKS + 1)];
+        task_stats_format(table, sizeof(table), task_stats_entries, task_stats_entry_count);
+        LOG_INFO("Task stats over %d ms, %d tasks\n%s", task_stats_elapsed / 1000, task_stats_entry_count, table);
+        watermark_format(table, sizeof(table));
+        LOG_INFO("Watermarks since boot\n%s", table);
+}
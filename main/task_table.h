@@ -0,0 +1,95 @@
+#pragma once
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/cdefs.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "logging.h"
+#include "mem_budget.h"
+#include "task_stats.h"
+#include "telemetry.h"
+#include "watermark.h"
+
+/*
+ * Every task of the application is created from `task_table` so core
+ * affinity and priority are decided in one place:
+ *
+ *   core 0: Wi-Fi (23) and esp_timer (22) from IDF, tx_task (5) which
+ *           sends every queued ESP-NOW frame in priority order, rssi_task
+ *           (4) which feeds on promiscuous frames and queues the heartbeats
+ *   core 1: the input to radio path, button_task and joystick_task (10)
+ *           sample inputs, app_task (9) turns them into ESP-NOW frames,
+ *           task_stats (1) only runs when everything else is idle
+ *
+ * Nothing on core 1 shares a core with the Wi-Fi task, so a burst of radio
+ * work cannot delay an input sample.
+ * */
+
+#define TASK_STATS_DEFAULT_PERIOD_MS (2 * 1000)
+#define TASK_STATS_COMMAND "tasks" // Typed on the console, prints the task and watermark tables
+
+typedef enum
+{
+        TASK_ID_BUTTON,
+        TASK_ID_JOYSTICK,
+        TASK_ID_RSSI,
+        TASK_ID_TX,
+        TASK_ID_APP,
+        TASK_ID_STATS,
+        TASK_ID_MAX,
+} task_id_t;
+
+typedef struct
+{
+        const char *name;
+        StackType_t *stack;  // Static, see mem_budget.h
+        uint32_t stack_size; // Unit: byte
+        UBaseType_t priority;
+        BaseType_t core; // tskNO_AFFINITY to let it migrate
+} task_spec_t;
+
+/* Payload of TELEMETRY_RECORD_TASK_STAT, CPU load per-mille of one core */
+typedef struct
+{
+        uint16_t idle[2];
+        uint16_t wifi;
+        uint16_t esp_timer;
+        uint16_t task[TASK_ID_MAX]; // task_id_t order
+} __packed task_stat_record_t;
+
+typedef struct
+{
+        uint16_t capacity;
+        uint16_t peak;
+        uint32_t sent;
+        uint32_t dropped;
+        uint32_t latency_avg_us;
+        uint32_t latency_max_us;
+} __packed watermark_queue_record_t;
+
+/* Payload of TELEMETRY_RECORD_WATERMARK, counters since boot */
+typedef struct
+{
+        watermark_queue_record_t queue[WATERMARK_QUEUE_MAX]; // watermark_queue_t order
+        uint16_t stack_peak[TASK_ID_MAX];                    // task_id_t order, unit: byte
+} __packed watermark_record_t;
+
+_Static_assert(TASK_ID_MAX <= WATERMARK_TASK_MAX, "Task table outgrew the watermark registry");
+
+TaskHandle_t task_table_create(task_id_t id, TaskFunction_t function, void *arg);
+void task_table_delete(task_id_t id);
+TaskHandle_t task_table_get_handle(task_id_t id);
+bool watermark_queue_send(watermark_queue_t id, QueueHandle_t queue, const void *item);
+bool watermark_queue_receive(watermark_queue_t id, QueueHandle_t queue, void *item);
+esp_err_t task_table_stats_start(uint32_t period_ms);
+void task_table_show_stats(void);
@@ -0,0 +1,24 @@
+
+#include "telemetry.h"
+
+static const char *TAG = "telemetry";
+
+esp_err_t telemetry_send(telemetry_record_type_t type, const void *data, size_t len)
+{
+        if ((type >= TELEMETRY_RECORD_MAX) || (len > TELEMETRY_MAX_PAYLOAD) || ((data == NULL) && (len != 0)))
+        {
+                LOG_WARNING("Invalid record, type=%d, len=%d", type, len);
+                return ESP_ERR_INVALID_ARG;
+        }
+
+        uint8_t encoded[TELEMETRY_ENCODED_FRAME_SIZE];
+        size_t encoded_len = telemetry_frame_encode(type, esp_log_timestamp(), data, len, encoded);
+
+        // Hold the stdout lock so a frame never lands in the middle of a log line
+        flockfile(stdout);
+        size_t written = fwrite(encoded, 1, encoded_len, stdout);
+        fflush(stdout);
+        funlockfile(stdout);
+
+        return (written == encoded_len) ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "logging.h"
+#include "telemetry_frame.h"
+
+/*
+ * Binary telemetry records are multiplexed with the text log on the console,
+ * framed as in telemetry_frame.h so the host can tell both streams apart.
+ * */
+
+typedef enum
+{
+        TELEMETRY_RECORD_MOTOR_STAT,
+        TELEMETRY_RECORD_TASK_STAT,
+        TELEMETRY_RECORD_WATERMARK,
+        TELEMETRY_RECORD_MOTOR_STAT_DELTA, // motor_stat_codec frame as received, decoded on the host
+        TELEMETRY_RECORD_LINK_BENCH,
+        TELEMETRY_RECORD_LINK_THROUGHPUT,
+        TELEMETRY_RECORD_MAX,
+} telemetry_record_type_t;
+
+static const char __attribute__((unused)) * TELEMETRY_RECORD_STRING[] = {
+    "TELEMETRY_RECORD_MOTOR_STAT",
+    "TELEMETRY_RECORD_TASK_STAT",
+    "TELEMETRY_RECORD_WATERMARK",
+    "TELEMETRY_RECORD_MOTOR_STAT_DELTA",
+    "TELEMETRY_RECORD_LINK_BENCH",
+    "TELEMETRY_RECORD_LINK_THROUGHPUT",
+    "TELEMETRY_RECORD_MAX"};
+
+esp_err_t telemetry_send(telemetry_record_type_t type, const void *data, size_t len);
@@ -0,0 +1,65 @@
+
+#include "telemetry_frame.h"
+
+#include <string.h>
+
+/* CRC-16/CCITT-FALSE, poly 0x1021, matches python's binascii.crc_hqx() */
+uint16_t telemetry_crc16(uint16_t crc, const uint8_t *data, size_t len)
+{
+        for (size_t i = 0; i < len; i++)
+        {
+                crc ^= (uint16_t)data[i] << 8;
+                for (uint8_t bit = 0; bit < 8; bit++)
+                        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+        return crc;
+}
+
+/* Consistent Overhead Byte Stuffing, the output never contains 0x00.
+ * `dst` must hold at least len + len / 254 + 1 bytes. */
+size_t telemetry_cobs_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+        size_t code_pos = 0;
+        size_t out = 1;
+        uint8_t code = 1;
+
+        for (size_t i = 0; i < len; i++)
+        {
+                if (src[i] != 0)
+                {
+                        dst[out++] = src[i];
+                        code++;
+                }
+                if ((src[i] == 0) || (code == 0xFF))
+                {
+                        dst[code_pos] = code;
+                        code_pos = out++;
+                        code = 1;
+                }
+        }
+        dst[code_pos] = code;
+        return out;
+}
+
+/* Whole frame with both delimiters into `dst` of TELEMETRY_ENCODED_FRAME_SIZE, returns its length, 0 when `len` is too long */
+size_t telemetry_frame_encode(uint8_t type, uint32_t time_ms, const void *data, size_t len, uint8_t *dst)
+{
+        if (len > TELEMETRY_MAX_PAYLOAD)
+                return 0;
+
+        uint8_t raw[TELEMETRY_RAW_FRAME_SIZE];
+        telemetry_header_t header = {.type = type, .len = len, .time_ms = time_ms};
+        memcpy(raw, &header, sizeof(header));
+        if (len)
+                memcpy(raw + sizeof(header), data, len);
+
+        size_t raw_len = sizeof(header) + len;
+        uint16_t crc = telemetry_crc16(UINT16_MAX, raw, raw_len);
+        raw[raw_len++] = crc & 0xFF;
+        raw[raw_len++] = crc >> 8;
+
+        dst[0] = TELEMETRY_FRAME_DELIMITER;
+        size_t encoded_len = 1 + telemetry_cobs_encode(raw, raw_len, dst + 1);
+        dst[encoded_len++] = TELEMETRY_FRAME_DELIMITER;
+        return encoded_len;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Framing of a telemetry record on the console: telemetry_header_t, the
+ * payload and a CRC-16/CCITT-FALSE over both (little endian), COBS encoded
+ * and wrapped in TELEMETRY_FRAME_DELIMITER bytes, which never appear in log
+ * text. telemetryDecoder.py undoes it.
+ *
+ * No IDF headers, runs on a host as is.
+ * */
+
+#define TELEMETRY_FRAME_DELIMITER (0x00)
+#define TELEMETRY_MAX_PAYLOAD (240)
+
+typedef struct
+{
+        uint8_t type;     // telemetry_record_type_t
+        uint8_t len;      // Length of payload, unit: byte.
+        uint32_t time_ms; // Same clock as the log timestamp
+} __attribute__((packed)) telemetry_header_t;
+
+#define TELEMETRY_RAW_FRAME_SIZE (sizeof(telemetry_header_t) + TELEMETRY_MAX_PAYLOAD + sizeof(uint16_t))
+#define TELEMETRY_ENCODED_FRAME_SIZE (TELEMETRY_RAW_FRAME_SIZE + (TELEMETRY_RAW_FRAME_SIZE / 254) + 1 + 2)
+
+uint16_t telemetry_crc16(uint16_t crc, const uint8_t *data, size_t len);
+size_t telemetry_cobs_encode(const uint8_t *src, size_t len, uint8_t *dst);
+size_t telemetry_frame_encode(uint8_t type, uint32_t time_ms, const void *data, size_t len, uint8_t *dst);
@@ -0,0 +1,163 @@
+
+#include "tof_scheduler.h"
+
+#define TOF_SCHEDULER_NEVER (INT64_MAX)
+
+/* No conflicts, every sensor on its own */
+tof_scheduler_config_t *tof_scheduler_default_config(tof_scheduler_config_t *config, uint8_t count)
+{
+        if (config == NULL)
+                return NULL;
+        *config = (tof_scheduler_config_t){
+            .count = (count > TOF_SCHEDULER_MAX) ? TOF_SCHEDULER_MAX : count,
+            .max_echo_us = 25 * 1000, // 4.3 m
+            .timeout_us = 60 * 1000,  // Past the 38 ms echo of an SR04 that sees nothing
+            .min_cooldown_us = 2 * 1000,
+            .cooldown_percent = 100,
+        };
+        return config;
+}
+
+void tof_scheduler_init(tof_scheduler_t *scheduler, const tof_scheduler_config_t *config)
+{
+        scheduler->config = *config;
+        if (scheduler->config.count > TOF_SCHEDULER_MAX)
+                scheduler->config.count = TOF_SCHEDULER_MAX;
+
+        const uint32_t all = (1UL << scheduler->config.count) - 1;
+        for (size_t i = 0; i < TOF_SCHEDULER_MAX; i++)
+                scheduler->slots[i] = (tof_scheduler_slot_t){.fired_us = INT64_MIN}; // Never fired, ahead of one that fired at 0
+        for (size_t i = 0; i < scheduler->config.count; i++)
+        {
+                // Hearing is not always mutual, but a ping either way spoils both readings
+                uint32_t conflicts = config->conflicts[i] & all & ~(1UL << i);
+                scheduler->slots[i].conflicts |= conflicts;
+                for (size_t j = 0; j < scheduler->config.count; j++)
+                {
+                        if (conflicts & (1UL << j))
+                                scheduler->slots[j].conflicts |= 1UL << i;
+                }
+        }
+}
+
+static bool tof_scheduler_idle(const tof_scheduler_slot_t *slot, int64_t now_us)
+{
+        return !slot->busy && (now_us >= slot->ready_us);
+}
+
+static void tof_scheduler_finish(tof_scheduler_t *scheduler, tof_scheduler_slot_t *slot, int64_t now_us, uint32_t echo_us)
+{
+        const tof_scheduler_config_t *config = &scheduler->config;
+        if (echo_us > config->max_echo_us)
+                echo_us = config->max_echo_us;
+        slot->busy = false;
+        slot->ready_us = now_us + config->min_cooldown_us + (uint64_t)echo_us * config->cooldown_percent / 100;
+}
+
+/*
+ * Returns the sensors to trigger now and marks them busy. Sensors past
+ * their timeout are set in `timed_out`, when not NULL, and cool down as
+ * after the longest echo.
+ * */
+uint32_t tof_scheduler_poll(tof_scheduler_t *scheduler, int64_t now_us, uint32_t *timed_out)
+{
+        const size_t count = scheduler->config.count;
+        uint32_t expired = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+                tof_scheduler_slot_t *slot = &scheduler->slots[i];
+                if (slot->busy && (now_us - slot->fired_us >= scheduler->config.timeout_us))
+                {
+                        slot->timeouts++;
+                        tof_scheduler_finish(scheduler, slot, now_us, scheduler->config.max_echo_us);
+                        expired |= 1UL << i;
+                }
+        }
+        if (timed_out != NULL)
+                *timed_out = expired;
+
+        // Cooled down sensors in the order they last fired, the longest waiting goes first. One
+        // still blocked by a busy neighbour holds its other neighbours back, or it could starve
+        uint32_t waiting = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+                if (tof_scheduler_idle(&scheduler->slots[i], now_us))
+                        waiting |= 1UL << i;
+        }
+
+        uint32_t fire = 0;
+        uint32_t held = 0;
+        while (waiting != 0)
+        {
+                size_t pick = count;
+                for (size_t i = 0; i < count; i++)
+                {
+                        if ((waiting & (1UL << i)) && ((pick == count) || (scheduler->slots[i].fired_us < scheduler->slots[pick].fired_us)))
+                                pick = i;
+                }
+                waiting &= ~(1UL << pick);
+                tof_scheduler_slot_t *slot = &scheduler->slots[pick];
+                if (held & (1UL << pick))
+                        continue;
+                held |= slot->conflicts;
+
+                bool clear = true;
+                for (size_t j = 0; clear && (j < count); j++)
+                {
+                        if (slot->conflicts & (1UL << j))
+                                clear = tof_scheduler_idle(&scheduler->slots[j], now_us);
+                }
+                if (!clear)
+                        continue;
+
+                if (slot->fires > 0)
+                {
+                        uint32_t interval = now_us - slot->fired_us;
+                        slot->interval_avg_us = (slot->fires == 1) ? interval : slot->interval_avg_us - slot->interval_avg_us / 4 + interval / 4;
+                }
+                slot->busy = true;
+                slot->fired_us = now_us;
+                slot->fires++;
+                fire |= 1UL << pick;
+        }
+        return fire;
+}
+
+/* Echo of sensor `index` measured at `now_us`, false when the sensor was not waiting for one */
+bool tof_scheduler_echo(tof_scheduler_t *scheduler, size_t index, int64_t now_us, uint32_t echo_us)
+{
+        if (index >= scheduler->config.count)
+                return false;
+        tof_scheduler_slot_t *slot = &scheduler->slots[index];
+        if (!slot->busy)
+                return false;
+        slot->echoes++;
+        tof_scheduler_finish(scheduler, slot, now_us, echo_us);
+        return true;
+}
+
+/*
+ * Earliest time after `now_us` the result of tof_scheduler_poll can change,
+ * TOF_SCHEDULER_NEVER if only an echo can change it. Sensors already cooled
+ * down but blocked wait on their conflicts, which are accounted for.
+ * */
+int64_t tof_scheduler_next_us(const tof_scheduler_t *scheduler, int64_t now_us)
+{
+        int64_t next = TOF_SCHEDULER_NEVER;
+        for (size_t i = 0; i < scheduler->config.count; i++)
+        {
+                const tof_scheduler_slot_t *slot = &scheduler->slots[i];
+                int64_t at = slot->busy ? slot->fired_us + scheduler->config.timeout_us : slot->ready_us;
+                if ((at > now_us) && (at < next))
+                        next = at;
+        }
+        return next;
+}
+
+/* Trigger rate of sensor `index`, unit: mHz */
+uint32_t tof_scheduler_rate_mhz(const tof_scheduler_t *scheduler, size_t index)
+{
+        if ((index >= scheduler->config.count) || (scheduler->slots[index].interval_avg_us == 0))
+                return 0;
+        return (uint32_t)(1000ULL * 1000 * 1000 / scheduler->slots[index].interval_avg_us);
+}
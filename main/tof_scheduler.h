@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Firing order of an ultrasonic sensor array. Sensors that can hear each
+ * other's pings are marked as conflicting, a sensor fires only once every
+ * sensor it conflicts with is idle and cooled down. Others fire in parallel.
+ * When several are due, the one waiting longest goes first, so conflicting
+ * sensors interleave fairly.
+ *
+ * After each echo a sensor cools down for `min_cooldown_us` plus
+ * `cooldown_percent` of the echo time: a near obstacle means short lived
+ * reflections and a fast cycle, a far or missing one a long cycle.
+ *
+ * Time is passed in by the caller, no IDF headers, runs on a host as is.
+ * */
+
+#define TOF_SCHEDULER_MAX (8)
+
+typedef struct
+{
+        uint8_t count;
+        uint32_t conflicts[TOF_SCHEDULER_MAX]; // Bit j of entry i when sensor i hears sensor j
+        uint32_t max_echo_us;                  // Echo time of the farthest valid range, caps the cooldown
+        uint32_t timeout_us;                   // From the trigger, no echo by then is a missing sensor
+        uint32_t min_cooldown_us;
+        uint16_t cooldown_percent;
+} tof_scheduler_config_t;
+
+typedef struct
+{
+        uint32_t conflicts; // Made symmetric at init
+        bool busy;          // Fired, echo not in yet
+        int64_t fired_us;
+        int64_t ready_us;         // End of the cooldown
+        uint32_t interval_avg_us; // Between consecutive triggers
+        uint32_t fires;
+        uint32_t echoes;
+        uint32_t timeouts;
+} tof_scheduler_slot_t;
+
+typedef struct
+{
+        tof_scheduler_config_t config;
+        tof_scheduler_slot_t slots[TOF_SCHEDULER_MAX];
+} tof_scheduler_t;
+
+tof_scheduler_config_t *tof_scheduler_default_config(tof_scheduler_config_t *config, uint8_t count);
+void tof_scheduler_init(tof_scheduler_t *scheduler, const tof_scheduler_config_t *config);
+uint32_t tof_scheduler_poll(tof_scheduler_t *scheduler, int64_t now_us, uint32_t *timed_out);
+bool tof_scheduler_echo(tof_scheduler_t *scheduler, size_t index, int64_t now_us, uint32_t echo_us);
+int64_t tof_scheduler_next_us(const tof_scheduler_t *scheduler, int64_t now_us);
+uint32_t tof_scheduler_rate_mhz(const tof_scheduler_t *scheduler, size_t index);
@@ -1,193 +1,305 @@
-
 #include "tof_sensor.h"
 
 static const char *TAG = "tof_sensor";
 
+#define TOF_SENSOR_WAKE_BIT (1UL << 31) // Scheduler deadline, bits 0 to TOF_SENSOR_MAX - 1 are echoes
+
 typedef struct
 {
-    gpio_num_t trig_pin;
-    gpio_num_t echo_pin;
-
-    tof_sensor_state_t state;
-    int64_t trig_high_time;
-    int64_t trig_low_time;
-    int64_t echo_high_time;
-    int64_t echo_low_time;
-    int64_t duration;
+    tof_sensor_config_t config;
+    volatile uint32_t echo_rise;  // Capture counter at the rising edge
+    volatile uint32_t echo_ticks; // Width of the latest pulse
+    volatile bool echo_high;
+
+    mcpwm_cap_channel_handle_t capture_channel;
+    mcpwm_timer_handle_t trig_timer;
+    mcpwm_oper_handle_t trig_operator;
+    mcpwm_cmpr_handle_t trig_comparator;
+    mcpwm_gen_handle_t trig_generator;
+
+    range_filter_t filter;
 } tof_sensor_data_t;
 
-tof_sensor_data_t tof_sensor_data = {0};
-QueueHandle_t tof_sensor_queue = NULL;
-TaskHandle_t tof_sensor_task_handle = NULL;
+static tof_sensor_data_t tof_sensor_data[TOF_SENSOR_MAX];
+static size_t tof_sensor_count = 0;
+static int8_t tof_sensor_temperature_c = 20;
+static mcpwm_cap_timer_handle_t tof_capture_timers[SOC_MCPWM_GROUPS];
+static uint32_t tof_capture_hz = 0;
+static tof_scheduler_t tof_scheduler;
+static esp_timer_handle_t tof_wake_timer = NULL;
+static QueueHandle_t tof_sensor_queue = NULL;
+static TaskHandle_t tof_sensor_task_handle = NULL;
+static uint8_t tof_sensor_queue_storage[TOF_SENSOR_QUEUE_DEPTH * sizeof(tof_sensor_event_t)];
+static StaticQueue_t tof_sensor_queue_buffer;
+static StackType_t tof_sensor_task_stack[3072];
+static StaticTask_t tof_sensor_task_tcb;
+_Static_assert(sizeof(tof_sensor_data) + sizeof(tof_scheduler) + sizeof(tof_sensor_queue_storage) + sizeof(tof_sensor_queue_buffer) +
+                       sizeof(tof_sensor_task_stack) + sizeof(tof_sensor_task_tcb) <=
+                   MEM_BUDGET_TOF_SENSOR_BYTES,
+               "ToF sensors over budget");
+_Static_assert(TOF_SENSOR_MAX <= TOF_SCHEDULER_MAX, "Scheduler too small for the array");
 
-void set_trig(void)
+tof_sensor_config_t *tof_sensor_default_config(tof_sensor_config_t *config, gpio_num_t trig, gpio_num_t echo)
 {
-    gpio_set_level(tof_sensor_data.trig_pin, 1);
+    if (config == NULL)
+    {
+        LOG_ERROR("NULL pointer, config=0x%X", (uintptr_t)config);
+        return NULL;
+    }
+    config->trig_pin = trig;
+    config->echo_pin = echo;
+    config->conflicts = 0;
+    range_filter_default_config(&config->filter);
+    return config;
 }
 
-void clear_trig(void)
+/* No sensors yet, add them with tof_sensor_default_config */
+tof_array_config_t *tof_array_default_config(tof_array_config_t *array)
 {
-    gpio_set_level(tof_sensor_data.trig_pin, 0);
+    if (array == NULL)
+    {
+        LOG_ERROR("NULL pointer, array=0x%X", (uintptr_t)array);
+        return NULL;
+    }
+    tof_scheduler_config_t scheduler_config;
+    tof_scheduler_default_config(&scheduler_config, 0);
+    memset(array, 0, sizeof(tof_array_config_t));
+    array->temperature_c = 20;
+    array->min_cooldown_us = scheduler_config.min_cooldown_us;
+    array->cooldown_percent = scheduler_config.cooldown_percent;
+    return array;
 }
 
-bool read_echo(void)
+/* Both echo edges, the pulse width goes to the task and its bit is set in the notification */
+static bool IRAM_ATTR tof_sensor_capture_cb(mcpwm_cap_channel_handle_t channel, const mcpwm_capture_event_data_t *edata, void *arg)
 {
-    return gpio_get_level(tof_sensor_data.echo_pin);
+    size_t index = (uintptr_t)arg;
+    tof_sensor_data_t *sensor = &tof_sensor_data[index];
+    if (edata->cap_edge == MCPWM_CAP_EDGE_POS)
+    {
+        sensor->echo_rise = edata->cap_value;
+        sensor->echo_high = true;
+        return false;
+    }
+    if (!sensor->echo_high)
+        return false; // Falling edge of a pulse that started before the capture did
+    sensor->echo_high = false;
+    sensor->echo_ticks = edata->cap_value - sensor->echo_rise; // Wraps cleanly, the counter is 32 bit
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xTaskNotifyFromISR(tof_sensor_task_handle, 1UL << index, eSetBits, &higher_priority_task_woken);
+    return higher_priority_task_woken == pdTRUE;
 }
 
-static void IRAM_ATTR echo_pin_event(void *arg)
+static void tof_wake_timer_cb(void *arg)
 {
-    bool state = read_echo();
-    if (state)
-        tof_sensor_data.echo_high_time = esp_timer_get_time();
-    else
-    {
-        tof_sensor_data.echo_low_time = esp_timer_get_time();
-        tof_sensor_data.duration = tof_sensor_data.echo_low_time - tof_sensor_data.echo_high_time;
-    }
-    // ets_printf("ISR event %d\r\n", state);
+    xTaskNotify(tof_sensor_task_handle, TOF_SENSOR_WAKE_BIT, eSetBits);
 }
 
-static void tof_sensor_send_event(tof_sensor_data_t tof_sensor_data, tof_sensor_state_t state)
+/* Newest reading wins, the oldest queued one makes room */
+static void tof_sensor_send_event(size_t index, uint32_t echo_ns, uint32_t raw_mm, tof_sensor_state_t state)
 {
+    range_filter_result_t result;
+    range_filter_push(&tof_sensor_data[index].filter, raw_mm, state == TOF_OK, &result);
+    if ((state == TOF_OK) && result.outlier)
+        state = TOF_OUTLIER;
+
     tof_sensor_event_t event = {
-        .echo_pin = tof_sensor_data.echo_pin,
-        .trig_pin = tof_sensor_data.trig_pin,
+        .echo_ns = echo_ns,
+        .raw_mm = raw_mm,
+        .distance_mm = result.distance_mm,
+        .rate_mhz = tof_scheduler_rate_mhz(&tof_scheduler, index),
+        .confidence = result.confidence,
+        .sensor = index,
         .state = state,
-        .duration_us = tof_sensor_data.duration,
     };
-    xQueueOverwrite(tof_sensor_queue, &event);
+    if (xQueueSend(tof_sensor_queue, &event, 0) != pdTRUE)
+    {
+        tof_sensor_event_t oldest;
+        xQueueReceive(tof_sensor_queue, &oldest, 0);
+        xQueueSend(tof_sensor_queue, &event, 0);
+    }
 }
 
+static void tof_sensor_handle_echo(size_t index, int64_t now_us)
+{
+    uint32_t echo_ns = (uint64_t)tof_sensor_data[index].echo_ticks * 1000 * 1000 * 1000 / tof_capture_hz;
+    if (!tof_scheduler_echo(&tof_scheduler, index, now_us, echo_ns / 1000))
+        return; // Late echo of a ping already given up on
+
+    uint32_t raw_mm = range_filter_echo_to_mm(echo_ns, tof_sensor_temperature_c);
+    if (echo_ns < SR04_BAD_MEASUREMENT_TIME_US * 1000)
+        tof_sensor_send_event(index, echo_ns, raw_mm, TOF_BAD_MEASUREMENT);
+    else if (echo_ns > SR04_OUT_OF_RANGE_TIME_US * 1000)
+        tof_sensor_send_event(index, echo_ns, raw_mm, TOF_OUT_OF_RANGE);
+    else
+        tof_sensor_send_event(index, echo_ns, raw_mm, TOF_OK);
+}
+
+/* Fires what the scheduler allows, then sleeps until an echo or the next scheduler deadline */
 static void tof_sensor_task(void *pvParameter)
 {
+    uint32_t notified = 0;
     while (true)
     {
-        uint8_t loop = 10;
-        while (0 < loop--)
+        int64_t now = esp_timer_get_time();
+        for (size_t i = 0; i < tof_sensor_count; i++)
         {
-            switch (tof_sensor_data.state)
+            if (notified & (1UL << i))
+                tof_sensor_handle_echo(i, now);
+        }
+
+        uint32_t timed_out;
+        uint32_t fire = tof_scheduler_poll(&tof_scheduler, now, &timed_out);
+        for (size_t i = 0; i < tof_sensor_count; i++)
+        {
+            if (timed_out & (1UL << i))
+                tof_sensor_send_event(i, 0, 0, TOF_DEVICE_TIMEOUT);
+            if (fire & (1UL << i))
             {
-            case TOF_INIT:
-                ESP_LOGV(TAG, "TOF_INIT");
-                tof_sensor_data.state = TOF_TRIG_HIGH;
-                break;
-            case TOF_TRIG_HIGH:
-                ESP_LOGV(TAG, "TOF_TRIG_HIGH");
-                set_trig();
-                tof_sensor_data.state = TOF_TRIG_HOLD;
-                tof_sensor_data.trig_high_time = esp_timer_get_time();
-                break;
-            case TOF_TRIG_HOLD:
-                ESP_LOGV(TAG, "TOF_TRIG_HOLD");
-                if ((esp_timer_get_time() - tof_sensor_data.trig_high_time) > SR04_ECHO_HIGH_TIME_US)
-                    tof_sensor_data.state = TOF_TRIG_LOW;
-                else
-                    loop = 0;
-                break;
-            case TOF_TRIG_LOW:
-                ESP_LOGV(TAG, "TOF_TRIG_LOW");
-                clear_trig();
-                tof_sensor_data.state = TOF_WAIT_HIGH;
-                tof_sensor_data.trig_low_time = esp_timer_get_time();
-                break;
-            case TOF_WAIT_HIGH:
-                ESP_LOGV(TAG, "TOF_WAIT_HIGH");
-                if (tof_sensor_data.echo_high_time >= tof_sensor_data.trig_high_time)
-                    tof_sensor_data.state = TOF_WAIT_LOW;
-                else if ((esp_timer_get_time() - tof_sensor_data.trig_high_time) > SR04_TIMEOUT_TIME_US)
-                    tof_sensor_data.state = TOF_DEVICE_TIMEOUT;
-                else
-                    loop = 0;
-                break;
-            case TOF_WAIT_LOW:
-                ESP_LOGV(TAG, "TOF_WAIT_LOW");
-                if (tof_sensor_data.echo_low_time >= tof_sensor_data.echo_high_time)
-                    if (tof_sensor_data.duration < SR04_BAD_MEASUREMENT_TIME_US)
-                        tof_sensor_data.state = TOF_BAD_MEASUREMENT;
-                    else if (tof_sensor_data.duration > SR04_OUT_OF_RANGE_TIME_US)
-                        tof_sensor_data.state = TOF_OUT_OF_RANGE;
-                    else
-                    {
-                        tof_sensor_send_event(tof_sensor_data, TOF_OK);
-                        tof_sensor_data.state = TOF_COOLDOWN;
-                    }
-                else
-                    loop = 0;
-                break;
-            case TOF_COOLDOWN:
-                ESP_LOGV(TAG, "TOF_COOLDOWN");
-                if ((tof_sensor_data.echo_low_time + tof_sensor_data.duration * 2) <= esp_timer_get_time())
-                    tof_sensor_data.state = TOF_TRIG_HIGH;
-                else
-                    loop = 0;
-                break;
-            case TOF_OUT_OF_RANGE:
-                tof_sensor_send_event(tof_sensor_data, TOF_OUT_OF_RANGE);
-                // ESP_LOGI(TAG, "TOF_OUT_OF_RANGE");
-                tof_sensor_data.state = TOF_INIT;
-                break;
-            case TOF_DEVICE_TIMEOUT:
-                tof_sensor_send_event(tof_sensor_data, TOF_DEVICE_TIMEOUT);
-                // ESP_LOGI(TAG, "TOF_DEVICE_TIMEOUT");
-                tof_sensor_data.state = TOF_INIT;
-                break;
-            case TOF_BAD_MEASUREMENT:
-                tof_sensor_send_event(tof_sensor_data, TOF_BAD_MEASUREMENT);
-                // ESP_LOGI(TAG, "TOF_BAD_MEASUREMENT");
-                tof_sensor_data.state = TOF_INIT;
-                break;
-            default:
-                // tof_sensor_send_event(tof_sensor_data);
-                ESP_LOGE(TAG, "(%d, %d) ERROR", tof_sensor_data.trig_pin, tof_sensor_data.echo_pin);
-                vTaskDelete(NULL);
-                break;
+                tof_sensor_data[i].echo_high = false;
+                ESP_ERROR_CHECK_WITHOUT_ABORT(mcpwm_timer_start_stop(tof_sensor_data[i].trig_timer, MCPWM_TIMER_START_STOP_FULL));
             }
         }
-        vTaskDelay(1);
+
+        int64_t next = tof_scheduler_next_us(&tof_scheduler, now);
+        esp_timer_stop(tof_wake_timer);
+        if (next != INT64_MAX)
+            esp_timer_start_once(tof_wake_timer, next - now);
+        xTaskNotifyWait(0, UINT32_MAX, &notified, portMAX_DELAY);
     }
 }
 
-QueueHandle_t tof_sensor_init(gpio_num_t trig, gpio_num_t echo)
+static void tof_sensor_capture_init(size_t index)
+{
+    tof_sensor_data_t *sensor = &tof_sensor_data[index];
+    const int group = index / TOF_SENSOR_PER_GROUP;
+    if (tof_capture_timers[group] == NULL)
+    {
+        const mcpwm_capture_timer_config_t timer_config = {
+            .group_id = group,
+            .clk_src = MCPWM_CAPTURE_CLK_SRC_DEFAULT, // APB, 80 MHz
+        };
+        ESP_ERROR_CHECK(mcpwm_new_capture_timer(&timer_config, &tof_capture_timers[group]));
+        ESP_ERROR_CHECK(mcpwm_capture_timer_get_resolution(tof_capture_timers[group], &tof_capture_hz));
+    }
+
+    const mcpwm_capture_channel_config_t channel_config = {
+        .gpio_num = sensor->config.echo_pin,
+        .prescale = 1,
+        .flags.pos_edge = true,
+        .flags.neg_edge = true,
+    };
+    ESP_ERROR_CHECK(mcpwm_new_capture_channel(tof_capture_timers[group], &channel_config, &sensor->capture_channel));
+
+    const mcpwm_capture_event_callbacks_t callbacks = {
+        .on_cap = tof_sensor_capture_cb,
+    };
+    ESP_ERROR_CHECK(mcpwm_capture_channel_register_event_callbacks(sensor->capture_channel, &callbacks, (void *)(uintptr_t)index));
+    ESP_ERROR_CHECK(mcpwm_capture_channel_enable(sensor->capture_channel));
+}
+
+/* One period per start: high at the start, low SR04_TRIG_PULSE_US later, then the timer stops */
+static void tof_sensor_trigger_init(size_t index)
 {
-    tof_sensor_data.trig_pin = trig;
-    tof_sensor_data.echo_pin = echo;
-    tof_sensor_data.state = TOF_INIT;
-    tof_sensor_data.trig_high_time = 0;
-
-    // Configure the pins
-    ESP_ERROR_CHECK(gpio_install_isr_service(0));
-    ESP_ERROR_CHECK(gpio_isr_handler_add(echo, echo_pin_event, NULL));
-
-    gpio_config_t echo_io_conf = {
-        .pin_bit_mask = 1 << echo,
-        .mode = GPIO_MODE_INPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_ANYEDGE,
+    tof_sensor_data_t *sensor = &tof_sensor_data[index];
+    const int group = index / TOF_SENSOR_PER_GROUP;
+    const mcpwm_timer_config_t timer_config = {
+        .group_id = group,
+        .clk_src = MCPWM_TIMER_CLK_SRC_DEFAULT,
+        .resolution_hz = 1000 * 1000,
+        .count_mode = MCPWM_TIMER_COUNT_MODE_UP,
+        .period_ticks = 2 * SR04_TRIG_PULSE_US,
     };
-    ESP_ERROR_CHECK(gpio_config(&echo_io_conf));
-
-    gpio_config_t trig_io_conf = {
-        .pin_bit_mask = 1 << trig,
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE,
+    ESP_ERROR_CHECK(mcpwm_new_timer(&timer_config, &sensor->trig_timer));
+
+    const mcpwm_operator_config_t operator_config = {
+        .group_id = group,
+    };
+    ESP_ERROR_CHECK(mcpwm_new_operator(&operator_config, &sensor->trig_operator));
+    ESP_ERROR_CHECK(mcpwm_operator_connect_timer(sensor->trig_operator, sensor->trig_timer));
+
+    const mcpwm_comparator_config_t comparator_config = {
+        .flags.update_cmp_on_tez = true,
+    };
+    ESP_ERROR_CHECK(mcpwm_new_comparator(sensor->trig_operator, &comparator_config, &sensor->trig_comparator));
+    ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(sensor->trig_comparator, SR04_TRIG_PULSE_US));
+
+    const mcpwm_generator_config_t generator_config = {
+        .gen_gpio_num = sensor->config.trig_pin,
     };
-    ESP_ERROR_CHECK(gpio_config(&trig_io_conf));
+    ESP_ERROR_CHECK(mcpwm_new_generator(sensor->trig_operator, &generator_config, &sensor->trig_generator));
+    ESP_ERROR_CHECK(mcpwm_generator_set_action_on_timer_event(sensor->trig_generator,
+                                                              MCPWM_GEN_TIMER_EVENT_ACTION(MCPWM_TIMER_DIRECTION_UP, MCPWM_TIMER_EVENT_EMPTY, MCPWM_GEN_ACTION_HIGH)));
+    ESP_ERROR_CHECK(mcpwm_generator_set_action_on_compare_event(sensor->trig_generator,
+                                                                MCPWM_GEN_COMPARE_EVENT_ACTION(MCPWM_TIMER_DIRECTION_UP, sensor->trig_comparator, MCPWM_GEN_ACTION_LOW)));
+    ESP_ERROR_CHECK(mcpwm_timer_enable(sensor->trig_timer));
+}
 
-    tof_sensor_queue = xQueueCreate(1, sizeof(tof_sensor_event_t)); // TODO: statically allow memory
+QueueHandle_t tof_sensor_init(const tof_array_config_t *array)
+{
+    if (array == NULL)
+    {
+        LOG_ERROR("NULL pointer, array=0x%X", (uintptr_t)array);
+        return NULL;
+    }
+    if ((tof_sensor_queue != NULL) || (tof_sensor_task_handle != NULL))
+    {
+        LOG_WARNING("Already initialized, queue=0x%X, task=0x%X", (uintptr_t)tof_sensor_queue, (uintptr_t)tof_sensor_task_handle);
+        return NULL;
+    }
+    if ((array->count == 0) || (array->count > TOF_SENSOR_MAX))
+    {
+        LOG_ERROR("Invalid sensor count %d, max %d", array->count, TOF_SENSOR_MAX);
+        return NULL;
+    }
+
+    tof_scheduler_config_t scheduler_config;
+    tof_scheduler_default_config(&scheduler_config, array->count);
+    scheduler_config.min_cooldown_us = array->min_cooldown_us;
+    scheduler_config.cooldown_percent = array->cooldown_percent;
+    for (size_t i = 0; i < array->count; i++)
+    {
+        tof_sensor_data[i].config = array->sensors[i];
+        range_filter_init(&tof_sensor_data[i].filter, &array->sensors[i].filter);
+        scheduler_config.conflicts[i] = array->sensors[i].conflicts;
+    }
+    tof_scheduler_init(&tof_scheduler, &scheduler_config);
+    tof_sensor_count = array->count;
+    tof_sensor_temperature_c = array->temperature_c;
+
+    tof_sensor_queue = xQueueCreateStatic(TOF_SENSOR_QUEUE_DEPTH, sizeof(tof_sensor_event_t), tof_sensor_queue_storage, &tof_sensor_queue_buffer);
     if (tof_sensor_queue == NULL)
     {
-        ESP_LOGE(TAG, "NO MEMORY");
+        LOG_ERROR("Create queue failed");
         tof_sensor_deinit();
         return NULL;
     }
 
-    // Spawn a task to monitor the ultrasound sensor
-    xTaskCreate(tof_sensor_task, "tof_sensor_task", 4096, NULL, 10, &tof_sensor_task_handle);
+    const esp_timer_create_args_t timer_args = {
+        .callback = tof_wake_timer_cb,
+        .name = "tof_wake",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &tof_wake_timer));
+
+    for (size_t i = 0; i < tof_sensor_count; i++)
+    {
+        tof_sensor_capture_init(i);
+        tof_sensor_trigger_init(i);
+        LOG_INFO("Sensor %d: trig GPIO[%d], echo GPIO[%d], conflicts 0x%X", i, array->sensors[i].trig_pin,
+                 array->sensors[i].echo_pin, tof_scheduler.slots[i].conflicts);
+    }
 
+    // The task fires the first pings, after the capture ISRs have someone to notify
+    tof_sensor_task_handle = xTaskCreateStatic(tof_sensor_task, "tof_sensor_task", sizeof(tof_sensor_task_stack), NULL, 10,
+                                               tof_sensor_task_stack, &tof_sensor_task_tcb);
+    for (size_t group = 0; group < SOC_MCPWM_GROUPS; group++)
+    {
+        if (tof_capture_timers[group] == NULL)
+            continue;
+        ESP_ERROR_CHECK(mcpwm_capture_timer_enable(tof_capture_timers[group]));
+        ESP_ERROR_CHECK(mcpwm_capture_timer_start(tof_capture_timers[group]));
+    }
     return tof_sensor_queue;
 }
 
@@ -198,12 +310,45 @@ void tof_sensor_deinit(void)
         vTaskDelete(tof_sensor_task_handle);
         tof_sensor_task_handle = NULL;
     }
+    if (tof_wake_timer != NULL)
+    {
+        esp_timer_stop(tof_wake_timer);
+        esp_timer_delete(tof_wake_timer);
+        tof_wake_timer = NULL;
+    }
+    for (size_t i = 0; i < tof_sensor_count; i++)
+    {
+        tof_sensor_data_t *sensor = &tof_sensor_data[i];
+        if (sensor->trig_timer != NULL)
+        {
+            mcpwm_timer_disable(sensor->trig_timer);
+            mcpwm_del_generator(sensor->trig_generator);
+            mcpwm_del_comparator(sensor->trig_comparator);
+            mcpwm_del_operator(sensor->trig_operator);
+            mcpwm_del_timer(sensor->trig_timer);
+        }
+        if (sensor->capture_channel != NULL)
+        {
+            mcpwm_capture_channel_disable(sensor->capture_channel);
+            mcpwm_del_capture_channel(sensor->capture_channel);
+        }
+        gpio_reset_pin(sensor->config.trig_pin);
+        gpio_reset_pin(sensor->config.echo_pin);
+    }
+    for (size_t group = 0; group < SOC_MCPWM_GROUPS; group++)
+    {
+        if (tof_capture_timers[group] == NULL)
+            continue;
+        mcpwm_capture_timer_stop(tof_capture_timers[group]);
+        mcpwm_capture_timer_disable(tof_capture_timers[group]);
+        mcpwm_del_capture_timer(tof_capture_timers[group]);
+        tof_capture_timers[group] = NULL;
+    }
     if (tof_sensor_queue != NULL)
     {
         vQueueDelete(tof_sensor_queue);
         tof_sensor_queue = NULL;
     }
-    gpio_reset_pin(tof_sensor_data.trig_pin);
-    gpio_reset_pin(tof_sensor_data.echo_pin);
-    memset(&tof_sensor_data, 0, sizeof(tof_sensor_data_t));
-}
\ No newline at end of file
+    memset(tof_sensor_data, 0, sizeof(tof_sensor_data));
+    tof_sensor_count = 0;
+}
@@ -8,53 +8,84 @@
 #include "freertos/task.h"
 
 #include "driver/gpio.h"
-#include "rom/ets_sys.h"
+#include "driver/mcpwm_prelude.h"
+#include "soc/soc_caps.h"
 
 #include "esp_log.h"
 #include "esp_timer.h"
 
-#define SR04_TIMEOUT_TIME_US (1000 * 1000)
-#define SR04_BAD_MEASUREMENT_TIME_US (200)
-#define SR04_OUT_OF_RANGE_TIME_US (40 * 1000)
-#define SR04_ECHO_HIGH_TIME_US (10)
+#include "logging.h"
+#include "mem_budget.h"
+#include "range_filter.h"
+#include "tof_scheduler.h"
+
+/*
+ * Up to TOF_SENSOR_MAX HC-SR04 on MCPWM, sensor i on group i / 3, timer,
+ * operator and capture channel i % 3. Each trigger is a one-shot 10 us pulse
+ * from a PWM generator, each capture channel timestamps both echo edges on
+ * the APB clock (12.5 ns).
+ *
+ * A tof_scheduler decides who fires: sensors that hear each other never
+ * ping at the same time, the others run in parallel, and every cooldown
+ * follows the echo just measured. The task sleeps until an echo is in or
+ * the scheduler's next deadline, then publishes every reading, filtered,
+ * on one queue tagged with the sensor and its current rate.
+ * */
+
+#define TOF_SENSOR_MAX (6)
+#define TOF_SENSOR_PER_GROUP (3)
+#define TOF_SENSOR_QUEUE_DEPTH (8)
+#define SR04_TRIG_PULSE_US (10)
+#define SR04_BAD_MEASUREMENT_TIME_US (100)    // Below the 2 cm minimum range
+#define SR04_OUT_OF_RANGE_TIME_US (25 * 1000) // Beyond 4 m, or no obstacle
 
 typedef enum
 {
-    TOF_INIT,
-    TOF_TRIG_HIGH,
-    TOF_TRIG_HOLD,
-    TOF_TRIG_LOW,
-    TOF_WAIT_HIGH,
-    TOF_WAIT_LOW,
-    TOF_COOLDOWN,
-    TOF_DEVICE_TIMEOUT,
     TOF_OK,
+    TOF_OUTLIER, // Reported distance is the median, the reading itself was rejected
     TOF_OUT_OF_RANGE,
     TOF_BAD_MEASUREMENT,
+    TOF_DEVICE_TIMEOUT,
     TOF_ERROR,
 } tof_sensor_state_t;
 
 static const char __attribute__((unused)) * TOF_SENSOR_STATE_STRING[] = {
-    "TOF_INIT",
-    "TOF_TRIG_HIGH",
-    "TOF_TRIG_HOLD",
-    "TOF_TRIG_LOW",
-    "TOF_WAIT_HIGH",
-    "TOF_WAIT_LOW",
-    "TOF_COOLDOWN",
-    "TOF_DEVICE_TIMEOUT",
     "TOF_OK",
+    "TOF_OUTLIER",
     "TOF_OUT_OF_RANGE",
     "TOF_BAD_MEASUREMENT",
+    "TOF_DEVICE_TIMEOUT",
     "TOF_ERROR"};
 
 typedef struct
 {
-    uint64_t duration_us;
     gpio_num_t trig_pin;
     gpio_num_t echo_pin;
+    uint32_t conflicts; // Bit j when this sensor can hear the pings of sensor j
+    range_filter_config_t filter;
+} tof_sensor_config_t;
+
+typedef struct
+{
+    tof_sensor_config_t sensors[TOF_SENSOR_MAX];
+    uint8_t count;
+    int8_t temperature_c;
+    uint32_t min_cooldown_us;
+    uint16_t cooldown_percent; // Of the last echo time, added to the cooldown
+} tof_array_config_t;
+
+typedef struct
+{
+    uint32_t echo_ns;     // Latest echo pulse, 0 when none came back
+    uint32_t raw_mm;      // Latest reading
+    uint32_t distance_mm; // Filtered
+    uint32_t rate_mhz;    // Readings per second of this sensor, unit: mHz
+    uint8_t confidence;   // Percent
+    uint8_t sensor;
     tof_sensor_state_t state;
 } tof_sensor_event_t;
 
-QueueHandle_t tof_sensor_init(gpio_num_t trig, gpio_num_t echo);
-void tof_sensor_deinit(void);
\ No newline at end of file
+tof_sensor_config_t *tof_sensor_default_config(tof_sensor_config_t *config, gpio_num_t trig, gpio_num_t echo);
+tof_array_config_t *tof_array_default_config(tof_array_config_t *array);
+QueueHandle_t tof_sensor_init(const tof_array_config_t *array);
+void tof_sensor_deinit(void);
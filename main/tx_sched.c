@@ -0,0 +1,274 @@
+
+#include "tx_sched.h"
+
+#include <string.h>
+
+#define TX_SCHED_TOKEN (1000)      // One frame
+#define TX_SCHED_LATENCY_SHIFT (3) // Average over about 8 frames
+
+/* Control first at up to 250 frames/s, debug text last at a trickle */
+tx_sched_config_t *tx_sched_default_config(tx_sched_config_t *config)
+{
+        if (config == NULL)
+                return NULL;
+        *config = (tx_sched_config_t){
+            .classes = {
+                [TX_SCHED_CLASS_CONTROL] = {.depth = 8, .rate_hz = 250, .burst = 8, .drop_oldest = true},
+                [TX_SCHED_CLASS_HANDSHAKE] = {.depth = 4, .rate_hz = 50, .burst = 4},
+                [TX_SCHED_CLASS_ACK] = {.depth = 8, .rate_hz = 200, .burst = 8},
+                [TX_SCHED_CLASS_TELEMETRY] = {.depth = 4, .rate_hz = 50, .burst = 4, .max_age_us = 250 * 1000, .drop_oldest = true},
+                [TX_SCHED_CLASS_TEXT] = {.depth = 4, .rate_hz = 10, .burst = 2},
+            },
+        };
+        return config;
+}
+
+bool tx_sched_init(tx_sched_t *sched, const tx_sched_config_t *config, int64_t now_us)
+{
+        if ((sched == NULL) || (config == NULL))
+                return false;
+        for (size_t i = 0; i < TX_SCHED_CLASS_MAX; i++)
+                if ((config->classes[i].depth == 0) || (config->classes[i].depth > TX_SCHED_DEPTH_MAX) || (config->classes[i].burst == 0))
+                        return false;
+
+        memset(sched, 0, sizeof(tx_sched_t));
+        sched->config = *config;
+        for (size_t i = 0; i < TX_SCHED_CLASS_MAX; i++)
+        {
+                sched->queues[i].tokens = config->classes[i].burst * TX_SCHED_TOKEN;
+                sched->queues[i].refill_us = now_us;
+        }
+        return true;
+}
+
+static tx_sched_frame_t *tx_sched_at(tx_sched_t *sched, tx_sched_class_t tx_class, size_t index)
+{
+        tx_sched_queue_t *queue = &sched->queues[tx_class];
+        return &queue->frames[(queue->head + index) % sched->config.classes[tx_class].depth];
+}
+
+static void tx_sched_drop_head(tx_sched_t *sched, tx_sched_class_t tx_class)
+{
+        tx_sched_queue_t *queue = &sched->queues[tx_class];
+        queue->head = (queue->head + 1) % sched->config.classes[tx_class].depth;
+        queue->count--;
+}
+
+static bool tx_sched_is_blocked(const tx_sched_blocked_t *blocked, const uint8_t *dest)
+{
+        for (size_t i = 0; (blocked != NULL) && (i < blocked->count); i++)
+                if (memcmp(blocked->dest[i], dest, TX_SCHED_ADDR_LEN) == 0)
+                        return true;
+        return false;
+}
+
+/* Index of the first frame of the class to a destination not blocked, the count when there is none */
+static size_t tx_sched_first_ready(const tx_sched_t *sched, tx_sched_class_t tx_class, const tx_sched_blocked_t *blocked)
+{
+        const tx_sched_queue_t *queue = &sched->queues[tx_class];
+        size_t index = 0;
+        while ((index < queue->count) && tx_sched_is_blocked(blocked, queue->frames[(queue->head + index) % sched->config.classes[tx_class].depth].dest))
+                index++;
+        return index;
+}
+
+/* The queued frame `frame` would replace, NULL when it does not ask to or none matches */
+static tx_sched_frame_t *tx_sched_find_older(tx_sched_t *sched, tx_sched_class_t tx_class, const tx_sched_frame_t *frame)
+{
+        if (!(frame->flags & TX_SCHED_FLAG_LATEST))
+                return NULL;
+        for (size_t i = 0; i < sched->queues[tx_class].count; i++)
+        {
+                tx_sched_frame_t *queued = tx_sched_at(sched, tx_class, i);
+                if ((queued->type == frame->type) && (queued->broadcast == frame->broadcast) &&
+                    (memcmp(queued->dest, frame->dest, TX_SCHED_ADDR_LEN) == 0))
+                        return queued;
+        }
+        return NULL;
+}
+
+tx_sched_result_t tx_sched_push(tx_sched_t *sched, tx_sched_class_t tx_class, const tx_sched_frame_t *frame, int64_t now_us)
+{
+        if (frame->len > TX_SCHED_MAX_PAYLOAD)
+                return TX_SCHED_TOO_LONG;
+
+        tx_sched_queue_t *queue = &sched->queues[tx_class];
+        const size_t copy_len = offsetof(tx_sched_frame_t, payload) + frame->len;
+        tx_sched_frame_t *older = tx_sched_find_older(sched, tx_class, frame);
+        if (older != NULL)
+        {
+                memcpy(older, frame, copy_len);
+                older->queued_us = now_us; // Waits from its own push, keeps the older frame's place
+                queue->stat.queued++;
+                queue->stat.superseded++;
+                return TX_SCHED_SUPERSEDED;
+        }
+
+        tx_sched_result_t result = TX_SCHED_QUEUED;
+        if (queue->count >= sched->config.classes[tx_class].depth)
+        {
+                queue->stat.dropped++;
+                if (!sched->config.classes[tx_class].drop_oldest)
+                        return TX_SCHED_FULL;
+                tx_sched_drop_head(sched, tx_class);
+                result = TX_SCHED_DROPPED_OLD;
+        }
+
+        tx_sched_frame_t *slot = tx_sched_at(sched, tx_class, queue->count);
+        memcpy(slot, frame, copy_len);
+        slot->queued_us = now_us;
+        queue->count++;
+        queue->stat.queued++;
+        if (queue->count > queue->stat.peak)
+                queue->stat.peak = queue->count;
+        return result;
+}
+
+static void tx_sched_refill(tx_sched_t *sched, tx_sched_class_t tx_class, int64_t now_us)
+{
+        const tx_sched_class_config_t *config = &sched->config.classes[tx_class];
+        tx_sched_queue_t *queue = &sched->queues[tx_class];
+        const int32_t full = config->burst * TX_SCHED_TOKEN;
+        int64_t elapsed = now_us - queue->refill_us;
+        if ((config->rate_hz == 0) || (elapsed <= 0))
+        {
+                if (config->rate_hz == 0)
+                        queue->tokens = full;
+                return;
+        }
+        // rate_hz frames per second are rate_hz / 1000 tokens per microsecond
+        int64_t earned = elapsed * config->rate_hz / 1000;
+        if (earned == 0)
+                return; // Keeps the remainder for the next call instead of losing it
+        queue->refill_us += earned * 1000 / config->rate_hz;
+        queue->tokens = (queue->tokens + earned >= full) ? full : queue->tokens + earned;
+        if (queue->tokens == full)
+                queue->refill_us = now_us;
+}
+
+static void tx_sched_expire(tx_sched_t *sched, tx_sched_class_t tx_class, int64_t now_us)
+{
+        const uint32_t max_age_us = sched->config.classes[tx_class].max_age_us;
+        tx_sched_queue_t *queue = &sched->queues[tx_class];
+        while ((max_age_us != 0) && (queue->count > 0) && (now_us - tx_sched_at(sched, tx_class, 0)->queued_us > max_age_us))
+        {
+                tx_sched_drop_head(sched, tx_class);
+                queue->stat.expired++;
+        }
+}
+
+/*
+ * Takes the next frame to send, passing over the frames to `blocked`
+ * destinations, NULL for none. TX_SCHED_CLASS_MAX when every class is
+ * empty, blocked or out of tokens.
+ * */
+tx_sched_class_t tx_sched_pop(tx_sched_t *sched, int64_t now_us, const tx_sched_blocked_t *blocked, tx_sched_frame_t *frame)
+{
+        for (tx_sched_class_t tx_class = 0; tx_class < TX_SCHED_CLASS_MAX; tx_class++)
+        {
+                tx_sched_queue_t *queue = &sched->queues[tx_class];
+                tx_sched_expire(sched, tx_class, now_us);
+                size_t index = tx_sched_first_ready(sched, tx_class, blocked);
+                if (index == queue->count)
+                        continue;
+                tx_sched_refill(sched, tx_class, now_us);
+                if (queue->tokens < TX_SCHED_TOKEN)
+                        continue;
+
+                const tx_sched_frame_t *ready = tx_sched_at(sched, tx_class, index);
+                memcpy(frame, ready, offsetof(tx_sched_frame_t, payload) + ready->len);
+                for (; index > 0; index--) // The frames passed over move up one, in order
+                {
+                        const tx_sched_frame_t *prev = tx_sched_at(sched, tx_class, index - 1);
+                        memcpy(tx_sched_at(sched, tx_class, index), prev, offsetof(tx_sched_frame_t, payload) + prev->len);
+                }
+                tx_sched_drop_head(sched, tx_class);
+                queue->tokens -= TX_SCHED_TOKEN;
+                return tx_class;
+        }
+        return TX_SCHED_CLASS_MAX;
+}
+
+/*
+ * Puts a popped frame that could not be sent back in front of its class and
+ * refunds its token. Only frames to blocked destinations can be ahead of
+ * it, the order to each destination holds. Dropped when a newer frame replaced it meanwhile or
+ * the queue filled up.
+ * */
+void tx_sched_requeue(tx_sched_t *sched, tx_sched_class_t tx_class, const tx_sched_frame_t *frame)
+{
+        const tx_sched_class_config_t *config = &sched->config.classes[tx_class];
+        tx_sched_queue_t *queue = &sched->queues[tx_class];
+        queue->tokens += TX_SCHED_TOKEN;
+        if (queue->tokens > config->burst * TX_SCHED_TOKEN)
+                queue->tokens = config->burst * TX_SCHED_TOKEN;
+
+        if (tx_sched_find_older(sched, tx_class, frame) != NULL)
+        {
+                queue->stat.superseded++;
+                return;
+        }
+        if (queue->count >= config->depth)
+        {
+                queue->stat.dropped++;
+                return;
+        }
+        queue->head = (queue->head + config->depth - 1) % config->depth;
+        memcpy(tx_sched_at(sched, tx_class, 0), frame, offsetof(tx_sched_frame_t, payload) + frame->len);
+        queue->count++;
+        queue->stat.requeued++;
+}
+
+/* A popped frame reached the driver, counts it and its time in the queue */
+void tx_sched_sent(tx_sched_t *sched, tx_sched_class_t tx_class, const tx_sched_frame_t *frame, int64_t now_us)
+{
+        tx_sched_stat_t *stat = &sched->queues[tx_class].stat;
+        int64_t latency = now_us - frame->queued_us;
+        uint32_t latency_us = (latency < 0) ? 0 : (latency > UINT32_MAX) ? UINT32_MAX : latency;
+        stat->sent++;
+        if (stat->sent == 1)
+                stat->latency_avg_us = latency_us;
+        else
+                stat->latency_avg_us += ((int64_t)latency_us - stat->latency_avg_us) >> TX_SCHED_LATENCY_SHIFT;
+        if (latency_us > stat->latency_max_us)
+                stat->latency_max_us = latency_us;
+}
+
+/* Time until a class that holds frames to a destination not `blocked` but no token earns one, -1 when nothing waits on a token */
+int64_t tx_sched_next_us(const tx_sched_t *sched, int64_t now_us, const tx_sched_blocked_t *blocked)
+{
+        int64_t next_us = -1;
+        for (size_t i = 0; i < TX_SCHED_CLASS_MAX; i++)
+        {
+                const tx_sched_class_config_t *config = &sched->config.classes[i];
+                const tx_sched_queue_t *queue = &sched->queues[i];
+                if ((tx_sched_first_ready(sched, i, blocked) == queue->count) || (config->rate_hz == 0))
+                        continue;
+                int64_t missing = TX_SCHED_TOKEN - queue->tokens;
+                int64_t wait_us = (missing <= 0) ? 0 : queue->refill_us + (missing * 1000 + config->rate_hz - 1) / config->rate_hz - now_us;
+                if (wait_us < 0)
+                        wait_us = 0;
+                if ((next_us < 0) || (wait_us < next_us))
+                        next_us = wait_us;
+        }
+        return next_us;
+}
+
+size_t tx_sched_pending(const tx_sched_t *sched)
+{
+        size_t count = 0;
+        for (size_t i = 0; i < TX_SCHED_CLASS_MAX; i++)
+                count += sched->queues[i].count;
+        return count;
+}
+
+/* Adds `dest` to the destinations tx_sched_pop passes over, false when the set is full */
+bool tx_sched_block(tx_sched_blocked_t *blocked, const uint8_t *dest)
+{
+        if (tx_sched_is_blocked(blocked, dest))
+                return true;
+        if (blocked->count >= TX_SCHED_BLOCKED_MAX)
+                return false;
+        memcpy(blocked->dest[blocked->count++], dest, TX_SCHED_ADDR_LEN);
+        return true;
+}
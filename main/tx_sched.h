@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Strict priority TX queues. Frames wait in one bounded FIFO per class and
+ * tx_sched_pop always hands out the head of the highest class that has a
+ * frame and a token, so a burst of a low class never sits in front of a
+ * control frame. Each class has a token bucket of `rate_hz` frames per
+ * second up to `burst`, a class over its rate lets lower ones through
+ * instead of starving them.
+ *
+ * Staleness: a frame pushed with TX_SCHED_FLAG_LATEST replaces a queued
+ * frame of the same type to the same destination in place, only the newest
+ * setpoint or heartbeat goes on air. `max_age_us` drops frames that waited
+ * too long, `drop_oldest` makes a full queue give up its oldest frame
+ * rather than the new one.
+ *
+ * Blocked destinations: a frame whose peer has no free TX slot goes back to
+ * its class with tx_sched_requeue and its destination into a
+ * tx_sched_blocked_t. tx_sched_pop then passes over the frames to that
+ * destination and hands out the next one of the class instead, so one
+ * stalled peer does not hold up the class for the others. Frames to one
+ * destination keep their order.
+ *
+ * Not thread safe, the caller holds a lock around every call. No IDF
+ * headers, runs on a host as is.
+ * */
+
+#define TX_SCHED_DEPTH_MAX (8)
+#define TX_SCHED_BLOCKED_MAX (8)
+#define TX_SCHED_MAX_PAYLOAD (64)
+#define TX_SCHED_ADDR_LEN (6)
+#define TX_SCHED_FLAG_LATEST (1 << 0) // Replaces a queued frame of the same type to the same destination
+
+typedef enum
+{
+        TX_SCHED_CLASS_CONTROL,   // User inputs and setpoints
+        TX_SCHED_CLASS_HANDSHAKE, // Connect, channel switch and heartbeats, what keeps the link up
+        TX_SCHED_CLASS_ACK,
+        TX_SCHED_CLASS_TELEMETRY,
+        TX_SCHED_CLASS_TEXT, // Debug text
+        TX_SCHED_CLASS_MAX,
+} tx_sched_class_t;
+
+static const char __attribute__((unused)) * TX_SCHED_CLASS_STRING[] = {
+    "TX_SCHED_CLASS_CONTROL",
+    "TX_SCHED_CLASS_HANDSHAKE",
+    "TX_SCHED_CLASS_ACK",
+    "TX_SCHED_CLASS_TELEMETRY",
+    "TX_SCHED_CLASS_TEXT",
+    "TX_SCHED_CLASS_MAX"};
+
+typedef enum
+{
+        TX_SCHED_QUEUED,
+        TX_SCHED_SUPERSEDED,  // Queued in place of an older frame
+        TX_SCHED_DROPPED_OLD, // Queued, the oldest frame of the class made room
+        TX_SCHED_FULL,        // Not queued
+        TX_SCHED_TOO_LONG,    // Not queued, over TX_SCHED_MAX_PAYLOAD
+} tx_sched_result_t;
+
+typedef struct
+{
+        uint8_t depth;       // Up to TX_SCHED_DEPTH_MAX
+        uint16_t rate_hz;    // 0 for no limit
+        uint8_t burst;       // Tokens saved up while idle
+        uint32_t max_age_us; // 0 to keep frames until sent
+        bool drop_oldest;
+} tx_sched_class_config_t;
+
+typedef struct
+{
+        tx_sched_class_config_t classes[TX_SCHED_CLASS_MAX];
+} tx_sched_config_t;
+
+typedef struct
+{
+        uint8_t dest[TX_SCHED_ADDR_LEN];
+        uint8_t broadcast;
+        uint8_t type;
+        uint8_t flags;
+        uint8_t len;
+        int64_t queued_us;
+        uint8_t payload[TX_SCHED_MAX_PAYLOAD];
+} tx_sched_frame_t;
+
+typedef struct
+{
+        uint32_t queued;
+        uint32_t sent;
+        uint32_t superseded;
+        uint32_t dropped; // Full queue, either end
+        uint32_t expired; // Over max_age_us
+        uint32_t requeued;
+        uint32_t latency_avg_us; // Queued to sent
+        uint32_t latency_max_us;
+        uint8_t peak;
+} tx_sched_stat_t;
+
+typedef struct
+{
+        tx_sched_frame_t frames[TX_SCHED_DEPTH_MAX];
+        uint8_t head;
+        uint8_t count;
+        int32_t tokens; // Unit: 1/1000 frame
+        int64_t refill_us;
+        tx_sched_stat_t stat;
+} tx_sched_queue_t;
+
+typedef struct
+{
+        tx_sched_config_t config;
+        tx_sched_queue_t queues[TX_SCHED_CLASS_MAX];
+} tx_sched_t;
+
+typedef struct
+{
+        uint8_t dest[TX_SCHED_BLOCKED_MAX][TX_SCHED_ADDR_LEN];
+        uint8_t count;
+} tx_sched_blocked_t;
+
+tx_sched_config_t *tx_sched_default_config(tx_sched_config_t *config);
+bool tx_sched_init(tx_sched_t *sched, const tx_sched_config_t *config, int64_t now_us);
+tx_sched_result_t tx_sched_push(tx_sched_t *sched, tx_sched_class_t tx_class, const tx_sched_frame_t *frame, int64_t now_us);
+tx_sched_class_t tx_sched_pop(tx_sched_t *sched, int64_t now_us, const tx_sched_blocked_t *blocked, tx_sched_frame_t *frame);
+void tx_sched_requeue(tx_sched_t *sched, tx_sched_class_t tx_class, const tx_sched_frame_t *frame);
+void tx_sched_sent(tx_sched_t *sched, tx_sched_class_t tx_class, const tx_sched_frame_t *frame, int64_t now_us);
+int64_t tx_sched_next_us(const tx_sched_t *sched, int64_t now_us, const tx_sched_blocked_t *blocked);
+bool tx_sched_block(tx_sched_blocked_t *blocked, const uint8_t *dest);
+size_t tx_sched_pending(const tx_sched_t *sched);
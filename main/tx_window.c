@@ -0,0 +1,101 @@
+
+#include "tx_window.h"
+
+#include <string.h>
+
+#define TX_WINDOW_LATENCY_SHIFT (3) // Average over about 8 completions
+
+void tx_window_shared_init(tx_window_shared_t *shared, uint8_t limit)
+{
+        *shared = (tx_window_shared_t){.limit = (limit > 0) ? limit : 1};
+}
+
+/* Empties the window and hands its slots back to `shared`, counters start over */
+void tx_window_reset(tx_window_t *window, tx_window_shared_t *shared, uint8_t limit)
+{
+        if (shared->in_flight >= window->in_flight)
+                shared->in_flight -= window->in_flight;
+        else
+                shared->in_flight = 0;
+        memset(window, 0, sizeof(tx_window_t));
+        window->limit = (limit == 0) ? 1 : (limit > TX_WINDOW_MAX) ? TX_WINDOW_MAX : limit;
+}
+
+/* Takes a slot for a frame about to be sent, false when the peer or all peers are at their limit */
+bool tx_window_acquire(tx_window_t *window, tx_window_shared_t *shared, int64_t now_us)
+{
+        if ((window->in_flight >= window->limit) || (shared->in_flight >= shared->limit))
+                return false;
+        window->sent_us[(window->head + window->in_flight) % TX_WINDOW_MAX] = now_us;
+        window->in_flight++;
+        shared->in_flight++;
+        window->sent++;
+        if (window->in_flight > window->peak)
+                window->peak = window->in_flight;
+        if (shared->in_flight > shared->peak)
+                shared->peak = shared->in_flight;
+        return true;
+}
+
+/* The frame never reached the driver, gives its slot back. Drops the newest entry, the same when no other sender got in between */
+void tx_window_cancel(tx_window_t *window, tx_window_shared_t *shared)
+{
+        if (window->in_flight == 0)
+                return;
+        window->in_flight--;
+        window->sent--;
+        if (shared->in_flight > 0)
+                shared->in_flight--;
+}
+
+static void tx_window_pop(tx_window_t *window, tx_window_shared_t *shared)
+{
+        window->head = (window->head + 1) % TX_WINDOW_MAX;
+        window->in_flight--;
+        if (shared->in_flight > 0)
+                shared->in_flight--;
+}
+
+/* From the send callback, false for a late callback of an expired frame, its slot is not in the window anymore */
+bool tx_window_complete(tx_window_t *window, tx_window_shared_t *shared, int64_t now_us, bool success)
+{
+        if ((window->unacked > 0) && (now_us < window->unacked_until_us))
+        {
+                window->unacked--;
+                window->late++;
+                return false;
+        }
+        window->unacked = 0;
+        if (window->in_flight == 0)
+                return false;
+
+        int64_t latency = now_us - window->sent_us[window->head];
+        tx_window_pop(window, shared);
+        window->completed++;
+        if (!success)
+                window->failed++;
+
+        window->latency_us = (latency < 0) ? 0 : (latency > UINT32_MAX) ? UINT32_MAX : latency;
+        if (window->completed == 1)
+                window->latency_avg_us = window->latency_us;
+        else
+                window->latency_avg_us += ((int64_t)window->latency_us - window->latency_avg_us) >> TX_WINDOW_LATENCY_SHIFT;
+        if (window->latency_us > window->latency_max_us)
+                window->latency_max_us = window->latency_us;
+        return true;
+}
+
+/* Takes back slots older than `timeout_us`, returns how many */
+size_t tx_window_expire(tx_window_t *window, tx_window_shared_t *shared, int64_t now_us, int64_t timeout_us)
+{
+        size_t count = 0;
+        while ((window->in_flight > 0) && (now_us - window->sent_us[window->head] >= timeout_us))
+        {
+                tx_window_pop(window, shared);
+                window->expired++;
+                window->unacked += (window->unacked < UINT8_MAX);
+                window->unacked_until_us = now_us + 2 * timeout_us; // The driver may still sit on the frames behind it
+                count++;
+        }
+        return count;
+}
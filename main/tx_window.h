@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bounded number of frames handed to the driver and not yet reported by its
+ * send callback, per peer and over all peers. A sender takes a slot before
+ * esp_now_send and the send callback gives it back, so bursts wait in the
+ * caller instead of overflowing the driver's buffers.
+ *
+ * The driver reports frames to one peer in the order they were sent, so
+ * the send times form a FIFO and each callback yields the TX complete
+ * latency of its frame. A slot held longer than the timeout given to
+ * tx_window_expire() is taken back. Its callback may still come, ahead of
+ * those of the frames in flight, so the window counts the expired slots
+ * and swallows that many callbacks. A callback that never comes would
+ * shift every later one by a frame, the count is dropped once nothing
+ * expired for two timeouts.
+ *
+ * Not thread safe, the caller holds a lock around every call. No IDF
+ * headers, runs on a host as is.
+ * */
+
+#define TX_WINDOW_MAX (8) // Largest per peer limit
+
+typedef struct
+{
+        uint8_t in_flight;
+        uint8_t limit;
+        uint8_t peak;
+} tx_window_shared_t;
+
+typedef struct
+{
+        int64_t sent_us[TX_WINDOW_MAX]; // FIFO of the frames in flight
+        uint8_t head;                   // Oldest
+        uint8_t in_flight;
+        uint8_t limit;
+        uint8_t peak;
+        uint8_t unacked;          // Expired slots whose callback may still come
+        int64_t unacked_until_us; // Given up on them after this
+        uint32_t sent;
+        uint32_t completed;
+        uint32_t failed;  // Send callback reported no ACK, still a completion
+        uint32_t expired; // No send callback within the timeout
+        uint32_t late;    // Send callbacks of expired slots
+        uint32_t waits;   // Senders that found the window full, kept by the caller
+        uint32_t timeouts;
+        uint32_t latency_us; // Of the last completion
+        uint32_t latency_avg_us;
+        uint32_t latency_max_us;
+} tx_window_t;
+
+void tx_window_shared_init(tx_window_shared_t *shared, uint8_t limit);
+void tx_window_reset(tx_window_t *window, tx_window_shared_t *shared, uint8_t limit);
+bool tx_window_acquire(tx_window_t *window, tx_window_shared_t *shared, int64_t now_us);
+void tx_window_cancel(tx_window_t *window, tx_window_shared_t *shared);
+bool tx_window_complete(tx_window_t *window, tx_window_shared_t *shared, int64_t now_us, bool success);
+size_t tx_window_expire(tx_window_t *window, tx_window_shared_t *shared, int64_t now_us, int64_t timeout_us);
@@ -0,0 +1,202 @@
+
+#include <stdio.h>
+#include <string.h>
+
+#include "watermark.h"
+
+#define WATERMARK_LATENCY_IDLE (0)
+#define WATERMARK_LATENCY_ARMING (UINT32_MAX) // A sender is storing the start time
+
+typedef struct
+{
+        uint32_t capacity;
+        atomic_uint_fast32_t peak;
+        atomic_uint_fast32_t sent;
+        atomic_uint_fast32_t dropped;
+        atomic_uint_fast32_t received;
+        atomic_uint_fast32_t latency_pending; // Receives until the followed item comes out
+        atomic_uint_fast32_t latency_start_us;
+        atomic_uint_fast32_t latency_samples;
+        atomic_uint_fast32_t latency_sum_us;
+        atomic_uint_fast32_t latency_max_us;
+} watermark_queue_slot_t;
+
+typedef struct
+{
+        const char *name;
+        uint32_t stack_size;
+        atomic_uint_fast32_t stack_peak;
+} watermark_task_slot_t;
+
+static watermark_queue_slot_t watermark_queues[WATERMARK_QUEUE_MAX];
+static watermark_task_slot_t watermark_tasks[WATERMARK_TASK_MAX];
+
+static void watermark_update_max(atomic_uint_fast32_t *max, uint32_t value)
+{
+        uint_fast32_t seen = atomic_load(max);
+        while ((value > seen) && !atomic_compare_exchange_weak(max, &seen, value))
+                ;
+}
+
+void watermark_queue_register(watermark_queue_t queue, uint32_t capacity)
+{
+        if (queue >= WATERMARK_QUEUE_MAX)
+                return;
+        watermark_queues[queue].capacity = capacity;
+}
+
+/* `depth` is the number of items waiting right after the send, the sent item included */
+void watermark_queue_sent(watermark_queue_t queue, uint32_t depth, uint32_t now_us)
+{
+        if (queue >= WATERMARK_QUEUE_MAX)
+                return;
+        watermark_queue_slot_t *slot = &watermark_queues[queue];
+        atomic_fetch_add(&slot->sent, 1);
+        watermark_update_max(&slot->peak, depth);
+
+        uint_fast32_t idle = WATERMARK_LATENCY_IDLE;
+        if ((depth > 0) && atomic_compare_exchange_strong(&slot->latency_pending, &idle, WATERMARK_LATENCY_ARMING))
+        {
+                atomic_store(&slot->latency_start_us, now_us);
+                atomic_store(&slot->latency_pending, depth);
+        }
+}
+
+void watermark_queue_dropped(watermark_queue_t queue)
+{
+        if (queue >= WATERMARK_QUEUE_MAX)
+                return;
+        atomic_fetch_add(&watermark_queues[queue].dropped, 1);
+}
+
+void watermark_queue_received(watermark_queue_t queue, uint32_t now_us)
+{
+        if (queue >= WATERMARK_QUEUE_MAX)
+                return;
+        watermark_queue_slot_t *slot = &watermark_queues[queue];
+        atomic_fetch_add(&slot->received, 1);
+
+        uint_fast32_t pending = atomic_load(&slot->latency_pending);
+        while ((pending != WATERMARK_LATENCY_IDLE) && (pending != WATERMARK_LATENCY_ARMING))
+        {
+                if (!atomic_compare_exchange_weak(&slot->latency_pending, &pending, pending - 1))
+                        continue;
+                if (pending == 1)
+                {
+                        uint32_t latency = now_us - (uint32_t)atomic_load(&slot->latency_start_us); // Unsigned, survives a wrap
+                        atomic_fetch_add(&slot->latency_sum_us, latency);
+                        atomic_fetch_add(&slot->latency_samples, 1);
+                        watermark_update_max(&slot->latency_max_us, latency);
+                }
+                break;
+        }
+}
+
+bool watermark_queue_get(watermark_queue_t queue, watermark_queue_stat_t *stat)
+{
+        if ((queue >= WATERMARK_QUEUE_MAX) || (stat == NULL))
+                return false;
+        watermark_queue_slot_t *slot = &watermark_queues[queue];
+        uint32_t samples = atomic_load(&slot->latency_samples);
+        *stat = (watermark_queue_stat_t){
+            .capacity = slot->capacity,
+            .peak = atomic_load(&slot->peak),
+            .sent = atomic_load(&slot->sent),
+            .dropped = atomic_load(&slot->dropped),
+            .received = atomic_load(&slot->received),
+            .latency_samples = samples,
+            .latency_avg_us = samples ? (uint32_t)atomic_load(&slot->latency_sum_us) / samples : 0,
+            .latency_max_us = atomic_load(&slot->latency_max_us),
+        };
+        return slot->capacity != 0;
+}
+
+void watermark_task_register(size_t id, const char *name, uint32_t stack_size)
+{
+        if (id >= WATERMARK_TASK_MAX)
+                return;
+        watermark_tasks[id].name = name;
+        watermark_tasks[id].stack_size = stack_size;
+}
+
+/* `stack_free` is the task's stack high water mark, the least free stack seen so far */
+void watermark_task_update(size_t id, uint32_t stack_free)
+{
+        if ((id >= WATERMARK_TASK_MAX) || (watermark_tasks[id].stack_size == 0))
+                return;
+        watermark_task_slot_t *slot = &watermark_tasks[id];
+        uint32_t used = (stack_free < slot->stack_size) ? slot->stack_size - stack_free : 0;
+        watermark_update_max(&slot->stack_peak, used);
+}
+
+bool watermark_task_get(size_t id, watermark_task_stat_t *stat)
+{
+        if ((id >= WATERMARK_TASK_MAX) || (stat == NULL) || (watermark_tasks[id].stack_size == 0))
+                return false;
+        *stat = (watermark_task_stat_t){
+            .name = watermark_tasks[id].name,
+            .stack_size = watermark_tasks[id].stack_size,
+            .stack_peak = atomic_load(&watermark_tasks[id].stack_peak),
+        };
+        return true;
+}
+
+/* Clears the peaks and counters, registrations stay */
+void watermark_reset(void)
+{
+        for (size_t i = 0; i < WATERMARK_QUEUE_MAX; i++)
+        {
+                watermark_queue_slot_t *slot = &watermark_queues[i];
+                atomic_store(&slot->peak, 0);
+                atomic_store(&slot->sent, 0);
+                atomic_store(&slot->dropped, 0);
+                atomic_store(&slot->received, 0);
+                atomic_store(&slot->latency_pending, WATERMARK_LATENCY_IDLE);
+                atomic_store(&slot->latency_samples, 0);
+                atomic_store(&slot->latency_sum_us, 0);
+                atomic_store(&slot->latency_max_us, 0);
+        }
+        for (size_t i = 0; i < WATERMARK_TASK_MAX; i++)
+                atomic_store(&watermark_tasks[i].stack_peak, 0);
+}
+
+/* Queue table then stack table, truncated to `size`. Returns the length written */
+size_t watermark_format(char *buf, size_t size)
+{
+        if ((buf == NULL) || (size == 0))
+                return 0;
+
+        int n = snprintf(buf, size, "%-16s %5s %5s %8s %8s %8s %8s\n", "queue", "cap", "peak", "sent", "dropped", "avg_us", "max_us");
+        if (n < 0)
+                return 0;
+        size_t len = n;
+        for (size_t i = 0; (i < WATERMARK_QUEUE_MAX) && (len < size); i++)
+        {
+                watermark_queue_stat_t stat;
+                if (!watermark_queue_get(i, &stat))
+                        continue;
+                n = snprintf(buf + len, size - len, "%-16s %5lu %5lu %8lu %8lu %8lu %8lu\n", WATERMARK_QUEUE_STRING[i],
+                             (unsigned long)stat.capacity, (unsigned long)stat.peak, (unsigned long)stat.sent,
+                             (unsigned long)stat.dropped, (unsigned long)stat.latency_avg_us, (unsigned long)stat.latency_max_us);
+                if (n < 0)
+                        return len;
+                len += n;
+        }
+        if (len < size)
+        {
+                n = snprintf(buf + len, size - len, "%-16s %5s %5s\n", "task", "stack", "peak");
+                len += (n > 0) ? n : 0;
+        }
+        for (size_t i = 0; (i < WATERMARK_TASK_MAX) && (len < size); i++)
+        {
+                watermark_task_stat_t stat;
+                if (!watermark_task_get(i, &stat))
+                        continue;
+                n = snprintf(buf + len, size - len, "%-16s %5lu %5lu\n", stat.name ? stat.name : "?",
+                             (unsigned long)stat.stack_size, (unsigned long)stat.stack_peak);
+                if (n < 0)
+                        return len;
+                len += n;
+        }
+        return (len < size) ? len : size - 1;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Registry of how close every queue and task stack comes to its limit.
+ * Modules register their queues at init, task_table registers the tasks it
+ * creates. Producers and consumers report each send, drop and receive, the
+ * registry keeps the peaks so buffers can be sized from real runs.
+ *
+ * Counters are C11 atomics, safe from Wi-Fi callbacks and any core. No IDF
+ * headers so the bookkeeping can be exercised on a Linux host.
+ *
+ * Enqueue to dequeue latency is sampled: one item per queue is followed at
+ * a time, the next send after it comes out starts a new sample.
+ * */
+
+#define WATERMARK_TASK_MAX (8)
+
+typedef enum
+{
+        WATERMARK_QUEUE_ESPNOW,
+        WATERMARK_QUEUE_RSSI,
+        WATERMARK_QUEUE_BUTTON,
+        WATERMARK_QUEUE_JOYSTICK,
+        WATERMARK_QUEUE_MAX,
+} watermark_queue_t;
+
+static const char __attribute__((unused)) * WATERMARK_QUEUE_STRING[] = {
+    "espnow_ring",
+    "rssi_ring",
+    "button_queue",
+    "joystick_queue",
+    "WATERMARK_QUEUE_MAX"};
+
+typedef struct
+{
+        uint32_t capacity; // Unit: item
+        uint32_t peak;     // Deepest seen right after a send
+        uint32_t sent;
+        uint32_t dropped; // Send failed, queue full
+        uint32_t received;
+        uint32_t latency_samples;
+        uint32_t latency_avg_us;
+        uint32_t latency_max_us;
+} watermark_queue_stat_t;
+
+typedef struct
+{
+        const char *name;
+        uint32_t stack_size; // Unit: byte
+        uint32_t stack_peak; // Most stack ever used, unit: byte
+} watermark_task_stat_t;
+
+void watermark_queue_register(watermark_queue_t queue, uint32_t capacity);
+void watermark_queue_sent(watermark_queue_t queue, uint32_t depth, uint32_t now_us);
+void watermark_queue_dropped(watermark_queue_t queue);
+void watermark_queue_received(watermark_queue_t queue, uint32_t now_us);
+bool watermark_queue_get(watermark_queue_t queue, watermark_queue_stat_t *stat);
+
+void watermark_task_register(size_t id, const char *name, uint32_t stack_size);
+void watermark_task_update(size_t id, uint32_t stack_free);
+bool watermark_task_get(size_t id, watermark_task_stat_t *stat);
+
+void watermark_reset(void);
+size_t watermark_format(char *buf, size_t size);
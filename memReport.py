@@ -0,0 +1,191 @@
+import os
+import re
+import sys
+from collections import defaultdict
+
+# Static RAM of every firmware module, read from the linker map of a build and
+# checked against the budgets of `main/mem_budget.h`. Also scans the firmware
+# sources for heap allocation outside init, after init nothing may touch the heap.
+#
+# The heap scan reads the sources, it does not run them. Init is app_main and
+# every function only ever called from init, a name ending in _init alone does
+# not count. Task bodies, callbacks and anything referenced as a value run
+# later. An _init function nothing here calls is an entry point of the car
+# firmware and counts as init, its callers are not in this tree. It sees the C
+# library and FreeRTOS allocators and the IDF calls in HEAP_CALL that allocate
+# inside, not an IDF call missing from that list, a call through a function
+# pointer, or an allocation hidden in a macro. Static functions of the same
+# name in different files count as one function.
+#
+#   python memReport.py build/controller.map    RAM per module and subsystem
+#   python memReport.py --check-heap [main]     fails on a heap allocation after init
+
+FIRMWARE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "main")
+
+BUDGET = re.compile(r"^#define MEM_BUDGET_(\w+)_BYTES \(([\d\s*+]+)\)", re.M)
+
+# Input sections that end up in DRAM, size and object file may sit on the line after the name
+RAM_SECTION = re.compile(
+    r"^ (\.(?:bss|sbss|data|sdata|dram1)[\w.$]*|COMMON)\s+0x[0-9a-f]+\s+0x([0-9a-f]+)\s+\S*libmain\.a\((\w+)\.c\.obj\)",
+    re.M,
+)
+
+SUBSYSTEMS = {
+    "tasks": ("task_table",),
+    "radio": (
+        "espnow", "espnow_bundle", "bundle_pack", "espnow_tx", "tx_sched", "espnow_pair", "pair_cache", "rssi", "packet_dispatch", "dispatch_table", "channel_scan", "channel_score",
+        "event_ring", "spsc_ring", "frame_pool", "clock_sync", "seq_window",
+        "link_bench", "link_bench_espnow", "link_throughput", "link_throughput_espnow", "tx_window",
+    ),
+    "input": ("button", "joystick", "tof_sensor", "tof_scheduler", "range_filter"),
+    "actuators": ("servo", "servo_group", "servo_profile", "servo_stream", "setpoint_stream"),
+    "diagnostics": ("telemetry", "telemetry_frame", "motor_stat_codec", "task_stats", "watermark", "mem_probe"),
+    "system": ("main", "power_manager", "ws2812", "led_strip_encoder", "mathop"),
+}
+
+HEAP_CALL = re.compile(
+    r"\b(malloc|calloc|realloc|strdup|strndup|asprintf|heap_caps_\w*alloc\w*"
+    r"|xQueueCreate|xQueueCreateSet|xTaskCreate|xTaskCreatePinnedToCore|xStreamBufferCreate|xMessageBufferCreate"
+    r"|xSemaphoreCreate(?:Mutex|RecursiveMutex|Binary|Counting)?|xEventGroupCreate|xTimerCreate|xRingbufferCreate"
+    r"|esp_timer_create|esp_pm_lock_create|esp_event_loop_create(?:_default)?|esp_netif_create_default_wifi_\w+"
+    r"|esp_wifi_init|esp_now_init|esp_now_add_peer|gpio_install_isr_service|nvs_open|\w+_new_\w+)\s*\("
+)
+FUNCTION = re.compile(r"^[A-Za-z_][\w \t*]*?\b(\w+)\s*\([^;]*\)\s*$")
+IDENTIFIER = re.compile(r"\b([A-Za-z_]\w*)\b(\s*\()?")
+FOREVER = re.compile(r"\b(?:for\s*\(\s*;\s*;\s*\)|while\s*\(\s*(?:true|1)\s*\))")
+STRING = re.compile(r"\"(?:\\\\.|[^\"\\\\])*\"|'(?:\\\\.|[^'\\\\])*'")
+INIT_ROOT = "app_main"
+# Allocations after init that cannot be avoided, with the reason
+RUNTIME_ALLOWED = {
+    "esp_now_add_peer": "ESP-NOW keeps its peer list on the heap, bounded by ESP_NOW_MAX_TOTAL_PEER_NUM, freed by esp_now_del_peer",
+}
+
+
+def load_budgets(firmware_dir: str = FIRMWARE_DIR) -> dict[str, int]:
+    with open(os.path.join(firmware_dir, "mem_budget.h")) as f:
+        text = f.read()
+    return {name.lower(): eval(expr) for name, expr in BUDGET.findall(text) if name != "TOTAL"}
+
+
+def static_ram(map_path: str) -> dict[str, int]:
+    with open(map_path) as f:
+        text = f.read()
+    usage: dict[str, int] = defaultdict(int)
+    for _, size, module in RAM_SECTION.findall(text):
+        usage[module] += int(size, 16)
+    return dict(usage)
+
+
+def subsystem_of(module: str) -> str:
+    for subsystem, modules in SUBSYSTEMS.items():
+        if module in modules:
+            return subsystem
+    return "other"
+
+
+def print_report(usage: dict[str, int], budgets: dict[str, int]) -> bool:
+    fits = True
+    print(f"{'module':20s} {'subsystem':12s} {'bytes':>8s} {'budget':>8s}")
+    for module in sorted(usage, key=lambda m: (subsystem_of(m), -usage[m])):
+        budget = budgets.get(module)
+        over = budget is not None and usage[module] > budget
+        fits &= not over
+        print(f"{module:20s} {subsystem_of(module):12s} {usage[module]:8d} {budget if budget else '':>8}{'  OVER' if over else ''}")
+
+    totals: dict[str, int] = defaultdict(int)
+    for module, size in usage.items():
+        totals[subsystem_of(module)] += size
+    print()
+    for subsystem, size in sorted(totals.items(), key=lambda item: -item[1]):
+        print(f"{subsystem:20s} {size:8d}")
+    print(f"{'total':20s} {sum(usage.values()):8d}, budgeted modules: {sum(budgets.values())}")
+    return fits
+
+
+# Source lines without comments and with empty string literals, as (line number, code)
+def _code_lines(path: str) -> list[tuple[int, str]]:
+    with open(path) as f:
+        lines = f.read().splitlines()
+    code_lines, in_comment = [], False
+    for number, line in enumerate(lines, 1):
+        code = line
+        if in_comment:
+            if "*/" not in code:
+                continue
+            code, in_comment = code.split("*/", 1)[1], False
+        code = re.sub(r"/\*.*?\*/", "", STRING.sub('""', code).split("//", 1)[0])
+        if "/*" in code:
+            code, in_comment = code.split("/*", 1)[0], True
+        code_lines.append((number, code))
+    return code_lines
+
+
+# Functions run by app_main and nothing else: called from it or from each other only, never a
+# task body with a loop that runs for good, never handed out as a callback
+def init_functions(calls: dict[str, set[str]], references: set[str], forever: set[str]) -> set[str]:
+    callers: dict[str, set[str]] = defaultdict(set)
+    for function, callees in calls.items():
+        for callee in callees:
+            callers[callee].add(function)
+    init = {function for function in calls if function not in references and function not in forever}
+    roots = {INIT_ROOT} | {function for function in init if function.endswith("_init") and not callers[function]}
+    while True:
+        reached, todo = set(), [function for function in roots if function in init]
+        while todo:
+            function = todo.pop()
+            if function not in reached:
+                reached.add(function)
+                todo += [callee for callee in calls.get(function, ()) if callee in init]
+        kept = {f for f in reached if f in roots or callers[f] <= reached}
+        if kept == init:
+            return init
+        init = kept
+
+
+# Heap calls outside the init functions, as (file, line, function, call)
+def heap_calls_after_init(firmware_dir: str = FIRMWARE_DIR) -> list[tuple[str, int, str, str]]:
+    sources = {name: _code_lines(os.path.join(firmware_dir, name)) for name in sorted(os.listdir(firmware_dir)) if name.endswith(".c")}
+
+    # Functions are Allman style, the header on one line, braces in the first column
+    heap, calls, forever = [], defaultdict(set), set()
+    words: list[tuple[str, bool]] = []
+    for name, code_lines in sources.items():
+        function = ""
+        for i, (number, code) in enumerate(code_lines):
+            header = FUNCTION.match(code)
+            if header and i + 1 < len(code_lines) and code_lines[i + 1][1].startswith("{"):
+                function = header.group(1)
+                calls[function]
+                continue
+            if code.startswith("}"):
+                function = ""
+            if FOREVER.search(code) and function:
+                forever.add(function)
+            heap += [(name, number, function, call) for call in HEAP_CALL.findall(code)]
+            for word, call in IDENTIFIER.findall(code):
+                words.append((word, bool(call)))
+                if call and function:
+                    calls[function].add(word)
+
+    references = {word for word, call in words if not call and word in calls}  # Handed out by name, run by whoever holds it
+    init = init_functions(calls, references, forever)
+    return [(name, number, function, call) for name, number, function, call in heap if function not in init]
+
+
+if __name__ == "__main__":
+
+    if len(sys.argv) > 1 and sys.argv[1] == "--check-heap":
+        firmware_dir = sys.argv[2] if len(sys.argv) > 2 else FIRMWARE_DIR
+        calls = heap_calls_after_init(firmware_dir)
+        for name, number, function, call in [c for c in calls if c[3] in RUNTIME_ALLOWED]:
+            print(f"{name}:{number}: {call}() in {function or 'file scope'} allowed, {RUNTIME_ALLOWED[call]}")
+        calls = [c for c in calls if c[3] not in RUNTIME_ALLOWED]
+        for name, number, function, call in calls:
+            print(f"{name}:{number}: {call}() in {function or 'file scope'} runs after init")
+        print(f"{len(calls)} heap allocation(s) after init")
+        sys.exit(1 if calls else 0)
+
+    if len(sys.argv) < 2:
+        print(f"usage: {sys.argv[0]} <build/project.map> | --check-heap [firmware dir]")
+        sys.exit(2)
+    sys.exit(0 if print_report(static_ram(sys.argv[1]), load_budgets()) else 1)
@@ -0,0 +1,206 @@
+import math
+import random
+import struct
+import sys
+from typing import Optional
+
+# Host side of main/motor_stat_codec.c, the compact motor_group_stat_pkt_t.
+# Frame: seq (u8) | mask (u16) | zigzag varint of the change of each field set in the mask.
+# Fields in packet order, floats quantized to int16 with SCALES, counters exact.
+
+FIELDS = 12
+HEADER = struct.Struct("<BH")  # seq, mask
+KEYFRAME = 0x8000
+MAX_FRAME = HEADER.size + 2 * 5 + 10 * 3  # MOTOR_STAT_CODEC_MAX_FRAME
+DEFAULT_KEYFRAME_INTERVAL = 25  # MOTOR_STAT_CODEC_DEFAULT_KEYFRAME_INTERVAL
+
+# Must match `motor_stat_codec_scale`, 0 for the counters
+SCALES = (
+    0, 1000, 1000, 100, 1000,
+    0, 1000, 1000, 100, 1000,
+    1000, 1000,
+)
+
+
+def _wrap32(value: int) -> int:
+    return (value + 2**31) % 2**32 - 2**31
+
+
+# Rounded to float as the firmware computes, past its range is infinite
+def _f32(value: float) -> float:
+    try:
+        return struct.unpack("<f", struct.pack("<f", value))[0]
+    except OverflowError:
+        return math.copysign(math.inf, value)
+
+
+# In float like motor_stat_codec_quantize, in double a value on the rounding point between two steps can go the other way
+def quantize(value: float, scale: int) -> int:
+    if scale == 0:
+        return _wrap32(int(value))
+    scaled = _f32(value * scale)
+    if math.isnan(scaled):
+        return 0
+    if scaled >= 32767:
+        return 32767
+    if scaled <= -32768:
+        return -32768
+    return int(_f32(scaled + (0.5 if scaled >= 0 else -0.5)))
+
+
+def dequantize(value: int, scale: int) -> float:
+    return value if scale == 0 else value / scale
+
+
+def put_varint(out: bytearray, value: int) -> None:
+    zigzag = ((value << 1) ^ (value >> 31)) & 0xFFFFFFFF
+    while zigzag >= 0x80:
+        out.append((zigzag & 0x7F) | 0x80)
+        zigzag >>= 7
+    out.append(zigzag)
+
+
+def get_varint(data: bytes, pos: int) -> tuple[int, int]:
+    zigzag = 0
+    for length in range(5):
+        if pos + length >= len(data):
+            break
+        zigzag |= (data[pos + length] & 0x7F) << (7 * length)
+        if not data[pos + length] & 0x80:
+            zigzag &= 0xFFFFFFFF
+            return (zigzag >> 1) ^ -(zigzag & 1), pos + length + 1
+    raise ValueError("bad varint")
+
+
+class MotorStatEncoder:
+    def __init__(self, keyframe_interval: int = DEFAULT_KEYFRAME_INTERVAL) -> None:
+        self.keyframe_interval = max(keyframe_interval, 1)
+        self.values = [0] * FIELDS
+        self.seq = 0
+        self.since_keyframe = 0
+        self.keyframe_due = True
+
+    # Next frame is a keyframe, after a reconnect or a decoder restart
+    def request_keyframe(self) -> None:
+        self.keyframe_due = True
+
+    def encode(self, stat: list[float]) -> bytes:
+        values = [quantize(value, scale) for value, scale in zip(stat, SCALES)]
+        keyframe = self.keyframe_due or self.since_keyframe + 1 >= self.keyframe_interval
+        if keyframe:
+            self.values = [0] * FIELDS
+            self.keyframe_due = False
+            self.since_keyframe = 0
+        else:
+            self.since_keyframe += 1
+
+        mask = KEYFRAME if keyframe else 0
+        body = bytearray()
+        for i, value in enumerate(values):
+            delta = _wrap32(value - self.values[i])
+            if delta:
+                mask |= 1 << i
+                put_varint(body, delta)
+                self.values[i] = value
+        frame = HEADER.pack(self.seq, mask) + body
+        self.seq = (self.seq + 1) & 0xFF
+        return frame
+
+
+class MotorStatDecoder:
+    def __init__(self) -> None:
+        self.reset()
+
+    def reset(self) -> None:
+        self.values = [0] * FIELDS
+        self.seq = 0
+        self.synced = False
+        self.frames = self.keyframes = self.lost = self.dropped = self.bad = 0
+
+    # Field values in packet order, None while waiting for a keyframe or on a bad frame
+    def decode(self, frame: bytes) -> Optional[list[float]]:
+        if len(frame) < HEADER.size:
+            self.bad += 1
+            return None
+        seq, mask = HEADER.unpack_from(frame)
+        keyframe = bool(mask & KEYFRAME)
+        if self.synced and seq != (self.seq + 1) & 0xFF:
+            self.lost += (seq - self.seq - 1) & 0xFF
+            self.synced = False
+        self.seq = seq
+        if not keyframe and not self.synced:
+            self.dropped += 1
+            return None
+
+        values = [0] * FIELDS if keyframe else list(self.values)
+        pos = HEADER.size
+        try:
+            if mask & ~KEYFRAME & ~((1 << FIELDS) - 1):
+                raise ValueError("unknown field")
+            for i in range(FIELDS):
+                if mask & (1 << i):
+                    delta, pos = get_varint(frame, pos)
+                    values[i] = _wrap32(values[i] + delta)
+            if pos != len(frame):
+                raise ValueError("trailing bytes")
+        except ValueError:
+            self.bad += 1
+            self.synced = False
+            return None
+
+        self.values = values
+        self.synced = True
+        self.frames += 1
+        self.keyframes += keyframe
+        return [dequantize(value, scale) for value, scale in zip(values, SCALES)]
+
+
+# Round trip of a synthetic drive: error bound, frame size and recovery after losses
+if __name__ == "__main__":
+    rng = random.Random(1)
+    frames = 5000
+    loss_probability = 0.02
+    encoder = MotorStatEncoder()
+    decoder = MotorStatDecoder()
+    lossless = MotorStatDecoder()
+
+    counters = [2**31 - 3000, -12345]  # The left one wraps during the run
+    velocity = [0.0, 0.0]
+    sizes, max_error, decoded, expected = [], [0.0] * FIELDS, 0, 0
+    for n in range(frames):
+        stat = []
+        for side in range(2):
+            set_velocity = 1.5 if (n // 500) % 2 else 0.0
+            acceleration = (set_velocity - velocity[side]) * 4 + rng.gauss(0, 0.05)
+            velocity[side] += acceleration * 0.02
+            counters[side] = _wrap32(counters[side] + int(velocity[side] * 60))
+            duty = max(-1.0, min(1.0, set_velocity / 2 + acceleration / 20))
+            stat += [counters[side], set_velocity, velocity[side], acceleration, duty]
+        stat += [(stat[2] - stat[7]) * 0.02, stat[2] - stat[7]]
+        stat = [struct.unpack("<f", struct.pack("<f", value))[0] if scale else value for value, scale in zip(stat, SCALES)]
+
+        frame = encoder.encode(stat)
+        assert len(frame) <= MAX_FRAME
+        sizes.append(len(frame))
+        values = lossless.decode(frame)
+        assert values is not None
+        for i, (got, want, scale) in enumerate(zip(values, stat, SCALES)):
+            error = abs(got - want)
+            max_error[i] = max(max_error[i], error)
+            bound = 0 if scale == 0 else 0.5 / scale + abs(want) * 1e-6
+            assert error <= bound, f"frame {n} field {i}: {got} != {want}"
+
+        if rng.random() >= loss_probability:
+            expected += 1
+            decoded += decoder.decode(frame) is not None
+
+    raw = struct.calcsize("<i4fi4f2f")
+    average = sum(sizes) / len(sizes)
+    print(f"frames: {frames}, raw {raw} B, encoded average {average:.1f} B ({raw / average:.1f}x), max {max(sizes)} B")
+    print("max error: " + ", ".join(f"{error:.2g}" for error in max_error))
+    print(
+        f"{loss_probability:.0%} loss: decoded {decoded}/{expected}, lost {decoder.lost},"
+        f" dropped until keyframe {decoder.dropped}, bad {decoder.bad}"
+    )
+    if average > raw / 4:
+        sys.exit("average frame above a quarter of the raw packet")
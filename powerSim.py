@@ -0,0 +1,157 @@
+import os
+import re
+import sys
+from dataclasses import dataclass, field
+
+import numpy as np
+
+# Host side model of main/power_manager.c, replays input event times through the
+# same ACTIVE -> IDLE -> DEEP_IDLE policy and estimates current draw and battery life.
+
+GPIO_EVENT = re.compile(r"GPIO event: pin (\d+)")
+
+
+@dataclass
+class PowerConfig:
+    # Same defaults as power_manager_default_config
+    latency_budget_ms: float = 20
+    idle_timeout_ms: float = 5 * 1000
+    deep_idle_timeout_ms: float = 60 * 1000
+    active_poll_ms: float = 10
+    idle_poll_ms: float = 100
+    deep_idle_poll_ms: float = 1000
+    idle_wake_window_ms: float = 50
+    deep_idle_wake_window_ms: float = 10
+    wake_interval_ms: float = 100
+    light_sleep_wake_ms: float = 2
+    station_mode: bool = True  # Wake windows only apply to a station, see espnow_wifi_default_config
+
+
+@dataclass
+class CurrentModel:
+    # ESP32-S3 ballpark figures, unit: mA
+    radio_rx: float = 95
+    cpu_active: float = 40
+    light_sleep: float = 1.5
+    cpu_idle: float = 13  # Clock gated at min_freq_mhz, where idle time goes when light sleep is blocked
+    poll_busy_ms: float = 0.3  # CPU time spent per poll of all tasks
+    pollers: int = 4  # button, joystick, rssi and main loop
+
+
+@dataclass
+class PowerReport:
+    duration_ms: float = 0
+    state_ms: dict = field(default_factory=lambda: {"active": 0.0, "idle": 0.0, "deep_idle": 0.0})
+    latencies_ms: list = field(default_factory=list)
+    average_ma: float = 0
+
+    def battery_hours(self, capacity_mah: float) -> float:
+        return capacity_mah / self.average_ma if self.average_ma else float("inf")
+
+
+# As an AP the Wi-Fi driver holds off automatic light sleep for good, only a station sleeps between wake windows
+def light_sleep_allowed(config: PowerConfig) -> bool:
+    return config.station_mode
+
+
+def state_current(config: PowerConfig, model: CurrentModel, state: str) -> float:
+    poll_ms = {"active": config.active_poll_ms, "idle": config.idle_poll_ms, "deep_idle": config.deep_idle_poll_ms}[state]
+    cpu_duty = min(1.0, model.pollers * model.poll_busy_ms / poll_ms)
+    if state == "active" and config.active_poll_ms + config.light_sleep_wake_ms > config.latency_budget_ms:
+        cpu_duty = 1.0  # Light sleep is blocked to keep the budget
+
+    radio_duty = 1.0
+    if config.station_mode and state != "active":
+        window = config.idle_wake_window_ms if state == "idle" else config.deep_idle_wake_window_ms
+        radio_duty = min(1.0, window / config.wake_interval_ms)
+
+    idle_duty = 1.0 - cpu_duty
+    idle_current = model.light_sleep if light_sleep_allowed(config) else model.cpu_idle
+    return radio_duty * model.radio_rx + cpu_duty * model.cpu_active + idle_duty * idle_current
+
+
+# Walks the gaps between input events, every event restarts the inactivity timeout
+def simulate(events_ms: np.ndarray, duration_ms: float, config: PowerConfig, model: CurrentModel) -> PowerReport:
+    report = PowerReport(duration_ms=duration_ms)
+    events = np.sort(np.asarray(events_ms, dtype=float))
+    boundaries = np.concatenate(([0.0], events, [duration_ms]))
+
+    rng = np.random.default_rng(0)
+    for start, stop in zip(boundaries[:-1], boundaries[1:]):
+        gap = stop - start
+        active = min(gap, config.idle_timeout_ms)
+        idle = min(gap, config.deep_idle_timeout_ms) - active
+        deep = gap - active - idle
+        report.state_ms["active"] += active
+        report.state_ms["idle"] += idle
+        report.state_ms["deep_idle"] += deep
+
+        if stop < duration_ms:
+            # State the input arrives in decides its latency
+            state = "deep_idle" if deep > 0 else "idle" if idle > 0 else "active"
+            if state == "active":
+                latency = rng.uniform(0, config.active_poll_ms)
+                if light_sleep_allowed(config) and config.active_poll_ms + config.light_sleep_wake_ms <= config.latency_budget_ms:
+                    latency += config.light_sleep_wake_ms
+            else:
+                # Level interrupt wakes every poller, out of light sleep when there is any
+                latency = config.light_sleep_wake_ms if light_sleep_allowed(config) else 0.0
+            report.latencies_ms.append(latency)
+
+    charge = sum(ms * state_current(config, model, state) for state, ms in report.state_ms.items())
+    report.average_ma = charge / duration_ms if duration_ms else 0
+    return report
+
+
+# Input times of a recording made by espGraphing, taken from the firmware "GPIO event" log lines
+def load_recording_events(path: str) -> tuple[np.ndarray, float]:
+    from telemetryRecorder import LOG_STREAM, TelemetryRecording
+
+    recording = TelemetryRecording(path)
+    host = recording.column(LOG_STREAM, "host_ms")
+    lines = recording.lines(0, len(host))
+    events = [host[i] for i, line in enumerate(lines) if GPIO_EVENT.search(line)]
+    return np.asarray(events, dtype=float), float(host[-1]) if len(host) else 0.0
+
+
+# Plain trace, one input time in milliseconds per line
+def load_trace_events(path: str) -> tuple[np.ndarray, float]:
+    events = np.loadtxt(path, ndmin=1)
+    return events, float(events.max()) + 1 if len(events) else 0.0
+
+
+def print_report(report: PowerReport, config: PowerConfig, capacity_mah: float) -> None:
+    print(f"duration: {report.duration_ms / 1000 / 60:.1f} min, inputs: {len(report.latencies_ms)}")
+    for state, ms in report.state_ms.items():
+        share = 100 * ms / report.duration_ms if report.duration_ms else 0
+        print(f"    {state:10s} {share:5.1f}%")
+    if report.latencies_ms:
+        latencies = np.asarray(report.latencies_ms)
+        over = np.count_nonzero(latencies > config.latency_budget_ms)
+        print(f"latency: mean {latencies.mean():.1f} ms, max {latencies.max():.1f} ms, over budget: {over}")
+    print(f"average current: {report.average_ma:.1f} mA, {capacity_mah:.0f} mAh lasts {report.battery_hours(capacity_mah):.1f} h")
+
+
+if __name__ == "__main__":
+
+    capacity_mah = 1000
+    config = PowerConfig()
+    model = CurrentModel()
+
+    if len(sys.argv) > 1:
+        path = sys.argv[1]
+        events, duration_ms = load_recording_events(path) if os.path.isdir(path) else load_trace_events(path)
+    else:
+        # Synthetic match: bursts of play with pauses between rounds
+        rng = np.random.default_rng(1)
+        events, t = [], 0.0
+        while t < 60 * 60 * 1000:
+            burst = rng.integers(20, 200)
+            events.extend(t + np.cumsum(rng.exponential(300, burst)))
+            t = events[-1] + rng.exponential(90 * 1000)
+        events, duration_ms = np.asarray(events), t
+
+    for station_mode in (False, True):
+        config.station_mode = station_mode
+        print(f"--- {'station, wake windows and light sleep' if station_mode else 'access point, radio on, no light sleep'}")
+        print_report(simulate(events, duration_ms, config, model), config, capacity_mah)
@@ -0,0 +1,179 @@
+import os
+import queue
+import threading
+import time
+from dataclasses import dataclass, field
+from typing import Optional
+
+import serial
+
+from telemetryDecoder import RECORD_FORMATS, TelemetryDecoder, TelemetryRecord, encode_frame
+
+
+@dataclass
+class PipelineStats:
+    bytes_read: int = 0
+    chunks_dropped: int = 0
+    batches_dropped: int = 0
+    lines: int = 0
+    records: int = 0
+    raw_backlog: int = 0
+    ui_backlog: int = 0
+
+
+@dataclass
+class PipelineBatch:
+    lines: list[str] = field(default_factory=list)
+    records: list[TelemetryRecord] = field(default_factory=list)
+
+
+# Reader stage drains the port in bulk, parser stage decodes and batches,
+# the consumer (usually the Tk main loop) pulls batches with `get_batches`
+class SerialPipeline:
+    def __init__(
+        self,
+        raw_depth: int = 256,
+        ui_depth: int = 64,
+        read_timeout: float = 0.05,
+    ) -> None:
+        self.serial_port: Optional[serial.Serial] = None
+        self.read_timeout = read_timeout
+        self.decoder = TelemetryDecoder()
+        self.stats = PipelineStats()
+        self.recorder = None  # anything with `write_batch(PipelineBatch)`, fed before the UI may drop
+
+        self.raw_queue: queue.Queue[bytes] = queue.Queue(maxsize=raw_depth)
+        self.ui_queue: queue.Queue[PipelineBatch] = queue.Queue(maxsize=ui_depth)
+        self.messages: queue.Queue[str] = queue.Queue()
+
+        self.killed = False
+        self.reader_thread = threading.Thread(target=self.read_from_port, daemon=True)
+        self.parser_thread = threading.Thread(target=self.parse_chunks, daemon=True)
+        self.reader_thread.start()
+        self.parser_thread.start()
+
+    def open(self, port: serial.Serial) -> None:
+        self.decoder.reset()
+        self.serial_port = port
+
+    def close(self) -> None:
+        port, self.serial_port = self.serial_port, None
+        if port and port.is_open:
+            port.close()
+
+    def stop(self) -> None:
+        self.killed = True
+        self.close()
+        self.reader_thread.join()
+        self.parser_thread.join()
+
+    # Reader stage, never blocks on the consumers, drops the chunk when the parser falls behind
+    def read_from_port(self) -> None:
+        while not self.killed:
+            port = self.serial_port
+            if not (port and port.is_open):
+                time.sleep(self.read_timeout)
+                continue
+            try:
+                data = port.read(port.in_waiting or 1)
+            except (serial.SerialException, TypeError, OSError) as err:
+                self.close()
+                self.messages.put(f"Could not read port [{port.port}]: {err}")
+                continue
+            if not data:
+                continue
+            self.stats.bytes_read += len(data)
+            try:
+                self.raw_queue.put_nowait(data)
+            except queue.Full:
+                self.stats.chunks_dropped += 1
+
+    # Parser stage, folds everything that is queued into one batch per wakeup
+    def parse_chunks(self) -> None:
+        while not self.killed:
+            try:
+                chunks = [self.raw_queue.get(timeout=self.read_timeout)]
+            except queue.Empty:
+                continue
+            while True:
+                try:
+                    chunks.append(self.raw_queue.get_nowait())
+                except queue.Empty:
+                    break
+
+            batch = PipelineBatch()
+            for item in self.decoder.feed(b"".join(chunks)):
+                if isinstance(item, TelemetryRecord):
+                    batch.records.append(item)
+                else:
+                    batch.lines.append(item)
+            self.stats.lines += len(batch.lines)
+            self.stats.records += len(batch.records)
+            if self.recorder:
+                self.recorder.write_batch(batch)
+
+            try:
+                self.ui_queue.put_nowait(batch)
+            except queue.Full:
+                self.stats.batches_dropped += 1
+
+    # Consumer stage, returns at most `limit` batches without blocking
+    def get_batches(self, limit: int = 16) -> list[PipelineBatch]:
+        batches: list[PipelineBatch] = []
+        while len(batches) < limit:
+            try:
+                batches.append(self.ui_queue.get_nowait())
+            except queue.Empty:
+                break
+        self.stats.raw_backlog = self.raw_queue.qsize()
+        self.stats.ui_backlog = self.ui_queue.qsize()
+        return batches
+
+    # Errors raised in the background threads, for the consumer to report
+    def get_messages(self) -> list[str]:
+        messages: list[str] = []
+        while not self.messages.empty():
+            messages.append(self.messages.get_nowait())
+        return messages
+
+
+if __name__ == "__main__":
+
+    # Benchmark: push a synthetic log + telemetry stream through a pty as fast as possible
+    seconds = 5
+    master, slave = os.openpty()
+    pipeline = SerialPipeline()
+    pipeline.open(serial.Serial(os.ttyname(slave), timeout=pipeline.read_timeout))
+
+    name, layout, names = RECORD_FORMATS[0]
+    line = b"\x1b[0;32mI (12345) app_main: Lcnt:   123, Rcnt:   456 | Lspd: 1.234, Rspd: 2.345\x1b[0m\r\n"
+    sent = {"lines": 0, "records": 0}
+
+    def writer() -> None:
+        end = time.monotonic() + seconds
+        t = 0
+        while time.monotonic() < end:
+            block = bytearray()
+            for _ in range(32):
+                block += line
+                block += encode_frame(0, t, layout.pack(t, 0, 1, 2, 3, t, 0, 1, 2, 3, 4, 5)).replace(b"\n", b"\r\n")
+                t += 1
+            os.write(master, bytes(block))
+            sent["lines"] += 32
+            sent["records"] += 32
+
+    writer_thread = threading.Thread(target=writer)
+    start = time.monotonic()
+    writer_thread.start()
+
+    consumed = 0
+    while writer_thread.is_alive() or pipeline.ui_queue.qsize() or pipeline.raw_queue.qsize():
+        consumed += len(pipeline.get_batches())
+        time.sleep(0.016)
+    elapsed = time.monotonic() - start
+    pipeline.stop()
+
+    stats = pipeline.stats
+    print(f"{stats.bytes_read / elapsed / 1024:.0f} kB/s, {stats.lines / elapsed:.0f} lines/s, {stats.records / elapsed:.0f} records/s")
+    print(f"sent {sent['lines']} lines / {sent['records']} records, parsed {stats.lines} / {stats.records}")
+    print(f"dropped {stats.chunks_dropped} chunks, {stats.batches_dropped} batches, bad frames {pipeline.decoder.bad_frames}, {consumed} batches consumed")
@@ -0,0 +1,147 @@
+import sys
+from dataclasses import dataclass, field
+
+import numpy as np
+
+# Host side model of the joystick to servo setpoint stream, main/setpoint_stream.c
+# and main/servo_stream.c. The remote samples and sends a setpoint every period of
+# its own clock, the car applies the newest one at each servo frame of its clock.
+# Measures setpoint to actuation latency and its jitter, with and without the
+# receiver locking its frame phase to the arrivals.
+
+
+@dataclass
+class StreamConfig:
+    # Same defaults as servo_stream.h
+    frame_us: int = 20000
+    rate_multiplier: int = 1  # Setpoints per servo frame
+    lead_us: int = 5000  # SERVO_STREAM_LEAD_US
+    max_step_us: int = 500  # SERVO_STREAM_MAX_STEP_US
+    min_samples: int = 8  # SETPOINT_PHASE_MIN_SAMPLES
+    average_shift: int = 3  # SETPOINT_PHASE_AVERAGE_SHIFT
+    phase_lock: bool = True
+
+
+@dataclass
+class LinkModel:
+    clock_skew_ppm: float = 150  # Remote clock against the car clock, both crystals at their tolerance
+    latency_us: float = 1500  # Sampling, ESP-NOW air time and delivery to the handler
+    jitter_us: float = 1500  # Mean of the exponential extra delay
+    late_probability: float = 0.02  # Retries and channel busy periods
+    late_us: float = 12000
+    loss_probability: float = 0.01
+
+
+@dataclass
+class StreamReport:
+    latencies_us: np.ndarray = field(default_factory=lambda: np.zeros(0))
+    frames: int = 0
+    repeated: int = 0  # Frames without a new setpoint, the servo holds the last one
+    superseded: int = 0  # Setpoints replaced by a newer one before their frame
+    late: int = 0  # Arrived after a newer one, dropped
+    lost: int = 0
+
+
+# Mirror of setpoint_phase_t, integer math kept the same as the firmware
+class PhaseTracker:
+    def __init__(self, config: StreamConfig):
+        self.period = config.frame_us // config.rate_multiplier
+        self.lead = config.lead_us if config.lead_us < self.period else self.period // 2
+        self.max_step = config.max_step_us
+        self.min_samples = config.min_samples
+        self.shift = config.average_shift
+        self.error_q4 = 0
+        self.samples = 0
+
+    def arrival(self, arrival_us: int, frame_us: int) -> None:
+        offset = (arrival_us - frame_us) % self.period
+        error = offset - (self.period - self.lead)
+        if error >= self.period // 2:
+            error -= self.period
+        elif error < -(self.period // 2):
+            error += self.period
+        if self.samples == 0:
+            self.error_q4 = error * 16
+        else:
+            self.error_q4 += (error * 16 - self.error_q4) >> self.shift
+        self.samples += 1
+
+    def correction(self) -> int:
+        if self.samples < self.min_samples:
+            return 0
+        correction = int(self.error_q4 / 16)  # C division truncates toward zero
+        correction = max(-self.max_step, min(self.max_step, correction))
+        self.error_q4 -= correction * 16
+        return correction
+
+
+def simulate(duration_s: float, config: StreamConfig, link: LinkModel, seed: int = 0) -> StreamReport:
+    rng = np.random.default_rng(seed)
+    send_period = config.frame_us / config.rate_multiplier * (1 + link.clock_skew_ppm * 1e-6)
+    count = int(duration_s * 1e6 / send_period)
+
+    sent_us = np.arange(count) * send_period
+    delay = link.latency_us + rng.exponential(link.jitter_us, count)
+    delay += np.where(rng.random(count) < link.late_probability, link.late_us, 0)
+    arrival_us = sent_us + delay
+    delivered = rng.random(count) >= link.loss_probability
+    order = np.argsort(arrival_us, kind="stable")
+
+    report = StreamReport(lost=int(count - np.count_nonzero(delivered)))
+    tracker = PhaseTracker(config)
+    latencies = []
+    frame_us = float(rng.uniform(0, config.frame_us))  # Car boots at an arbitrary phase
+    last_frame_us = frame_us - config.frame_us
+    newest_seq, pending = -1, None
+    i = 0
+    while frame_us < sent_us[-1]:
+        while i < count and arrival_us[order[i]] <= frame_us:
+            seq = order[i]
+            i += 1
+            if not delivered[seq]:
+                continue
+            if seq <= newest_seq:
+                report.late += 1
+                continue
+            newest_seq = seq
+            if config.phase_lock:
+                tracker.arrival(int(arrival_us[seq]), int(last_frame_us))
+            if pending is not None:
+                report.superseded += 1
+            pending = seq
+
+        report.frames += 1
+        if pending is None:
+            report.repeated += 1
+        else:
+            latencies.append(frame_us - sent_us[pending])
+            pending = None
+        last_frame_us = frame_us
+        frame_us += config.frame_us + (tracker.correction() if config.phase_lock else 0)
+
+    # Leave out the first seconds while the lock pulls in
+    report.latencies_us = np.asarray(latencies[int(2e6 / config.frame_us):])
+    return report
+
+
+def print_report(report: StreamReport) -> None:
+    latencies = report.latencies_us / 1000
+    print(
+        f"latency: mean {latencies.mean():.2f} ms, jitter (std) {latencies.std():.2f} ms, "
+        f"p99 {np.percentile(latencies, 99):.2f} ms, max {latencies.max():.2f} ms"
+    )
+    print(
+        f"frames: {report.frames}, repeated: {report.repeated}, superseded: {report.superseded}, "
+        f"late dropped: {report.late}, lost: {report.lost}"
+    )
+
+
+if __name__ == "__main__":
+
+    duration_s = float(sys.argv[1]) if len(sys.argv) > 1 else 600
+    link = LinkModel()
+    for rate_multiplier in (1, 2):
+        for phase_lock in (False, True):
+            config = StreamConfig(rate_multiplier=rate_multiplier, phase_lock=phase_lock)
+            print(f"--- {50 * rate_multiplier} Hz setpoints, {'phase locked' if phase_lock else 'free running'} frames")
+            print_report(simulate(duration_s, config, link))
@@ -0,0 +1,213 @@
+import binascii
+import struct
+from dataclasses import dataclass
+from typing import Optional, Union
+
+from motorStatCodec import MotorStatDecoder
+
+# Must match `main/telemetry_frame.h`
+FRAME_DELIMITER = 0x00
+HEADER = struct.Struct("<BBI")  # type, len, time_ms
+CRC = struct.Struct("<H")
+
+# Must match `telemetry_record_type_t`, field names are used as plot keys
+RECORD_FORMATS: dict[int, tuple[str, struct.Struct, tuple[str, ...]]] = {
+    0: (
+        "motor_stat",
+        struct.Struct("<i4fi4f2f"),
+        (
+            "lcnt", "lset", "lspd", "lacc", "lpwm",
+            "rcnt", "rset", "rspd", "racc", "rpwm",
+            "delta_distance", "delta_velocity",
+        ),
+    ),
+    1: (
+        "task_stat",
+        struct.Struct("<10H"),  # CPU load per-mille, `task_stat_record_t`
+        (
+            "idle0", "idle1", "wifi", "esp_timer",
+            "button_task", "joystick_task", "rssi_task", "tx_task", "app_task", "task_stats",
+        ),
+    ),
+    2: (
+        "watermark",
+        struct.Struct("<" + "2H4I" * 4 + "6H"),  # `watermark_record_t`, counters since boot
+        tuple(
+            f"{queue}_{field}"
+            for queue in ("espnow", "rssi", "button", "joystick")
+            for field in ("capacity", "peak", "sent", "dropped", "latency_avg_us", "latency_max_us")
+        )
+        + tuple(f"{task}_stack" for task in ("button_task", "joystick_task", "rssi_task", "tx_task", "app_task", "task_stats")),
+    ),
+    4: (
+        "link_bench",
+        struct.Struct("<2B2H5I7I"),  # `link_bench_record_t`, one run of a benchmark sweep
+        (
+            "phy_rate", "channel", "payload_len", "rate_hz",
+            "sent", "received", "lost", "late", "duplicates",
+            "min_us", "p50_us", "p90_us", "p99_us", "p999_us", "max_us", "mean_us",
+        ),
+    ),
+    5: (
+        "link_throughput",
+        struct.Struct("<BBHBB2HI8I"),  # `link_throughput_record_t`, one setting of a throughput sweep
+        (
+            "phy_rate", "channel", "payload_len", "window", "limit", "cpu0_permille", "cpu1_permille", "elapsed_us",
+            "offered", "accepted", "no_buffer", "queue_full", "submit_error", "completed_ok", "completed_fail", "ring_dropped",
+        ),
+    ),
+}
+
+
+# `TELEMETRY_RECORD_MOTOR_STAT_DELTA`, a motor_stat_codec frame, decoded into a motor_stat record
+MOTOR_STAT_DELTA = 3
+
+
+@dataclass
+class TelemetryRecord:
+    type: int
+    name: str
+    time_ms: int
+    fields: dict[str, float]
+
+
+def cobs_decode(data: bytes) -> bytes:
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        code = data[pos]
+        if code == 0 or pos + code > len(data):
+            raise ValueError("bad COBS block")
+        out += data[pos + 1 : pos + code]
+        pos += code
+        if code != 0xFF and pos < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def cobs_encode(data: bytes) -> bytes:
+    out = bytearray([0])
+    code_pos, code = 0, 1
+    for byte in data:
+        if byte:
+            out.append(byte)
+            code += 1
+        if not byte or code == 0xFF:
+            out[code_pos] = code
+            code_pos, code = len(out), 1
+            out.append(0)
+    out[code_pos] = code
+    return bytes(out)
+
+
+def encode_frame(type: int, time_ms: int, payload: bytes) -> bytes:
+    raw = HEADER.pack(type, len(payload), time_ms & 0xFFFFFFFF) + payload
+    raw += CRC.pack(binascii.crc_hqx(raw, 0xFFFF))
+    return bytes([FRAME_DELIMITER]) + cobs_encode(raw) + bytes([FRAME_DELIMITER])
+
+
+def decode_frame(raw: bytes) -> tuple[int, int, bytes]:
+    if len(raw) < HEADER.size + CRC.size:
+        raise ValueError("frame too short")
+    (crc,) = CRC.unpack_from(raw, len(raw) - CRC.size)
+    if binascii.crc_hqx(raw[: -CRC.size], 0xFFFF) != crc:
+        raise ValueError("frame CRC error")
+    type, length, time_ms = HEADER.unpack_from(raw)
+    payload = raw[HEADER.size : -CRC.size]
+    if length != len(payload):
+        raise ValueError("frame length mismatch")
+    return type, time_ms, payload
+
+
+def decode_record(raw: bytes) -> TelemetryRecord:
+    type, time_ms, payload = decode_frame(raw)
+    length = len(payload)
+    if type not in RECORD_FORMATS:
+        return TelemetryRecord(type, f"unknown_{type}", time_ms, {})
+    name, layout, names = RECORD_FORMATS[type]
+    if layout.size != length:
+        raise ValueError(f"{name} payload size {length} != {layout.size}")
+    return TelemetryRecord(type, name, time_ms, dict(zip(names, layout.unpack(payload))))
+
+
+# Splits a serial byte stream into text lines and telemetry records
+class TelemetryDecoder:
+    def __init__(self, crlf: bool = True) -> None:
+        # Firmware stdout translates "\n" into "\r\n" (CONFIG_NEWLIB_STDOUT_LINE_ENDING_CRLF),
+        # which also hits the binary frames, undo that before decoding
+        self.crlf = crlf
+        self.text = bytearray()
+        self.frame = bytearray()
+        self.in_frame = False
+        self.bad_frames = 0
+        self.motor_stat = MotorStatDecoder()
+
+    def reset(self) -> None:
+        self.text.clear()
+        self.frame.clear()
+        self.in_frame = False
+        self.motor_stat.reset()
+
+    # Returns decoded items in stream order, either `str` lines or `TelemetryRecord`
+    def feed(self, data: bytes) -> list[Union[str, TelemetryRecord]]:
+        items: list[Union[str, TelemetryRecord]] = []
+        pos = 0
+        while pos < len(data):
+            delimiter = data.find(FRAME_DELIMITER, pos)
+            end = len(data) if delimiter < 0 else delimiter
+
+            if self.in_frame:
+                self.frame += data[pos:end]
+            else:
+                self.text += data[pos:end]
+                self._split_lines(items)
+
+            if delimiter < 0:
+                break
+            pos = delimiter + 1
+
+            if not self.in_frame:
+                self.in_frame = True
+            elif self.frame:
+                # On a bad frame we were most likely out of phase (joined mid-frame),
+                # treat this delimiter as the opening of the next frame
+                self.in_frame = not self._finish_frame(items)
+            # An empty frame is a closing delimiter directly followed by an opening one
+
+        return items
+
+    def _split_lines(self, items: list) -> None:
+        start = 0
+        while (newline := self.text.find(b"\n", start)) >= 0:
+            items.append(self.text[start : newline + 1].decode("utf-8", errors="replace"))
+            start = newline + 1
+        del self.text[:start]
+
+    def _finish_frame(self, items: list) -> bool:
+        received = bytes(self.frame)
+        self.frame.clear()
+        frame = received.replace(b"\r\n", b"\n") if self.crlf else received
+        try:
+            raw = cobs_decode(frame)
+            if raw[:1] == bytes([MOTOR_STAT_DELTA]):
+                record = self._decode_motor_stat_delta(raw)
+                if record is not None:
+                    items.append(record)
+                return True
+            items.append(decode_record(raw))
+            return True
+        except ValueError:
+            # Out of phase what looked like a frame was the text between two frames, show it rather than lose the lines
+            self.bad_frames += 1
+            self.text += received
+            self._split_lines(items)
+            return False
+
+    # Deltas lost with a frame are skipped until the next keyframe, the record looks like a raw motor_stat
+    def _decode_motor_stat_delta(self, raw: bytes) -> Optional[TelemetryRecord]:
+        _, time_ms, payload = decode_frame(raw)
+        values = self.motor_stat.decode(payload)
+        if values is None:
+            return None
+        name, _, names = RECORD_FORMATS[0]
+        return TelemetryRecord(0, name, time_ms, dict(zip(names, values)))
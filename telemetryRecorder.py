@@ -0,0 +1,243 @@
+import json
+import os
+import tempfile
+import threading
+import time
+from typing import Optional
+
+import numpy as np
+
+from serialPipeline import PipelineBatch
+from telemetryDecoder import RECORD_FORMATS, TelemetryRecord
+
+# Recording layout, every column is an append-only raw little endian file:
+#
+#     <recording>/meta.json                  streams and their fields
+#     <recording>/<stream>/host_ms.i8        host receive time since start of recording
+#     <recording>/<stream>/time_ms.i8        device timestamp
+#     <recording>/<stream>/<field>.f8        one file per record field
+#     <recording>/<stream>/index.i8          (host_ms, row) pairs, one per chunk
+#     <recording>/log/host_ms.i8, offset.i8  line start offsets into log.txt
+
+LOG_STREAM = "log"
+
+
+class ColumnWriter:
+    def __init__(self, path: str, columns: dict[str, str], chunk_size: int) -> None:
+        os.makedirs(path, exist_ok=True)
+        self.path = path
+        self.columns = columns
+        self.chunk_size = chunk_size
+        self.buffers: dict[str, list] = {name: [] for name in columns}
+        self.rows = 0
+        self.index = open(os.path.join(path, "index.i8"), "ab")
+        self.files = {name: open(os.path.join(path, f"{name}.{dtype}"), "ab") for name, dtype in columns.items()}
+
+    def append(self, **values) -> None:
+        if self.rows % self.chunk_size == 0:
+            self.index.write(np.array([values["host_ms"], self.rows], dtype="<i8").tobytes())
+        for name, buffer in self.buffers.items():
+            buffer.append(values.get(name, np.nan))
+        self.rows += 1
+        if len(self.buffers["host_ms"]) >= self.chunk_size:
+            self.flush()
+
+    def flush(self) -> None:
+        for name, buffer in self.buffers.items():
+            if buffer:
+                self.files[name].write(np.asarray(buffer, dtype="<" + self.columns[name]).tobytes())
+                self.files[name].flush()
+                buffer.clear()
+        self.index.flush()
+
+    def close(self) -> None:
+        self.flush()
+        self.index.close()
+        for file in self.files.values():
+            file.close()
+
+
+# Appends every decoded record and log line of a session
+class TelemetryRecorder:
+    def __init__(self, path: str, chunk_size: int = 4096) -> None:
+        os.makedirs(path, exist_ok=True)
+        self.path = path
+        self.chunk_size = chunk_size
+        self.start = time.monotonic()
+        self.lock = threading.Lock()
+        self.streams: dict[str, ColumnWriter] = {}
+
+        streams = {name: {"fields": list(fields)} for name, _, fields in RECORD_FORMATS.values()}
+        with open(os.path.join(path, "meta.json"), "w") as meta:
+            json.dump({"version": 1, "chunk_size": chunk_size, "streams": streams}, meta, indent=2)
+
+        self.log = ColumnWriter(os.path.join(path, LOG_STREAM), {"host_ms": "i8", "offset": "i8"}, chunk_size)
+        self.log_file = open(os.path.join(path, LOG_STREAM, "log.txt"), "ab")
+        self.log_offset = self.log_file.tell()
+
+    def now_ms(self) -> int:
+        return int((time.monotonic() - self.start) * 1000)
+
+    def write_record(self, record: TelemetryRecord, host_ms: int) -> None:
+        if record.name not in self.streams:
+            columns = {"host_ms": "i8", "time_ms": "i8"} | {field: "f8" for field in record.fields}
+            self.streams[record.name] = ColumnWriter(os.path.join(self.path, record.name), columns, self.chunk_size)
+        self.streams[record.name].append(host_ms=host_ms, time_ms=record.time_ms, **record.fields)
+
+    def write_line(self, line: str, host_ms: int) -> None:
+        data = line.encode("utf-8")
+        self.log_file.write(data)
+        self.log.append(host_ms=host_ms, offset=self.log_offset)
+        self.log_offset += len(data)
+
+    def write_batch(self, batch: PipelineBatch) -> None:
+        host_ms = self.now_ms()
+        with self.lock:
+            for record in batch.records:
+                self.write_record(record, host_ms)
+            for line in batch.lines:
+                self.write_line(line, host_ms)
+
+    def close(self) -> None:
+        with self.lock:
+            for stream in self.streams.values():
+                stream.close()
+            self.log.close()
+            self.log_file.close()
+
+
+# Read side, columns are memory mapped so multi-hour sessions open instantly
+class TelemetryRecording:
+    def __init__(self, path: str) -> None:
+        self.path = path
+        self.cache: dict[tuple[str, str], np.ndarray] = {}
+        with open(os.path.join(path, "meta.json")) as meta:
+            self.meta = json.load(meta)
+        self.streams = [
+            name for name in self.meta["streams"] if os.path.exists(os.path.join(path, name, "host_ms.i8"))
+        ]
+
+    def column(self, stream: str, name: str) -> np.ndarray:
+        if (stream, name) not in self.cache:
+            dtype = "<i8" if name in ("host_ms", "time_ms", "offset") else "<f8"
+            file = os.path.join(self.path, stream, f"{name}.{dtype[-2:]}")
+            if os.path.getsize(file):
+                self.cache[(stream, name)] = np.memmap(file, dtype=dtype, mode="r")
+            else:
+                self.cache[(stream, name)] = np.zeros(0, dtype=dtype)
+        return self.cache[(stream, name)]
+
+    def fields(self, stream: str) -> list[str]:
+        return self.meta["streams"][stream]["fields"]
+
+    # Rows [start, stop) whose `key` time is within [t0, t1), the chunk index narrows the search
+    def rows(self, stream: str, t0: float, t1: float, key: str = "host_ms") -> tuple[int, int]:
+        times = self.column(stream, key)
+        lo, hi = 0, len(times)
+        if key == "host_ms":
+            index = np.fromfile(os.path.join(self.path, stream, "index.i8"), dtype="<i8").reshape(-1, 2)
+            first = np.searchsorted(index[:, 0], t0, side="right") - 1
+            last = np.searchsorted(index[:, 0], t1, side="right")
+            lo = int(index[first, 1]) if first >= 0 else 0
+            hi = int(index[last, 1]) if last < len(index) else hi
+        window = times[lo:hi]
+        return lo + int(np.searchsorted(window, t0)), lo + int(np.searchsorted(window, t1))
+
+    # Min/max decimation into at most `points` samples, keeps spikes visible when zoomed out
+    def decimate(self, stream: str, field: str, t0: float, t1: float, points: int = 2000, key: str = "time_ms"):
+        start, stop = self.rows(stream, t0, t1, key)
+        times = np.asarray(self.column(stream, key)[start:stop], dtype=float)
+        data = np.asarray(self.column(stream, field)[start:stop])
+        buckets = points // 2
+        if len(times) <= points or buckets == 0:
+            return times, data
+        size = len(times) // buckets
+        usable = size * buckets
+        shaped = data[:usable].reshape(buckets, size)
+        lo, hi = shaped.argmin(axis=1), shaped.argmax(axis=1)
+        base = np.arange(buckets) * size
+        order = np.sort(np.stack((base + lo, base + hi), axis=1), axis=1).ravel()
+        return times[order], data[order]
+
+    def lines(self, start: int, stop: int) -> list[str]:
+        offsets = self.column(LOG_STREAM, "offset")
+        if start >= stop:
+            return []
+        with open(os.path.join(self.path, LOG_STREAM, "log.txt"), "rb") as log:
+            log.seek(offsets[start])
+            end = offsets[stop] if stop < len(offsets) else None
+            data = log.read() if end is None else log.read(end - offsets[start])
+        return data.decode("utf-8", errors="replace").splitlines(keepends=True)
+
+
+# Streams a recording back as pipeline batches, paced by the recorded host time
+class TelemetryReplayer:
+    def __init__(self, recording: TelemetryRecording, speed: float = 1.0) -> None:
+        self.recording = recording
+        self.speed = speed
+        self.start = time.monotonic()
+        self.cursor = {stream: 0 for stream in recording.streams + [LOG_STREAM]}
+        self.type_of = {name: type for type, (name, _, _) in RECORD_FORMATS.items()}
+
+    def position_ms(self) -> float:
+        return (time.monotonic() - self.start) * 1000 * self.speed
+
+    def finished(self) -> bool:
+        return all(
+            self.cursor[stream] >= len(self.recording.column(stream, "host_ms")) for stream in self.cursor
+        )
+
+    # Same contract as `SerialPipeline.get_batches`
+    def get_batches(self, limit: int = 16, until_ms: Optional[float] = None) -> list[PipelineBatch]:
+        until_ms = self.position_ms() if until_ms is None else until_ms
+        batch = PipelineBatch()
+
+        start = self.cursor[LOG_STREAM]
+        stop = start + int(np.searchsorted(self.recording.column(LOG_STREAM, "host_ms")[start:], until_ms, side="right"))
+        batch.lines = self.recording.lines(start, stop)
+        self.cursor[LOG_STREAM] = stop
+
+        for stream in self.recording.streams:
+            start = self.cursor[stream]
+            host = self.recording.column(stream, "host_ms")
+            stop = start + int(np.searchsorted(host[start:], until_ms, side="right"))
+            if stop == start:
+                continue
+            times = self.recording.column(stream, "time_ms")[start:stop]
+            fields = self.recording.fields(stream)
+            columns = [self.recording.column(stream, field)[start:stop] for field in fields]
+            for row in range(stop - start):
+                values = {field: float(column[row]) for field, column in zip(fields, columns)}
+                batch.records.append(TelemetryRecord(self.type_of.get(stream, -1), stream, int(times[row]), values))
+            self.cursor[stream] = stop
+        return [batch] if batch.lines or batch.records else []
+
+
+if __name__ == "__main__":
+
+    # Self check: record a synthetic stream, then replay it at 100x and compare
+    name, layout, fields = RECORD_FORMATS[0]
+    with tempfile.TemporaryDirectory() as path:
+        recorder = TelemetryRecorder(path, chunk_size=256)
+        samples = 20000
+        for i in range(samples):
+            values = dict(zip(fields, (i, 0, np.sin(i / 100), 0, 0, i, 0, np.cos(i / 100), 0, 0, i / 10, 0)))
+            recorder.write_record(TelemetryRecord(0, name, i * 10, values), host_ms=i * 10)
+            if i % 10 == 0:
+                recorder.write_line(f"I ({i * 10}) app_main: sample {i}\n", host_ms=i * 10)
+        recorder.close()
+
+        recording = TelemetryRecording(path)
+        print("rows in [50 s, 60 s):", recording.rows(name, 50000, 60000))
+        times, data = recording.decimate(name, "lspd", 0, samples * 10, points=500)
+        print(f"decimated {samples} samples to {len(times)}, range {data.min():.3f}..{data.max():.3f}")
+
+        replayer = TelemetryReplayer(recording, speed=100)
+        records = lines = 0
+        while not replayer.finished():
+            for batch in replayer.get_batches():
+                records += len(batch.records)
+                lines += len(batch.lines)
+            time.sleep(0.01)
+        print(f"replayed {records}/{samples} records and {lines}/{samples // 10} lines")
+        assert records == samples and lines == samples // 10
@@ -29,17 +29,85 @@ ansi_colors_light = [
     "light cyan",
     "white",
 ]
+for i, (col_dark, col_light) in enumerate(zip(ansi_colors_dark, ansi_colors_light)):
+    ansi_color_fg[30 + i] = "foreground " + col_dark
+    ansi_color_fg[90 + i] = "foreground " + col_light
+    ansi_color_bg[40 + i] = "background " + col_dark
+    ansi_color_bg[100 + i] = "background " + col_light
 
 # regular expression to find ansi codes in string
 ansi_regexp = re.compile(r"\x1b\[((\d+;)*\d+)m")
 ansi_escape = re.compile(r"\x1B(?:[@-Z\\-_]|\[[0-?]*[ -/]*[@-~])")
 
+# longest escape sequence we hold back when a chunk ends in the middle of one
+ansi_max_pending = 32
+
+
+# Incremental SGR parser, keeps the open tags and any partial escape sequence across chunks
+class AnsiParser:
+    def __init__(self) -> None:
+        self.pending = ""
+        self.foreground = ""
+        self.background = ""
+        self.fonts: set[str] = set()
+        self.tags: tuple[str, ...] = ()
+
+    def reset(self) -> None:
+        self.__init__()
+
+    def apply(self, code: int) -> None:
+        if code == 0:  # reset all
+            self.foreground = self.background = ""
+            self.fonts.clear()
+        elif code in ansi_font_format:
+            self.fonts.add(ansi_font_format[code])
+        elif code in ansi_font_reset:
+            self.fonts.discard(ansi_font_reset[code])
+        elif code in ansi_color_fg:
+            self.foreground = ansi_color_fg[code]
+        elif code in ansi_color_bg:
+            self.background = ansi_color_bg[code]
+        self.tags = tuple(
+            tag for tag in (self.foreground, self.background, *sorted(self.fonts)) if tag
+        )
+
+    # Splits text into (run, tags) pairs, consecutive characters with the same tags form one run
+    def feed(self, txt: str) -> list[tuple[str, tuple[str, ...]]]:
+        txt = self.pending + txt
+        self.pending = ""
+        runs: list[tuple[str, tuple[str, ...]]] = []
+        pos = 0
+        while True:
+            esc = txt.find("\x1b", pos)
+            if esc < 0:
+                if pos < len(txt):
+                    runs.append((txt[pos:], self.tags))
+                return runs
+            if esc > pos:
+                runs.append((txt[pos:esc], self.tags))
+
+            match = ansi_escape.match(txt, esc)
+            if match is None:
+                # sequence is cut by the chunk boundary, keep it for the next feed
+                if len(txt) - esc < ansi_max_pending:
+                    self.pending = txt[esc:]
+                    return runs
+                pos = esc + 1
+                continue
+
+            sgr = ansi_regexp.fullmatch(match.group())
+            if sgr:
+                for code in sgr.group(1).split(";"):
+                    self.apply(int(code))
+            pos = match.end()
+
 
 class tkAnsiFormatter:
     def __init__(self, text: tk.Text, font: str = "Consolas", size: int = 9) -> None:
         self.text = text
         self.font = font
         self.size = size
+        self.parser = AnsiParser()
         self.configure_style()
 
     @staticmethod
@@ -55,92 +123,20 @@ class tkAnsiFormatter:
         self.text.tag_configure("foreground default", foreground=self.text["fg"])
         self.text.tag_configure("background default", background=self.text["bg"])
 
-        for i, (col_dark, col_light) in enumerate(
-            zip(ansi_colors_dark, ansi_colors_light)
-        ):
-            ansi_color_fg[30 + i] = "foreground " + col_dark
-            ansi_color_fg[90 + i] = "foreground " + col_light
-            ansi_color_bg[40 + i] = "background " + col_dark
-            ansi_color_bg[100 + i] = "background " + col_light
+        for col_dark, col_light in zip(ansi_colors_dark, ansi_colors_light):
             self.text.tag_configure("foreground " + col_dark, foreground=col_dark)
             self.text.tag_configure("background " + col_dark, background=col_dark)
             self.text.tag_configure("foreground " + col_light, foreground=col_light)
             self.text.tag_configure("background " + col_light, background=col_light)
 
+    # Inserts a chunk with one Tk call, formatting carries over to the next chunk
     def insert_ansi(self, txt: str, index: str = "insert") -> None:
-        first_line, first_char = map(int, str(self.text.index(index)).split("."))
-
-        if index == "end":
-            first_line -= 1
-
-        lines = txt.splitlines()
-        if not lines:
-            return
-
-        # insert text without ansi codes
-        self.text.insert(index, ansi_regexp.sub("", txt))
-
-        # find all ansi codes in txt and apply corresponding tags
-        opened_tags: dict[str, str] = {}
-
-        # text.tag_add(tag, start, end) when we reach a "closing" ansi code
-        def apply_formatting(code: int, code_index: str) -> None:
-            if code == 0:  # reset all by closing all opened tag
-                for tag, start in opened_tags.items():
-                    self.text.tag_add(tag, start, code_index)
-                opened_tags.clear()
-
-            elif code in ansi_font_format:  # open font formatting tag
-                tag = ansi_font_format[code]
-                opened_tags[tag] = code_index
-
-            elif code in ansi_font_reset:  # close font formatting tag
-                tag = ansi_font_reset[code]
-                if tag in opened_tags:
-                    self.text.tag_add(tag, opened_tags[tag], code_index)
-                    del opened_tags[tag]
-
-            elif (
-                code in ansi_color_fg
-            ):  # open foreground color tag (and close previously opened one if any)
-                for tag in tuple(opened_tags):
-                    if tag.startswith("foreground"):
-                        self.text.tag_add(tag, opened_tags[tag], code_index)
-                        del opened_tags[tag]
-                opened_tags[ansi_color_fg[code]] = code_index
-
-            elif (
-                code in ansi_color_bg
-            ):  # open background color tag (and close previously opened one if any)
-                for tag in tuple(opened_tags):
-                    if tag.startswith("background"):
-                        self.text.tag_add(tag, opened_tags[tag], code_index)
-                        del opened_tags[tag]
-                opened_tags[ansi_color_bg[code]] = code_index
-
-        def find_ansi(line_txt: str, line_nb: int, char_offset: int) -> None:
-            # difference between the character position in the original line and in the text widget
-            # (initial offset due to insertion position if first line + extra offset due to deletion of ansi codes)
-            delta = -char_offset
-
-            for match in ansi_regexp.finditer(line_txt):
-                codes = [int(c) for c in match.groups()[0].split(";")]
-                start, end = match.span()
-                for code in codes:
-                    apply_formatting(code, "{}.{}".format(line_nb, start - delta))
-
-                # take into account offset due to deletion of ansi code
-                delta += end - start
-
-        # first line, with initial offset due to insertion position
-        find_ansi(lines[0], first_line, first_char)
-
-        for line_nb, line in enumerate(lines[1:], first_line + 1):
-            find_ansi(line, line_nb, 0)  # next lines, no offset
-
-        # close still opened tag
-        for tag, start in opened_tags.items():
-            self.text.tag_add(tag, start, "end")
+        args: list = []
+        for run, tags in self.parser.feed(txt):
+            args.append(run)
+            args.append(tags)
+        if args:
+            self.text.insert(index, *args)
 
 
 if __name__ == "__main__":
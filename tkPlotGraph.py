@@ -1,8 +1,12 @@
 import queue
+import time
 from tkinter import Misc
+from typing import Optional
 
 import matplotlib
 import matplotlib.pyplot as plt
+import numpy as np
+from matplotlib.backends.backend_agg import FigureCanvasAgg
 from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg
 
 matplotlib.use("Agg")
@@ -11,36 +15,51 @@ matplotlib.use("Agg")
 class tkPlotGraph:
     def __init__(
         self,
-        root: Misc,
+        root: Optional[Misc],
         figsize: tuple[int, int] = (5, 4),
         dpi: int = 80,
         timespan: int = 5000,
         title: str = "Graph",
+        rate_hz: float = 1000,
     ) -> None:
 
-        # Create a figure and a canvas to draw on
+        # Create a figure and a canvas to draw on, no root gives a headless canvas
         self.figure = plt.figure(figsize=figsize, dpi=dpi)
         self.root = root
-        self.canvas = FigureCanvasTkAgg(self.figure, master=self.root)
+        if root is None:
+            self.canvas = FigureCanvasAgg(self.figure)
+        else:
+            self.canvas = FigureCanvasTkAgg(self.figure, master=self.root)
         self.timespan = timespan
         self.title = title
 
-        # Graph data
-        self.data = []
-        self.times = []
-        self.data_hash = hash(tuple(self.data))
+        # Graph data, a preallocated ring buffer sized for the timespan at `rate_hz` with some headroom, `head` is the
+        # next slot to write. Every sample is also written `capacity` further on, so the newest samples are always one
+        # contiguous slice and the line gets views instead of copies.
+        self.capacity = int(np.ceil(timespan * rate_hz / 1000 * 1.25)) + 1
+        self.data = np.zeros(2 * self.capacity)
+        self.times = np.zeros(2 * self.capacity)
+        self.head = 0
+        self.count = 0
+        self.dirty = False
         self.do_ylim = False
 
+        # Cached background for blitting, invalidated whenever the axes change
+        self.background = None
+        self.xlim = (0.0, 1.0)
+        self.ylim = (0.0, 1.0)
+        self.full_draws = 0
+        self.blit_draws = 0
+
         # Holding the draw command for main loop to update the UI
         self.draw_queue: queue.Queue[FigureCanvasTkAgg] = queue.Queue()
 
-        # Configure Axes object
+        # Configure Axes object, the line is animated so it is only ever drawn by blitting
         self.ax = self.figure.add_subplot(111)
         self.ax.set_title(self.title)
-        if self.do_ylim:
-            self.ax.set_ylim(self.low_ylim, self.high_ylim)
         self.ax.grid()
-        (self.line,) = self.ax.plot(self.times, self.data)
+        (self.line,) = self.ax.plot([], [], animated=True)
+        self.canvas.mpl_connect("draw_event", self.on_draw)
 
     # Partial function of tk.grid()
     def grid(self, row: int = 2, column: int = 0) -> None:
@@ -48,49 +67,103 @@ class tkPlotGraph:
 
     # Clears graph data
     def reset(self) -> None:
-        self.data.clear()
-        self.times.clear()
+        self.head = 0
+        self.count = 0
+        self.dirty = True
 
-    # Appends timestamp and data to the list, also clears old data
+    # Appends timestamp and data to the ring buffer, overwriting the oldest sample once it left the timespan
     def append(self, time, data) -> None:
-        self.data.append(data)
-        self.times.append(time)
-
-        # Remove data older than x milliseconds
-        while self.times and self.times[0] < time - self.timespan:
-            self.times.pop(0)
-            self.data.pop(0)
+        if self.count == self.capacity and self.times[self.head] >= time - self.timespan:
+            self.grow()
+        self.times[self.head] = self.times[self.head + self.capacity] = time
+        self.data[self.head] = self.data[self.head + self.capacity] = data
+        self.head = (self.head + 1) % self.capacity
+        self.count = min(self.count + 1, self.capacity)
+        self.dirty = True
+
+    # Doubles the ring buffer, samples come in faster than `rate_hz` and the oldest one is still on screen
+    def grow(self) -> None:
+        times, data = self.samples()
+        self.capacity *= 2
+        self.times = np.zeros(2 * self.capacity)
+        self.data = np.zeros(2 * self.capacity)
+        self.times[: self.count] = self.times[self.capacity : self.capacity + self.count] = times
+        self.data[: self.count] = self.data[self.capacity : self.capacity + self.count] = data
+        self.head = self.count
+
+    # Returns views of all samples in order, oldest first
+    def samples(self) -> tuple[np.ndarray, np.ndarray]:
+        end = self.head + self.capacity
+        return self.times[end - self.count : end], self.data[end - self.count : end]
+
+    # Returns views of the samples within the timespan
+    def window(self) -> tuple[np.ndarray, np.ndarray]:
+        times, data = self.samples()
+        if len(times):
+            start = np.searchsorted(times, times[-1] - self.timespan, side="left")
+            times, data = times[start:], data[start:]
+        return times, data
 
     # Set graph y-axis limit, default is automatic
     def set_ylim(self, low: float, high: float):
         self.do_ylim = True
         self.low_ylim = low
         self.high_ylim = high
+        self.ylim = (low, high)
+        self.ax.set_ylim(low, high)
+        self.background = None
+
+    # Canvas got redrawn (resize, first show), grab a fresh background
+    def on_draw(self, event) -> None:
+        self.background = self.canvas.copy_from_bbox(self.ax.bbox)
+        self.ax.draw_artist(self.line)
+
+    # Returns True when the axes limits had to move to fit the data
+    def rescale(self, times: np.ndarray, data: np.ndarray) -> bool:
+        changed = False
+
+        # x-axis moves in steps of a fifth of the timespan, not on every sample
+        if len(times) and not (self.xlim[0] <= times[0] and times[-1] <= self.xlim[1]):
+            step = self.timespan / 5
+            right = (np.floor(times[-1] / step) + 1) * step
+            self.xlim = (right - self.timespan - step, right)
+            changed = True
+
+        # y-axis grows with some headroom, and only shrinks when the data uses less than a quarter of it
+        if not self.do_ylim and len(data):
+            low, high = float(data.min()), float(data.max())
+            span = self.ylim[1] - self.ylim[0]
+            if low < self.ylim[0] or high > self.ylim[1] or (high - low) * 4 < span:
+                margin = max((high - low) * 0.25, 1e-3)
+                self.ylim = (low - margin, high + margin)
+                changed = True
+
+        if changed:
+            self.ax.set_xlim(*self.xlim)
+            self.ax.set_ylim(*self.ylim)
+        return changed
 
     # Draw graph on canvas
     def draw(self) -> None:
 
         # Skips if no updates
-        new_hash = hash(tuple(self.data))
-        if self.data_hash is new_hash:
+        if not self.dirty:
             return
-        self.data_hash = new_hash
+        self.dirty = False
 
         # Update the graph
-        self.line.set_data(self.times, self.data)
-
-        # Rescale the x-axis to fit the new data
-        if len(self.times) >= 2:
-            self.ax.set_xlim(self.times[0], self.times[-1])
+        times, data = self.window()
+        self.line.set_data(times, data)
 
-        # Rescale the y-axis to fit the new data
-        if self.do_ylim:
-            self.ax.set_ylim(self.low_ylim, self.high_ylim)
+        # Full redraw only when the axes moved, otherwise blit the line over the cached background
+        if self.rescale(times, data) or self.background is None:
+            self.full_draws += 1
+            self.canvas.draw()
         else:
-            self.ax.relim()
-            self.ax.autoscale_view(scalex=False)
-
-        self.canvas.draw()
+            self.blit_draws += 1
+            self.canvas.restore_region(self.background)
+            self.ax.draw_artist(self.line)
+        self.canvas.blit(self.ax.bbox)
         # self.draw_queue.put(self.canvas)
 
     # Take data from the queue and update the UI
@@ -113,3 +186,34 @@ class tkPlotGraph:
     # This function should only be called on main loop, once
     def stop(self) -> None:
         self.killed = True
+
+
+if __name__ == "__main__":
+
+    # Headless benchmark: three plots sized for 1 kHz, fed at 1 kHz and at 4 kHz, redrawn every 50 ms
+    frame_ms, seconds = 50, 20
+    for rate_hz in (1000, 4000):
+        graphs = [tkPlotGraph(root=None, title=f"Graph {i}") for i in range(3)]
+        graphs[0].set_ylim(-2, 15)
+
+        window_s = 0.0
+        start = time.process_time()
+        for frame in range(seconds * 1000 // frame_ms):
+            for sample in range(rate_hz * frame_ms // 1000):
+                t = frame * frame_ms + sample * 1000 / rate_hz
+                for i, graph in enumerate(graphs):
+                    graph.append(t, np.sin(t / 500 + i) * (i + 1) + 5)
+            for graph in graphs:
+                window_start = time.perf_counter()
+                graph.window()
+                window_s += time.perf_counter() - window_start
+                graph.draw()
+        elapsed = time.process_time() - start
+
+        print(f"{seconds} s of data, 3 plots at {rate_hz} Hz: {elapsed:.2f} s CPU ({elapsed / seconds * 100:.1f}% of a core), "
+              f"window() {window_s / (3 * seconds * 1000 // frame_ms) * 1e6:.1f} us per draw")
+        for graph in graphs:
+            times, _ = graph.window()
+            assert times[-1] - times[0] >= graph.timespan - 1000 / rate_hz, (graph.title, times[0], times[-1])
+            print(f"  {graph.title}: {graph.full_draws} full draws, {graph.blit_draws} blits, "
+                  f"{times[-1] - times[0]:.0f} ms on screen, capacity {graph.capacity}")
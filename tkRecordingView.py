@@ -0,0 +1,57 @@
+import tkinter as tk
+from tkinter import Misc
+
+import matplotlib.pyplot as plt
+from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg, NavigationToolbar2Tk
+
+from telemetryRecorder import TelemetryRecording
+
+
+# Zoomable view over a whole recording, every zoom or pan re-queries a decimated slice
+class tkRecordingView:
+    def __init__(
+        self,
+        root: Misc,
+        recording: TelemetryRecording,
+        stream: str = "motor_stat",
+        fields: tuple[str, ...] = ("lspd", "rspd", "delta_distance"),
+        points: int = 2000,
+    ) -> None:
+
+        self.recording = recording
+        self.stream = stream
+        self.points = points
+
+        self.window = tk.Toplevel(root)
+        self.window.title(f"Recording {recording.path}")
+
+        # Create a figure with one shared time axis per field
+        self.figure, axes = plt.subplots(len(fields), 1, sharex=True, figsize=(10, 2.5 * len(fields)), dpi=80)
+        self.canvas = FigureCanvasTkAgg(self.figure, master=self.window)
+        self.toolbar = NavigationToolbar2Tk(self.canvas, self.window)
+        self.canvas.get_tk_widget().pack(expand=1, fill="both")
+
+        self.lines = {}
+        for ax, field in zip(axes, fields):
+            ax.set_title(field)
+            ax.grid()
+            (self.lines[field],) = ax.plot([], [])
+
+        # Whole recording first, then follow the zoom
+        times = recording.column(stream, "time_ms")
+        if len(times):
+            self.reload(float(times[0]), float(times[-1]) + 1)
+            axes[0].set_xlim(float(times[0]), float(times[-1]) + 1)
+        axes[0].callbacks.connect("xlim_changed", self.on_xlim_changed)
+        self.canvas.draw()
+
+    def reload(self, t0: float, t1: float) -> None:
+        for field, line in self.lines.items():
+            times, data = self.recording.decimate(self.stream, field, t0, t1, self.points)
+            line.set_data(times, data)
+            if len(data):
+                line.axes.set_ylim(data.min() - 0.1, data.max() + 0.1)
+
+    def on_xlim_changed(self, ax) -> None:
+        self.reload(*ax.get_xlim())
+        self.canvas.draw_idle()
@@ -1,15 +1,27 @@
-from tkinter import END, Misc, Scrollbar, Text
+import time
+from tkinter import END, Misc, Scrollbar, TclError, Text, Tk
+from typing import Optional
 
-from tkAnsiFormatter import tkAnsiFormatter
+from tkAnsiFormatter import AnsiParser, tkAnsiFormatter
 
 
 class tkTerminal:
     def __init__(
-        self, root: Misc, width: int = 80, lines: int = 200, autoscroll: bool = True
+        self,
+        root: Misc,
+        width: int = 80,
+        lines: int = 200,
+        autoscroll: bool = True,
+        frame_ms: int = 33,
     ) -> None:
 
         self.lines = lines
         self.autoscroll = autoscroll
+        self.frame_ms = frame_ms
+
+        # Writes are coalesced and flushed once per frame
+        self.pending: list[str] = []
+        self.flush_scheduled = False
 
         # Create a scrollbar
         self.scrollbar = Scrollbar(root)
@@ -28,20 +40,143 @@ class tkTerminal:
         self.scrollbar.grid(row=row, column=columnspan, sticky="ns")
         self.terminal.grid(row=row, column=column, columnspan=columnspan)
 
-    # Writes text on screen
+    # Queues text for the next frame, call from the Tk main loop
     def write(self, data: str) -> None:
+        self.pending.append(data)
+        if not self.flush_scheduled:
+            self.flush_scheduled = True
+            self.terminal.after(self.frame_ms, self.flush)
+
+    # Writes everything queued since the last frame on screen
+    def flush(self) -> None:
+        self.flush_scheduled = False
+        if not self.pending:
+            return
+        data = "".join(self.pending)
+        self.pending.clear()
+
         if self.ansi_formatter:
             self.ansi_formatter.insert_ansi(txt=data, index=END)
         else:
             self.terminal.insert(chars=data, index=END)
 
+        # Limit the number of lines in the terminal, trimmed in blocks of a quarter of the limit
+        line_count = int(self.terminal.index("end-1c").split(".")[0])
+        if line_count > self.lines + self.lines // 4:
+            self.terminal.delete("1.0", f"{line_count - self.lines + 1}.0")
+
         # Scroll to the END
         if self.autoscroll:
             self.terminal.see(index=END)
 
-        # Limit the number of lines in the terminal
-        if int(self.terminal.index("end-1c").split(".")[0]) > self.lines:
-            self.terminal.delete("1.0", "2.0")
-
     def set_autoscroll(self, autoscroll: bool) -> None:
         self.autoscroll = autoscroll
+
+
+# Stand-ins for Text and Scrollbar without a display: the lines are kept, nothing is laid out or drawn
+class HeadlessText:
+    def __init__(self, root: Optional[Misc] = None, **options) -> None:
+        self.options = {"fg": "black", "bg": "white", **options}
+        self.lines = [""]
+        self.tags: dict[str, dict] = {}
+        self.runs = 0
+
+    def __getitem__(self, key: str) -> str:
+        return self.options.get(key, "")
+
+    def configure(self, **options) -> None:
+        self.options.update(options)
+
+    def tag_configure(self, tag: str, **options) -> None:
+        self.tags[tag] = options
+
+    def grid(self, **options) -> None:
+        pass
+
+    def yview(self, *args) -> None:
+        pass
+
+    def see(self, index: str) -> None:
+        pass
+
+    def after(self, ms: int, func) -> None:
+        pass
+
+    # Text.insert(index, chars, tags, chars, tags, ...)
+    def insert(self, index: str, chars: str, *args) -> None:
+        for tags in args[0::2]:
+            assert all(tag in self.tags for tag in ((tags,) if isinstance(tags, str) else tags)), tags
+        self.runs += 1 + len(args) // 2
+        new_lines = (chars + "".join(args[1::2])).split("\n")
+        self.lines[-1] += new_lines[0]
+        self.lines.extend(new_lines[1:])
+
+    def index(self, index: str) -> str:
+        assert index == "end-1c", index
+        return f"{len(self.lines)}.{len(self.lines[-1])}"
+
+    def delete(self, start: str, end: str) -> None:
+        assert start == "1.0", start
+        del self.lines[: int(end.split(".")[0]) - 1]
+
+
+class HeadlessScrollbar:
+    def __init__(self, root: Optional[Misc] = None) -> None:
+        pass
+
+    def grid(self, **options) -> None:
+        pass
+
+    def config(self, **options) -> None:
+        pass
+
+    def set(self, *args) -> None:
+        pass
+
+
+def benchmark(terminal: tkTerminal, line: str, batch: int, batches: int) -> float:
+    start = time.perf_counter()
+    for _ in range(batches):
+        for _ in range(batch):
+            terminal.write(line)
+        terminal.flush()
+    return batch * batches / (time.perf_counter() - start)
+
+
+if __name__ == "__main__":
+
+    # Throughput benchmark, lines of colored ESP log output per second
+    line = "\x1b[0;32mI (12345) app_main: Lcnt:   123, Rcnt:   456 | Lspd: 1.234, Rspd: 2.345 | \x1b[100mmain.c:42\x1b[0m\n"
+    batch, batches = 200, 200
+
+    parser = AnsiParser()
+    start = time.perf_counter()
+    for _ in range(batches):
+        parser.feed(line * batch)
+    elapsed = time.perf_counter() - start
+    print(f"parser only: {batch * batches / elapsed:.0f} lines/s")
+
+    # Every SGR code of the line must map to a tag, with or without a Tk widget around
+    runs = parser.feed(line)
+    assert [tags for _, tags in runs] == [("foreground green",), ("foreground green", "background dark gray"), ()], runs
+
+    # The terminal's own path, coalescing, one insert per flush and the trimming, around a Text that draws nothing
+    tk_widgets = Text, Scrollbar
+    Text, Scrollbar = HeadlessText, HeadlessScrollbar
+    terminal = tkTerminal(None, width=180)
+    print(f"terminal, headless Text: {benchmark(terminal, line, batch, batches):.0f} lines/s, "
+          f"{len(terminal.terminal.lines)} lines kept, {terminal.terminal.runs} runs inserted")
+    Text, Scrollbar = tk_widgets
+
+    # The Tk widget on top, needs a display, e.g. xvfb-run python3 tkTerminal.py
+    try:
+        root = Tk()
+    except TclError as err:
+        print(f"no display, skipping the Tk Text benchmark: {err}")
+    else:
+        root.withdraw()
+        terminal = tkTerminal(root, width=180)
+        rate = benchmark(terminal, line, batch, batches)
+        root.update()
+        print(f"terminal, Tk Text: {rate:.0f} lines/s")
+        root.destroy()